@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+// mDNS responder work-alike: records what the firmware advertises (HOST_TRACE
+// "MDNS ..." lines) without touching the network. Browses are answered from
+// HOST_MDNS_FOUND=<service>/<ip>:<port>[,...] (see host/host.h).
+class MDNSResponder
+{
+public:
+  bool begin(const char *hostName);
+  void end();
+  bool addService(const char *service, const char *proto, uint16_t port);
+  bool addServiceTxt(const char *service, const char *proto, const char *key, const char *value);
+
+  int queryService(const char *service, const char *proto);
+  String hostname(int i);
+  IPAddress IP(int i);
+  uint16_t port(int i);
+
+private:
+  struct Answer
+  {
+    std::string host;
+    IPAddress ip;
+    uint16_t port;
+  };
+  bool running_ = false;
+  std::vector<Answer> answers_;
+};
+
+extern MDNSResponder MDNS;
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "WString.h"
+
+class EspClass
+{
+public:
+  // Runs the host restart handler (re-exec by default, see host/host.h).
+  [[noreturn]] void restart();
+
+  uint32_t getFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getMaxFreeBlockSize() { return getMaxAllocHeap(); }
+  uint8_t getHeapFragmentation();
+  uint32_t getChipId() { return 0x00c0ffee; }
+  const char *getChipModel() { return "host"; }
+  const char *getSdkVersion() { return "host"; }
+};
+
+extern EspClass ESP;
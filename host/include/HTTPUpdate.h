@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "WiFiClient.h"
+
+enum HTTPUpdateResult
+{
+  HTTP_UPDATE_FAILED,
+  HTTP_UPDATE_NO_UPDATES,
+  HTTP_UPDATE_OK
+};
+typedef HTTPUpdateResult t_httpUpdate_return;
+
+typedef enum
+{
+  HTTPC_DISABLE_FOLLOW_REDIRECTS,
+  HTTPC_STRICT_FOLLOW_REDIRECTS,
+  HTTPC_FORCE_FOLLOW_REDIRECTS
+} followRedirects_t;
+
+// OTA is not emulated: every update() fails after recording the request in
+// host::lastOtaRequest() so tools can assert on it.
+class HTTPUpdate
+{
+public:
+  void setFollowRedirects(followRedirects_t follow) { follow_ = follow; }
+  void rebootOnUpdate(bool reboot) { reboot_ = reboot; }
+
+  t_httpUpdate_return update(WiFiClient &client, const String &url, const String &currentVersion = "");
+
+  int getLastError() const { return lastError_; }
+  String getLastErrorString() const { return lastErrorString_; }
+
+private:
+  followRedirects_t follow_ = HTTPC_DISABLE_FOLLOW_REDIRECTS;
+  bool reboot_ = true;
+  int lastError_ = 0;
+  String lastErrorString_;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Stream.h"
+
+// Serial port emulated over file descriptors: stdin/stdout by default, or the
+// pipes/FIFOs named by HOST_SERIAL_RX / HOST_SERIAL_TX.
+class HardwareSerial : public Stream
+{
+public:
+  void begin(unsigned long baud);
+  void end();
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  void flush() override;
+
+  operator bool() const { return true; }
+
+private:
+  bool fill();
+
+  int rxFd_ = -1;
+  int txFd_ = -1;
+  char rx_[256];
+  size_t rxHead_ = 0;
+  size_t rxLen_ = 0;
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Print.h"
+
+class IPAddress : public Printable
+{
+public:
+  IPAddress() : IPAddress(0, 0, 0, 0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes_{a, b, c, d} {}
+  explicit IPAddress(uint32_t address);
+
+  operator uint32_t() const;
+  uint8_t operator[](int index) const { return bytes_[index]; }
+  bool operator==(const IPAddress &rhs) const { return (uint32_t) * this == (uint32_t)rhs; }
+  bool operator!=(const IPAddress &rhs) const { return !(*this == rhs); }
+
+  bool fromString(const char *address);
+  String toString() const;
+  size_t printTo(Print &p) const override;
+
+private:
+  uint8_t bytes_[4];
+};
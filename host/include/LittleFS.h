@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+#include <stdio.h>
+
+#include <Arduino.h>
+
+// LittleFS emulation backed by a host directory (HOST_FS_DIR, default
+// .pio/hostfs). Paths are mapped 1:1 below that directory.
+namespace fs
+{
+class File : public Stream
+{
+public:
+  File() = default;
+  File(std::shared_ptr<FILE> fp, const String &name) : fp_(std::move(fp)), name_(name) {}
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t *buf, size_t size);
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  using Print::write;
+  void flush() override;
+
+  size_t size() const;
+  size_t position() const;
+  bool seek(uint32_t pos);
+  const char *name() const { return name_.c_str(); }
+  void close() { fp_.reset(); }
+  operator bool() const { return (bool)fp_; }
+
+private:
+  std::shared_ptr<FILE> fp_;
+  String name_;
+};
+
+class FS
+{
+public:
+  bool begin(bool formatOnFail = false);
+  void end() { mounted_ = false; }
+  bool format();
+
+  File open(const char *path, const char *mode = "r");
+  File open(const String &path, const char *mode = "r") { return open(path.c_str(), mode); }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to);
+
+private:
+  bool mounted_ = false;
+};
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+
+extern fs::FS LittleFS;
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+#define MQTT_CONNECT_BAD_PROTOCOL 1
+#define MQTT_CONNECT_BAD_CLIENT_ID 2
+#define MQTT_CONNECT_UNAVAILABLE 3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED 5
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char *, uint8_t *, unsigned int)> callback
+
+// knolleary PubSubClient work-alike speaking MQTT 3.1.1 on a POSIX socket, so
+// the native build can run against a local broker (mosquitto -p 1883). The
+// WiFiClient is ignored. connect() blocks for the TCP connect and the CONNACK
+// like the library does; QoS 0 only, which is all the firmware asks for.
+class PubSubClient
+{
+public:
+  explicit PubSubClient(WiFiClient &) {}
+  ~PubSubClient() { closeSocket(); }
+
+  PubSubClient &setServer(const char *domain, uint16_t port);
+  PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE);
+  PubSubClient &setKeepAlive(uint16_t keepAliveS);
+  PubSubClient &setSocketTimeout(uint16_t timeoutS);
+  bool setBufferSize(uint16_t size);
+
+  bool connect(const char *id, const char *user, const char *pass, const char *willTopic, uint8_t willQos,
+               bool willRetain, const char *willMessage, bool cleanSession = true);
+  void disconnect();
+  bool publish(const char *topic, const char *payload, bool retained = false);
+  bool subscribe(const char *topic, uint8_t qos = 0);
+  bool loop(); // false when not connected
+  bool connected() { return fd_ >= 0 && state_ == MQTT_CONNECTED; }
+  int state() const { return state_; }
+
+private:
+  bool sendPacket(uint8_t header, const std::string &body);
+  bool readPackets();
+  void lost(int state);
+  void closeSocket();
+
+  std::string domain_;
+  uint16_t port_ = 1883;
+  std::function<void(char *, uint8_t *, unsigned int)> callback_;
+  uint16_t keepAliveS_ = 15;
+  uint16_t socketTimeoutS_ = 15;
+  uint16_t bufferSize_ = 256;
+  int fd_ = -1;
+  int state_ = MQTT_DISCONNECTED;
+  uint16_t nextPacketId_ = 1;
+  uint32_t lastOutMs_ = 0;
+  uint32_t lastInMs_ = 0;
+  bool pingOutstanding_ = false;
+  std::string rx_;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Heap-backed string with the Arduino String API. Storage grows through
+// realloc() like the ESP cores do, so allocation counts measured on the host
+// are representative of the device.
+class String
+{
+public:
+  String(const char *cstr = "");
+  String(const char *cstr, unsigned int length);
+  String(const String &str);
+  String(String &&rval) noexcept;
+  explicit String(char c);
+  explicit String(unsigned char value, unsigned char base = 10);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(long long value, unsigned char base = 10);
+  explicit String(unsigned long long value, unsigned char base = 10);
+  explicit String(float value, unsigned char decimalPlaces = 2);
+  explicit String(double value, unsigned char decimalPlaces = 2);
+  ~String();
+
+  bool reserve(unsigned int size);
+  unsigned int length() const { return len_; }
+  bool isEmpty() const { return len_ == 0; }
+  const char *c_str() const { return buffer_ ? buffer_ : ""; }
+
+  String &operator=(const String &rhs);
+  String &operator=(String &&rval) noexcept;
+  String &operator=(const char *cstr);
+  String &operator=(char c);
+
+  bool concat(const String &str);
+  bool concat(const char *cstr);
+  bool concat(const char *cstr, unsigned int length);
+  bool concat(char c);
+  bool concat(unsigned char num);
+  bool concat(int num);
+  bool concat(unsigned int num);
+  bool concat(long num);
+  bool concat(unsigned long num);
+  bool concat(long long num);
+  bool concat(unsigned long long num);
+  bool concat(float num);
+  bool concat(double num);
+
+  template <typename T>
+  String &operator+=(const T &rhs)
+  {
+    concat(rhs);
+    return *this;
+  }
+
+  int compareTo(const String &s) const;
+  bool equals(const String &s) const;
+  bool equals(const char *cstr) const;
+  bool equalsIgnoreCase(const String &s) const;
+  bool operator==(const String &rhs) const { return equals(rhs); }
+  bool operator==(const char *cstr) const { return equals(cstr); }
+  bool operator!=(const String &rhs) const { return !equals(rhs); }
+  bool operator!=(const char *cstr) const { return !equals(cstr); }
+  bool operator<(const String &rhs) const { return compareTo(rhs) < 0; }
+
+  bool startsWith(const String &prefix) const;
+  bool startsWith(const String &prefix, unsigned int offset) const;
+  bool endsWith(const String &suffix) const;
+
+  char charAt(unsigned int index) const;
+  void setCharAt(unsigned int index, char c);
+  char operator[](unsigned int index) const;
+  char &operator[](unsigned int index);
+
+  int indexOf(char ch, unsigned int fromIndex = 0) const;
+  int indexOf(const String &str, unsigned int fromIndex = 0) const;
+  int lastIndexOf(char ch) const;
+  int lastIndexOf(const String &str) const;
+
+  String substring(unsigned int beginIndex) const { return substring(beginIndex, len_); }
+  String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+  void replace(char find, char replace);
+  void replace(const String &find, const String &replace);
+  void remove(unsigned int index);
+  void remove(unsigned int index, unsigned int count);
+  void toLowerCase();
+  void toUpperCase();
+  void trim();
+
+  long toInt() const;
+  float toFloat() const;
+  double toDouble() const;
+
+private:
+  void invalidate();
+  bool changeBuffer(unsigned int maxStrLen);
+  String &copy(const char *cstr, unsigned int length);
+  void move(String &rhs);
+
+  char *buffer_ = nullptr;
+  unsigned int capacity_ = 0;
+  unsigned int len_ = 0;
+};
+
+String operator+(const String &lhs, const String &rhs);
+String operator+(const String &lhs, const char *rhs);
+String operator+(const char *lhs, const String &rhs);
+String operator+(const String &lhs, char rhs);
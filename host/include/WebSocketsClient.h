@@ -0,0 +1,85 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <Arduino.h>
+#include <WebSockets.h>
+
+#include "host/ws_backend.h"
+
+// Links2004 WebSocketsClient work-alike. The transport comes from
+// host::makeWsBackend(): real TCP sockets by default, or whatever a host tool
+// installed (scripted relays, impairment shims, ...).
+class WebSocketsClient : private host::WsBackend::Events
+{
+public:
+  typedef std::function<void(WStype_t type, uint8_t *payload, size_t length)> WebSocketClientEvent;
+
+  WebSocketsClient();
+  ~WebSocketsClient();
+
+  void begin(const char *host, uint16_t port, const char *url = "/", const char *protocol = "arduino");
+  void begin(const String &host, uint16_t port, const String &url = "/", const String &protocol = "arduino");
+  void beginSSL(const char *host, uint16_t port, const char *url = "/", const char *fingerprint = "", const char *protocol = "arduino");
+
+  void loop();
+  void onEvent(WebSocketClientEvent cbEvent) { cbEvent_ = cbEvent; }
+
+  bool sendTXT(uint8_t *payload, size_t length = 0, bool headerToPayload = false);
+  bool sendTXT(const uint8_t *payload, size_t length = 0);
+  bool sendTXT(char *payload, size_t length = 0, bool headerToPayload = false);
+  bool sendTXT(const char *payload, size_t length = 0);
+  bool sendTXT(String &payload);
+  bool sendTXT(char payload);
+
+  bool sendBIN(uint8_t *payload, size_t length, bool headerToPayload = false);
+  bool sendBIN(const uint8_t *payload, size_t length);
+
+  bool sendPing(uint8_t *payload = nullptr, size_t length = 0);
+  bool sendPing(String &payload);
+
+  void disconnect();
+  bool isConnected() const { return connected_; }
+
+  void setExtraHeaders(const char *extraHeaders = nullptr);
+  void setAuthorization(const char *user, const char *password);
+  void setAuthorization(const char *auth);
+  void setReconnectInterval(unsigned long time) { reconnectIntervalMs_ = time; }
+
+  void enableHeartbeat(uint32_t pingInterval, uint32_t pongTimeout, uint8_t disconnectTimeoutCount);
+  void disableHeartbeat() { hbEnabled_ = false; }
+
+  // Host-only: feed an event straight into the registered handler, bypassing
+  // the transport. Used by benchmarks, replay and fuzz targets.
+  void injectEvent(WStype_t type, uint8_t *payload, size_t length);
+
+private:
+  void onWsOpen() override;
+  void onWsFrame(uint8_t opcode, const uint8_t *payload, size_t length) override;
+  void onWsClose() override;
+
+  bool send(uint8_t opcode, const uint8_t *payload, size_t length);
+  void runCbEvent(WStype_t type, uint8_t *payload, size_t length);
+  void handleHeartbeat();
+
+  WebSocketClientEvent cbEvent_;
+  std::unique_ptr<host::WsBackend> backend_;
+  host::WsEndpoint endpoint_;
+  String authHeader_;
+  String extraHeaders_;
+
+  bool configured_ = false;
+  bool connected_ = false;
+  bool connecting_ = false;
+  uint32_t reconnectIntervalMs_ = 500;
+  uint32_t lastConnectionFailMs_ = 0;
+
+  bool hbEnabled_ = false;
+  uint32_t hbPingIntervalMs_ = 0;
+  uint32_t hbPongTimeoutMs_ = 0;
+  uint8_t hbDisconnectCount_ = 0;
+  uint8_t hbMissed_ = 0;
+  bool hbAwaitingPong_ = false;
+  uint32_t hbLastPingMs_ = 0;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <Arduino.h>
+#include <WebSockets.h>
+
+#ifndef WEBSOCKETS_SERVER_CLIENT_MAX
+#define WEBSOCKETS_SERVER_CLIENT_MAX 5
+#endif
+
+// Links2004 WebSocketsServer work-alike on non-blocking POSIX sockets. Listens
+// on 127.0.0.1 unless HOST_LAN_BIND names another address; no TLS, no
+// fragmented frames, no subprotocol negotiation.
+class WebSocketsServer
+{
+public:
+  typedef std::function<void(uint8_t num, WStype_t type, uint8_t *payload, size_t length)> WebSocketServerEvent;
+
+  WebSocketsServer(uint16_t port, const String &origin = "", const String &protocol = "arduino");
+  ~WebSocketsServer();
+
+  void begin();
+  void close();
+  void loop();
+  void onEvent(WebSocketServerEvent cbEvent) { cbEvent_ = cbEvent; }
+
+  bool sendTXT(uint8_t num, const uint8_t *payload, size_t length = 0);
+  bool sendTXT(uint8_t num, const char *payload, size_t length = 0);
+  bool sendTXT(uint8_t num, String &payload);
+  bool sendBIN(uint8_t num, const uint8_t *payload, size_t length);
+
+  void disconnect(uint8_t num);
+  uint8_t connectedClients();
+
+private:
+  struct Client
+  {
+    int fd = -1;
+    bool open = false; // upgrade done
+    std::string rx;
+    std::string tx;
+  };
+
+  void acceptClients();
+  void service(uint8_t num);
+  void flush(uint8_t num);
+  void drop(uint8_t num);
+  bool send(uint8_t num, uint8_t opcode, const uint8_t *payload, size_t length);
+  void runCbEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length);
+
+  uint16_t port_;
+  int listenFd_ = -1;
+  Client clients_[WEBSOCKETS_SERVER_CLIENT_MAX];
+  WebSocketServerEvent cbEvent_;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "WiFiType.h"
+
+// Station-mode WiFi emulation. Link outcomes come from the policy installed
+// with host::setWifiPolicy(); by default every SSID associates immediately.
+class WiFiClass
+{
+public:
+  bool mode(wifi_mode_t m);
+  wifi_mode_t getMode() const { return mode_; }
+
+  wl_status_t begin(const char *ssid, const char *passphrase = nullptr);
+  wl_status_t begin();
+  bool disconnect(bool wifioff = false);
+  wl_status_t status();
+
+  String SSID() const;
+  IPAddress localIP();
+  int32_t RSSI();
+  String macAddress() const { return String("02:00:00:00:00:01"); }
+
+private:
+  wifi_mode_t mode_ = WIFI_MODE_NULL;
+};
+
+extern WiFiClass WiFi;
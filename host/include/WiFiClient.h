@@ -0,0 +1,11 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Placeholder client types: the host build only passes them through to the
+// OTA emulation, it never opens raw sockets through them.
+class WiFiClient
+{
+public:
+  virtual ~WiFiClient() = default;
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "WiFiClient.h"
+
+class WiFiClientSecure : public WiFiClient
+{
+public:
+  void setInsecure() { insecure_ = true; }
+
+private:
+  bool insecure_ = false;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include <Arduino.h>
+
+class WiFiManagerParameter
+{
+public:
+  explicit WiFiManagerParameter(const char *custom);
+  WiFiManagerParameter(const char *id, const char *label, const char *defaultValue, int length, const char *custom = "");
+
+  const char *getID() const { return id_; }
+  const char *getValue() const { return value_.c_str(); }
+  const char *getLabel() const { return label_; }
+  int getValueLength() const { return length_; }
+
+private:
+  friend class WiFiManager;
+
+  const char *id_ = nullptr;
+  const char *label_ = nullptr;
+  String value_;
+  int length_ = 0;
+};
+
+// Captive portal emulation. The portal "runs" for its timeout on the host
+// clock unless a submission was scripted with host::setPortalSubmission() or
+// the HOST_PORTAL_SSID environment variable.
+class WiFiManager
+{
+public:
+  void setConfigPortalTimeout(unsigned long seconds) { timeoutS_ = seconds; }
+  void setConnectTimeout(unsigned long seconds) { connectTimeoutS_ = seconds; }
+  void setCaptivePortalEnable(bool enabled) { captive_ = enabled; }
+  void setBreakAfterConfig(bool shouldBreak) { breakAfterConfig_ = shouldBreak; }
+  bool addParameter(WiFiManagerParameter *p);
+
+  bool startConfigPortal(const char *apName, const char *apPassword = nullptr);
+
+  String getWiFiSSID() const { return ssid_; }
+  String getWiFiPass() const { return pass_; }
+
+private:
+  std::vector<WiFiManagerParameter *> params_;
+  unsigned long timeoutS_ = 0;
+  unsigned long connectTimeoutS_ = 0;
+  bool captive_ = true;
+  bool breakAfterConfig_ = false;
+  String ssid_;
+  String pass_;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+// WiFiUDP work-alike on a non-blocking POSIX datagram socket. Binds
+// HOST_LAN_BIND when set, any address otherwise (it also talks to relays).
+class WiFiUDP
+{
+public:
+  WiFiUDP() = default;
+  ~WiFiUDP() { stop(); }
+
+  uint8_t begin(uint16_t port); // 0 = any free port
+  void stop();
+
+  int beginPacket(IPAddress ip, uint16_t port);
+  int beginPacket(const char *host, uint16_t port);
+  size_t write(const uint8_t *buffer, size_t size);
+  int endPacket();
+
+  int parsePacket(); // size of the next datagram, 0 when none
+  int read(uint8_t *buffer, size_t len);
+  IPAddress remoteIP() const { return remoteIp_; }
+  uint16_t remotePort() const { return remotePort_; }
+
+private:
+  int fd_ = -1;
+  std::string tx_;
+  uint32_t txAddr_ = 0; // network order
+  uint16_t txPort_ = 0;
+  std::string rx_;
+  size_t rxPos_ = 0;
+  IPAddress remoteIp_;
+  uint16_t remotePort_ = 0;
+};
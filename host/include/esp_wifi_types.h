@@ -0,0 +1,40 @@
+#pragma once
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef enum
+{
+  WIFI_MODE_NULL = 0,
+  WIFI_MODE_STA,
+  WIFI_MODE_AP,
+  WIFI_MODE_APSTA,
+} wifi_mode_t;
+
+typedef enum
+{
+  WIFI_IF_STA = 0,
+  WIFI_IF_AP,
+} wifi_interface_t;
+
+typedef enum
+{
+  WIFI_PS_NONE = 0,
+  WIFI_PS_MIN_MODEM,
+  WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+// Only the members the firmware touches
+typedef struct
+{
+  unsigned char ssid[32];
+  unsigned char password[64];
+  unsigned short listen_interval;
+} wifi_sta_config_t;
+
+typedef union
+{
+  wifi_sta_config_t sta;
+} wifi_config_t;
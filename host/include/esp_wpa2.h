@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_wifi_types.h"
+
+esp_err_t esp_wifi_sta_wpa2_ent_set_identity(const unsigned char *identity, int len);
+esp_err_t esp_wifi_sta_wpa2_ent_set_username(const unsigned char *username, int len);
+esp_err_t esp_wifi_sta_wpa2_ent_set_password(const unsigned char *password, int len);
+esp_err_t esp_wifi_sta_wpa2_ent_enable();
+esp_err_t esp_wifi_sta_wpa2_ent_disable();
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <functional>
+#include <string>
+
+#include "../WiFiType.h"
+
+// Control surface of the host emulation layer. Firmware code never includes
+// this; host tools (native runner, benchmarks, simulators) use it to drive the
+// emulated board.
+//
+// Environment read by init():
+//   HOST_CLOCK=virtual        start on the virtual clock
+//   HOST_FS_DIR=<dir>         LittleFS root (default .pio/hostfs)
+//   HOST_SERIAL_RX/TX=<path>  serial over pipes/FIFOs instead of stdin/stdout
+//   HOST_WIFI=down            every association fails with WL_NO_SSID_AVAIL
+//   HOST_WIFI_SAVED_SSID=<s>  SSID the "SDK" remembers from a previous boot
+//   HOST_WIFI_OUTAGE=<at>:<for>  AP disappears at <at> ms for <for> ms
+//   HOST_PORTAL_SSID/PASS/<ID> auto-submit the captive portal
+//   HOST_HEAP_BYTES=<n>       device heap budget reported by ESP.getFreeHeap()
+//   HOST_TRACE=1              emit "HOST <ms> ..." event lines on stderr
+//   HOST_LAN_BIND=<addr>      address WebSocketsServer listens on (default 127.0.0.1)
+//                             and WiFiUDP binds (default any)
+//   HOST_MDNS_FOUND=<service>/<ip>:<port>[,...]  answers to mDNS browses
+namespace host
+{
+// ---------- process ----------
+
+// Reads the HOST_* environment and remembers argv for restarts.
+void init(int argc, char **argv);
+
+// ESP.restart() calls this. The handler must not return; the default flushes
+// stdio and re-executes the current binary, keeping the HOST_FS_DIR contents.
+void setRestartHandler(std::function<void()> handler);
+
+// Prints "HOST <ms> <message>" to stderr when HOST_TRACE is set. Tools parse
+// these lines, so keep the first word of each message stable.
+void trace(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+bool traceEnabled();
+
+// ---------- clock ----------
+
+enum class ClockMode
+{
+  Realtime, // millis() follows CLOCK_MONOTONIC, delay() sleeps
+  Virtual,  // millis() only moves when delay()/advance() is called
+};
+
+void setClockMode(ClockMode mode);
+ClockMode clockMode();
+uint64_t nowMicros();
+
+// Moves the clock forward by us, firing timers in deadline order. In realtime
+// mode this sleeps.
+void advanceMicros(uint64_t us);
+
+// One-shot timer on the host clock. Timers fire from inside delay()/yield(),
+// which is where the firmware would be servicing the radio anyway.
+void schedule(uint32_t afterMs, std::function<void()> fn);
+void runDueTimers();
+
+// ---------- gpio ----------
+
+int pinLevel(uint8_t pin);
+void setPinInput(uint8_t pin, int level);
+void onPinWrite(std::function<void(uint8_t pin, uint8_t level)> observer);
+
+// ---------- serial ----------
+
+// Queues bytes as if they arrived on the UART.
+void serialInject(const char *data, size_t len);
+void serialInject(const std::string &line);
+// Observes everything the firmware writes to Serial.
+void onSerialWrite(std::function<void(const uint8_t *data, size_t len)> observer);
+// Stops Serial from touching stdin/stdout (tools that own the console).
+void serialDetach();
+
+// ---------- filesystem ----------
+
+const std::string &fsRoot();
+void setFsRoot(const std::string &dir);
+
+// ---------- wifi ----------
+
+struct WifiOutcome
+{
+  wl_status_t status;
+  uint32_t afterMs;
+};
+
+// Decides how WiFi.begin() for an SSID ends and how long association takes.
+void setWifiPolicy(std::function<WifiOutcome(const std::string &ssid, bool enterprise)> policy);
+void setSavedSsid(const std::string &ssid);
+// Simulates losing the AP: status() reports WL_CONNECTION_LOST until begin().
+void dropWifi();
+// Drops WiFi at atMs; associations started before atMs + forMs only complete
+// once the AP is back.
+void setWifiOutage(uint32_t atMs, uint32_t forMs);
+
+// ---------- captive portal ----------
+
+struct PortalSubmission
+{
+  std::string ssid;
+  std::string pass;
+  // WiFiManagerParameter id -> value
+  std::function<std::string(const std::string &id)> param;
+  uint32_t afterMs = 0;
+};
+
+void setPortalSubmission(const PortalSubmission &submission);
+void clearPortalSubmission();
+uint32_t portalOpenCount();
+
+// ---------- OTA ----------
+
+const std::string &lastOtaRequest();
+} // namespace host
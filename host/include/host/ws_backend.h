@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace host
+{
+struct WsEndpoint
+{
+  std::string host;
+  uint16_t port = 0;
+  std::string path = "/";
+  std::string protocol;
+  bool secure = false;
+  // Raw "Name: value\r\n" lines appended to the upgrade request.
+  std::string extraHeaders;
+};
+
+// Transport under WebSocketsClient. A backend owns one connection at a time;
+// connect() starts it and poll() reports progress through Events.
+class WsBackend
+{
+public:
+  struct Events
+  {
+    virtual ~Events() = default;
+    virtual void onWsOpen() = 0;
+    virtual void onWsFrame(uint8_t opcode, const uint8_t *payload, size_t length) = 0;
+    virtual void onWsClose() = 0;
+  };
+
+  virtual ~WsBackend() = default;
+  virtual void connect(const WsEndpoint &ep) = 0;
+  virtual bool send(uint8_t opcode, const uint8_t *payload, size_t length) = 0;
+  virtual void close() = 0;
+  virtual void poll(Events &events) = 0;
+};
+
+using WsBackendFactory = std::function<std::unique_ptr<WsBackend>()>;
+
+// RFC 6455 over non-blocking POSIX sockets (no TLS).
+std::unique_ptr<WsBackend> makeTcpWsBackend();
+
+void setWsBackendFactory(WsBackendFactory factory);
+std::unique_ptr<WsBackend> makeWsBackend();
+} // namespace host
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+// Minimal RFC 6455 codec shared by the host WebSocketsClient and the Linux
+// tools that speak the device protocol.
+namespace host
+{
+enum WsOpcode : uint8_t
+{
+  WS_OP_CONT = 0x0,
+  WS_OP_TEXT = 0x1,
+  WS_OP_BIN = 0x2,
+  WS_OP_CLOSE = 0x8,
+  WS_OP_PING = 0x9,
+  WS_OP_PONG = 0xA,
+};
+
+struct WsFrameHeader
+{
+  bool fin = false;
+  uint8_t opcode = 0;
+  bool masked = false;
+  uint8_t mask[4] = {0, 0, 0, 0};
+  uint64_t payloadLength = 0;
+  size_t headerLength = 0;
+};
+
+// Parses a frame header from buf. Returns 1 when complete, 0 when more bytes
+// are needed and -1 on a protocol error.
+int wsParseHeader(const uint8_t *buf, size_t len, WsFrameHeader &out);
+
+// Appends one complete frame to out. Client frames must be masked.
+void wsAppendFrame(std::string &out, uint8_t opcode, const uint8_t *payload, size_t length, bool mask, uint32_t maskKey = 0, bool fin = true);
+
+// XORs payload in place with the 4-byte mask starting at offset.
+void wsUnmask(uint8_t *payload, size_t length, const uint8_t mask[4], size_t offset = 0);
+
+// Sec-WebSocket-Accept for a Sec-WebSocket-Key.
+std::string wsAcceptKey(const std::string &key);
+
+void sha1(const uint8_t *data, size_t len, uint8_t out[20]);
+std::string base64Encode(const uint8_t *data, size_t len);
+} // namespace host
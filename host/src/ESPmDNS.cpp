@@ -0,0 +1,81 @@
+#include <ESPmDNS.h>
+
+#include <stdlib.h>
+
+#include "host/host.h"
+
+MDNSResponder MDNS;
+
+bool MDNSResponder::begin(const char *hostName)
+{
+  running_ = true;
+  host::trace("MDNS begin host=%s", hostName);
+  return true;
+}
+
+void MDNSResponder::end()
+{
+  if (running_)
+    host::trace("MDNS end");
+  running_ = false;
+}
+
+bool MDNSResponder::addService(const char *service, const char *proto, uint16_t port)
+{
+  if (!running_)
+    return false;
+  host::trace("MDNS service _%s._%s port=%u", service, proto, port);
+  return true;
+}
+
+bool MDNSResponder::addServiceTxt(const char *service, const char *proto, const char *key, const char *value)
+{
+  if (!running_)
+    return false;
+  host::trace("MDNS txt _%s._%s %s=%s", service, proto, key, value);
+  return true;
+}
+
+int MDNSResponder::queryService(const char *service, const char *proto)
+{
+  answers_.clear();
+  if (!running_)
+    return 0;
+  const char *env = getenv("HOST_MDNS_FOUND");
+  std::string list = env ? env : "";
+  std::string want = std::string(service) + "/";
+  size_t at = 0;
+  while (at < list.size())
+  {
+    size_t end = list.find(',', at);
+    std::string entry = list.substr(at, end == std::string::npos ? std::string::npos : end - at);
+    at = end == std::string::npos ? list.size() : end + 1;
+    size_t colon = entry.rfind(':');
+    if (entry.compare(0, want.size(), want) != 0 || colon == std::string::npos)
+      continue;
+    Answer a;
+    std::string ip = entry.substr(want.size(), colon - want.size());
+    if (!a.ip.fromString(ip.c_str()))
+      continue;
+    a.port = (uint16_t)atoi(entry.c_str() + colon + 1);
+    a.host = std::string(service) + "-" + std::to_string(answers_.size()) + ".local";
+    answers_.push_back(a);
+  }
+  host::trace("MDNS query _%s._%s found=%zu", service, proto, answers_.size());
+  return (int)answers_.size();
+}
+
+String MDNSResponder::hostname(int i)
+{
+  return i >= 0 && (size_t)i < answers_.size() ? String(answers_[i].host.c_str()) : String();
+}
+
+IPAddress MDNSResponder::IP(int i)
+{
+  return i >= 0 && (size_t)i < answers_.size() ? answers_[i].ip : IPAddress();
+}
+
+uint16_t MDNSResponder::port(int i)
+{
+  return i >= 0 && (size_t)i < answers_.size() ? answers_[i].port : 0;
+}
@@ -0,0 +1,25 @@
+#include <HTTPUpdate.h>
+
+#include <string>
+
+#include "host/host.h"
+
+namespace host
+{
+namespace
+{
+std::string lastOta;
+}
+
+const std::string &lastOtaRequest() { return lastOta; }
+} // namespace host
+
+t_httpUpdate_return HTTPUpdate::update(WiFiClient &client, const String &url, const String &currentVersion)
+{
+  (void)client;
+  host::lastOta = url.c_str();
+  host::trace("OTA url=%s current=%s", url.c_str(), currentVersion.c_str());
+  lastError_ = -1;
+  lastErrorString_ = "OTA is not emulated on the host";
+  return HTTP_UPDATE_FAILED;
+}
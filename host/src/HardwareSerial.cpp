@@ -0,0 +1,129 @@
+#include <Arduino.h>
+
+#include <deque>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "host/host.h"
+
+HardwareSerial Serial;
+
+namespace host
+{
+namespace
+{
+std::deque<char> injected;
+std::vector<std::function<void(const uint8_t *, size_t)>> serialObservers;
+bool detached = false;
+} // namespace
+
+void serialInject(const char *data, size_t len) { injected.insert(injected.end(), data, data + len); }
+void serialInject(const std::string &line) { serialInject(line.data(), line.size()); }
+
+void onSerialWrite(std::function<void(const uint8_t *, size_t)> observer)
+{
+  serialObservers.push_back(std::move(observer));
+}
+
+void serialDetach() { detached = true; }
+} // namespace host
+
+static int openPipe(const char *envName, int flags, int fallback)
+{
+  const char *path = getenv(envName);
+  if (!path || !path[0])
+    return fallback;
+  // O_RDWR on FIFOs keeps open() from blocking until the peer shows up
+  int fd = open(path, O_RDWR | flags);
+  if (fd < 0)
+  {
+    fprintf(stderr, "HOST serial: cannot open %s=%s: %s\n", envName, path, strerror(errno));
+    return fallback;
+  }
+  return fd;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+  (void)baud;
+  if (host::detached)
+    return;
+  if (rxFd_ < 0)
+  {
+    rxFd_ = openPipe("HOST_SERIAL_RX", 0, STDIN_FILENO);
+    fcntl(rxFd_, F_SETFL, fcntl(rxFd_, F_GETFL) | O_NONBLOCK);
+  }
+  if (txFd_ < 0)
+    txFd_ = openPipe("HOST_SERIAL_TX", 0, STDOUT_FILENO);
+}
+
+void HardwareSerial::end() {}
+
+bool HardwareSerial::fill()
+{
+  if (rxHead_ < rxLen_)
+    return true;
+  rxHead_ = rxLen_ = 0;
+
+  while (!host::injected.empty() && rxLen_ < sizeof(rx_))
+  {
+    rx_[rxLen_++] = host::injected.front();
+    host::injected.pop_front();
+  }
+  if (rxLen_ > 0)
+    return true;
+
+  if (rxFd_ < 0 || host::detached)
+    return false;
+  ssize_t n = ::read(rxFd_, rx_, sizeof(rx_));
+  if (n <= 0)
+    return false;
+  rxLen_ = (size_t)n;
+  return true;
+}
+
+int HardwareSerial::available()
+{
+  fill();
+  return (int)(rxLen_ - rxHead_) + (int)host::injected.size();
+}
+
+int HardwareSerial::read()
+{
+  if (!fill())
+    return -1;
+  return (unsigned char)rx_[rxHead_++];
+}
+
+int HardwareSerial::peek()
+{
+  if (!fill())
+    return -1;
+  return (unsigned char)rx_[rxHead_];
+}
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  for (auto &o : host::serialObservers)
+    o(buffer, size);
+  if (host::detached)
+    return size;
+  int fd = txFd_ >= 0 ? txFd_ : STDOUT_FILENO;
+  size_t off = 0;
+  while (off < size)
+  {
+    ssize_t n = ::write(fd, buffer + off, size - off);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    off += (size_t)n;
+  }
+  return size;
+}
+
+void HardwareSerial::flush() {}
@@ -0,0 +1,157 @@
+#include <LittleFS.h>
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "host/host.h"
+
+fs::FS LittleFS;
+
+namespace host
+{
+namespace
+{
+std::string &root()
+{
+  static std::string r = ".pio/hostfs";
+  return r;
+}
+
+bool mkdirs(const std::string &dir)
+{
+  std::string partial;
+  size_t pos = 0;
+  while (pos != std::string::npos)
+  {
+    pos = dir.find('/', pos + 1);
+    partial = dir.substr(0, pos);
+    if (partial.empty())
+      continue;
+    if (mkdir(partial.c_str(), 0755) != 0 && errno != EEXIST)
+      return false;
+  }
+  return true;
+}
+
+std::string mapPath(const char *path)
+{
+  std::string p = path ? path : "";
+  if (p.empty() || p[0] != '/')
+    p = "/" + p;
+  return root() + p;
+}
+} // namespace
+
+const std::string &fsRoot() { return root(); }
+void setFsRoot(const std::string &dir) { root() = dir; }
+} // namespace host
+
+namespace fs
+{
+int File::available()
+{
+  if (!fp_)
+    return 0;
+  long pos = ftell(fp_.get());
+  return (int)(size() - (size_t)pos);
+}
+
+int File::read()
+{
+  if (!fp_)
+    return -1;
+  int c = fgetc(fp_.get());
+  return c == EOF ? -1 : c;
+}
+
+int File::peek()
+{
+  if (!fp_)
+    return -1;
+  int c = fgetc(fp_.get());
+  if (c == EOF)
+    return -1;
+  ungetc(c, fp_.get());
+  return c;
+}
+
+size_t File::read(uint8_t *buf, size_t size)
+{
+  return fp_ ? fread(buf, 1, size, fp_.get()) : 0;
+}
+
+size_t File::write(uint8_t c) { return write(&c, 1); }
+
+size_t File::write(const uint8_t *buf, size_t size)
+{
+  return fp_ ? fwrite(buf, 1, size, fp_.get()) : 0;
+}
+
+void File::flush()
+{
+  if (fp_)
+    fflush(fp_.get());
+}
+
+size_t File::size() const
+{
+  if (!fp_)
+    return 0;
+  struct stat st;
+  fflush(fp_.get());
+  if (fstat(fileno(fp_.get()), &st) != 0)
+    return 0;
+  return (size_t)st.st_size;
+}
+
+size_t File::position() const { return fp_ ? (size_t)ftell(fp_.get()) : 0; }
+
+bool File::seek(uint32_t pos) { return fp_ && fseek(fp_.get(), pos, SEEK_SET) == 0; }
+
+bool FS::begin(bool formatOnFail)
+{
+  (void)formatOnFail;
+  mounted_ = host::mkdirs(host::fsRoot());
+  return mounted_;
+}
+
+bool FS::format()
+{
+  std::string cmd = "rm -rf '" + host::fsRoot() + "'";
+  if (system(cmd.c_str()) != 0)
+    return false;
+  return begin();
+}
+
+File FS::open(const char *path, const char *mode)
+{
+  if (!mounted_)
+    return File();
+  std::string full = host::mapPath(path);
+  if (mode[0] != 'r')
+    host::mkdirs(full.substr(0, full.rfind('/')));
+  FILE *fp = fopen(full.c_str(), mode);
+  if (!fp)
+    return File();
+  return File(std::shared_ptr<FILE>(fp, fclose), path);
+}
+
+bool FS::exists(const char *path)
+{
+  if (!mounted_)
+    return false;
+  struct stat st;
+  return stat(host::mapPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char *path)
+{
+  return mounted_ && unlink(host::mapPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *from, const char *to)
+{
+  return mounted_ && ::rename(host::mapPath(from).c_str(), host::mapPath(to).c_str()) == 0;
+}
+} // namespace fs
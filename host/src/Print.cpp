@@ -0,0 +1,173 @@
+#include <Arduino.h>
+
+#include "host/host.h"
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--)
+  {
+    if (!write(*buffer++))
+      break;
+    n++;
+  }
+  return n;
+}
+
+size_t Print::write(const char *str)
+{
+  if (!str)
+    return 0;
+  return write((const uint8_t *)str, strlen(str));
+}
+
+size_t Print::vprintf(const char *format, va_list args)
+{
+  char stackBuf[128];
+  va_list copy;
+  va_copy(copy, args);
+  int len = vsnprintf(stackBuf, sizeof(stackBuf), format, copy);
+  va_end(copy);
+  if (len < 0)
+    return 0;
+  if ((size_t)len < sizeof(stackBuf))
+    return write((const uint8_t *)stackBuf, len);
+
+  char *heapBuf = (char *)malloc(len + 1);
+  if (!heapBuf)
+    return 0;
+  vsnprintf(heapBuf, len + 1, format, args);
+  size_t n = write((const uint8_t *)heapBuf, len);
+  free(heapBuf);
+  return n;
+}
+
+size_t Print::printf(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  size_t n = vprintf(format, args);
+  va_end(args);
+  return n;
+}
+
+size_t Print::print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+size_t Print::print(const char str[]) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char n, int base) { return printNumber(n, base); }
+size_t Print::print(unsigned int n, int base) { return printNumber(n, base); }
+size_t Print::print(unsigned long n, int base) { return printNumber(n, base); }
+size_t Print::print(unsigned long long n, int base) { return printNumber(n, base); }
+size_t Print::print(int n, int base) { return print((long long)n, base); }
+size_t Print::print(long n, int base) { return print((long long)n, base); }
+
+size_t Print::print(long long n, int base)
+{
+  if (base == 10 && n < 0)
+    return print('-') + printNumber((unsigned long long)(-(n + 1)) + 1, 10);
+  return printNumber((unsigned long long)n, base);
+}
+
+size_t Print::print(double n, int digits) { return printf("%.*f", digits, n); }
+size_t Print::print(const Printable &p) { return p.printTo(*this); }
+size_t Print::println() { return write((const uint8_t *)"\r\n", 2); }
+
+size_t Print::printNumber(unsigned long long n, uint8_t base)
+{
+  char buf[8 * sizeof(n) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2)
+    base = 10;
+  do
+  {
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+// ---------- Stream ----------
+
+int Stream::timedRead()
+{
+  uint32_t start = millis();
+  do
+  {
+    int c = read();
+    if (c >= 0)
+      return c;
+    // the UART would fill in the background; on the host we have to wait
+    delay(1);
+  } while (millis() - start < timeout_);
+  return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+  size_t count = 0;
+  while (count < length)
+  {
+    int c = timedRead();
+    if (c < 0)
+      break;
+    *buffer++ = (char)c;
+    count++;
+  }
+  return count;
+}
+
+String Stream::readString()
+{
+  String ret;
+  int c;
+  while ((c = timedRead()) >= 0)
+    ret += (char)c;
+  return ret;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+  String ret;
+  int c;
+  while ((c = timedRead()) >= 0 && c != terminator)
+    ret += (char)c;
+  return ret;
+}
+
+// ---------- IPAddress ----------
+
+IPAddress::IPAddress(uint32_t address)
+{
+  memcpy(bytes_, &address, 4);
+}
+
+IPAddress::operator uint32_t() const
+{
+  uint32_t v;
+  memcpy(&v, bytes_, 4);
+  return v;
+}
+
+bool IPAddress::fromString(const char *address)
+{
+  unsigned a, b, c, d;
+  char tail;
+  if (sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+    return false;
+  bytes_[0] = a;
+  bytes_[1] = b;
+  bytes_[2] = c;
+  bytes_[3] = d;
+  return true;
+}
+
+String IPAddress::toString() const
+{
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes_[0], bytes_[1], bytes_[2], bytes_[3]);
+  return String(buf);
+}
+
+size_t IPAddress::printTo(Print &p) const { return p.print(toString()); }
@@ -0,0 +1,304 @@
+#include <PubSubClient.h>
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "host/host.h"
+
+namespace
+{
+void putString(std::string &out, const char *s)
+{
+  size_t n = strlen(s);
+  out += (char)(n >> 8);
+  out += (char)(n & 0xFF);
+  out.append(s, n);
+}
+} // namespace
+
+PubSubClient &PubSubClient::setServer(const char *domain, uint16_t port)
+{
+  domain_ = domain;
+  port_ = port;
+  return *this;
+}
+
+PubSubClient &PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE)
+{
+  callback_ = callback;
+  return *this;
+}
+
+PubSubClient &PubSubClient::setKeepAlive(uint16_t keepAliveS)
+{
+  keepAliveS_ = keepAliveS;
+  return *this;
+}
+
+PubSubClient &PubSubClient::setSocketTimeout(uint16_t timeoutS)
+{
+  socketTimeoutS_ = timeoutS;
+  return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size)
+{
+  if (size == 0)
+    return false;
+  bufferSize_ = size;
+  return true;
+}
+
+bool PubSubClient::connect(const char *id, const char *user, const char *pass, const char *willTopic, uint8_t willQos,
+                           bool willRetain, const char *willMessage, bool cleanSession)
+{
+  closeSocket();
+  state_ = MQTT_CONNECT_FAILED;
+
+  addrinfo hints{};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *res = nullptr;
+  std::string port = std::to_string(port_);
+  if (getaddrinfo(domain_.c_str(), port.c_str(), &hints, &res) != 0 || !res)
+  {
+    host::trace("MQTT connect-fail host=%s resolve", domain_.c_str());
+    return false;
+  }
+  int fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int rc = fd < 0 ? -1 : ::connect(fd, res->ai_addr, res->ai_addrlen);
+  freeaddrinfo(res);
+  if (fd < 0 || (rc != 0 && errno != EINPROGRESS))
+  {
+    host::trace("MQTT connect-fail host=%s errno=%d", domain_.c_str(), errno);
+    if (fd >= 0)
+      ::close(fd);
+    return false;
+  }
+  pollfd p{fd, POLLOUT, 0};
+  int err = 0;
+  socklen_t errLen = sizeof(err);
+  if (::poll(&p, 1, socketTimeoutS_ * 1000) <= 0 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen) != 0 || err)
+  {
+    host::trace("MQTT connect-fail host=%s errno=%d", domain_.c_str(), err ? err : ETIMEDOUT);
+    ::close(fd);
+    state_ = err ? MQTT_CONNECT_FAILED : MQTT_CONNECTION_TIMEOUT;
+    return false;
+  }
+  fd_ = fd;
+
+  uint8_t flags = cleanSession ? 0x02 : 0;
+  if (willTopic)
+    flags |= 0x04 | (uint8_t)(willQos << 3) | (willRetain ? 0x20 : 0);
+  if (user)
+    flags |= 0x80;
+  if (pass)
+    flags |= 0x40;
+  std::string body;
+  putString(body, "MQTT");
+  body += (char)4; // 3.1.1
+  body += (char)flags;
+  body += (char)(keepAliveS_ >> 8);
+  body += (char)(keepAliveS_ & 0xFF);
+  putString(body, id);
+  if (willTopic)
+  {
+    putString(body, willTopic);
+    putString(body, willMessage ? willMessage : "");
+  }
+  if (user)
+    putString(body, user);
+  if (pass)
+    putString(body, pass);
+  state_ = MQTT_CONNECTED; // sendPacket needs it
+  if (!sendPacket(0x10, body))
+    return false;
+
+  // CONNACK: 0x20 0x02 <session present> <return code>
+  uint32_t start = millis();
+  while (rx_.size() < 4)
+  {
+    pollfd in{fd_, POLLIN, 0};
+    int waitMs = (int)(socketTimeoutS_ * 1000) - (int)(millis() - start);
+    char buf[64];
+    ssize_t n = waitMs > 0 && ::poll(&in, 1, waitMs) > 0 ? recv(fd_, buf, sizeof(buf), 0) : -1;
+    if (n <= 0)
+    {
+      host::trace("MQTT connack-timeout host=%s", domain_.c_str());
+      lost(MQTT_CONNECTION_TIMEOUT);
+      return false;
+    }
+    rx_.append(buf, (size_t)n);
+  }
+  if ((uint8_t)rx_[0] != 0x20 || rx_[1] != 2)
+  {
+    lost(MQTT_CONNECT_FAILED);
+    return false;
+  }
+  int code = (uint8_t)rx_[3];
+  rx_.erase(0, 4);
+  host::trace("MQTT connack host=%s:%u rc=%d", domain_.c_str(), port_, code);
+  if (code != 0)
+  {
+    lost(code);
+    return false;
+  }
+  lastInMs_ = lastOutMs_ = millis();
+  pingOutstanding_ = false;
+  return true;
+}
+
+void PubSubClient::disconnect()
+{
+  if (connected())
+    sendPacket(0xE0, std::string());
+  closeSocket();
+  state_ = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload, bool retained)
+{
+  std::string body;
+  putString(body, topic);
+  body += payload;
+  if (body.size() + 5 > bufferSize_)
+    return false;
+  host::trace("MQTT pub topic=%s len=%zu retain=%d", topic, strlen(payload), retained ? 1 : 0);
+  return sendPacket(retained ? 0x31 : 0x30, body);
+}
+
+bool PubSubClient::subscribe(const char *topic, uint8_t qos)
+{
+  std::string body;
+  uint16_t id = nextPacketId_++;
+  if (nextPacketId_ == 0)
+    nextPacketId_ = 1;
+  body += (char)(id >> 8);
+  body += (char)(id & 0xFF);
+  putString(body, topic);
+  body += (char)qos;
+  host::trace("MQTT sub topic=%s", topic);
+  return sendPacket(0x82, body);
+}
+
+bool PubSubClient::loop()
+{
+  if (!connected())
+    return false;
+  // as the library: a ping after keepAlive of silence either way, and a
+  // second keepAlive without anything back drops the connection
+  uint32_t now = millis();
+  if (now - lastInMs_ >= keepAliveS_ * 1000u || now - lastOutMs_ >= keepAliveS_ * 1000u)
+  {
+    if (pingOutstanding_)
+    {
+      lost(MQTT_CONNECTION_TIMEOUT);
+      return false;
+    }
+    if (!sendPacket(0xC0, std::string()))
+      return false;
+    lastInMs_ = now;
+    pingOutstanding_ = true;
+  }
+  return readPackets();
+}
+
+bool PubSubClient::sendPacket(uint8_t header, const std::string &body)
+{
+  if (fd_ < 0)
+    return false;
+  std::string packet(1, (char)header);
+  size_t len = body.size();
+  do
+  {
+    uint8_t digit = len & 0x7F;
+    len >>= 7;
+    packet += (char)(len ? digit | 0x80 : digit);
+  } while (len);
+  packet += body;
+  // packets are small; a full socket buffer is a dead broker for our purposes
+  if (send(fd_, packet.data(), packet.size(), MSG_NOSIGNAL) != (ssize_t)packet.size())
+  {
+    lost(MQTT_CONNECTION_LOST);
+    return false;
+  }
+  lastOutMs_ = millis();
+  return true;
+}
+
+bool PubSubClient::readPackets()
+{
+  char buf[1024];
+  for (;;)
+  {
+    ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+      lost(MQTT_CONNECTION_LOST);
+      return false;
+    }
+    if (n < 0)
+      break;
+    rx_.append(buf, (size_t)n);
+    lastInMs_ = millis();
+    pingOutstanding_ = false;
+  }
+
+  for (;;)
+  {
+    size_t len = 0, pos = 1;
+    for (uint8_t shift = 0;; shift += 7)
+    {
+      if (pos >= rx_.size())
+        return true; // incomplete
+      uint8_t digit = (uint8_t)rx_[pos++];
+      len |= (size_t)(digit & 0x7F) << shift;
+      if (!(digit & 0x80))
+        break;
+      if (shift >= 21)
+      {
+        lost(MQTT_CONNECTION_LOST);
+        return false;
+      }
+    }
+    if (rx_.size() < pos + len)
+      return true;
+    uint8_t type = (uint8_t)rx_[0] & 0xF0;
+    uint8_t qos = ((uint8_t)rx_[0] >> 1) & 0x03;
+    std::string body = rx_.substr(pos, len);
+    rx_.erase(0, pos + len);
+
+    // the library drops what does not fit its buffer
+    if (type != 0x30 || len + pos > bufferSize_ || body.size() < 2)
+      continue;
+    size_t topicLen = (uint8_t)body[0] << 8 | (uint8_t)body[1];
+    size_t payloadAt = 2 + topicLen + (qos ? 2 : 0);
+    if (payloadAt > body.size())
+      continue;
+    std::string topic = body.substr(2, topicLen);
+    std::string payload = body.substr(payloadAt);
+    host::trace("MQTT msg topic=%s len=%zu", topic.c_str(), payload.size());
+    if (callback_)
+      callback_(&topic[0], (uint8_t *)&payload[0], (unsigned int)payload.size());
+    if (!connected())
+      return false;
+  }
+}
+
+void PubSubClient::lost(int state)
+{
+  closeSocket();
+  state_ = state;
+}
+
+void PubSubClient::closeSocket()
+{
+  if (fd_ >= 0)
+    ::close(fd_);
+  fd_ = -1;
+  rx_.clear();
+}
@@ -0,0 +1,393 @@
+#include "WString.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utility>
+
+String::String(const char *cstr)
+{
+  if (cstr)
+    copy(cstr, strlen(cstr));
+}
+
+String::String(const char *cstr, unsigned int length)
+{
+  if (cstr)
+    copy(cstr, length);
+}
+
+String::String(const String &str) { *this = str; }
+
+String::String(String &&rval) noexcept { move(rval); }
+
+String::String(char c)
+{
+  char buf[2] = {c, 0};
+  *this = buf;
+}
+
+#define STRING_FROM_INT(T, FMT_DEC)                                     \
+  String::String(T value, unsigned char base)                          \
+  {                                                                    \
+    char buf[8 * sizeof(T) + 2];                                       \
+    if (base == 16)                                                    \
+      snprintf(buf, sizeof(buf), "%llx", (unsigned long long)value);   \
+    else                                                               \
+      snprintf(buf, sizeof(buf), FMT_DEC, value);                      \
+    *this = buf;                                                       \
+  }
+
+STRING_FROM_INT(unsigned char, "%u")
+STRING_FROM_INT(int, "%d")
+STRING_FROM_INT(unsigned int, "%u")
+STRING_FROM_INT(long, "%ld")
+STRING_FROM_INT(unsigned long, "%lu")
+STRING_FROM_INT(long long, "%lld")
+STRING_FROM_INT(unsigned long long, "%llu")
+#undef STRING_FROM_INT
+
+String::String(float value, unsigned char decimalPlaces) : String((double)value, decimalPlaces) {}
+
+String::String(double value, unsigned char decimalPlaces)
+{
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+  *this = buf;
+}
+
+String::~String() { free(buffer_); }
+
+void String::invalidate()
+{
+  free(buffer_);
+  buffer_ = nullptr;
+  capacity_ = len_ = 0;
+}
+
+bool String::reserve(unsigned int size)
+{
+  if (buffer_ && capacity_ >= size)
+    return true;
+  if (changeBuffer(size))
+  {
+    if (len_ == 0)
+      buffer_[0] = 0;
+    return true;
+  }
+  return false;
+}
+
+bool String::changeBuffer(unsigned int maxStrLen)
+{
+  char *newbuffer = (char *)realloc(buffer_, maxStrLen + 1);
+  if (!newbuffer)
+    return false;
+  buffer_ = newbuffer;
+  capacity_ = maxStrLen;
+  return true;
+}
+
+String &String::copy(const char *cstr, unsigned int length)
+{
+  if (!reserve(length))
+  {
+    invalidate();
+    return *this;
+  }
+  len_ = length;
+  memmove(buffer_, cstr, length);
+  buffer_[len_] = 0;
+  return *this;
+}
+
+void String::move(String &rhs)
+{
+  free(buffer_);
+  buffer_ = rhs.buffer_;
+  capacity_ = rhs.capacity_;
+  len_ = rhs.len_;
+  rhs.buffer_ = nullptr;
+  rhs.capacity_ = rhs.len_ = 0;
+}
+
+String &String::operator=(const String &rhs)
+{
+  if (this == &rhs)
+    return *this;
+  if (rhs.buffer_)
+    copy(rhs.buffer_, rhs.len_);
+  else
+    invalidate();
+  return *this;
+}
+
+String &String::operator=(String &&rval) noexcept
+{
+  if (this != &rval)
+    move(rval);
+  return *this;
+}
+
+String &String::operator=(const char *cstr)
+{
+  if (cstr)
+    copy(cstr, strlen(cstr));
+  else
+    invalidate();
+  return *this;
+}
+
+String &String::operator=(char c)
+{
+  char buf[2] = {c, 0};
+  return *this = buf;
+}
+
+bool String::concat(const char *cstr, unsigned int length)
+{
+  if (!cstr)
+    return false;
+  if (length == 0)
+    return true;
+  unsigned int newlen = len_ + length;
+  if (cstr >= buffer_ && cstr < buffer_ + len_)
+  {
+    // appending a slice of ourselves: realloc may move the source
+    size_t offset = cstr - buffer_;
+    if (!reserve(newlen))
+      return false;
+    memmove(buffer_ + len_, buffer_ + offset, length);
+  }
+  else
+  {
+    if (!reserve(newlen))
+      return false;
+    memcpy(buffer_ + len_, cstr, length);
+  }
+  len_ = newlen;
+  buffer_[len_] = 0;
+  return true;
+}
+
+bool String::concat(const String &str) { return concat(str.c_str(), str.len_); }
+bool String::concat(const char *cstr) { return cstr ? concat(cstr, strlen(cstr)) : false; }
+bool String::concat(char c) { return concat(&c, 1); }
+bool String::concat(unsigned char num) { return concat(String(num)); }
+bool String::concat(int num) { return concat(String(num)); }
+bool String::concat(unsigned int num) { return concat(String(num)); }
+bool String::concat(long num) { return concat(String(num)); }
+bool String::concat(unsigned long num) { return concat(String(num)); }
+bool String::concat(long long num) { return concat(String(num)); }
+bool String::concat(unsigned long long num) { return concat(String(num)); }
+bool String::concat(float num) { return concat(String(num)); }
+bool String::concat(double num) { return concat(String(num)); }
+
+String operator+(const String &lhs, const String &rhs)
+{
+  String s;
+  s.reserve(lhs.length() + rhs.length());
+  s.concat(lhs);
+  s.concat(rhs);
+  return s;
+}
+
+String operator+(const String &lhs, const char *rhs) { return lhs + String(rhs); }
+String operator+(const char *lhs, const String &rhs) { return String(lhs) + rhs; }
+String operator+(const String &lhs, char rhs)
+{
+  String s(lhs);
+  s.concat(rhs);
+  return s;
+}
+
+int String::compareTo(const String &s) const { return strcmp(c_str(), s.c_str()); }
+
+bool String::equals(const String &s) const { return len_ == s.len_ && compareTo(s) == 0; }
+
+bool String::equals(const char *cstr) const
+{
+  if (!cstr)
+    return len_ == 0;
+  return strcmp(c_str(), cstr) == 0;
+}
+
+bool String::equalsIgnoreCase(const String &s) const
+{
+  if (len_ != s.len_)
+    return false;
+  return strcasecmp(c_str(), s.c_str()) == 0;
+}
+
+bool String::startsWith(const String &prefix) const
+{
+  if (len_ < prefix.len_)
+    return false;
+  return startsWith(prefix, 0);
+}
+
+bool String::startsWith(const String &prefix, unsigned int offset) const
+{
+  if (offset > len_ || len_ - offset < prefix.len_)
+    return false;
+  return strncmp(c_str() + offset, prefix.c_str(), prefix.len_) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+  if (len_ < suffix.len_)
+    return false;
+  return strcmp(c_str() + len_ - suffix.len_, suffix.c_str()) == 0;
+}
+
+char String::charAt(unsigned int index) const { return (*this)[index]; }
+
+void String::setCharAt(unsigned int index, char c)
+{
+  if (index < len_)
+    buffer_[index] = c;
+}
+
+char String::operator[](unsigned int index) const
+{
+  if (index >= len_ || !buffer_)
+    return 0;
+  return buffer_[index];
+}
+
+char &String::operator[](unsigned int index)
+{
+  static char dummy;
+  if (index >= len_ || !buffer_)
+  {
+    dummy = 0;
+    return dummy;
+  }
+  return buffer_[index];
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const
+{
+  if (fromIndex >= len_)
+    return -1;
+  const char *p = (const char *)memchr(buffer_ + fromIndex, ch, len_ - fromIndex);
+  return p ? (int)(p - buffer_) : -1;
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const
+{
+  if (fromIndex >= len_)
+    return -1;
+  const char *found = strstr(buffer_ + fromIndex, str.c_str());
+  return found ? (int)(found - buffer_) : -1;
+}
+
+int String::lastIndexOf(char ch) const
+{
+  if (!buffer_)
+    return -1;
+  const char *p = strrchr(buffer_, ch);
+  return p ? (int)(p - buffer_) : -1;
+}
+
+int String::lastIndexOf(const String &str) const
+{
+  if (str.len_ > len_ || !buffer_)
+    return -1;
+  for (int i = (int)(len_ - str.len_); i >= 0; i--)
+  {
+    if (strncmp(buffer_ + i, str.c_str(), str.len_) == 0)
+      return i;
+  }
+  return -1;
+}
+
+String String::substring(unsigned int left, unsigned int right) const
+{
+  if (left > right)
+  {
+    unsigned int tmp = left;
+    left = right;
+    right = tmp;
+  }
+  if (left >= len_)
+    return String();
+  if (right > len_)
+    right = len_;
+  return String(buffer_ + left, right - left);
+}
+
+void String::replace(char find, char replace)
+{
+  for (unsigned int i = 0; i < len_; i++)
+  {
+    if (buffer_[i] == find)
+      buffer_[i] = replace;
+  }
+}
+
+void String::replace(const String &find, const String &replace)
+{
+  if (len_ == 0 || find.len_ == 0)
+    return;
+  String out;
+  unsigned int pos = 0;
+  int hit;
+  while ((hit = indexOf(find, pos)) >= 0)
+  {
+    out.concat(buffer_ + pos, hit - pos);
+    out.concat(replace);
+    pos = hit + find.len_;
+  }
+  if (pos == 0)
+    return;
+  out.concat(buffer_ + pos, len_ - pos);
+  *this = std::move(out);
+}
+
+void String::remove(unsigned int index) { remove(index, (unsigned int)-1); }
+
+void String::remove(unsigned int index, unsigned int count)
+{
+  if (index >= len_)
+    return;
+  if (count > len_ - index)
+    count = len_ - index;
+  memmove(buffer_ + index, buffer_ + index + count, len_ - index - count);
+  len_ -= count;
+  buffer_[len_] = 0;
+}
+
+void String::toLowerCase()
+{
+  for (unsigned int i = 0; i < len_; i++)
+    buffer_[i] = (char)tolower((unsigned char)buffer_[i]);
+}
+
+void String::toUpperCase()
+{
+  for (unsigned int i = 0; i < len_; i++)
+    buffer_[i] = (char)toupper((unsigned char)buffer_[i]);
+}
+
+void String::trim()
+{
+  if (!buffer_ || len_ == 0)
+    return;
+  char *begin = buffer_;
+  while (isspace((unsigned char)*begin))
+    begin++;
+  char *end = buffer_ + len_ - 1;
+  while (end >= begin && isspace((unsigned char)*end))
+    end--;
+  len_ = end + 1 - begin;
+  if (begin > buffer_)
+    memmove(buffer_, begin, len_);
+  buffer_[len_] = 0;
+}
+
+long String::toInt() const { return buffer_ ? atol(buffer_) : 0; }
+float String::toFloat() const { return buffer_ ? (float)atof(buffer_) : 0; }
+double String::toDouble() const { return buffer_ ? atof(buffer_) : 0; }
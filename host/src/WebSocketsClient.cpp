@@ -0,0 +1,230 @@
+#include <WebSocketsClient.h>
+
+#include <vector>
+
+#include "host/host.h"
+#include "host/ws_frame.h"
+
+WebSocketsClient::WebSocketsClient() = default;
+WebSocketsClient::~WebSocketsClient() = default;
+
+void WebSocketsClient::begin(const char *host, uint16_t port, const char *url, const char *protocol)
+{
+  endpoint_.host = host;
+  endpoint_.port = port;
+  endpoint_.path = (url && url[0]) ? url : "/";
+  endpoint_.protocol = protocol ? protocol : "";
+  endpoint_.secure = false;
+  configured_ = true;
+  lastConnectionFailMs_ = 0;
+  // the real client connects from loop(), not from begin()
+}
+
+void WebSocketsClient::begin(const String &host, uint16_t port, const String &url, const String &protocol)
+{
+  begin(host.c_str(), port, url.c_str(), protocol.c_str());
+}
+
+void WebSocketsClient::beginSSL(const char *host, uint16_t port, const char *url, const char *fingerprint, const char *protocol)
+{
+  (void)fingerprint;
+  begin(host, port, url, protocol);
+  endpoint_.secure = true;
+}
+
+void WebSocketsClient::setExtraHeaders(const char *extraHeaders)
+{
+  extraHeaders_ = extraHeaders ? extraHeaders : "";
+}
+
+void WebSocketsClient::setAuthorization(const char *user, const char *password)
+{
+  std::string creds = std::string(user ? user : "") + ":" + (password ? password : "");
+  authHeader_ = host::base64Encode((const uint8_t *)creds.data(), creds.size()).c_str();
+}
+
+void WebSocketsClient::setAuthorization(const char *auth) { authHeader_ = auth ? auth : ""; }
+
+void WebSocketsClient::enableHeartbeat(uint32_t pingInterval, uint32_t pongTimeout, uint8_t disconnectTimeoutCount)
+{
+  hbEnabled_ = pingInterval > 0;
+  hbPingIntervalMs_ = pingInterval;
+  hbPongTimeoutMs_ = pongTimeout;
+  hbDisconnectCount_ = disconnectTimeoutCount;
+}
+
+void WebSocketsClient::loop()
+{
+  if (!configured_)
+    return;
+  if (!backend_)
+    backend_ = host::makeWsBackend();
+
+  if (!connected_ && !connecting_)
+  {
+    // do not flood the server
+    if (millis() - lastConnectionFailMs_ < reconnectIntervalMs_)
+      return;
+    host::WsEndpoint ep = endpoint_;
+    if (authHeader_.length() > 0)
+      ep.extraHeaders += std::string("Authorization: Basic ") + authHeader_.c_str() + "\r\n";
+    if (extraHeaders_.length() > 0)
+      ep.extraHeaders += std::string(extraHeaders_.c_str()) + "\r\n";
+    host::trace("WS connect %s:%u%s", ep.host.c_str(), ep.port, ep.path.c_str());
+    connecting_ = true;
+    backend_->connect(ep);
+  }
+
+  backend_->poll(*this);
+
+  if (connected_)
+    handleHeartbeat();
+}
+
+void WebSocketsClient::handleHeartbeat()
+{
+  if (!hbEnabled_)
+    return;
+  uint32_t now = millis();
+  if (hbAwaitingPong_)
+  {
+    if (now - hbLastPingMs_ <= hbPongTimeoutMs_)
+      return;
+    hbAwaitingPong_ = false;
+    hbMissed_++;
+    host::trace("WS pong-timeout %u/%u", hbMissed_, hbDisconnectCount_);
+    if (hbDisconnectCount_ && hbMissed_ >= hbDisconnectCount_)
+    {
+      disconnect();
+      return;
+    }
+    hbLastPingMs_ = now - hbPingIntervalMs_ - 1; // ping again straight away
+  }
+  if (now - hbLastPingMs_ > hbPingIntervalMs_)
+  {
+    hbLastPingMs_ = now;
+    hbAwaitingPong_ = true;
+    send(host::WS_OP_PING, nullptr, 0);
+  }
+}
+
+void WebSocketsClient::onWsOpen()
+{
+  connecting_ = false;
+  connected_ = true;
+  hbMissed_ = 0;
+  hbAwaitingPong_ = false;
+  hbLastPingMs_ = millis();
+  host::trace("WS open");
+  std::vector<uint8_t> url(endpoint_.path.begin(), endpoint_.path.end());
+  url.push_back(0);
+  runCbEvent(WStype_CONNECTED, url.data(), endpoint_.path.size());
+}
+
+void WebSocketsClient::onWsFrame(uint8_t opcode, const uint8_t *payload, size_t length)
+{
+  // like the library, hand out a NUL-terminated copy
+  std::vector<uint8_t> buf(payload, payload + length);
+  buf.push_back(0);
+
+  switch (opcode)
+  {
+  case host::WS_OP_TEXT:
+    runCbEvent(WStype_TEXT, buf.data(), length);
+    break;
+  case host::WS_OP_BIN:
+    runCbEvent(WStype_BIN, buf.data(), length);
+    break;
+  case host::WS_OP_PING:
+    runCbEvent(WStype_PING, buf.data(), length);
+    break;
+  case host::WS_OP_PONG:
+    hbAwaitingPong_ = false;
+    hbMissed_ = 0;
+    runCbEvent(WStype_PONG, buf.data(), length);
+    break;
+  default:
+    break;
+  }
+}
+
+void WebSocketsClient::onWsClose()
+{
+  bool wasConnected = connected_;
+  connected_ = false;
+  connecting_ = false;
+  lastConnectionFailMs_ = millis();
+  host::trace("WS closed was_connected=%d", wasConnected);
+  if (wasConnected)
+    runCbEvent(WStype_DISCONNECTED, nullptr, 0);
+}
+
+void WebSocketsClient::disconnect()
+{
+  if (!backend_ || (!connected_ && !connecting_))
+    return;
+  bool wasConnected = connected_;
+  connected_ = false;
+  connecting_ = false;
+  backend_->close();
+  host::trace("WS disconnect was_connected=%d", wasConnected);
+  if (wasConnected)
+    runCbEvent(WStype_DISCONNECTED, nullptr, 0);
+}
+
+bool WebSocketsClient::send(uint8_t opcode, const uint8_t *payload, size_t length)
+{
+  if (!connected_ || !backend_)
+    return false;
+  return backend_->send(opcode, payload, length);
+}
+
+bool WebSocketsClient::sendTXT(uint8_t *payload, size_t length, bool headerToPayload)
+{
+  (void)headerToPayload;
+  return sendTXT((const uint8_t *)payload, length);
+}
+
+bool WebSocketsClient::sendTXT(const uint8_t *payload, size_t length)
+{
+  if (length == 0)
+    length = strlen((const char *)payload);
+  return send(host::WS_OP_TEXT, payload, length);
+}
+
+bool WebSocketsClient::sendTXT(char *payload, size_t length, bool headerToPayload)
+{
+  return sendTXT((uint8_t *)payload, length, headerToPayload);
+}
+
+bool WebSocketsClient::sendTXT(const char *payload, size_t length) { return sendTXT((const uint8_t *)payload, length); }
+
+bool WebSocketsClient::sendTXT(String &payload)
+{
+  return send(host::WS_OP_TEXT, (const uint8_t *)payload.c_str(), payload.length());
+}
+
+bool WebSocketsClient::sendTXT(char payload) { return send(host::WS_OP_TEXT, (const uint8_t *)&payload, 1); }
+
+bool WebSocketsClient::sendBIN(uint8_t *payload, size_t length, bool headerToPayload)
+{
+  (void)headerToPayload;
+  return send(host::WS_OP_BIN, payload, length);
+}
+
+bool WebSocketsClient::sendBIN(const uint8_t *payload, size_t length) { return send(host::WS_OP_BIN, payload, length); }
+
+bool WebSocketsClient::sendPing(uint8_t *payload, size_t length) { return send(host::WS_OP_PING, payload, length); }
+
+bool WebSocketsClient::sendPing(String &payload)
+{
+  return send(host::WS_OP_PING, (const uint8_t *)payload.c_str(), payload.length());
+}
+
+void WebSocketsClient::injectEvent(WStype_t type, uint8_t *payload, size_t length) { runCbEvent(type, payload, length); }
+
+void WebSocketsClient::runCbEvent(WStype_t type, uint8_t *payload, size_t length)
+{
+  if (cbEvent_)
+    cbEvent_(type, payload, length);
+}
@@ -0,0 +1,269 @@
+#include <WebSocketsServer.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "host/host.h"
+#include "host/ws_frame.h"
+
+WebSocketsServer::WebSocketsServer(uint16_t port, const String &, const String &) : port_(port) {}
+
+WebSocketsServer::~WebSocketsServer() { close(); }
+
+void WebSocketsServer::begin()
+{
+  if (listenFd_ >= 0)
+    return;
+  const char *bind = getenv("HOST_LAN_BIND");
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port_);
+  if (inet_pton(AF_INET, bind && bind[0] ? bind : "127.0.0.1", &addr.sin_addr) != 1)
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (fd < 0 || ::bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0)
+  {
+    host::trace("WSS listen-fail port=%u errno=%d", port_, errno);
+    if (fd >= 0)
+      ::close(fd);
+    return;
+  }
+  listenFd_ = fd;
+  host::trace("WSS listen port=%u", port_);
+}
+
+void WebSocketsServer::close()
+{
+  for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++)
+    disconnect(i);
+  if (listenFd_ >= 0)
+    ::close(listenFd_);
+  listenFd_ = -1;
+}
+
+void WebSocketsServer::loop()
+{
+  if (listenFd_ < 0)
+    return;
+  acceptClients();
+  for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++)
+    if (clients_[i].fd >= 0)
+      service(i);
+}
+
+void WebSocketsServer::acceptClients()
+{
+  for (;;)
+  {
+    int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+      return;
+    uint8_t num = 0;
+    while (num < WEBSOCKETS_SERVER_CLIENT_MAX && clients_[num].fd >= 0)
+      num++;
+    if (num == WEBSOCKETS_SERVER_CLIENT_MAX)
+    {
+      // the library answers a full server with a close right after the upgrade
+      host::trace("WSS full");
+      ::close(fd);
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    clients_[num] = Client();
+    clients_[num].fd = fd;
+  }
+}
+
+void WebSocketsServer::service(uint8_t num)
+{
+  Client &c = clients_[num];
+  uint8_t buf[2048];
+  for (;;)
+  {
+    ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+    if (n > 0)
+    {
+      c.rx.append((const char *)buf, (size_t)n);
+      continue;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+      drop(num);
+      return;
+    }
+    break;
+  }
+
+  if (!c.open)
+  {
+    size_t end = c.rx.find("\r\n\r\n");
+    if (end == std::string::npos)
+      return;
+    std::string head = c.rx.substr(0, end + 2);
+    c.rx.erase(0, end + 4);
+    std::string key, path = "/";
+    size_t sp = head.find(' ');
+    if (sp != std::string::npos)
+      path = head.substr(sp + 1, head.find(' ', sp + 1) - sp - 1);
+    for (size_t pos = head.find("\r\n"); pos != std::string::npos; pos = head.find("\r\n", pos + 2))
+      if (strncasecmp(head.c_str() + pos + 2, "Sec-WebSocket-Key:", 18) == 0)
+      {
+        size_t v = head.find_first_not_of(' ', pos + 20);
+        key = head.substr(v, head.find("\r\n", v) - v);
+      }
+    if (key.empty())
+    {
+      static const char bad[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+      ::send(c.fd, bad, sizeof(bad) - 1, MSG_NOSIGNAL);
+      ::close(c.fd);
+      c = Client();
+      return;
+    }
+    c.tx += "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Accept: " +
+            host::wsAcceptKey(key) + "\r\n\r\n";
+    flush(num);
+    if (c.fd < 0)
+      return;
+    c.open = true;
+    host::trace("WSS open num=%u", num);
+    std::vector<uint8_t> url(path.begin(), path.end());
+    url.push_back(0);
+    runCbEvent(num, WStype_CONNECTED, url.data(), path.size());
+  }
+
+  while (c.fd >= 0 && c.open)
+  {
+    host::WsFrameHeader h;
+    int r = host::wsParseHeader((const uint8_t *)c.rx.data(), c.rx.size(), h);
+    if (r < 0 || (r > 0 && !h.masked))
+    {
+      drop(num); // client frames must be masked
+      return;
+    }
+    if (r == 0 || c.rx.size() < h.headerLength + h.payloadLength)
+      return;
+    std::vector<uint8_t> payload(c.rx.begin() + h.headerLength, c.rx.begin() + h.headerLength + (size_t)h.payloadLength);
+    c.rx.erase(0, h.headerLength + (size_t)h.payloadLength);
+    host::wsUnmask(payload.data(), payload.size(), h.mask);
+    size_t length = payload.size();
+    payload.push_back(0); // like the library, hand out a NUL-terminated copy
+
+    switch (h.opcode)
+    {
+    case host::WS_OP_TEXT:
+      runCbEvent(num, WStype_TEXT, payload.data(), length);
+      break;
+    case host::WS_OP_BIN:
+      runCbEvent(num, WStype_BIN, payload.data(), length);
+      break;
+    case host::WS_OP_PING:
+      send(num, host::WS_OP_PONG, payload.data(), length);
+      break;
+    case host::WS_OP_CLOSE:
+      disconnect(num);
+      return;
+    default:
+      break;
+    }
+  }
+}
+
+void WebSocketsServer::flush(uint8_t num)
+{
+  Client &c = clients_[num];
+  while (c.fd >= 0 && !c.tx.empty())
+  {
+    ssize_t n = ::send(c.fd, c.tx.data(), c.tx.size(), MSG_NOSIGNAL);
+    if (n > 0)
+    {
+      c.tx.erase(0, (size_t)n);
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+      return;
+    drop(num);
+  }
+}
+
+void WebSocketsServer::drop(uint8_t num)
+{
+  Client &c = clients_[num];
+  bool wasOpen = c.open;
+  if (c.fd >= 0)
+    ::close(c.fd);
+  c = Client();
+  if (wasOpen)
+  {
+    host::trace("WSS closed num=%u", num);
+    runCbEvent(num, WStype_DISCONNECTED, nullptr, 0);
+  }
+}
+
+void WebSocketsServer::disconnect(uint8_t num)
+{
+  if (num >= WEBSOCKETS_SERVER_CLIENT_MAX || clients_[num].fd < 0)
+    return;
+  if (clients_[num].open)
+  {
+    uint8_t code[2] = {0x03, 0xE8}; // 1000 normal closure
+    send(num, host::WS_OP_CLOSE, code, sizeof(code));
+  }
+  drop(num);
+}
+
+uint8_t WebSocketsServer::connectedClients()
+{
+  uint8_t n = 0;
+  for (const Client &c : clients_)
+    n += c.open ? 1 : 0;
+  return n;
+}
+
+bool WebSocketsServer::send(uint8_t num, uint8_t opcode, const uint8_t *payload, size_t length)
+{
+  if (num >= WEBSOCKETS_SERVER_CLIENT_MAX || !clients_[num].open)
+    return false;
+  host::wsAppendFrame(clients_[num].tx, opcode, payload, length, false);
+  flush(num);
+  return clients_[num].fd >= 0;
+}
+
+bool WebSocketsServer::sendTXT(uint8_t num, const uint8_t *payload, size_t length)
+{
+  if (length == 0)
+    length = strlen((const char *)payload);
+  return send(num, host::WS_OP_TEXT, payload, length);
+}
+
+bool WebSocketsServer::sendTXT(uint8_t num, const char *payload, size_t length)
+{
+  return sendTXT(num, (const uint8_t *)payload, length);
+}
+
+bool WebSocketsServer::sendTXT(uint8_t num, String &payload)
+{
+  return send(num, host::WS_OP_TEXT, (const uint8_t *)payload.c_str(), payload.length());
+}
+
+bool WebSocketsServer::sendBIN(uint8_t num, const uint8_t *payload, size_t length)
+{
+  return send(num, host::WS_OP_BIN, payload, length);
+}
+
+void WebSocketsServer::runCbEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length)
+{
+  if (cbEvent_)
+    cbEvent_(num, type, payload, length);
+}
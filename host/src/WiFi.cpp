@@ -0,0 +1,192 @@
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include <esp_wpa2.h>
+
+#include "host/host.h"
+
+WiFiClass WiFi;
+
+namespace host
+{
+namespace
+{
+struct WifiState
+{
+  std::function<WifiOutcome(const std::string &, bool)> policy;
+  std::string savedSsid;
+  std::string currentSsid;
+  bool enterprise = false;
+  bool associating = false;
+  wl_status_t status = WL_DISCONNECTED;
+  wl_status_t pendingStatus = WL_DISCONNECTED;
+  uint64_t settleAtUs = 0;
+  uint64_t outageStartUs = 0;
+  uint64_t outageEndUs = 0;
+};
+
+WifiState &wifi()
+{
+  static WifiState s;
+  return s;
+}
+
+WifiOutcome defaultPolicy(const std::string &ssid, bool)
+{
+  const char *env = getenv("HOST_WIFI");
+  if (env && strcmp(env, "down") == 0)
+    return {WL_NO_SSID_AVAIL, 3000};
+  if (ssid.empty())
+    return {WL_NO_SSID_AVAIL, 0};
+  return {WL_CONNECTED, 0};
+}
+
+wl_status_t startAssociation(const std::string &ssid)
+{
+  WifiState &w = wifi();
+  WifiOutcome out = w.policy ? w.policy(ssid, w.enterprise) : defaultPolicy(ssid, w.enterprise);
+  uint64_t now = nowMicros();
+  if (out.status == WL_CONNECTED && now >= w.outageStartUs && now < w.outageEndUs)
+  {
+    // the radio keeps scanning; the association lands when the AP returns
+    uint32_t remainingMs = (uint32_t)((w.outageEndUs - now + 999) / 1000);
+    out.afterMs = out.afterMs > remainingMs ? out.afterMs : remainingMs;
+  }
+  w.currentSsid = ssid;
+  w.associating = true;
+  w.pendingStatus = out.status;
+  w.settleAtUs = nowMicros() + (uint64_t)out.afterMs * 1000ull;
+  w.status = WL_DISCONNECTED;
+  trace("WIFI begin ssid=%s enterprise=%d -> %d after %ums", ssid.c_str(), w.enterprise, out.status, out.afterMs);
+  return WiFi.status();
+}
+} // namespace
+
+void setWifiPolicy(std::function<WifiOutcome(const std::string &, bool)> policy) { wifi().policy = std::move(policy); }
+void setSavedSsid(const std::string &ssid) { wifi().savedSsid = ssid; }
+
+void dropWifi()
+{
+  WifiState &w = wifi();
+  w.associating = false;
+  w.status = WL_CONNECTION_LOST;
+  trace("WIFI dropped");
+}
+
+void setWifiOutage(uint32_t atMs, uint32_t forMs)
+{
+  WifiState &w = wifi();
+  w.outageStartUs = (uint64_t)atMs * 1000ull;
+  w.outageEndUs = w.outageStartUs + (uint64_t)forMs * 1000ull;
+  uint64_t now = nowMicros();
+  schedule(w.outageStartUs > now ? (uint32_t)((w.outageStartUs - now) / 1000) : 0, [] {
+    // association in progress or established: either way the AP is gone
+    dropWifi();
+  });
+}
+} // namespace host
+
+bool WiFiClass::mode(wifi_mode_t m)
+{
+  mode_ = m;
+  if (m == WIFI_MODE_NULL)
+    host::wifi().status = WL_DISCONNECTED;
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *passphrase)
+{
+  (void)passphrase;
+  if (mode_ == WIFI_MODE_NULL)
+    mode_ = WIFI_MODE_STA;
+  std::string s = ssid ? ssid : "";
+  // like the SDK's persistent mode: credentials used last are remembered
+  host::wifi().savedSsid = s;
+  return host::startAssociation(s);
+}
+
+wl_status_t WiFiClass::begin()
+{
+  if (mode_ == WIFI_MODE_NULL)
+    mode_ = WIFI_MODE_STA;
+  return host::startAssociation(host::wifi().savedSsid);
+}
+
+bool WiFiClass::disconnect(bool wifioff)
+{
+  host::wifi().associating = false;
+  host::wifi().status = WL_DISCONNECTED;
+  if (wifioff)
+    mode_ = WIFI_MODE_NULL;
+  return true;
+}
+
+wl_status_t WiFiClass::status()
+{
+  host::WifiState &w = host::wifi();
+  if (w.associating && host::nowMicros() >= w.settleAtUs)
+  {
+    w.associating = false;
+    w.status = w.pendingStatus;
+  }
+  return w.status;
+}
+
+String WiFiClass::SSID() const
+{
+  host::WifiState &w = host::wifi();
+  return String((w.status == WL_CONNECTED ? w.currentSsid : w.savedSsid).c_str());
+}
+
+IPAddress WiFiClass::localIP()
+{
+  return status() == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+int32_t WiFiClass::RSSI() { return status() == WL_CONNECTED ? -55 : 0; }
+
+// ---------- ESP-IDF ----------
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+  WiFi.mode(mode);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_start() { return ESP_OK; }
+
+static wifi_config_t staConfig = {};
+
+esp_err_t esp_wifi_get_config(wifi_interface_t, wifi_config_t *conf)
+{
+  *conf = staConfig;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t, wifi_config_t *conf)
+{
+  staConfig = *conf;
+  host::trace("WIFI listen_interval=%u", staConfig.sta.listen_interval);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+  host::trace("WIFI ps=%d", (int)type);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_wpa2_ent_set_identity(const unsigned char *, int) { return ESP_OK; }
+esp_err_t esp_wifi_sta_wpa2_ent_set_username(const unsigned char *, int) { return ESP_OK; }
+esp_err_t esp_wifi_sta_wpa2_ent_set_password(const unsigned char *, int) { return ESP_OK; }
+
+esp_err_t esp_wifi_sta_wpa2_ent_enable()
+{
+  host::wifi().enterprise = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_wpa2_ent_disable()
+{
+  host::wifi().enterprise = false;
+  return ESP_OK;
+}
@@ -0,0 +1,87 @@
+#include <WiFiManager.h>
+
+#include <memory>
+
+#include "host/host.h"
+
+namespace host
+{
+namespace
+{
+std::unique_ptr<PortalSubmission> submission;
+uint32_t portalOpens = 0;
+
+// HOST_PORTAL_SSID / HOST_PORTAL_PASS / HOST_PORTAL_<ID> script a submission
+// from the environment for interactive runs of the native build.
+bool submissionFromEnv(PortalSubmission &out)
+{
+  const char *ssid = getenv("HOST_PORTAL_SSID");
+  if (!ssid || !ssid[0])
+    return false;
+  const char *pass = getenv("HOST_PORTAL_PASS");
+  out.ssid = ssid;
+  out.pass = pass ? pass : "";
+  out.param = [](const std::string &id) {
+    std::string name = "HOST_PORTAL_" + id;
+    for (auto &ch : name)
+      ch = (char)toupper((unsigned char)ch);
+    const char *v = getenv(name.c_str());
+    return std::string(v ? v : "");
+  };
+  return true;
+}
+} // namespace
+
+void setPortalSubmission(const PortalSubmission &s) { submission.reset(new PortalSubmission(s)); }
+void clearPortalSubmission() { submission.reset(); }
+uint32_t portalOpenCount() { return portalOpens; }
+} // namespace host
+
+WiFiManagerParameter::WiFiManagerParameter(const char *custom) : label_(custom) {}
+
+WiFiManagerParameter::WiFiManagerParameter(const char *id, const char *label, const char *defaultValue, int length, const char *custom)
+    : id_(id), label_(label), value_(defaultValue), length_(length)
+{
+  (void)custom;
+}
+
+bool WiFiManager::addParameter(WiFiManagerParameter *p)
+{
+  params_.push_back(p);
+  return true;
+}
+
+bool WiFiManager::startConfigPortal(const char *apName, const char *apPassword)
+{
+  (void)apPassword;
+  host::portalOpens++;
+  host::trace("PORTAL open ap=%s timeout=%lus", apName, timeoutS_);
+
+  host::PortalSubmission env;
+  const host::PortalSubmission *sub = host::submission.get();
+  if (!sub && host::submissionFromEnv(env))
+    sub = &env;
+
+  if (!sub)
+  {
+    // nobody shows up: the real portal blocks until its timeout
+    delay(timeoutS_ > 0 ? (uint32_t)timeoutS_ * 1000 : 0);
+    host::trace("PORTAL timeout");
+    return false;
+  }
+
+  delay(sub->afterMs);
+  ssid_ = sub->ssid.c_str();
+  pass_ = sub->pass.c_str();
+  for (auto *p : params_)
+  {
+    if (!p->id_ || !sub->param)
+      continue;
+    std::string v = sub->param(p->id_);
+    if (p->length_ > 0 && (int)v.size() >= p->length_)
+      v.resize(p->length_ - 1);
+    p->value_ = v.c_str();
+  }
+  host::trace("PORTAL submit ssid=%s", sub->ssid.c_str());
+  return true;
+}
@@ -0,0 +1,118 @@
+#include <WiFiUdp.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "host/host.h"
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+  stop();
+  const char *bind = getenv("HOST_LAN_BIND");
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (!bind || !bind[0] || inet_pton(AF_INET, bind, &addr.sin_addr) != 1)
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0 || ::bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+  {
+    host::trace("UDP bind-fail port=%u errno=%d", port, errno);
+    if (fd >= 0)
+      ::close(fd);
+    return 0;
+  }
+  socklen_t len = sizeof(addr);
+  getsockname(fd, (sockaddr *)&addr, &len);
+  host::trace("UDP bind port=%u", ntohs(addr.sin_port));
+  fd_ = fd;
+  return 1;
+}
+
+void WiFiUDP::stop()
+{
+  if (fd_ >= 0)
+    ::close(fd_);
+  fd_ = -1;
+  rx_.clear();
+  rxPos_ = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+  txAddr_ = htonl((uint32_t)ip[0] << 24 | (uint32_t)ip[1] << 16 | (uint32_t)ip[2] << 8 | ip[3]);
+  txPort_ = port;
+  tx_.clear();
+  return fd_ >= 0 ? 1 : 0;
+}
+
+int WiFiUDP::beginPacket(const char *host, uint16_t port)
+{
+  addrinfo hints{};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo *res = nullptr;
+  if (getaddrinfo(host, nullptr, &hints, &res) != 0 || !res)
+  {
+    host::trace("UDP dns-fail host=%s", host);
+    return 0;
+  }
+  txAddr_ = ((sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+  freeaddrinfo(res);
+  txPort_ = port;
+  tx_.clear();
+  return fd_ >= 0 ? 1 : 0;
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size)
+{
+  tx_.append((const char *)buffer, size);
+  return size;
+}
+
+int WiFiUDP::endPacket()
+{
+  if (fd_ < 0)
+    return 0;
+  sockaddr_in to{};
+  to.sin_family = AF_INET;
+  to.sin_addr.s_addr = txAddr_;
+  to.sin_port = htons(txPort_);
+  ssize_t n = sendto(fd_, tx_.data(), tx_.size(), 0, (sockaddr *)&to, sizeof(to));
+  tx_.clear();
+  return n >= 0 ? 1 : 0;
+}
+
+int WiFiUDP::parsePacket()
+{
+  rx_.clear();
+  rxPos_ = 0;
+  if (fd_ < 0)
+    return 0;
+  char buf[1500];
+  sockaddr_in from{};
+  socklen_t len = sizeof(from);
+  ssize_t n = recvfrom(fd_, buf, sizeof(buf), 0, (sockaddr *)&from, &len);
+  if (n <= 0)
+    return 0;
+  rx_.assign(buf, (size_t)n);
+  uint32_t a = ntohl(from.sin_addr.s_addr);
+  remoteIp_ = IPAddress((uint8_t)(a >> 24), (uint8_t)(a >> 16), (uint8_t)(a >> 8), (uint8_t)a);
+  remotePort_ = ntohs(from.sin_port);
+  return (int)n;
+}
+
+int WiFiUDP::read(uint8_t *buffer, size_t len)
+{
+  size_t n = rx_.size() - rxPos_;
+  if (n > len)
+    n = len;
+  memcpy(buffer, rx_.data() + rxPos_, n);
+  rxPos_ += n;
+  return (int)n;
+}
@@ -0,0 +1,310 @@
+#include <Arduino.h>
+
+#include <map>
+#include <vector>
+#include <malloc.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host/host.h"
+
+namespace host
+{
+namespace
+{
+struct ClockState
+{
+  ClockMode mode = ClockMode::Realtime;
+  uint64_t virtualUs = 0;
+  uint64_t realStartUs = 0;
+  std::multimap<uint64_t, std::function<void()>> timers;
+  bool firing = false;
+};
+
+ClockState &clk()
+{
+  static ClockState s;
+  return s;
+}
+
+uint64_t monotonicUs()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000ull;
+}
+
+std::vector<char *> savedArgv;
+std::function<void()> restartHandler;
+int traceFlag = -1;
+
+uint8_t pinLevels[64];
+std::vector<std::function<void(uint8_t, uint8_t)>> pinObservers;
+
+// The host heap is far larger than a device's, so heap figures are reported
+// against a device-sized budget (HOST_HEAP_BYTES) relative to usage at init().
+size_t heapBudget = 50000;
+size_t heapBaseline = 0;
+size_t holesBaseline = 0;
+
+// Free bytes inside the arena, minus the releasable top chunk: holes between
+// live blocks, which is what fragmentation looks like on a device heap.
+size_t heapHoles()
+{
+  struct mallinfo2 mi = mallinfo2();
+  return mi.fordblks > mi.keepcost ? mi.fordblks - mi.keepcost : 0;
+}
+} // namespace
+
+void init(int argc, char **argv)
+{
+  savedArgv.assign(argv, argv + argc);
+  savedArgv.push_back(nullptr);
+
+  const char *mode = getenv("HOST_CLOCK");
+  if (mode && strcmp(mode, "virtual") == 0)
+    setClockMode(ClockMode::Virtual);
+
+  const char *fsDir = getenv("HOST_FS_DIR");
+  if (fsDir && fsDir[0])
+    setFsRoot(fsDir);
+
+  const char *saved = getenv("HOST_WIFI_SAVED_SSID");
+  if (saved)
+    setSavedSsid(saved);
+
+  const char *outage = getenv("HOST_WIFI_OUTAGE");
+  unsigned long outageAt = 0, outageFor = 0;
+  if (outage && sscanf(outage, "%lu:%lu", &outageAt, &outageFor) == 2)
+    setWifiOutage((uint32_t)outageAt, (uint32_t)outageFor);
+
+  const char *heap = getenv("HOST_HEAP_BYTES");
+  if (heap && atol(heap) > 0)
+    heapBudget = (size_t)atol(heap);
+  heapBaseline = mallinfo2().uordblks;
+  holesBaseline = heapHoles();
+}
+
+void setRestartHandler(std::function<void()> handler) { restartHandler = std::move(handler); }
+
+[[noreturn]] static void defaultRestart()
+{
+  fflush(stdout);
+  fflush(stderr);
+  if (savedArgv.size() > 1)
+    execv("/proc/self/exe", savedArgv.data());
+  // exec failed (or init() was never called): nothing sensible left to do
+  _exit(3);
+}
+
+bool traceEnabled()
+{
+  if (traceFlag < 0)
+  {
+    const char *t = getenv("HOST_TRACE");
+    traceFlag = (t && t[0] && strcmp(t, "0") != 0) ? 1 : 0;
+  }
+  return traceFlag == 1;
+}
+
+void trace(const char *fmt, ...)
+{
+  if (!traceEnabled())
+    return;
+  char buf[512];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  fprintf(stderr, "HOST %llu %s\n", (unsigned long long)(nowMicros() / 1000), buf);
+}
+
+// ---------- clock ----------
+
+void setClockMode(ClockMode mode)
+{
+  ClockState &c = clk();
+  if (mode == c.mode)
+    return;
+  // keep time continuous across the switch
+  uint64_t now = nowMicros();
+  c.mode = mode;
+  if (mode == ClockMode::Virtual)
+    c.virtualUs = now;
+  else
+    c.realStartUs = monotonicUs() - now;
+}
+
+ClockMode clockMode() { return clk().mode; }
+
+uint64_t nowMicros()
+{
+  ClockState &c = clk();
+  if (c.mode == ClockMode::Virtual)
+    return c.virtualUs;
+  if (c.realStartUs == 0)
+    c.realStartUs = monotonicUs();
+  return monotonicUs() - c.realStartUs;
+}
+
+void schedule(uint32_t afterMs, std::function<void()> fn)
+{
+  clk().timers.emplace(nowMicros() + (uint64_t)afterMs * 1000ull, std::move(fn));
+}
+
+void runDueTimers()
+{
+  ClockState &c = clk();
+  if (c.firing)
+    return; // a timer called delay(); it will be picked up by the outer loop
+  c.firing = true;
+  while (!c.timers.empty() && c.timers.begin()->first <= nowMicros())
+  {
+    auto fn = std::move(c.timers.begin()->second);
+    c.timers.erase(c.timers.begin());
+    fn();
+  }
+  c.firing = false;
+}
+
+void advanceMicros(uint64_t us)
+{
+  ClockState &c = clk();
+  uint64_t target = nowMicros() + us;
+
+  if (c.mode == ClockMode::Virtual)
+  {
+    while (!c.firing && !c.timers.empty() && c.timers.begin()->first <= target)
+    {
+      if (c.timers.begin()->first > c.virtualUs)
+        c.virtualUs = c.timers.begin()->first;
+      runDueTimers();
+    }
+    if (target > c.virtualUs)
+      c.virtualUs = target;
+    return;
+  }
+
+  for (;;)
+  {
+    runDueTimers();
+    uint64_t now = nowMicros();
+    if (now >= target)
+      return;
+    uint64_t wake = target;
+    if (!c.timers.empty() && c.timers.begin()->first < wake)
+      wake = c.timers.begin()->first;
+    uint64_t sleepUs = wake > now ? wake - now : 0;
+    timespec ts{(time_t)(sleepUs / 1000000ull), (long)(sleepUs % 1000000ull) * 1000};
+    nanosleep(&ts, nullptr);
+  }
+}
+
+// ---------- gpio ----------
+
+int pinLevel(uint8_t pin) { return pin < sizeof(pinLevels) ? pinLevels[pin] : LOW; }
+
+void setPinInput(uint8_t pin, int level)
+{
+  if (pin < sizeof(pinLevels))
+    pinLevels[pin] = level ? HIGH : LOW;
+}
+
+void onPinWrite(std::function<void(uint8_t, uint8_t)> observer) { pinObservers.push_back(std::move(observer)); }
+
+static void notifyPinWrite(uint8_t pin, uint8_t level)
+{
+  trace("GPIO %u %u", pin, level);
+  for (auto &o : pinObservers)
+    o(pin, level);
+}
+} // namespace host
+
+// ---------- Arduino core ----------
+
+uint32_t millis() { return (uint32_t)(host::nowMicros() / 1000ull); }
+uint32_t micros() { return (uint32_t)host::nowMicros(); }
+void delay(uint32_t ms) { host::advanceMicros((uint64_t)ms * 1000ull); }
+void delayMicroseconds(uint32_t us) { host::advanceMicros(us); }
+void yield() { host::runDueTimers(); }
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (mode == INPUT_PULLUP)
+    host::setPinInput(pin, HIGH);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  uint8_t level = val ? HIGH : LOW;
+  if (pin < sizeof(host::pinLevels))
+    host::pinLevels[pin] = level;
+  host::notifyPinWrite(pin, level);
+}
+
+int digitalRead(uint8_t pin) { return host::pinLevel(pin); }
+
+long random(long howbig)
+{
+  if (howbig <= 0)
+    return 0;
+  return ::random() % howbig;
+}
+
+long random(long howsmall, long howbig)
+{
+  if (howsmall >= howbig)
+    return howsmall;
+  return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) { srandom((unsigned)seed); }
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+  size_t len = strlen(src);
+  if (size > 0)
+  {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
+
+// ---------- ESP ----------
+
+EspClass ESP;
+
+void EspClass::restart()
+{
+  host::trace("RESTART");
+  if (host::restartHandler)
+    host::restartHandler();
+  host::defaultRestart();
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+  size_t used = mallinfo2().uordblks;
+  size_t grown = used > host::heapBaseline ? used - host::heapBaseline : 0;
+  return grown >= host::heapBudget ? 0 : (uint32_t)(host::heapBudget - grown);
+}
+
+// Holes opened since init() are treated as unusable for one large allocation.
+uint32_t EspClass::getMaxAllocHeap()
+{
+  size_t holes = host::heapHoles();
+  holes = holes > host::holesBaseline ? holes - host::holesBaseline : 0;
+  uint32_t free = getFreeHeap();
+  return holes >= free ? 0 : (uint32_t)(free - holes);
+}
+
+uint8_t EspClass::getHeapFragmentation()
+{
+  uint32_t free = getFreeHeap();
+  return free > 0 ? (uint8_t)(100 - (uint64_t)getMaxAllocHeap() * 100 / free) : 0;
+}
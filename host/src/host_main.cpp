@@ -0,0 +1,20 @@
+// Entry point of the native build: runs the firmware's setup()/loop() against
+// the host emulation layer, the way the Arduino core's main() does on-chip.
+
+#include <Arduino.h>
+
+#include "host/host.h"
+
+void setup();
+void loop();
+
+int main(int argc, char **argv)
+{
+  host::init(argc, argv);
+  setup();
+  for (;;)
+  {
+    loop();
+    yield();
+  }
+}
@@ -0,0 +1,199 @@
+#include "host/ws_frame.h"
+
+#include <string.h>
+
+namespace host
+{
+int wsParseHeader(const uint8_t *buf, size_t len, WsFrameHeader &out)
+{
+  if (len < 2)
+    return 0;
+  out.fin = (buf[0] & 0x80) != 0;
+  if (buf[0] & 0x70)
+    return -1; // no extensions negotiated, RSV bits must be clear
+  out.opcode = buf[0] & 0x0F;
+  out.masked = (buf[1] & 0x80) != 0;
+
+  uint64_t plen = buf[1] & 0x7F;
+  size_t pos = 2;
+  if (plen == 126)
+  {
+    if (len < 4)
+      return 0;
+    plen = ((uint64_t)buf[2] << 8) | buf[3];
+    pos = 4;
+  }
+  else if (plen == 127)
+  {
+    if (len < 10)
+      return 0;
+    plen = 0;
+    for (int i = 0; i < 8; i++)
+      plen = (plen << 8) | buf[2 + i];
+    pos = 10;
+  }
+
+  if ((out.opcode & 0x08) && (plen > 125 || !out.fin))
+    return -1; // control frames are short and never fragmented
+
+  if (out.masked)
+  {
+    if (len < pos + 4)
+      return 0;
+    memcpy(out.mask, buf + pos, 4);
+    pos += 4;
+  }
+  out.payloadLength = plen;
+  out.headerLength = pos;
+  return 1;
+}
+
+void wsAppendFrame(std::string &out, uint8_t opcode, const uint8_t *payload, size_t length, bool mask, uint32_t maskKey, bool fin)
+{
+  uint8_t hdr[14];
+  size_t n = 0;
+  hdr[n++] = (fin ? 0x80 : 0x00) | (opcode & 0x0F);
+  uint8_t maskBit = mask ? 0x80 : 0x00;
+  if (length < 126)
+  {
+    hdr[n++] = maskBit | (uint8_t)length;
+  }
+  else if (length <= 0xFFFF)
+  {
+    hdr[n++] = maskBit | 126;
+    hdr[n++] = (uint8_t)(length >> 8);
+    hdr[n++] = (uint8_t)length;
+  }
+  else
+  {
+    hdr[n++] = maskBit | 127;
+    for (int i = 7; i >= 0; i--)
+      hdr[n++] = (uint8_t)((uint64_t)length >> (8 * i));
+  }
+  uint8_t key[4] = {(uint8_t)(maskKey >> 24), (uint8_t)(maskKey >> 16), (uint8_t)(maskKey >> 8), (uint8_t)maskKey};
+  if (mask)
+  {
+    memcpy(hdr + n, key, 4);
+    n += 4;
+  }
+
+  size_t start = out.size();
+  out.append((const char *)hdr, n);
+  if (length > 0)
+    out.append((const char *)payload, length);
+  if (mask)
+    wsUnmask((uint8_t *)&out[start + n], length, key);
+}
+
+void wsUnmask(uint8_t *payload, size_t length, const uint8_t mask[4], size_t offset)
+{
+  for (size_t i = 0; i < length; i++)
+    payload[i] ^= mask[(offset + i) & 3];
+}
+
+// ---------- SHA-1 (RFC 3174), only needed for the handshake ----------
+
+static inline uint32_t rol(uint32_t v, int bits) { return (v << bits) | (v >> (32 - bits)); }
+
+static void sha1Block(uint32_t h[5], const uint8_t block[64])
+{
+  uint32_t w[80];
+  for (int i = 0; i < 16; i++)
+    w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+  for (int i = 16; i < 80; i++)
+    w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+  for (int i = 0; i < 80; i++)
+  {
+    uint32_t f, k;
+    if (i < 20)
+    {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    }
+    else if (i < 40)
+    {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    }
+    else if (i < 60)
+    {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    }
+    else
+    {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+    uint32_t t = rol(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = rol(b, 30);
+    b = a;
+    a = t;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+}
+
+void sha1(const uint8_t *data, size_t len, uint8_t out[20])
+{
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  size_t full = len / 64 * 64;
+  for (size_t i = 0; i < full; i += 64)
+    sha1Block(h, data + i);
+
+  uint8_t tail[128] = {0};
+  size_t rem = len - full;
+  memcpy(tail, data + full, rem);
+  tail[rem] = 0x80;
+  size_t tailLen = rem < 56 ? 64 : 128;
+  uint64_t bits = (uint64_t)len * 8;
+  for (int i = 0; i < 8; i++)
+    tail[tailLen - 1 - i] = (uint8_t)(bits >> (8 * i));
+  sha1Block(h, tail);
+  if (tailLen == 128)
+    sha1Block(h, tail + 64);
+
+  for (int i = 0; i < 5; i++)
+  {
+    out[i * 4] = (uint8_t)(h[i] >> 24);
+    out[i * 4 + 1] = (uint8_t)(h[i] >> 16);
+    out[i * 4 + 2] = (uint8_t)(h[i] >> 8);
+    out[i * 4 + 3] = (uint8_t)h[i];
+  }
+}
+
+std::string base64Encode(const uint8_t *data, size_t len)
+{
+  static const char tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve((len + 2) / 3 * 4);
+  for (size_t i = 0; i < len; i += 3)
+  {
+    uint32_t v = (uint32_t)data[i] << 16;
+    if (i + 1 < len)
+      v |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < len)
+      v |= data[i + 2];
+    out += tbl[(v >> 18) & 63];
+    out += tbl[(v >> 12) & 63];
+    out += i + 1 < len ? tbl[(v >> 6) & 63] : '=';
+    out += i + 2 < len ? tbl[v & 63] : '=';
+  }
+  return out;
+}
+
+std::string wsAcceptKey(const std::string &key)
+{
+  std::string s = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+  uint8_t digest[20];
+  sha1((const uint8_t *)s.data(), s.size(), digest);
+  return base64Encode(digest, sizeof(digest));
+}
+} // namespace host
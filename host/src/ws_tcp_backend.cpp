@@ -0,0 +1,350 @@
+#include <Arduino.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "host/host.h"
+#include "host/ws_backend.h"
+#include "host/ws_frame.h"
+
+namespace host
+{
+namespace
+{
+// Matches WEBSOCKETS_TCP_TIMEOUT in the Links2004 library.
+const uint32_t TCP_TIMEOUT_MS = 5000;
+
+class TcpWsBackend : public WsBackend
+{
+public:
+  ~TcpWsBackend() override { shutdownSocket(); }
+
+  void connect(const WsEndpoint &ep) override
+  {
+    shutdownSocket();
+    gen_++;
+    rx_.clear();
+    tx_.clear();
+    frag_.clear();
+    failed_ = false;
+
+    if (ep.secure)
+    {
+      // no TLS stack on the host; report it like a failed connect
+      trace("WS tls unsupported host=%s", ep.host.c_str());
+      failed_ = true;
+      return;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    char port[8];
+    snprintf(port, sizeof(port), "%u", ep.port);
+    if (getaddrinfo(ep.host.c_str(), port, &hints, &res) != 0 || !res)
+    {
+      trace("WS dns-fail host=%s", ep.host.c_str());
+      failed_ = true;
+      return;
+    }
+
+    fd_ = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ >= 0)
+    {
+      int one = 1;
+      setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      if (::connect(fd_, res->ai_addr, res->ai_addrlen) != 0 && errno != EINPROGRESS)
+        shutdownSocket();
+    }
+    freeaddrinfo(res);
+    if (fd_ < 0)
+    {
+      failed_ = true;
+      return;
+    }
+
+    uint8_t nonce[16];
+    for (auto &b : nonce)
+      b = (uint8_t)random(256);
+    key_ = base64Encode(nonce, sizeof(nonce));
+
+    tx_ = "GET " + ep.path + " HTTP/1.1\r\n"
+                             "Host: " +
+          ep.host + ":" + port + "\r\n"
+                                 "Connection: Upgrade\r\n"
+                                 "Upgrade: websocket\r\n"
+                                 "Sec-WebSocket-Version: 13\r\n"
+                                 "Sec-WebSocket-Key: " +
+          key_ + "\r\n";
+    if (!ep.protocol.empty())
+      tx_ += "Sec-WebSocket-Protocol: " + ep.protocol + "\r\n";
+    tx_ += ep.extraHeaders;
+    tx_ += "User-Agent: arduino-WebSocket-Client\r\n\r\n";
+
+    state_ = State::Connecting;
+    deadlineMs_ = millis() + TCP_TIMEOUT_MS;
+  }
+
+  bool send(uint8_t opcode, const uint8_t *payload, size_t length) override
+  {
+    if (state_ != State::Open)
+      return false;
+    wsAppendFrame(tx_, opcode, payload, length, true, (uint32_t)random(0x7FFFFFFF));
+    flushTx();
+    return fd_ >= 0;
+  }
+
+  void close() override
+  {
+    if (state_ == State::Open)
+    {
+      uint8_t code[2] = {0x03, 0xE8}; // 1000 normal closure
+      wsAppendFrame(tx_, WS_OP_CLOSE, code, sizeof(code), true, (uint32_t)random(0x7FFFFFFF));
+      flushTx();
+    }
+    shutdownSocket();
+  }
+
+  void poll(Events &events) override
+  {
+    if (failed_)
+    {
+      failed_ = false;
+      events.onWsClose();
+      return;
+    }
+    if (fd_ < 0)
+      return;
+
+    if (state_ == State::Connecting)
+    {
+      pollfd p{fd_, POLLOUT, 0};
+      if (::poll(&p, 1, 0) <= 0)
+      {
+        checkTimeout(events);
+        return;
+      }
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err != 0)
+      {
+        trace("WS connect-fail errno=%d", err);
+        fail(events);
+        return;
+      }
+      state_ = State::Handshake;
+    }
+
+    flushTx();
+    if (fd_ < 0)
+    {
+      events.onWsClose();
+      return;
+    }
+
+    uint8_t buf[2048];
+    for (;;)
+    {
+      ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+      if (n > 0)
+      {
+        rx_.append((const char *)buf, (size_t)n);
+        continue;
+      }
+      if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+      {
+        // peer went away; deliver whatever already arrived first
+        uint32_t gen = gen_;
+        process(events);
+        if (gen == gen_ && fd_ >= 0)
+          fail(events);
+        return;
+      }
+      break;
+    }
+
+    process(events);
+    if (fd_ >= 0 && state_ == State::Handshake)
+      checkTimeout(events);
+  }
+
+private:
+  enum class State
+  {
+    Idle,
+    Connecting,
+    Handshake,
+    Open,
+  };
+
+  void shutdownSocket()
+  {
+    if (fd_ >= 0)
+      ::close(fd_);
+    fd_ = -1;
+    state_ = State::Idle;
+  }
+
+  void fail(Events &events)
+  {
+    shutdownSocket();
+    events.onWsClose();
+  }
+
+  void checkTimeout(Events &events)
+  {
+    if ((int32_t)(millis() - deadlineMs_) >= 0)
+    {
+      trace("WS timeout");
+      fail(events);
+    }
+  }
+
+  void flushTx()
+  {
+    while (fd_ >= 0 && !tx_.empty() && state_ != State::Connecting)
+    {
+      ssize_t n = ::send(fd_, tx_.data(), tx_.size(), MSG_NOSIGNAL);
+      if (n > 0)
+      {
+        tx_.erase(0, (size_t)n);
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return;
+      shutdownSocket();
+    }
+  }
+
+  void process(Events &events)
+  {
+    uint32_t gen = gen_;
+
+    if (state_ == State::Handshake)
+    {
+      size_t end = rx_.find("\r\n\r\n");
+      if (end == std::string::npos)
+        return;
+      std::string head = rx_.substr(0, end);
+      rx_.erase(0, end + 4);
+      std::string expect = "Sec-WebSocket-Accept: " + wsAcceptKey(key_);
+      if (head.compare(0, 12, "HTTP/1.1 101") != 0 || !containsHeader(head, expect))
+      {
+        trace("WS handshake-rejected status=%s", head.substr(0, head.find('\r')).c_str());
+        fail(events);
+        return;
+      }
+      state_ = State::Open;
+      events.onWsOpen();
+      if (gen != gen_ || fd_ < 0)
+        return;
+    }
+
+    while (state_ == State::Open)
+    {
+      WsFrameHeader h;
+      int r = wsParseHeader((const uint8_t *)rx_.data(), rx_.size(), h);
+      if (r < 0)
+      {
+        fail(events);
+        return;
+      }
+      if (r == 0 || rx_.size() < h.headerLength + h.payloadLength)
+        return;
+
+      std::string payload = rx_.substr(h.headerLength, (size_t)h.payloadLength);
+      rx_.erase(0, h.headerLength + (size_t)h.payloadLength);
+      if (h.masked)
+        wsUnmask((uint8_t *)&payload[0], payload.size(), h.mask);
+
+      switch (h.opcode)
+      {
+      case WS_OP_PING:
+        wsAppendFrame(tx_, WS_OP_PONG, (const uint8_t *)payload.data(), payload.size(), true, (uint32_t)random(0x7FFFFFFF));
+        flushTx();
+        events.onWsFrame(h.opcode, (const uint8_t *)payload.data(), payload.size());
+        break;
+      case WS_OP_CLOSE:
+        close();
+        events.onWsClose();
+        return;
+      case WS_OP_CONT:
+        frag_ += payload;
+        if (h.fin)
+        {
+          std::string whole;
+          whole.swap(frag_);
+          events.onWsFrame(fragOpcode_, (const uint8_t *)whole.data(), whole.size());
+        }
+        break;
+      default:
+        if (!h.fin)
+        {
+          fragOpcode_ = h.opcode;
+          frag_ = payload;
+          break;
+        }
+        events.onWsFrame(h.opcode, (const uint8_t *)payload.data(), payload.size());
+        break;
+      }
+      if (gen != gen_ || fd_ < 0)
+        return;
+    }
+  }
+
+  static bool containsHeader(const std::string &head, const std::string &line)
+  {
+    // header names are case-insensitive; values (the accept key) are not
+    size_t colon = line.find(':');
+    std::string name = line.substr(0, colon + 1);
+    size_t pos = 0;
+    while ((pos = head.find("\r\n", pos)) != std::string::npos)
+    {
+      pos += 2;
+      if (strncasecmp(head.c_str() + pos, name.c_str(), name.size()) != 0)
+        continue;
+      size_t v = head.find_first_not_of(' ', pos + name.size());
+      size_t e = head.find("\r\n", v);
+      return head.compare(v, e == std::string::npos ? std::string::npos : e - v, line.substr(colon + 2)) == 0;
+    }
+    return false;
+  }
+
+  int fd_ = -1;
+  State state_ = State::Idle;
+  uint32_t gen_ = 0;
+  bool failed_ = false;
+  uint32_t deadlineMs_ = 0;
+  std::string key_;
+  std::string rx_;
+  std::string tx_;
+  std::string frag_;
+  uint8_t fragOpcode_ = WS_OP_TEXT;
+};
+
+WsBackendFactory &factory()
+{
+  static WsBackendFactory f;
+  return f;
+}
+} // namespace
+
+std::unique_ptr<WsBackend> makeTcpWsBackend() { return std::unique_ptr<WsBackend>(new TcpWsBackend()); }
+
+void setWsBackendFactory(WsBackendFactory f) { factory() = std::move(f); }
+
+std::unique_ptr<WsBackend> makeWsBackend()
+{
+  if (factory())
+    return factory()();
+  return makeTcpWsBackend();
+}
+} // namespace host
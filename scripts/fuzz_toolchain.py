@@ -0,0 +1,18 @@
+import shutil
+from SCons.Script import Import
+
+Import("env")
+
+# Fuzz envs: libFuzzer needs clang. Without it the same targets build with gcc
+# and link tools/fuzz/standalone_main.cpp, which replays a corpus under
+# ASan/UBSan instead of fuzzing.
+flags = ["-fsanitize=address,undefined", "-fno-omit-frame-pointer", "-fno-sanitize-recover=undefined"]
+
+if shutil.which("clang++"):
+    env.Replace(CC="clang", CXX="clang++", LINK="clang++")
+    env.Append(CPPDEFINES=["FUZZ_LIBFUZZER"])
+    flags[0] = "-fsanitize=fuzzer,address,undefined"
+else:
+    print("fuzz: clang++ not found, building a corpus replayer with gcc")
+
+env.Append(CCFLAGS=flags, LINKFLAGS=flags)
@@ -3,8 +3,12 @@ from SCons.Script import Import
 
 Import("env")
 
+# Second-stage bootloader offset per chip; partitions and app are the same on all
+BOOTLOADER_OFFSETS = {"esp32": 0x1000, "esp32s2": 0x1000, "esp32s3": 0x0, "esp32c3": 0x0}
+
 def after_build(source, target, env):
     build_dir = env.subst("$BUILD_DIR")
+    chip = env.BoardConfig().get("build.mcu")
 
     bootloader = os.path.join(build_dir, "bootloader.bin")
     partitions = os.path.join(build_dir, "partitions.bin")
@@ -16,12 +20,12 @@ def after_build(source, target, env):
     esptool_py = os.path.join(esptool_dir, "esptool.py")
 
     cmd = (
-        f'"{env.subst("$PYTHONEXE")}" "{esptool_py}" --chip esp32s2 merge_bin -o "{out}" '
-        f'0x1000 "{bootloader}" 0x8000 "{partitions}" 0x10000 "{app}"'
+        f'"{env.subst("$PYTHONEXE")}" "{esptool_py}" --chip {chip} merge_bin -o "{out}" '
+        f'0x{BOOTLOADER_OFFSETS[chip]:x} "{bootloader}" 0x8000 "{partitions}" 0x10000 "{app}"'
     )
 
-    print("Merging ESP32-S2 firmware:", cmd)
+    print(f"Merging {chip} firmware:", cmd)
     if env.Execute(cmd) != 0:
-        raise Exception("Failed to merge ESP32-S2 binaries")
+        raise Exception(f"Failed to merge {chip} binaries")
 
 env.AddPostAction("buildprog", after_build)
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Build each feature profile and report flash, static RAM and boot time.
+
+Flash and RAM come from the "RAM:" / "Flash:" summary `pio run` prints for a
+firmware env, plus the size of firmware.bin (what an OTA transfers). Boot time
+needs a device: with --boot <env>=<port> the board on that port is reset and
+the "Ready in <n> ms" line setup() prints at the end is read back, so flash
+that env first (pio run -e <env> -t upload).
+
+  python3 scripts/profile_report.py
+  python3 scripts/profile_report.py esp8266 esp8266_lite --boot esp8266_lite=/dev/ttyUSB0
+  python3 scripts/profile_report.py --json > profiles.json
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(HERE)
+
+ENVS = ["esp8266", "esp8266_lite", "esp32s2", "esp32s2_lite"]
+BOOT_TIMEOUT_S = 90  # a lite build with no WiFi in range still gets there
+
+USAGE_RE = re.compile(r"^(RAM|Flash):.*\(used (\d+) bytes from (\d+) bytes\)", re.M)
+READY_RE = re.compile(r"Ready in (\d+) ms \((\w+) build\)")
+
+
+def build(env):
+    proc = subprocess.run(["pio", "run", "-e", env], cwd=ROOT, stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT, text=True, errors="replace")
+    result = {"env": env}
+    if proc.returncode != 0:
+        sys.stderr.write(proc.stdout[-4000:])
+        result["error"] = "build failed (exit %d)" % proc.returncode
+        return result
+    for kind, used, total in USAGE_RE.findall(proc.stdout):
+        result[kind.lower()] = int(used)
+        result[kind.lower() + "_total"] = int(total)
+    image = os.path.join(ROOT, ".pio", "build", env, "firmware.bin")
+    if os.path.exists(image):
+        result["image"] = os.path.getsize(image)
+    return result
+
+
+def boot_ms(port):
+    import serial  # pyserial, shipped with PlatformIO
+
+    with serial.Serial(port, 115200, timeout=0.5) as s:
+        # EN low via RTS with GPIO0 left high (DTR off): a plain reset
+        s.dtr = False
+        s.rts = True
+        time.sleep(0.1)
+        s.rts = False
+        deadline = time.time() + BOOT_TIMEOUT_S
+        while time.time() < deadline:
+            m = READY_RE.search(s.readline().decode("utf-8", "replace"))
+            if m:
+                return int(m.group(1))
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("envs", nargs="*", default=ENVS)
+    ap.add_argument("--boot", action="append", default=[], metavar="ENV=PORT",
+                    help="measure boot time of ENV on the board at PORT")
+    ap.add_argument("--json", action="store_true", help="print JSON instead of a table")
+    args = ap.parse_args()
+
+    ports = dict(b.split("=", 1) for b in args.boot)
+    results = []
+    for env in args.envs:
+        r = build(env)
+        if env in ports and "error" not in r:
+            r["boot_ms"] = boot_ms(ports[env])
+        results.append(r)
+
+    if args.json:
+        json.dump(results, sys.stdout, indent=2)
+        print()
+    else:
+        print("%-16s %10s %10s %10s %8s" % ("env", "flash", "image", "ram", "boot_ms"))
+        for r in results:
+            if "error" in r:
+                print("%-16s %s" % (r["env"], r["error"]))
+                continue
+            boot = r.get("boot_ms")
+            print("%-16s %10s %10s %10s %8s" % (r["env"], r.get("flash", "?"), r.get("image", "?"), r.get("ram", "?"),
+                                                "-" if boot is None else boot))
+    return 1 if any("error" in r for r in results) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+// Board profiles: what main.cpp needs to know about the hardware, as
+// compile-time constants. Code tests a BOARD member instead of the chip
+// macro, so the branch a board does not take compiles away; #if defined(ESP8266)
+// is left only where the two SDKs spell an API differently. Each PlatformIO
+// env picks one with -D BOARD_<NAME>; a build without one gets the original
+// board for its chip (nodemcuv2 on ESP8266, lolin_s2_mini otherwise, host
+// builds included).
+
+enum class TaskModel : uint8_t
+{
+  Loop,     // everything in setup()/loop()
+  DualCore, // network and outputs on separate cores
+};
+
+struct BoardProfile
+{
+  const char *name;
+  const char *chip;      // CAPS "chip", mDNS TXT chip, OTA "chip" match
+  const char *chipAlias; // also taken as OTA "chip" (from relays older than spec 13), "" for none
+  uint8_t ledPin;        // output bit 0
+  bool ledActiveLow;     // LED lit when the pin is LOW
+  int8_t forcePortalPin; // held LOW at boot opens the portal, -1 = none
+  bool wsTls;            // wss:// relays work (ESP8266 downgrades to ws://)
+  TaskModel tasks;
+};
+
+#if defined(BOARD_ESP32C3)
+// ESP32-C3 DevKitM/SuperMini class: the on-board LED is addressable or sits
+// on a strapping pin, so the status LED goes on GPIO3
+static constexpr BoardProfile BOARD = {"esp32c3", "esp32c3", "", 3, false, -1, true, TaskModel::Loop};
+#elif defined(BOARD_ESP32S3)
+// ESP32-S3 DevKitC class, external LED on GPIO4 (GPIO48 is the RGB LED)
+static constexpr BoardProfile BOARD = {"esp32s3", "esp32s3", "", 4, false, -1, true, TaskModel::DualCore};
+#define BOARD_DUAL_CORE 1
+#elif defined(ESP8266) // BOARD_NODEMCUV2
+static constexpr BoardProfile BOARD = {"nodemcuv2", "esp8266", "", 5, false, -1, false, TaskModel::Loop};
+#else // BOARD_LOLIN_S2_MINI
+// The only ESP32 target before spec 13, when it still called itself "esp32"
+static constexpr BoardProfile BOARD = {"lolin_s2_mini", "esp32s2", "esp32", 2, false, -1, true, TaskModel::Loop};
+#endif
+
+// The task model again for the preprocessor: the dual-core code calls FreeRTOS
+// APIs that only the ESP32 SDK has
+#ifndef BOARD_DUAL_CORE
+#define BOARD_DUAL_CORE 0
+#endif
+static_assert((BOARD.tasks == TaskModel::DualCore) == (BOARD_DUAL_CORE != 0), "BOARD_DUAL_CORE must match BOARD.tasks");
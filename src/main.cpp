@@ -1,27 +1,101 @@
 #include <Arduino.h>
 
+// ================== FEATURES ==================
+// Build-time switches, all on by default; the *_lite envs in platformio.ini
+// turn off what a fleet with compiled-in DEFAULT_* credentials never uses.
+// 0 compiles the subsystem (and its library) out.
+#ifndef FEATURE_PORTAL
+#define FEATURE_PORTAL 1 // WiFiManager captive portal
+#endif
+#ifndef FEATURE_EAP
+#define FEATURE_EAP 1 // 802.1X (WPA2 Enterprise) joins
+#endif
+#ifndef FEATURE_OTA
+#define FEATURE_OTA 1 // HTTP(S) OTA from relay or broker triggers
+#endif
+#ifndef FEATURE_TLS
+#define FEATURE_TLS 1 // wss:// relays (ESP32) and https:// OTA
+#endif
+#ifndef FEATURE_SERIAL_CONFIG
+#define FEATURE_SERIAL_CONFIG 1 // serial commands and the boot-time WEB_CONFIG window
+#endif
+#ifndef FEATURE_MQTT
+#define FEATURE_MQTT 1 // mqttUrl, see MQTT
+#endif
+#ifndef FEATURE_LAN
+#define FEATURE_LAN 1 // lanPort: WS listener for a LAN agent, see LAN direct
+#endif
+#ifndef FEATURE_UDP
+#define FEATURE_UDP 1 // status datagrams next to the WS, see UDP status
+#endif
+#ifndef FEATURE_MDNS
+#define FEATURE_MDNS 1 // LAN listener advertisement and relay discovery (preferLocal)
+#endif
+#ifndef FW_PROFILE
+#define FW_PROFILE "full"
+#endif
+// ==============================================
+
 #if defined(ESP8266)
 #include <ESP8266WiFi.h>
 #include <LittleFS.h>
+#if FEATURE_OTA
 #include <ESP8266httpUpdate.h>
+#endif
+#if FEATURE_TLS
 #include <WiFiClientSecureBearSSL.h>
+#endif
+#if FEATURE_MDNS
+#include <ESP8266mDNS.h>
+#endif
 extern "C" {
   #include "user_interface.h"
+#if FEATURE_EAP
   #include "wpa2_enterprise.h"
+#endif
 }
 #else
 #include <WiFi.h>
 #include <LittleFS.h>
+#if FEATURE_OTA
 #include <HTTPUpdate.h>
+#endif
+#if FEATURE_TLS
 #include <WiFiClientSecure.h>
+#endif
+#if FEATURE_MDNS
+#include <ESPmDNS.h>
+#endif
+#if FEATURE_EAP
 #include "esp_wpa2.h"
+#endif
 #include "esp_wifi.h"
 #endif
 
+#if FEATURE_PORTAL
 #include <WiFiManager.h>
+#endif
 #include <WebSocketsClient.h>
+#if FEATURE_LAN
+#include <WebSocketsServer.h>
+#endif
+#if FEATURE_UDP
+#include <WiFiUdp.h>
+#endif
+#if FEATURE_MQTT
+#include <PubSubClient.h>
+#endif
 #include <ArduinoJson.h>
 
+#include "board.h"
+#include "protocol.h"
+#if FEATURE_UDP
+#include "status_datagram.h"
+#endif
+#if BOARD_DUAL_CORE
+#include "spsc_queue.h"
+#endif
+
 // ================== USER DEFAULTS ==================
 // If all are set, no portal is created for the user to enter these
 static const char *DEFAULT_WS_URL = "";
@@ -38,36 +112,49 @@ static const char *DEFAULT_EAP_PASSWORD = "";
   #define FW_VERSION "dev"
 #endif
 static const char *FW_VERSION_STR = FW_VERSION;
+static const char *FW_PROFILE_STR = FW_PROFILE; // which feature set, see FEATURES
 
-// LED pins (Active HIGH)
-#if defined(ESP8266)
-static const uint8_t LED_PIN = 5; // ESP8266 GPIO5
-#else
-static const uint8_t LED_PIN = 2; // ESP32 GPIO2
-#endif
+// Pins and chip come from the board profile (board.h)
+static constexpr uint8_t LED_PIN = BOARD.ledPin;
+static constexpr const char *CHIP_NAME = BOARD.chip;
+static const uint8_t OUTPUT_COUNT = 1; // bit 0 of a binary status frame is LED_PIN
 
-static const int FORCE_PORTAL_PIN = -1;
+static constexpr int FORCE_PORTAL_PIN = BOARD.forcePortalPin;
+// wss:// needs both a board that can hold a TLS session and FEATURE_TLS
+static constexpr bool WS_TLS = BOARD.wsTls && FEATURE_TLS;
 
-// WiFi retry behavior
-static const uint8_t WIFI_CONNECT_TRIES = 4;
-static const uint32_t WIFI_TRY_TIMEOUT_MS = 15000;  // 15s for enterprise networks
+// WiFi retry behavior (build-time overridable like the WS timing in protocol.h)
+#ifndef TUNE_WIFI_CONNECT_TRIES
+#define TUNE_WIFI_CONNECT_TRIES 4
+#endif
+#ifndef TUNE_WIFI_TRY_TIMEOUT_MS
+#define TUNE_WIFI_TRY_TIMEOUT_MS 15000
+#endif
+static const uint8_t WIFI_CONNECT_TRIES = TUNE_WIFI_CONNECT_TRIES;
+static const uint32_t WIFI_TRY_TIMEOUT_MS = TUNE_WIFI_TRY_TIMEOUT_MS;  // 15s for enterprise networks
 
-// Auth failure behavior
-static const uint8_t MAX_AUTH_FAILURES = 3;
+// Auth failure behavior (limit in protocol.h). NOAUTHs count across
+// reconnects, since relays hang up after one; only an OK resets the count.
 static uint8_t authFailureCount = 0;
 
 // Config storage
 static const char *CONFIG_PATH = "/config.json";
+#if FEATURE_MDNS
+static const char *LOCAL_RELAY_PATH = "/local_relay.txt"; // last relay found over mDNS
+#endif
 
-// WS reconnect pacing
-static const uint32_t WS_RECONNECT_MS = 5000;
+// WS reconnect pacing (interval in protocol.h)
 static bool wsWasConnected = false;
 
 WebSocketsClient webSocket;
 
+// Relays tried after wsUrl, in order (see Relays)
+static const uint8_t MAX_FALLBACK_URLS = 3;
+
 struct AppConfig
 {
   String wsUrl;
+  String fallbackUrls[MAX_FALLBACK_URLS];
   String authToken;
   // WiFi credentials (optional - can also use captive portal)
   String wifiSsid;
@@ -75,6 +162,17 @@ struct AppConfig
   // 802.1X WPA Enterprise credentials
   String eapIdentity;
   String eapPassword;
+  // Telemetry interval overriding the relay's SESSION pick (0 = relay decides)
+  uint32_t telemetryMs;
+  // LAN-direct listener port (0 = off), see LAN direct
+  uint16_t lanPort;
+  // MQTT broker used instead of the relay when set, see MQTT
+  String mqttUrl;
+  // Use a relay found on the LAN ahead of wsUrl, see Local relay discovery
+  bool preferLocal;
+  // WiFi sleep for battery units (0 = off) and beacons between wakes, see Power
+  uint8_t powerMode;
+  uint8_t listenInterval;
 };
 static AppConfig cfg;
 
@@ -86,10 +184,215 @@ struct WsParts
   String path;
 };
 
+struct MqttParts
+{
+  String host;
+  uint16_t port;
+  String prefix; // topic prefix, without the trailing slash
+};
+
 static uint32_t lastWsAttemptMs = 0;
+static String wsHost; // host of the relay being connected to; UDP hellos go there
 
 // ---------- helpers ----------
-static void setLed(bool on) { digitalWrite(LED_PIN, on ? HIGH : LOW); }
+static void setLed(bool on) { digitalWrite(LED_PIN, on != BOARD.ledActiveLow ? HIGH : LOW); }
+
+#if FEATURE_MDNS || FEATURE_MQTT || FEATURE_LAN
+// <PROTO_MDNS_HOST_PREFIX><last 6 MAC hex digits>: mDNS host name, MQTT client id and login
+static const String &deviceId()
+{
+  static String id;
+  if (id.length() == 0)
+  {
+    String mac = WiFi.macAddress();
+    mac.replace(":", "");
+    mac.toLowerCase();
+    id = String(PROTO_MDNS_HOST_PREFIX) + mac.substring(6);
+  }
+  return id;
+}
+#endif
+
+// -------------- Cores --------------
+// On a DualCore board (board.h) the network side runs in a task pinned to
+// NET_CORE, next to the WiFi driver: WiFi, relay/LAN/MQTT/UDP connections,
+// config and OTA. loop() stays on OUT_CORE and only writes outputs and reads
+// serial. Two SpscQueue rings join them: accepted status masks go one way,
+// stamped with micros(), and complete serial lines go the other. A TLS
+// handshake or a blocking reconnect then never holds up the LED. Serial
+// commands still execute on the network core, because they change cfg and
+// restart connections there. Other boards run both halves in turn in loop().
+//
+// GET_CORES reports each side's load: busy time per pass (everything but the
+// idle delay) over the last LOAD_WINDOW_MS. It also reports status latency,
+// measured from the network side accepting a status to the pin write.
+static const uint32_t LOAD_WINDOW_MS = 1000;
+
+#if BOARD_DUAL_CORE
+typedef std::atomic<uint32_t> CoreCounter; // written on one core, read on the other
+#else
+typedef uint32_t CoreCounter;
+#endif
+
+struct CoreLoad
+{
+  uint32_t windowStartMs;
+  uint32_t busyUs;
+  CoreCounter pct;     // busy share of the last full window
+  CoreCounter peakPct; // highest pct since boot
+};
+static CoreLoad netLoad; // the whole loop() on single-core boards
+
+static void countBusy(CoreLoad &load, uint32_t passStartUs)
+{
+  load.busyUs += micros() - passStartUs;
+  uint32_t now = millis();
+  if (now - load.windowStartMs < LOAD_WINDOW_MS)
+    return;
+  uint32_t pct = (uint32_t)((uint64_t)load.busyUs * 100 / ((uint64_t)(now - load.windowStartMs) * 1000));
+  if (pct > 100)
+    pct = 100;
+  load.pct = pct;
+  if (pct > load.peakPct)
+    load.peakPct = pct;
+  load.busyUs = 0;
+  load.windowStartMs = now;
+}
+
+#if BOARD_DUAL_CORE
+static const BaseType_t NET_CORE = 0; // PRO_CPU, where the WiFi driver runs
+static const BaseType_t OUT_CORE = 1; // APP_CPU, the Arduino loop task
+#ifndef TUNE_NET_TASK_STACK
+#define TUNE_NET_TASK_STACK 12288
+#endif
+static const uint32_t NET_TASK_STACK = TUNE_NET_TASK_STACK; // TLS handshakes and OTA run here
+static const uint16_t SERIAL_LINE_MAX = 1024;
+
+struct OutputEvent
+{
+  uint32_t mask;
+  uint32_t acceptedUs;
+};
+
+struct StatusLatency
+{
+  uint32_t windowStartMs; // output core only
+  uint32_t windowSamples;
+  uint32_t windowSumUs;
+  CoreCounter samples; // since boot
+  CoreCounter avgUs;   // over the last window that had any
+  CoreCounter maxUs;   // since boot
+};
+
+static SpscQueue<OutputEvent, 16> outputQueue; // network -> output
+#if FEATURE_SERIAL_CONFIG
+static SpscQueue<String *, 4> serialQueue;     // output -> network, one command line each
+#endif
+static CoreLoad outLoad;
+static StatusLatency statusLatency;
+static CoreCounter outputStalls; // pushes that waited for a full outputQueue
+static bool coresSplit = false;  // network task started; before that outputs are written in place
+static TaskHandle_t outputTask = nullptr;
+#if FEATURE_SERIAL_CONFIG
+static String serialLine;        // output core's partial line
+#endif
+#endif
+
+// Network side: put a status mask on the outputs
+static void outputStatus(uint32_t mask)
+{
+#if BOARD_DUAL_CORE
+  if (coresSplit)
+  {
+    // the newest status must not be lost, so wait for the output core
+    OutputEvent ev = {mask, micros()};
+    while (!outputQueue.push(ev))
+    {
+      outputStalls++;
+      delay(1);
+    }
+    xTaskNotifyGive(outputTask);
+    return;
+  }
+#endif
+  setLed(mask & 0x01); // bit 0 is LED_PIN
+}
+
+#if BOARD_DUAL_CORE
+static void drainOutputs()
+{
+  OutputEvent ev;
+  while (outputQueue.pop(ev))
+  {
+    setLed(ev.mask & 0x01);
+    uint32_t us = micros() - ev.acceptedUs;
+    statusLatency.samples++;
+    statusLatency.windowSamples++;
+    statusLatency.windowSumUs += us;
+    if (us > statusLatency.maxUs)
+      statusLatency.maxUs = us;
+  }
+  uint32_t now = millis();
+  if (now - statusLatency.windowStartMs >= LOAD_WINDOW_MS)
+  {
+    if (statusLatency.windowSamples)
+      statusLatency.avgUs = statusLatency.windowSumUs / statusLatency.windowSamples;
+    statusLatency.windowSamples = 0;
+    statusLatency.windowSumUs = 0;
+    statusLatency.windowStartMs = now;
+  }
+}
+
+#if FEATURE_SERIAL_CONFIG
+// Output core: collect a line without blocking, then hand it over
+static void readSerialLines()
+{
+  while (Serial.available())
+  {
+    char c = (char)Serial.read();
+    if (c != '\n')
+    {
+      if (serialLine.length() < SERIAL_LINE_MAX)
+        serialLine += c;
+      continue;
+    }
+    serialLine.trim(); // Removes \r and whitespace
+    if (serialLine.length() > 0)
+    {
+      String *line = new String(serialLine);
+      if (!serialQueue.push(line))
+      {
+        delete line;
+        Serial.println("ERR:BUSY");
+      }
+    }
+    serialLine = "";
+  }
+}
+#endif
+#endif
+
+#if FEATURE_SERIAL_CONFIG
+// CORES:{"model":"dual","net":{"core":0,"loadPct":n,"peakPct":n},"out":{"core":1,...},
+//        "queued":n,"stalls":n,"latSamples":n,"latAvgUs":n,"latMaxUs":n}
+// CORES:{"model":"loop","loop":{"loadPct":n,"peakPct":n}}
+static void printCores()
+{
+#if BOARD_DUAL_CORE
+  Serial.printf("CORES:{\"model\":\"dual\",\"net\":{\"core\":%d,\"loadPct\":%lu,\"peakPct\":%lu},"
+                "\"out\":{\"core\":%d,\"loadPct\":%lu,\"peakPct\":%lu},\"queued\":%lu,\"stalls\":%lu,"
+                "\"latSamples\":%lu,\"latAvgUs\":%lu,\"latMaxUs\":%lu}\n",
+                (int)NET_CORE, (unsigned long)netLoad.pct, (unsigned long)netLoad.peakPct,
+                (int)OUT_CORE, (unsigned long)outLoad.pct, (unsigned long)outLoad.peakPct,
+                (unsigned long)outputQueue.size(), (unsigned long)outputStalls,
+                (unsigned long)statusLatency.samples, (unsigned long)statusLatency.avgUs,
+                (unsigned long)statusLatency.maxUs);
+#else
+  Serial.printf("CORES:{\"model\":\"loop\",\"loop\":{\"loadPct\":%lu,\"peakPct\":%lu}}\n",
+                (unsigned long)netLoad.pct, (unsigned long)netLoad.peakPct);
+#endif
+}
+#endif
 
 static bool ensureFS()
 {
@@ -117,18 +420,32 @@ static bool loadConfig(AppConfig &out)
   if (!f)
     return false;
 
-  StaticJsonDocument<512> doc;
+  StaticJsonDocument<1024> doc;
   auto err = deserializeJson(doc, f);
   f.close();
   if (err)
     return false;
 
   out.wsUrl = doc["wsUrl"] | DEFAULT_WS_URL;
+  for (uint8_t i = 0; i < MAX_FALLBACK_URLS; i++)
+    out.fallbackUrls[i] = doc["fallbackUrls"][i] | "";
   out.authToken = doc["authToken"] | DEFAULT_AUTH_TOKEN;
   out.wifiSsid = doc["wifiSsid"] | "";
   out.wifiPass = doc["wifiPass"] | "";
   out.eapIdentity = doc["eapIdentity"] | DEFAULT_EAP_IDENTITY;
   out.eapPassword = doc["eapPassword"] | DEFAULT_EAP_PASSWORD;
+  out.telemetryMs = doc["telemetryMs"] | 0u;
+#if FEATURE_LAN
+  out.lanPort = doc["lanPort"] | 0u;
+#endif
+#if FEATURE_MQTT
+  out.mqttUrl = doc["mqttUrl"] | "";
+#endif
+#if FEATURE_MDNS
+  out.preferLocal = doc["preferLocal"] | false;
+#endif
+  out.powerMode = doc["powerMode"] | 0;
+  out.listenInterval = doc["listenInterval"] | 3;
   return true;
 }
 
@@ -139,11 +456,27 @@ static bool saveConfig(const AppConfig &in)
 
   StaticJsonDocument<1024> doc;
   doc["wsUrl"] = in.wsUrl;
+  for (uint8_t i = 0; i < MAX_FALLBACK_URLS; i++)
+    if (in.fallbackUrls[i].length() > 0)
+      doc["fallbackUrls"].add(in.fallbackUrls[i]);
   doc["authToken"] = in.authToken;
   doc["wifiSsid"] = in.wifiSsid;
   doc["wifiPass"] = in.wifiPass;
   doc["eapIdentity"] = in.eapIdentity;
   doc["eapPassword"] = in.eapPassword;
+  if (in.telemetryMs > 0)
+    doc["telemetryMs"] = in.telemetryMs;
+  if (in.lanPort > 0)
+    doc["lanPort"] = in.lanPort;
+  if (in.mqttUrl.length() > 0)
+    doc["mqttUrl"] = in.mqttUrl;
+  if (in.preferLocal)
+    doc["preferLocal"] = true;
+  if (in.powerMode > 0)
+  {
+    doc["powerMode"] = in.powerMode;
+    doc["listenInterval"] = in.listenInterval;
+  }
 
   File f = LittleFS.open(CONFIG_PATH, "w");
   if (!f)
@@ -198,6 +531,41 @@ static bool parseWsUrl(const String &url, WsParts &out)
   return true;
 }
 
+// mqtt://host[:port][/prefix]; no TLS, brokers for this sit on the site network
+static bool parseMqttUrl(const String &url, MqttParts &out)
+{
+  String u = url;
+  u.trim();
+  if (!u.startsWith(PROTO_MQTT_SCHEME))
+    return false;
+  u = u.substring(strlen(PROTO_MQTT_SCHEME));
+
+  int slash = u.indexOf('/');
+  String hostPort = (slash >= 0) ? u.substring(0, slash) : u;
+  out.prefix = (slash >= 0) ? u.substring(slash + 1) : String(PROTO_MQTT_DEFAULT_PREFIX);
+  while (out.prefix.endsWith("/"))
+    out.prefix.remove(out.prefix.length() - 1);
+  if (out.prefix.length() == 0)
+    out.prefix = PROTO_MQTT_DEFAULT_PREFIX;
+
+  int colon = hostPort.indexOf(':');
+  if (colon >= 0)
+  {
+    out.host = hostPort.substring(0, colon);
+    long p = hostPort.substring(colon + 1).toInt();
+    if (p <= 0 || p > 65535)
+      return false;
+    out.port = (uint16_t)p;
+  }
+  else
+  {
+    out.host = hostPort;
+    out.port = PROTO_MQTT_DEFAULT_PORT;
+  }
+  // wildcards would subscribe to other devices' topics
+  return out.host.length() > 0 && out.prefix.indexOf('+') < 0 && out.prefix.indexOf('#') < 0;
+}
+
 static bool isBlank(const char *s)
 {
   return (s == nullptr) || (s[0] == '\0');
@@ -213,18 +581,24 @@ static bool defaultsHaveAppConfig()
   return !isBlank(DEFAULT_WS_URL) && !isBlank(DEFAULT_AUTH_TOKEN);
 }
 
-// Check if we have a valid app config (from defaults OR loaded from flash)
+// Check if we have a valid app config (from defaults OR loaded from flash).
+// A blank wsUrl is valid with preferLocal: the relay is then found on the LAN.
 static bool hasAppConfig()
 {
-  return cfg.wsUrl.length() > 0 && cfg.authToken.length() > 0;
+  return (cfg.wsUrl.length() > 0 || cfg.mqttUrl.length() > 0 || cfg.preferLocal) && cfg.authToken.length() > 0;
 }
 
 // Check if 802.1X enterprise authentication is configured
 static bool hasEapCredentials()
 {
+#if FEATURE_EAP
   return cfg.eapIdentity.length() > 0 && cfg.eapPassword.length() > 0;
+#else
+  return false; // every enterprise branch below folds away
+#endif
 }
 
+#if FEATURE_EAP
 // Try connecting using 802.1X WPA Enterprise
 static bool tryConnectWifiEnterprise(const char *ssid, const char *identity, const char *password, uint8_t tries, uint32_t perTryTimeoutMs)
 {
@@ -330,6 +704,9 @@ static bool tryConnectWifiEnterprise(const char *ssid, const char *identity, con
 #endif
   return false;
 }
+#else
+static bool tryConnectWifiEnterprise(const char *, const char *, const char *, uint8_t, uint32_t) { return false; }
+#endif
 
 // Try connecting to a specific SSID/pass (no saving). Returns true if connected.
 static bool tryConnectWifiExplicit(const char *ssid, const char *pass, uint8_t tries, uint32_t perTryTimeoutMs)
@@ -406,6 +783,7 @@ static bool tryConnectWifiSaved(uint8_t tries, uint32_t perTryTimeoutMs)
   return false;
 }
 
+#if FEATURE_PORTAL
 static void startConfigPortalAndSave()
 {
   WiFiManager wm;
@@ -427,7 +805,11 @@ static void startConfigPortalAndSave()
   strlcpy(eapIdentityBuf, cfg.eapIdentity.c_str(), sizeof(eapIdentityBuf));
   strlcpy(eapPasswordBuf, cfg.eapPassword.c_str(), sizeof(eapPasswordBuf));
 
+#if FEATURE_MDNS
+  WiFiManagerParameter p_wsurl("wsurl", "WebSocket URL (ws:// or wss://, blank = find a relay on this network)", wsUrlBuf, sizeof(wsUrlBuf));
+#else
   WiFiManagerParameter p_wsurl("wsurl", "WebSocket URL (ws:// or wss://)", wsUrlBuf, sizeof(wsUrlBuf));
+#endif
   WiFiManagerParameter p_token("authtok", "Auth Token", tokenBuf, sizeof(tokenBuf));
   
   // 802.1X Enterprise WiFi parameters
@@ -447,7 +829,7 @@ static void startConfigPortalAndSave()
   wm.setConnectTimeout(1);
 
   Serial.println("🛠 Starting config portal...");
-  setLed(false);
+  outputStatus(0);
 
   wm.startConfigPortal("DiscordVoiceSetup");
   
@@ -464,6 +846,10 @@ static void startConfigPortalAndSave()
 
   cfg.wsUrl = String(p_wsurl.getValue());
   cfg.wsUrl.trim();
+#if FEATURE_MDNS
+  if (cfg.wsUrl.length() == 0)
+    cfg.preferLocal = true; // what "blank" on the form means
+#endif
   cfg.authToken = String(p_token.getValue());
   cfg.authToken.trim();
   cfg.eapIdentity = String(p_eap_identity.getValue());
@@ -500,9 +886,17 @@ static void startConfigPortalAndSave()
     Serial.println("❌ WiFi connection failed");
   }
 }
+#else
+// Settings come from DEFAULT_*, serial CONFIG: or the relay instead
+static void startConfigPortalAndSave()
+{
+  Serial.println("⚠️ Config portal not in this build (FEATURE_PORTAL=0)");
+}
+#endif
 
 // ---------------- OTA ----------------
 
+#if FEATURE_OTA
 static void performOtaUpdate(const String &url, const String &md5Optional)
 {
   Serial.println("🚀 OTA requested");
@@ -514,49 +908,55 @@ static void performOtaUpdate(const String &url, const String &md5Optional)
   delay(100);
 
   // LED off during update start
-  setLed(false);
+  outputStatus(0);
 
 #if defined(ESP8266)
+  ESP8266HTTPUpdate &updater = ESPhttpUpdate;
   // Optional MD5
   if (md5Optional.length() > 0)
   {
-    ESPhttpUpdate.setMD5sum(md5Optional);
+    updater.setMD5sum(md5Optional);
   }
+#else
+  HTTPUpdate updater;
+
+  // NOTE: Some ESP32 cores don't expose setMD5() on HTTPUpdate.
+  // We'll skip MD5 verification on ESP32 for compatibility.
+  (void)md5Optional;
+#endif
 
   // Follow redirects (GitHub pages/CDNs sometimes redirect)
-  ESPhttpUpdate.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+  updater.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+  updater.rebootOnUpdate(true);
 
+  WiFiClient plain;
+  WiFiClient *client = &plain;
+#if FEATURE_TLS
+#if defined(ESP8266)
+  BearSSL::WiFiClientSecure secure;
+#else
+  WiFiClientSecure secure;
+#endif
+  secure.setInsecure(); // easiest; CA pinning can come later
+  if (url.startsWith("https://"))
+    client = &secure;
+#else
   if (url.startsWith("https://"))
   {
-    BearSSL::WiFiClientSecure client;
-    client.setInsecure(); // practical for ESP8266 remote OTA
-    auto ret = ESPhttpUpdate.update(client, url, String(FW_VERSION_STR));
-    switch (ret)
-    {
-    case HTTP_UPDATE_OK:
-      // Usually reboot occurs automatically; if not:
-      Serial.println("✅ OTA OK (ESP8266) - rebooting");
-      ESP.restart();
-      break;
-    case HTTP_UPDATE_NO_UPDATES:
-      Serial.println("ℹ️ OTA: no updates");
-      break;
-    case HTTP_UPDATE_FAILED:
-    default:
-      Serial.printf("❌ OTA failed (ESP8266): (%d) %s\n",
-                    ESPhttpUpdate.getLastError(),
-                    ESPhttpUpdate.getLastErrorString().c_str());
-      break;
-    }
+    Serial.println("❌ OTA: https:// not in this build (FEATURE_TLS=0)");
+    client = nullptr;
   }
-  else
+#endif
+
+  if (client)
   {
-    WiFiClient client;
-    auto ret = ESPhttpUpdate.update(client, url, String(FW_VERSION_STR));
+    t_httpUpdate_return ret = updater.update(*client, url, String(FW_VERSION_STR));
     switch (ret)
     {
     case HTTP_UPDATE_OK:
-      Serial.println("✅ OTA OK (ESP8266) - rebooting");
+      // Usually reboot occurs automatically; if not:
+      Serial.printf("✅ OTA OK (%s) - rebooting\n", BOARD.name);
+      delay(200);
       ESP.restart();
       break;
     case HTTP_UPDATE_NO_UPDATES:
@@ -564,79 +964,31 @@ static void performOtaUpdate(const String &url, const String &md5Optional)
       break;
     case HTTP_UPDATE_FAILED:
     default:
-      Serial.printf("❌ OTA failed (ESP8266): (%d) %s\n",
-                    ESPhttpUpdate.getLastError(),
-                    ESPhttpUpdate.getLastErrorString().c_str());
+      Serial.printf("❌ OTA failed (%s): (%d) %s\n", BOARD.name,
+                    updater.getLastError(),
+                    updater.getLastErrorString().c_str());
       break;
     }
   }
 
-#else // ESP32
-  HTTPUpdate httpUpdate;
-
-  // NOTE: Some ESP32 cores don't expose setMD5() on HTTPUpdate.
-  // We'll skip MD5 verification on ESP32 for compatibility.
-  // (ESP8266 still supports ESPhttpUpdate.setMD5()).
-  (void)md5Optional;
-
-  httpUpdate.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-  httpUpdate.rebootOnUpdate(true);
-
-  if (url.startsWith("https://"))
-  {
-    WiFiClientSecure client;
-    client.setInsecure(); // easiest; if you want CA pinning later we can do it
-    t_httpUpdate_return ret = httpUpdate.update(client, url, String(FW_VERSION_STR));
-    if (ret == HTTP_UPDATE_OK)
-    {
-      Serial.println("✅ OTA OK (ESP32) - rebooting");
-      delay(200);
-      ESP.restart();
-    }
-    else if (ret == HTTP_UPDATE_NO_UPDATES)
-    {
-      Serial.println("ℹ️ OTA: no updates");
-    }
-    else
-    {
-      Serial.printf("❌ OTA failed (ESP32): (%d) %s\n",
-                    httpUpdate.getLastError(),
-                    httpUpdate.getLastErrorString().c_str());
-    }
-  }
-  else
-  {
-    WiFiClient client;
-    t_httpUpdate_return ret = httpUpdate.update(client, url, String(FW_VERSION_STR));
-    if (ret == HTTP_UPDATE_OK)
-    {
-      Serial.println("✅ OTA OK (ESP32) - rebooting");
-      delay(200);
-      ESP.restart();
-    }
-    else if (ret == HTTP_UPDATE_NO_UPDATES)
-    {
-      Serial.println("ℹ️ OTA: no updates");
-    }
-    else
-    {
-      Serial.printf("❌ OTA failed (ESP32): (%d) %s\n",
-                    httpUpdate.getLastError(),
-                    httpUpdate.getLastErrorString().c_str());
-    }
-  }
-#endif
-
   // If update failed, resume normal operation
   Serial.println("↩️ OTA did not complete; resuming WS");
 }
+#else
+// Triggers are still parsed (and chip-checked) so they are not mistaken for
+// unknown frames
+static void performOtaUpdate(const String &url, const String &)
+{
+  Serial.printf("ℹ️ OTA ignored, not in this build (FEATURE_OTA=0): %s\n", url.c_str());
+}
+#endif
 
 static bool maybeHandleOtaMessage(const String &msg)
 {
   // Text format: OTA:<url>
-  if (msg.startsWith("OTA:"))
+  if (msg.startsWith(PROTO_OTA_PREFIX))
   {
-    String url = msg.substring(4);
+    String url = msg.substring(strlen(PROTO_OTA_PREFIX));
     url.trim();
     if (url.length() == 0)
       return false;
@@ -644,7 +996,7 @@ static bool maybeHandleOtaMessage(const String &msg)
     return true;
   }
 
-  // JSON format: {"type":"ota","url":"...","md5":"...","chip":"esp8266|esp32"}
+  // JSON format: {"type":"ota","url":"...","md5":"...","chip":"esp8266|esp32s2|esp32s3|esp32c3"}
   if (msg.length() > 0 && msg[0] == '{')
   {
     StaticJsonDocument<768> doc;
@@ -660,19 +1012,11 @@ static bool maybeHandleOtaMessage(const String &msg)
     const char *md5 = doc["md5"] | "";
     const char *chip = doc["chip"] | "";
 
-#if defined(ESP8266)
-    if (String(chip).length() > 0 && String(chip) != "esp8266")
-    {
-      Serial.println("ℹ️ OTA ignored: chip mismatch (need esp8266)");
-      return true;
-    }
-#else
-    if (String(chip).length() > 0 && String(chip) != "esp32")
+    if (strlen(chip) > 0 && strcmp(chip, CHIP_NAME) != 0 && strcmp(chip, BOARD.chipAlias) != 0)
     {
-      Serial.println("ℹ️ OTA ignored: chip mismatch (need esp32)");
+      Serial.printf("ℹ️ OTA ignored: chip mismatch (need %s)\n", CHIP_NAME);
       return true;
     }
-#endif
 
     String sUrl(url);
     sUrl.trim();
@@ -692,114 +1036,1909 @@ static bool maybeHandleOtaMessage(const String &msg)
   return false;
 }
 
-// -------------- WS setup --------------
+// -------------- WS session capture --------------
+// Inbound WS events and outbound frames go into a RAM ring; CAPTURE_DUMP
+// prints it over serial for tools/replay. Off unless the build defines
+// WS_CAPTURE_BYTES (e.g. -D WS_CAPTURE_BYTES=4096).
+#ifndef WS_CAPTURE_BYTES
+#define WS_CAPTURE_BYTES 0
+#endif
 
-static void setupWebSocketFromConfig()
+#if WS_CAPTURE_BYTES > 0
+// Record layout: ms(4) dir(1) type(1) len(2) payload(len), little endian.
+// dir is 'I' (event from the library), 'O' (frame we sent) or 'S' (state
+// snapshot, written whenever the ring starts empty). Payloads are clipped
+// and the oldest records are dropped when the ring is full.
+static const uint16_t WS_CAPTURE_MAX_PAYLOAD = 256;
+static uint8_t wsCapture[WS_CAPTURE_BYTES];
+static uint32_t wsCaptureHead = 0; // next write offset
+static uint32_t wsCaptureTail = 0; // oldest record
+static uint32_t wsCaptureUsed = 0;
+static uint32_t wsCaptureRecords = 0;
+static uint32_t wsCaptureDropped = 0;
+
+static String wsCaptureStateLine()
 {
-  WsParts parts;
-  if (!parseWsUrl(cfg.wsUrl, parts))
+  char buf[64];
+  snprintf(buf, sizeof(buf), "led=%d authFailures=%u connected=%d", (digitalRead(LED_PIN) == HIGH) != BOARD.ledActiveLow ? 1 : 0, authFailureCount, wsWasConnected ? 1 : 0);
+  return String(buf);
+}
+
+static void wsCaptureRead(uint32_t at, uint8_t *out, uint32_t len)
+{
+  for (uint32_t i = 0; i < len; i++)
+    out[i] = wsCapture[(at + i) % WS_CAPTURE_BYTES];
+}
+
+static void wsCaptureWrite(const uint8_t *data, uint32_t len)
+{
+  for (uint32_t i = 0; i < len; i++)
   {
-    Serial.println("❌ Bad WS URL -> portal");
-    startConfigPortalAndSave();
-    return;
+    wsCapture[wsCaptureHead] = data[i];
+    wsCaptureHead = (wsCaptureHead + 1) % WS_CAPTURE_BYTES;
   }
+}
 
-#if defined(ESP8266)
-  if (parts.secure)
+static void wsCaptureAppend(char dir, uint8_t type, const uint8_t *payload, size_t length)
+{
+  uint16_t len = length > WS_CAPTURE_MAX_PAYLOAD ? WS_CAPTURE_MAX_PAYLOAD : (uint16_t)length;
+  uint32_t size = 8 + len;
+  if (size > WS_CAPTURE_BYTES)
+    return;
+
+  while (WS_CAPTURE_BYTES - wsCaptureUsed < size)
   {
-    Serial.println("⚠️ ESP8266 auto-switching wss:// to ws://");
-    cfg.wsUrl.replace("wss://", "ws://");
-    saveConfig(cfg);
-    if (!parseWsUrl(cfg.wsUrl, parts))
-      return;
+    uint8_t old[8];
+    wsCaptureRead(wsCaptureTail, old, sizeof(old));
+    uint32_t oldSize = 8 + (old[6] | (old[7] << 8));
+    wsCaptureTail = (wsCaptureTail + oldSize) % WS_CAPTURE_BYTES;
+    wsCaptureUsed -= oldSize;
+    wsCaptureRecords--;
+    wsCaptureDropped++;
   }
-#endif
-
-  authFailureCount = 0;
 
-  webSocket.disconnect();
-  webSocket.setReconnectInterval(0); // manual pacing
-  webSocket.enableHeartbeat(15000, 3000, 2);
-
-  webSocket.onEvent([](WStype_t type, uint8_t *payload, size_t length)
-                    {
-    switch (type) {
-      case WStype_CONNECTED: {
-        wsWasConnected = true;
-        Serial.println("🔌 WS connected -> AUTH");
-        authFailureCount = 0;
-
-        String authMsg = "AUTH:" + cfg.authToken;
-        webSocket.sendTXT(authMsg);
-      } break;
-
-      case WStype_DISCONNECTED:
-        if (wsWasConnected) {
-          Serial.println("⚠️ WS disconnected");
-          wsWasConnected = false;
-        }
-        break;
+  uint32_t ms = millis();
+  uint8_t hdr[8] = {(uint8_t)ms, (uint8_t)(ms >> 8), (uint8_t)(ms >> 16), (uint8_t)(ms >> 24),
+                    (uint8_t)dir, type, (uint8_t)len, (uint8_t)(len >> 8)};
+  wsCaptureWrite(hdr, sizeof(hdr));
+  if (len > 0)
+    wsCaptureWrite(payload, len);
+  wsCaptureUsed += size;
+  wsCaptureRecords++;
+}
 
-      case WStype_TEXT: {
-        String s = String((char*)payload).substring(0, length);
-        s.trim();
+static void wsCaptureRecord(char dir, uint8_t type, const uint8_t *payload, size_t length)
+{
+  if (wsCaptureUsed == 0)
+  {
+    String state = wsCaptureStateLine();
+    wsCaptureAppend('S', 0, (const uint8_t *)state.c_str(), state.length());
+  }
+  wsCaptureAppend(dir, type, payload, length);
+}
 
-        // OTA first
-        if (maybeHandleOtaMessage(s)) return;
+static const char *wsCaptureTypeName(uint8_t type)
+{
+  switch (type)
+  {
+  case WStype_ERROR: return "ERROR";
+  case WStype_DISCONNECTED: return "DISCONNECTED";
+  case WStype_CONNECTED: return "CONNECTED";
+  case WStype_TEXT: return "TEXT";
+  case WStype_BIN: return "BIN";
+  case WStype_PING: return "PING";
+  case WStype_PONG: return "PONG";
+  default: return "OTHER";
+  }
+}
 
-        if (s == "OK") {
-          Serial.println("✅ Auth OK");
-          authFailureCount = 0;
-          return;
-        }
+static void wsCaptureClear()
+{
+  wsCaptureHead = wsCaptureTail = wsCaptureUsed = 0;
+  wsCaptureRecords = wsCaptureDropped = 0;
+}
+
+// CAPTURE:BEGIN {...}, one CAP:<ms> <dir> <type> <hex payload> per record,
+// CAPTURE:STATE <current state>, CAPTURE:END
+static void wsCaptureDump()
+{
+  Serial.printf("CAPTURE:BEGIN {\"fw\":\"%s\",\"records\":%u,\"dropped\":%u,\"now\":%u}\n", FW_VERSION_STR, wsCaptureRecords, wsCaptureDropped, millis());
+  uint32_t at = wsCaptureTail;
+  for (uint32_t r = 0; r < wsCaptureRecords; r++)
+  {
+    uint8_t hdr[8];
+    wsCaptureRead(at, hdr, sizeof(hdr));
+    uint32_t ms = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+    uint16_t len = hdr[6] | (hdr[7] << 8);
+    Serial.printf("CAP:%u %c %s ", ms, (char)hdr[4], hdr[4] == 'S' ? "STATE" : wsCaptureTypeName(hdr[5]));
+    for (uint16_t i = 0; i < len; i++)
+      Serial.printf("%02x", wsCapture[(at + 8 + i) % WS_CAPTURE_BYTES]);
+    Serial.println();
+    at = (at + 8 + len) % WS_CAPTURE_BYTES;
+    yield();
+  }
+  Serial.print("CAPTURE:STATE ");
+  Serial.println(wsCaptureStateLine());
+  Serial.println("CAPTURE:END");
+}
+#else
+static inline void wsCaptureRecord(char, uint8_t, const uint8_t *, size_t) {}
+#endif
+
+// -------------- Power --------------
+// cfg.powerMode trades status latency for current draw on battery units:
+//   0 off    radio always on, loop idles LOOP_IDLE_MS (the USB-powered default)
+//   1 modem  WiFi modem sleep: the radio wakes every cfg.listenInterval
+//            beacons and the AP holds frames for the device until then
+//   2 light  modem sleep, plus light sleep during the loop's idle delay on
+//            ESP8266; the ESP32 Arduino core has no automatic light sleep, so
+//            there it is modem sleep
+// In both sleep modes the loop idles POWER_LOOP_IDLE_MS and CAPS asks for a
+// POWER_HEARTBEAT_MS heartbeat instead of the 15 s default: just under the
+// 60 s after which the stingiest home NATs (and the reference relay's idle
+// timeout) drop a silent TCP connection. The relay has the last word in
+// SESSION; without one the default stays.
+//
+// A status frame waits in the AP for the next wake and then for the end of
+// the idle delay, so a setting adds up to listenInterval * BEACON_MS + idle,
+// about half that on average. GET_POWER prints this estimate next to a
+// measurement: relays may put the round trip of their previous ping in the
+// next one ({"type":"ping","rtt":n}), and that includes both waits.
+#ifndef TUNE_POWER_LOOP_IDLE_MS
+#define TUNE_POWER_LOOP_IDLE_MS 50
+#endif
+#ifndef TUNE_POWER_HEARTBEAT_MS
+#define TUNE_POWER_HEARTBEAT_MS 45000
+#endif
+static const uint32_t LOOP_IDLE_MS = 5;
+static const uint32_t POWER_LOOP_IDLE_MS = TUNE_POWER_LOOP_IDLE_MS;
+static const uint32_t POWER_HEARTBEAT_MS = TUNE_POWER_HEARTBEAT_MS;
+static const uint32_t BEACON_MS = 102; // 100 TU, what nearly every AP uses
+static const uint8_t POWER_MODE_MAX = 2;
+static const uint8_t LISTEN_INTERVAL_MAX = 10;
+static const char *const POWER_MODE_NAMES[] = {"off", "modem", "light"};
+
+// Round trips reported by the relay since the power setting last changed
+struct PowerStats
+{
+  uint32_t rttSamples;
+  uint32_t rttSumMs;
+  uint32_t rttMaxMs;
+};
+static PowerStats powerStats = {0, 0, 0};
+static uint32_t sessionHeartbeatMs = WS_HEARTBEAT_PING_MS; // what the current connection pings at
+
+static uint32_t loopIdleMs() { return cfg.powerMode ? POWER_LOOP_IDLE_MS : LOOP_IDLE_MS; }
+
+// Worst case a status frame waits because of the power setting
+static uint32_t powerAddedMaxMs()
+{
+  return (cfg.powerMode ? cfg.listenInterval * BEACON_MS : 0) + loopIdleMs();
+}
+
+// After every WiFi join and on a powerMode/listenInterval change. On ESP32 the
+// listen interval goes into the station config, which the AP learns at the
+// next association; WiFi.begin() keeps it as long as the network is the same.
+static void applyPowerMode()
+{
+#if defined(ESP8266)
+  WiFiSleepType_t type = cfg.powerMode == 2 ? WIFI_LIGHT_SLEEP : cfg.powerMode == 1 ? WIFI_MODEM_SLEEP : WIFI_NONE_SLEEP;
+  WiFi.setSleepMode(type, cfg.powerMode ? cfg.listenInterval : 0);
+#else
+  wifi_config_t conf;
+  if (cfg.powerMode && esp_wifi_get_config(WIFI_IF_STA, &conf) == ESP_OK && conf.sta.listen_interval != cfg.listenInterval)
+  {
+    conf.sta.listen_interval = cfg.listenInterval;
+    esp_wifi_set_config(WIFI_IF_STA, &conf);
+  }
+  esp_wifi_set_ps(cfg.powerMode ? WIFI_PS_MAX_MODEM : WIFI_PS_NONE);
+#endif
+  powerStats = {0, 0, 0};
+  if (cfg.powerMode)
+    Serial.printf("🔋 Power %s, listen interval %u, up to %lu ms added per status\n", POWER_MODE_NAMES[cfg.powerMode],
+                  cfg.listenInterval, (unsigned long)powerAddedMaxMs());
+}
+
+static void recordRelayRtt(uint32_t rttMs)
+{
+  powerStats.rttSamples++;
+  powerStats.rttSumMs += rttMs;
+  if (rttMs > powerStats.rttMaxMs)
+    powerStats.rttMaxMs = rttMs;
+}
+
+#if FEATURE_SERIAL_CONFIG
+// POWER:{"mode":"modem","listenInterval":n,"loopIdleMs":n,"heartbeatMs":n,
+//        "addedAvgMs":n,"addedMaxMs":n,"rttSamples":n,"rttAvgMs":n,"rttMaxMs":n}
+static void printPower()
+{
+  uint32_t added = powerAddedMaxMs();
+  Serial.printf("POWER:{\"mode\":\"%s\",\"listenInterval\":%u,\"loopIdleMs\":%lu,\"heartbeatMs\":%lu,"
+                "\"addedAvgMs\":%lu,\"addedMaxMs\":%lu,\"rttSamples\":%lu,\"rttAvgMs\":%lu,\"rttMaxMs\":%lu}\n",
+                POWER_MODE_NAMES[cfg.powerMode], cfg.listenInterval, (unsigned long)loopIdleMs(),
+                (unsigned long)sessionHeartbeatMs, (unsigned long)(added / 2), (unsigned long)added,
+                (unsigned long)powerStats.rttSamples,
+                (unsigned long)(powerStats.rttSamples ? powerStats.rttSumMs / powerStats.rttSamples : 0),
+                (unsigned long)powerStats.rttMaxMs);
+}
+#endif
+
+// -------------- WS session --------------
+// What the relay chose in its SESSION answer to our CAPS. Reset on every
+// connection; a relay that never answers leaves the text protocol in place.
+
+struct WsSession
+{
+  bool binary;               // status frames arrive as binary, telemetry goes out as binary
+  uint32_t telemetryMs;      // 0 = relay did not ask for telemetry
+  uint32_t relayTelemetryMs; // what SESSION asked for, before cfg.telemetryMs
+  uint16_t udpPort;          // relay's status datagram port, 0 = WS only (see UDP status)
+  uint32_t udpSid;           // session id the relay's datagrams carry
+};
+static WsSession wsSession = {false, 0, 0, 0, 0};
+static bool udpHelloDue = false;
+static uint32_t lastTelemetryMs = 0;
+
+static void sendCaps()
+{
+  StaticJsonDocument<192> doc;
+  doc["chip"] = CHIP_NAME;
+  doc["fw"] = FW_VERSION_STR;
+  doc["out"] = OUTPUT_COUNT;
+  doc["bin"] = 1;
+  doc["tele"] = 1;
+  if (FEATURE_UDP)
+    doc["udp"] = 1;
+  if (cfg.powerMode)
+    doc["hb"] = POWER_HEARTBEAT_MS; // see Power
+  String body;
+  serializeJson(doc, body);
+  String msg = String(PROTO_CAPS_PREFIX) + body;
+  wsCaptureRecord('O', WStype_TEXT, (const uint8_t *)msg.c_str(), msg.length());
+  webSocket.sendTXT(msg);
+}
+
+// A configured telemetryMs replaces the relay's interval, but never turns
+// telemetry on for a relay that did not ask for it.
+static uint32_t sessionTelemetryMs(uint32_t relayMs)
+{
+  return (relayMs > 0 && cfg.telemetryMs > 0) ? cfg.telemetryMs : relayMs;
+}
+
+static bool maybeHandleSession(const String &msg)
+{
+  if (!msg.startsWith(PROTO_SESSION_PREFIX))
+    return false;
+
+  StaticJsonDocument<256> doc;
+  if (deserializeJson(doc, msg.substring(strlen(PROTO_SESSION_PREFIX))))
+  {
+    Serial.println("❌ SESSION: invalid JSON");
+    return true;
+  }
+
+  const char *enc = doc["enc"] | "text";
+  uint32_t hb = doc["hb"] | WS_HEARTBEAT_PING_MS;
+  uint32_t tele = doc["tele"] | 0;
+  uint32_t udp = doc["udp"] | 0;
+  uint32_t sid = doc["sid"] | 0;
+  if (hb < PROTO_HEARTBEAT_MIN_MS) hb = PROTO_HEARTBEAT_MIN_MS;
+  if (hb > PROTO_HEARTBEAT_MAX_MS) hb = PROTO_HEARTBEAT_MAX_MS;
+  if (tele > 0 && tele < PROTO_TELEMETRY_MIN_MS) tele = PROTO_TELEMETRY_MIN_MS;
+
+  wsSession.binary = strcmp(enc, "bin") == 0;
+  wsSession.relayTelemetryMs = tele;
+  wsSession.telemetryMs = sessionTelemetryMs(tele);
+  lastTelemetryMs = millis();
+  wsSession.udpPort = (FEATURE_UDP && udp > 0 && udp <= 65535 && sid != 0) ? udp : 0;
+  wsSession.udpSid = wsSession.udpPort ? sid : 0;
+  udpHelloDue = wsSession.udpPort != 0;
+  sessionHeartbeatMs = hb;
+  webSocket.enableHeartbeat(hb, WS_HEARTBEAT_PONG_TIMEOUT_MS, WS_HEARTBEAT_MISSES);
+
+  Serial.printf("🤝 Session: %s, heartbeat %lu ms, telemetry %lu ms, udp %u\n", wsSession.binary ? "bin" : "text",
+                (unsigned long)hb, (unsigned long)wsSession.telemetryMs, wsSession.udpPort);
+  return true;
+}
+
+// Status can arrive from the relay and from a LAN agent at the same time. A
+// status with a seq is applied only when it is newer than the last one that
+// had a seq (serial arithmetic, so senders may wrap); one without a seq always
+// applies, as it did before there were two sources.
+static bool statusSeqValid = false;
+static uint32_t statusSeq = 0;
+static uint32_t statusStale = 0; // dropped as older than statusSeq
+
+static bool applyStatus(uint32_t mask, bool hasSeq, uint32_t seq)
+{
+  if (hasSeq)
+  {
+    if (statusSeqValid && (int32_t)(seq - statusSeq) <= 0)
+    {
+      statusStale++;
+      return false;
+    }
+    statusSeqValid = true;
+    statusSeq = seq;
+  }
+  outputStatus(mask);
+  return true;
+}
+
+// [PROTO_BIN_STATUS, mask] or [PROTO_BIN_STATUS, mask, seq u32le]
+static bool handleBinaryStatus(const uint8_t *payload, size_t length)
+{
+  if (length < 2 || payload[0] != PROTO_BIN_STATUS)
+    return false;
+  bool hasSeq = length >= PROTO_BIN_STATUS_SEQ_LEN;
+  uint32_t seq = hasSeq ? (uint32_t)payload[2] | (uint32_t)payload[3] << 8 | (uint32_t)payload[4] << 16 | (uint32_t)payload[5] << 24 : 0;
+  return applyStatus(payload[1], hasSeq, seq);
+}
+
+static void handleBinaryFrame(const uint8_t *payload, size_t length)
+{
+  // only a session that chose "bin" gets binary frames; anything else is noise
+  if (!wsSession.binary)
+    return;
+  handleBinaryStatus(payload, length);
+}
+
+static void maybeSendTelemetry(uint32_t now)
+{
+  if (wsSession.telemetryMs == 0 || !webSocket.isConnected() || (now - lastTelemetryMs) < wsSession.telemetryMs)
+    return;
+  lastTelemetryMs = now;
+
+  int8_t rssi = (int8_t)WiFi.RSSI();
+  uint32_t heap = ESP.getFreeHeap();
+  uint32_t up = now / 1000;
+  if (wsSession.binary)
+  {
+    uint8_t frame[PROTO_BIN_TELEMETRY_LEN] = {PROTO_BIN_TELEMETRY, (uint8_t)rssi,
+                                              (uint8_t)heap, (uint8_t)(heap >> 8), (uint8_t)(heap >> 16), (uint8_t)(heap >> 24),
+                                              (uint8_t)up, (uint8_t)(up >> 8), (uint8_t)(up >> 16), (uint8_t)(up >> 24)};
+    wsCaptureRecord('O', WStype_BIN, frame, sizeof(frame));
+    webSocket.sendBIN(frame, sizeof(frame));
+  }
+  else
+  {
+    char msg[80];
+    int n = snprintf(msg, sizeof(msg), "%s{\"rssi\":%d,\"heap\":%lu,\"up\":%lu}", PROTO_TELEMETRY_PREFIX, rssi,
+                     (unsigned long)heap, (unsigned long)up);
+    wsCaptureRecord('O', WStype_TEXT, (const uint8_t *)msg, (size_t)n);
+    webSocket.sendTXT(msg);
+  }
+}
+
+// -------------- WS setup --------------
+
+static void setupWebSocketFromConfig();
+static void restartMqtt();
+static void resetRelays(bool keepCurrent);
+static void restartLanListener();
+
+// -------------- Live config --------------
+// CONFIG: on serial and {"type":"config",...} from the relay change settings
+// in place; only the subsystems whose settings changed are restarted. A new
+// URL, token or network is on trial until the relay answers OK: NOAUTH, a
+// failed WiFi join or CONFIG_TRIAL_MS (protocol.h) without OK puts the previous settings
+// back. Flash is written only once the new settings work.
+//
+//   serial: OK:CONFIG_SAVED[:<changes>] | OK:CONFIG_APPLIED[:<changes>] | OK:CONFIG_PENDING:<changes>
+//           ERR:CONFIG_REJECTED:<reason> | ERR:CONFIG_ROLLED_BACK:<reason>
+//           (<changes> as in configChangeNames(), e.g. "ws,telemetry")
+//   relay:  {"type":"config_result","state":"saved|applied|pending|rejected|rolled_back",
+//            "changes":"ws,wifi,telemetry","error":"<reason>"}
+enum ConfigChange : uint8_t
+{
+  CFG_CHANGE_WS = 0x01,        // wsUrl, authToken, mqttUrl: reconnect the WS (or MQTT)
+  CFG_CHANGE_WIFI = 0x02,      // wifiSsid/Pass, eapIdentity/Password: rejoin, then reconnect
+  CFG_CHANGE_TELEMETRY = 0x04, // telemetryMs: applied to the running session
+  CFG_CHANGE_RELAYS = 0x08,    // fallbackUrls, preferLocal: new list, current connection kept
+  CFG_CHANGE_LAN = 0x10,       // lanPort: listener restarted, relay connection kept
+  CFG_CHANGE_POWER = 0x20,     // powerMode, listenInterval: applied in place, heartbeat from the next connection
+};
+
+struct ConfigTrial
+{
+  bool active;
+  bool fromWs; // the relay asked, so it hears the outcome too
+  uint8_t changes;
+  uint32_t startMs;
+  AppConfig previous;
+};
+static ConfigTrial configTrial;
+static bool appRunning = false;    // past setup(): changes restart subsystems
+static String configResultPending; // for the relay, sent after the next OK
+
+static String configChangeNames(uint8_t changes)
+{
+  String names;
+  if (changes & CFG_CHANGE_WS)
+    names += "ws,";
+  if (changes & CFG_CHANGE_WIFI)
+    names += "wifi,";
+  if (changes & CFG_CHANGE_TELEMETRY)
+    names += "telemetry,";
+  if (changes & CFG_CHANGE_RELAYS)
+    names += "relays,";
+  if (changes & CFG_CHANGE_LAN)
+    names += "lan,";
+  if (changes & CFG_CHANGE_POWER)
+    names += "power,";
+  if (names.length() > 0)
+    names.remove(names.length() - 1);
+  return names;
+}
+
+static void reportConfig(bool toWs, const char *state, uint8_t changes, const char *error)
+{
+  String line = error ? String("ERR:CONFIG_") : String("OK:CONFIG_");
+  String upper(state);
+  upper.toUpperCase();
+  line += upper;
+  if (error)
+    line += String(":") + error;
+  else if (changes)
+    line += String(":") + configChangeNames(changes);
+  Serial.println(line);
+
+  if (!toWs)
+    return;
+  StaticJsonDocument<160> doc;
+  doc["type"] = "config_result";
+  doc["state"] = state;
+  doc["changes"] = configChangeNames(changes);
+  if (error)
+    doc["error"] = error;
+  String reply;
+  serializeJson(doc, reply);
+  // a rollback happens while the connection is being replaced
+  if (strcmp(state, "rolled_back") == 0 || !webSocket.isConnected())
+  {
+    configResultPending = reply;
+    return;
+  }
+  wsCaptureRecord('O', WStype_TEXT, (const uint8_t *)reply.c_str(), reply.length());
+  webSocket.sendTXT(reply);
+}
+
+// Joins the network cfg names: the serial-configured SSID, else the saved one.
+static bool rejoinWifiFromConfig()
+{
+  WiFi.disconnect();
+  if (hasSerialWifiCreds())
+  {
+    if (hasEapCredentials())
+      return tryConnectWifiEnterprise(cfg.wifiSsid.c_str(), cfg.eapIdentity.c_str(), cfg.eapPassword.c_str(), WIFI_CONNECT_TRIES, WIFI_TRY_TIMEOUT_MS);
+    return tryConnectWifiExplicit(cfg.wifiSsid.c_str(), cfg.wifiPass.c_str(), WIFI_CONNECT_TRIES, WIFI_TRY_TIMEOUT_MS);
+  }
+  if (!hasSavedWiFiCreds())
+    return false;
+  if (hasEapCredentials() && tryConnectWifiEnterprise(WiFi.SSID().c_str(), cfg.eapIdentity.c_str(), cfg.eapPassword.c_str(), WIFI_CONNECT_TRIES, WIFI_TRY_TIMEOUT_MS))
+    return true;
+  return tryConnectWifiSaved(WIFI_CONNECT_TRIES, WIFI_TRY_TIMEOUT_MS);
+}
+
+static void rollbackConfig(const char *reason)
+{
+  uint8_t changes = configTrial.changes;
+  cfg = configTrial.previous;
+  configTrial.active = false;
+  resetRelays(false);
+  wsSession.telemetryMs = sessionTelemetryMs(wsSession.relayTelemetryMs);
+  Serial.printf("↩️ Config rolled back (%s)\n", reason);
+  reportConfig(configTrial.fromWs, "rolled_back", changes, reason);
+  if (changes & CFG_CHANGE_LAN)
+    restartLanListener();
+
+  // if the old network is gone too, loop() handles it as a WiFi loss
+  if (changes & CFG_CHANGE_WIFI)
+    rejoinWifiFromConfig();
+  if (changes & (CFG_CHANGE_WIFI | CFG_CHANGE_POWER))
+    applyPowerMode();
+  setupWebSocketFromConfig();
+}
+
+static void configTrialAuthOk()
+{
+  if (configTrial.active)
+  {
+    configTrial.active = false;
+    saveConfig(cfg);
+    Serial.println("✅ New config works");
+    reportConfig(configTrial.fromWs, "saved", configTrial.changes, nullptr);
+  }
+  if (configResultPending.length() > 0)
+  {
+    wsCaptureRecord('O', WStype_TEXT, (const uint8_t *)configResultPending.c_str(), configResultPending.length());
+    webSocket.sendTXT(configResultPending);
+    configResultPending = "";
+  }
+}
+
+// NOAUTH for a token on trial rolls back instead of counting towards the portal
+static bool configTrialNoAuth()
+{
+  if (!configTrial.active)
+    return false;
+  rollbackConfig("noauth");
+  return true;
+}
+
+static void maybeExpireConfigTrial(uint32_t now)
+{
+  if (configTrial.active && (now - configTrial.startMs) >= CONFIG_TRIAL_MS)
+    rollbackConfig("timeout");
+}
+
+// Copies the members present in doc over next and returns what changed, or
+// sets error. The relay may not move the device to another network.
+static uint8_t readConfigChanges(JsonDocument &doc, AppConfig &next, bool fromWs, const char *&error)
+{
+  static const char *const WIFI_KEYS[] = {"wifiSsid", "wifiPass", "eapIdentity", "eapPassword"};
+  String *wifiFields[] = {&next.wifiSsid, &next.wifiPass, &next.eapIdentity, &next.eapPassword};
+  uint8_t changes = 0;
+  error = nullptr;
+
+  if (doc.containsKey("wsUrl") && doc["wsUrl"].as<String>() != next.wsUrl)
+  {
+    next.wsUrl = doc["wsUrl"].as<String>();
+    next.wsUrl.trim();
+    changes |= CFG_CHANGE_WS;
+  }
+  if (!FEATURE_MQTT && strlen(doc["mqttUrl"] | "") > 0)
+  {
+    error = "no_mqtt";
+    return 0;
+  }
+  if ((!FEATURE_LAN && (uint32_t)(doc["lanPort"] | 0u) > 0) || (!FEATURE_MDNS && (doc["preferLocal"] | false)))
+  {
+    error = !FEATURE_LAN && (uint32_t)(doc["lanPort"] | 0u) > 0 ? "no_lan" : "no_mdns";
+    return 0;
+  }
+  if (doc.containsKey("mqttUrl") && doc["mqttUrl"].as<String>() != next.mqttUrl)
+  {
+    next.mqttUrl = doc["mqttUrl"].as<String>();
+    next.mqttUrl.trim();
+    changes |= CFG_CHANGE_WS;
+  }
+  if (doc.containsKey("authToken") && doc["authToken"].as<String>() != next.authToken)
+  {
+    next.authToken = doc["authToken"].as<String>();
+    changes |= CFG_CHANGE_WS;
+  }
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    if (!doc.containsKey(WIFI_KEYS[i]) || doc[WIFI_KEYS[i]].as<String>() == *wifiFields[i])
+      continue;
+    if (fromWs)
+    {
+      error = "wifi_not_remote";
+      return 0;
+    }
+    *wifiFields[i] = doc[WIFI_KEYS[i]].as<String>();
+    changes |= CFG_CHANGE_WIFI;
+  }
+  if (doc.containsKey("fallbackUrls"))
+  {
+    for (uint8_t i = 0; i < MAX_FALLBACK_URLS; i++)
+    {
+      String url = doc["fallbackUrls"][i] | "";
+      url.trim();
+      WsParts parts;
+      if (url.length() > 0 && !parseWsUrl(url, parts))
+        error = "bad_url";
+      if (url != next.fallbackUrls[i])
+      {
+        next.fallbackUrls[i] = url;
+        changes |= CFG_CHANGE_RELAYS;
+      }
+    }
+    if (error)
+      return 0;
+  }
+  if (doc.containsKey("preferLocal") && (doc["preferLocal"] | false) != next.preferLocal)
+  {
+    next.preferLocal = doc["preferLocal"] | false;
+    changes |= CFG_CHANGE_RELAYS;
+  }
+  if (doc.containsKey("telemetryMs") && (uint32_t)(doc["telemetryMs"] | 0u) != next.telemetryMs)
+  {
+    next.telemetryMs = doc["telemetryMs"] | 0u;
+    changes |= CFG_CHANGE_TELEMETRY;
+  }
+
+  if ((changes & CFG_CHANGE_WS) && appRunning)
+  {
+    WsParts parts;
+    MqttParts broker;
+    if (next.mqttUrl.length() > 0 ? !parseMqttUrl(next.mqttUrl, broker)
+                                  : !(next.wsUrl.length() == 0 && next.preferLocal) && !parseWsUrl(next.wsUrl, parts))
+      error = "bad_url";
+    else if (next.authToken.length() == 0 || next.authToken.indexOf('\r') >= 0 || next.authToken.indexOf('\n') >= 0)
+      error = "bad_token";
+  }
+  if (doc.containsKey("lanPort"))
+  {
+    uint32_t port = doc["lanPort"] | 0u;
+    if (port > 65535)
+      error = "bad_lan_port";
+    else if (port != next.lanPort)
+    {
+      next.lanPort = (uint16_t)port;
+      changes |= CFG_CHANGE_LAN;
+    }
+  }
+  if (doc.containsKey("powerMode") || doc.containsKey("listenInterval"))
+  {
+    uint32_t mode = doc["powerMode"] | (uint32_t)next.powerMode;
+    uint32_t interval = doc["listenInterval"] | (uint32_t)next.listenInterval;
+    if (mode > POWER_MODE_MAX || interval < 1 || interval > LISTEN_INTERVAL_MAX)
+      error = "bad_power";
+    else if (mode != next.powerMode || interval != next.listenInterval)
+    {
+      next.powerMode = (uint8_t)mode;
+      next.listenInterval = (uint8_t)interval;
+      changes |= CFG_CHANGE_POWER;
+    }
+  }
+  if (next.telemetryMs > 0 && next.telemetryMs < PROTO_TELEMETRY_MIN_MS)
+    error = "bad_telemetry";
+  return error ? 0 : changes;
+}
+
+// CONFIG: and {"type":"config"} share this. Before setup() finishes there is
+// nothing running to restart, so the settings are just stored for the boot path.
+static void applyConfig(JsonDocument &doc, bool fromWs)
+{
+  if (configTrial.active)
+  {
+    reportConfig(fromWs, "rejected", 0, "busy");
+    return;
+  }
+
+  AppConfig next = cfg;
+  const char *error;
+  uint8_t changes = readConfigChanges(doc, next, fromWs, error);
+  if (error)
+  {
+    reportConfig(fromWs, "rejected", 0, error);
+    return;
+  }
+  if (changes == 0)
+  {
+    if (fromWs)
+      reportConfig(true, "applied", 0, nullptr);
+    else
+      Serial.println("OK:NO_CHANGES");
+    return;
+  }
+
+  if (!appRunning)
+  {
+    cfg = next;
+    saveConfig(cfg);
+    reportConfig(fromWs, "saved", changes, nullptr);
+    return;
+  }
+
+  if (!(changes & (CFG_CHANGE_WS | CFG_CHANGE_WIFI)))
+  {
+    cfg = next;
+    if (changes & CFG_CHANGE_RELAYS)
+      resetRelays(true);
+    if (changes & CFG_CHANGE_LAN)
+      restartLanListener();
+    if (changes & CFG_CHANGE_POWER)
+      applyPowerMode();
+    wsSession.telemetryMs = sessionTelemetryMs(wsSession.relayTelemetryMs);
+    saveConfig(cfg);
+    reportConfig(fromWs, "applied", changes, nullptr);
+    return;
+  }
+
+  configTrial.active = true;
+  configTrial.fromWs = fromWs;
+  configTrial.changes = changes;
+  configTrial.previous = cfg;
+  cfg = next;
+  resetRelays(false);
+  if (changes & CFG_CHANGE_LAN)
+    restartLanListener();
+  Serial.printf("🔧 Trying new config (%s)\n", configChangeNames(changes).c_str());
+  reportConfig(fromWs, "pending", changes, nullptr); // while the old connection is still up
+
+  if (changes & CFG_CHANGE_WIFI)
+  {
+    webSocket.disconnect();
+    if (!rejoinWifiFromConfig())
+    {
+      rollbackConfig("wifi_failed");
+      return;
+    }
+  }
+  if (changes & (CFG_CHANGE_WIFI | CFG_CHANGE_POWER))
+    applyPowerMode();
+  configTrial.startMs = millis(); // after the (blocking) WiFi join
+  setupWebSocketFromConfig();
+}
+
+static bool handleConfigMessage(const String &msg)
+{
+  StaticJsonDocument<512> doc;
+  if (deserializeJson(doc, msg))
+    return false;
+  applyConfig(doc, true);
+  return true;
+}
+
+// -------------- Relays --------------
+// cfg.wsUrl, then cfg.fallbackUrls, then (while discovery is on) a relay
+// found on the LAN, then (while one is set) the URL of a relay redirect. Each
+// relay keeps a smoothed attempt-to-OK latency and a failure count; a relay
+// that fails is skipped for a backoff that doubles per failure. An attempt
+// still unconnected after WS_RECONNECT_MS, or a session that drops, moves to
+// the best other relay at once. While connected to a worse relay the device
+// re-probes the best one every RELAY_REPROBE_MS.
+// A relay can move its devices with redirect or drain; each device waits
+// delayMs plus a random share of jitterMs first, so a relay's worth of
+// devices reconnects spread out instead of at once.
+#ifndef TUNE_RELAY_REPROBE_MS
+#define TUNE_RELAY_REPROBE_MS 600000
+#endif
+#ifndef TUNE_RELAY_DOWN_MS
+#define TUNE_RELAY_DOWN_MS 30000
+#endif
+static const uint32_t RELAY_REPROBE_MS = TUNE_RELAY_REPROBE_MS;
+static const uint32_t RELAY_DOWN_MS = TUNE_RELAY_DOWN_MS; // first backoff
+static const uint32_t RELAY_DOWN_MAX_MS = 600000;
+static const uint32_t RELAY_UNKNOWN_READY_MS = 250; // score of a relay never reached
+static const uint32_t RELAY_ORDER_BIAS_MS = 25;     // per position in the list
+static const uint32_t RELAY_SWITCH_MARGIN_MS = 50;  // a later relay must be this much faster
+static const uint32_t RELAY_MOVE_MAX_MS = 600000;   // cap on a redirect's delay + jitter
+
+static const uint8_t RELAY_COUNT = MAX_FALLBACK_URLS + 3; // wsUrl, fallbacks, local, redirect
+static const uint8_t RELAY_LOCAL = RELAY_COUNT - 2;
+static const uint8_t RELAY_REDIRECT = RELAY_COUNT - 1;
+
+struct RelayHealth
+{
+  uint32_t readyMs;     // smoothed attempt-to-OK latency, 0 = never reached
+  uint8_t failures;     // consecutive
+  uint32_t downUntilMs; // skipped until then, 0 = up
+};
+static RelayHealth relayHealth[RELAY_COUNT];
+static uint8_t currentRelay = 0;
+static String redirectUrl; // this boot only, never saved
+static String redirectFromUrl; // relay the redirect moved away from, tried once if it fails
+static String localRelayUrl;   // found over mDNS, cached in LOCAL_RELAY_PATH
+static uint32_t relayAttemptMs = 0;
+static bool relayAttemptOpen = false; // attempt on currentRelay not yet OK or failed
+static uint32_t lastReprobeMs = 0;
+
+// A redirect or drain waiting out its delay
+struct PendingMove
+{
+  bool active;
+  bool drain;        // leave fromRelay for the best other one
+  uint8_t fromRelay; // a drain is moot once the device left that relay
+  String url;        // redirect target
+  uint32_t dueMs;
+};
+static PendingMove pendingMove = {false, false, 0, "", 0};
+
+// A LAN relay is used with preferLocal: ahead of wsUrl, or instead of a blank
+// one. Never alongside a broker.
+static bool localDiscoveryOn()
+{
+  return cfg.mqttUrl.length() == 0 && cfg.preferLocal;
+}
+
+static String &relayUrl(uint8_t i)
+{
+  static String none;
+  if (i == 0)
+    return cfg.wsUrl;
+  if (i == RELAY_REDIRECT)
+    return redirectUrl;
+  if (i == RELAY_LOCAL)
+  {
+    if (localDiscoveryOn())
+      return localRelayUrl;
+    none = "";
+    return none;
+  }
+  return cfg.fallbackUrls[i - 1];
+}
+
+static bool relayUp(uint8_t i, uint32_t now)
+{
+  return relayUrl(i).length() > 0 && (relayHealth[i].downUntilMs == 0 || (int32_t)(now - relayHealth[i].downUntilMs) >= 0);
+}
+
+// Lower is better. A redirect target wins while it is up, then a LAN relay.
+static uint32_t relayScore(uint8_t i)
+{
+  if (i == RELAY_REDIRECT)
+    return 0;
+  if (i == RELAY_LOCAL)
+    return 1;
+  uint32_t ready = relayHealth[i].readyMs ? relayHealth[i].readyMs : RELAY_UNKNOWN_READY_MS;
+  return ready + i * RELAY_ORDER_BIAS_MS;
+}
+
+// Best relay that is up; when all are backing off, the next one in the list,
+// so a single-relay setup keeps retrying every WS_RECONNECT_MS as before.
+static uint8_t bestRelay(uint32_t now)
+{
+  if (configTrial.active)
+    return 0; // a new wsUrl has to work by itself, not through a fallback
+  uint8_t best = RELAY_COUNT;
+  for (uint8_t i = 0; i < RELAY_COUNT; i++)
+    if (relayUp(i, now) && (best == RELAY_COUNT || relayScore(i) < relayScore(best)))
+      best = i;
+  if (best < RELAY_COUNT)
+    return best;
+  for (uint8_t step = 1; step <= RELAY_COUNT; step++)
+  {
+    uint8_t i = (currentRelay + step) % RELAY_COUNT;
+    if (relayUrl(i).length() > 0)
+      return i;
+  }
+  return 0;
+}
+
+static void relayFailed(uint8_t i, uint32_t now)
+{
+  RelayHealth &h = relayHealth[i];
+  if (h.failures < 16)
+    h.failures++;
+  uint32_t backoff = RELAY_DOWN_MS << (h.failures < 6 ? h.failures - 1 : 5);
+  h.downUntilMs = (now + (backoff < RELAY_DOWN_MAX_MS ? backoff : RELAY_DOWN_MAX_MS)) | 1;
+  Serial.printf("⚠️ Relay %u down (%u failures)\n", i, h.failures);
+  if (i == RELAY_REDIRECT)
+  {
+    // One chance: back to where the redirect came from, then to the list
+    redirectUrl = redirectFromUrl;
+    redirectFromUrl = "";
+    h = {0, 0, 0};
+  }
+}
+
+static void relayReady(uint32_t now)
+{
+  if (!relayAttemptOpen)
+    return;
+  relayAttemptOpen = false;
+  RelayHealth &h = relayHealth[currentRelay];
+  uint32_t sample = now - relayAttemptMs;
+  h.readyMs = h.readyMs ? (h.readyMs * 3 + sample) / 4 : (sample ? sample : 1);
+  h.failures = 0;
+  h.downUntilMs = 0;
+  lastReprobeMs = now;
+}
+
+static void resetRelays(bool keepCurrent)
+{
+  for (uint8_t i = 0; i < RELAY_COUNT; i++)
+    if (!keepCurrent || i != currentRelay)
+      relayHealth[i] = {0, 0, 0};
+  if (!keepCurrent)
+  {
+    currentRelay = 0;
+    redirectUrl = "";
+    redirectFromUrl = "";
+  }
+  pendingMove.active = false;
+}
+
+static void switchRelay(uint8_t i)
+{
+  currentRelay = i;
+  setupWebSocketFromConfig();
+  lastWsAttemptMs = millis();
+}
+
+// Called when the reconnect pacing allows another attempt
+static void nextRelayAttempt(uint32_t now)
+{
+  if (relayAttemptOpen)
+    relayFailed(currentRelay, now);
+  currentRelay = bestRelay(now);
+}
+
+// A session that was up went away: that relay is suspect, try the next now
+static void relayDropped(uint32_t now)
+{
+  relayAttemptOpen = false;
+  relayFailed(currentRelay, now);
+  lastWsAttemptMs = now - WS_RECONNECT_MS;
+}
+
+static void maybeReprobeRelay(uint32_t now)
+{
+  if (!webSocket.isConnected() || relayAttemptOpen || (now - lastReprobeMs) < RELAY_REPROBE_MS)
+    return;
+  lastReprobeMs = now;
+  uint8_t best = bestRelay(now);
+  if (best == currentRelay)
+    return;
+  if (best > currentRelay && best != RELAY_LOCAL && relayScore(best) + RELAY_SWITCH_MARGIN_MS >= relayScore(currentRelay))
+    return;
+  Serial.printf("🔁 Re-probing relay %u\n", best);
+  switchRelay(best);
+}
+
+static void moveToUrl(const String &url)
+{
+  uint8_t target = RELAY_REDIRECT;
+  for (uint8_t i = 0; i < RELAY_REDIRECT; i++)
+    if (relayUrl(i) == url)
+      target = i;
+  if (target == RELAY_REDIRECT)
+  {
+    redirectFromUrl = relayUrl(currentRelay) == url ? "" : relayUrl(currentRelay);
+    redirectUrl = url;
+  }
+  relayHealth[target] = {relayHealth[target].readyMs, 0, 0};
+  Serial.printf("↪️ Redirected to %s\n", url.c_str());
+  switchRelay(target);
+}
+
+// Marks the current relay down for a while and moves to the best other one;
+// with a single relay URL this is a plain reconnect, which lets a load
+// balancer in front of several relays pick another node.
+static void drainRelay(uint32_t now)
+{
+  uint8_t from = currentRelay;
+  if (from == RELAY_REDIRECT)
+  {
+    redirectUrl = "";
+    redirectFromUrl = "";
+    relayHealth[from] = {0, 0, 0};
+  }
+  else
+  {
+    relayHealth[from].downUntilMs = (now + RELAY_DOWN_MAX_MS) | 1;
+  }
+  uint8_t next = bestRelay(now);
+  Serial.printf("🚰 Relay %u draining -> relay %u\n", from, next);
+  relayAttemptOpen = false;
+  switchRelay(next);
+}
+
+static uint32_t moveDelayMs(JsonDocument &doc)
+{
+  uint32_t delayMs = doc["delayMs"] | 0u;
+  uint32_t jitterMs = doc["jitterMs"] | 0u;
+  if (delayMs > RELAY_MOVE_MAX_MS)
+    delayMs = RELAY_MOVE_MAX_MS;
+  if (jitterMs > RELAY_MOVE_MAX_MS - delayMs)
+    jitterMs = RELAY_MOVE_MAX_MS - delayMs;
+  return delayMs + (jitterMs ? (uint32_t)random((long)jitterMs + 1) : 0);
+}
+
+static void scheduleMove(bool drain, const String &url, uint32_t waitMs)
+{
+  pendingMove = {true, drain, currentRelay, url, (millis() + waitMs) | 1};
+  Serial.printf("⏳ %s in %lu ms\n", drain ? "Drain" : "Redirect", (unsigned long)waitMs);
+}
+
+// {"type":"redirect","url":"ws://...","delayMs":n,"jitterMs":n}: move after
+// the delay (now when both are 0). A listed URL selects its entry; any other
+// takes the redirect slot, with the relay it came from and then the list
+// behind it.
+static bool handleRedirectMessage(const String &msg)
+{
+  StaticJsonDocument<256> doc;
+  if (deserializeJson(doc, msg))
+    return false;
+  String url = doc["url"] | "";
+  url.trim();
+  WsParts parts;
+  if (configTrial.active || !parseWsUrl(url, parts))
+    return false;
+
+  uint32_t waitMs = moveDelayMs(doc);
+  if (waitMs == 0)
+  {
+    pendingMove.active = false;
+    moveToUrl(url);
+  }
+  else
+  {
+    scheduleMove(false, url, waitMs);
+  }
+  return true;
+}
+
+// {"type":"drain","delayMs":n,"jitterMs":n}: this relay is going away
+static bool handleDrainMessage(const String &msg)
+{
+  StaticJsonDocument<128> doc;
+  if (configTrial.active || deserializeJson(doc, msg))
+    return false;
+  uint32_t waitMs = moveDelayMs(doc);
+  if (waitMs == 0)
+  {
+    pendingMove.active = false;
+    drainRelay(millis());
+  }
+  else
+  {
+    scheduleMove(true, "", waitMs);
+  }
+  return true;
+}
+
+static void maybeMoveRelay(uint32_t now)
+{
+  if (!pendingMove.active || (int32_t)(now - pendingMove.dueMs) < 0)
+    return;
+  pendingMove.active = false;
+  if (configTrial.active)
+    return;
+  if (pendingMove.drain)
+  {
+    if (pendingMove.fromRelay == currentRelay)
+      drainRelay(now);
+  }
+  else
+    moveToUrl(pendingMove.url);
+}
+
+#if FEATURE_SERIAL_CONFIG
+// RELAYS:[{"url":..,"readyMs":..,"failures":..,"up":..,"current":..},...]
+static void printRelays()
+{
+  uint32_t now = millis();
+  Serial.print("RELAYS:[");
+  bool first = true;
+  for (uint8_t i = 0; i < RELAY_COUNT; i++)
+  {
+    if (relayUrl(i).length() == 0)
+      continue;
+    Serial.printf("%s{\"url\":\"%s\",\"readyMs\":%lu,\"failures\":%u,\"up\":%s,\"current\":%s}", first ? "" : ",",
+                  relayUrl(i).c_str(), (unsigned long)relayHealth[i].readyMs, relayHealth[i].failures,
+                  relayUp(i, now) ? "true" : "false", i == currentRelay ? "true" : "false");
+    first = false;
+  }
+  Serial.println("]");
+}
+#endif
+
+// -------------- Local relay discovery --------------
+// A relay on the LAN advertises _discordvoice._tcp (e.g. `avahi-publish -s
+// relay _discordvoice._tcp 8080`); the device connects to ws://<ip>:<port>/.
+// It is only looked for with preferLocal set. It then goes ahead of wsUrl and
+// the fallbacks, which stay behind it for when it goes away; with a blank
+// wsUrl it is the relay. preferLocal is opt-in because the token goes to
+// whatever answers on the LAN. The last relay found is cached in flash so a reboot connects without
+// waiting for a browse. A browse blocks for the mDNS query timeout (1-3 s), so
+// it runs every LOCAL_BROWSE_MS while connected elsewhere and every
+// RELAY_DOWN_MS only while no relay is reachable, and never while connected
+// to the LAN relay itself.
+#ifndef TUNE_LOCAL_BROWSE_MS
+#define TUNE_LOCAL_BROWSE_MS 600000
+#endif
+static const uint32_t LOCAL_BROWSE_MS = TUNE_LOCAL_BROWSE_MS;
+
+#if FEATURE_MDNS
+static bool mdnsRunning = false;
+static uint32_t lastLocalBrowseMs = 0;
+
+// mDNS is shared with the LAN listener, which adds its service on top
+static bool startMdns()
+{
+  if (!mdnsRunning)
+    mdnsRunning = MDNS.begin(deviceId().c_str());
+  return mdnsRunning;
+}
+
+#if FEATURE_LAN
+static void stopMdns()
+{
+  if (mdnsRunning)
+    MDNS.end();
+  mdnsRunning = false;
+}
+#endif
+
+static void loadLocalRelay()
+{
+  if (!ensureFS() || !LittleFS.exists(LOCAL_RELAY_PATH))
+    return;
+  File f = LittleFS.open(LOCAL_RELAY_PATH, "r");
+  if (!f)
+    return;
+  String url = f.readStringUntil('\n');
+  f.close();
+  url.trim();
+  WsParts parts;
+  if (parseWsUrl(url, parts))
+    localRelayUrl = url;
+}
+
+static void saveLocalRelay()
+{
+  if (!ensureFS())
+    return;
+  File f = LittleFS.open(LOCAL_RELAY_PATH, "w");
+  if (!f)
+    return;
+  f.println(localRelayUrl);
+  f.close();
+}
+
+// True when a relay answered. The cached relay is kept if it is among the
+// answers; otherwise the first one replaces it.
+static bool browseLocalRelay(uint32_t now)
+{
+  lastLocalBrowseMs = now;
+  if (!startMdns())
+    return false;
+  int found = MDNS.queryService(PROTO_MDNS_RELAY_SERVICE, "tcp");
+  if (found <= 0)
+    return false;
+  int pick = 0;
+  for (int i = 0; i < found; i++)
+    if (String("ws://") + MDNS.IP(i).toString() + ":" + String(MDNS.port(i)) + "/" == localRelayUrl)
+      pick = i;
+  String url = String("ws://") + MDNS.IP(pick).toString() + ":" + String(MDNS.port(pick)) + "/";
+  if (url == localRelayUrl)
+    return true;
+  Serial.printf("🔎 Local relay %s (%s)\n", url.c_str(), MDNS.hostname(pick).c_str());
+  localRelayUrl = url;
+  relayHealth[RELAY_LOCAL] = {0, 0, 0};
+  saveLocalRelay();
+  lastReprobeMs = now - RELAY_REPROBE_MS; // move over on the next loop if connected elsewhere
+  return true;
+}
+
+static void maybeDiscoverRelay(uint32_t now)
+{
+  if (!localDiscoveryOn() || configTrial.active)
+    return;
+  bool connected = webSocket.isConnected();
+  if (connected && currentRelay == RELAY_LOCAL)
+    return;
+  if ((now - lastLocalBrowseMs) < (connected ? LOCAL_BROWSE_MS : RELAY_DOWN_MS))
+    return;
+  browseLocalRelay(now);
+}
+#else
+// cfg.preferLocal stays false (loadConfig skips it, CONFIG rejects it), so
+// there is no LAN relay to look for
+static void loadLocalRelay() {}
+static bool browseLocalRelay(uint32_t) { return false; }
+static void maybeDiscoverRelay(uint32_t) {}
+#endif
+
+// -------------- WS message router --------------
+// Every text frame is classified once: fixed words and prefixes by compare,
+// JSON objects by scanning for the top-level "type" without building a
+// document. Only the handler that owns a type deserializes, and only its own
+// frames, so the cost of a frame does not grow with the number of types.
+
+enum WsMsgType : uint8_t
+{
+  WSMSG_STATUS,  // 1 / 0 / {"type":"status","on":bool} or {"type":"status","mask":n}
+  WSMSG_AUTH_OK,
+  WSMSG_NOAUTH,
+  WSMSG_OTA,     // OTA:<url> / {"type":"ota",...}
+  WSMSG_SESSION,
+  WSMSG_PING,    // {"type":"ping",...} -> same members with "type":"pong"
+  WSMSG_CONFIG,  // {"type":"config",...}, see Live config
+  WSMSG_REDIRECT, // {"type":"redirect","url":...}, see Relays
+  WSMSG_DRAIN,   // {"type":"drain",...}, see Relays
+  WSMSG_IGNORED, // unknown or rejected by its handler
+  WSMSG_TYPE_COUNT
+};
+
+struct WsRoute
+{
+  const char *name;     // counter label, and the JSON "type" that selects it
+  bool jsonType;        // selectable by {"type":name}
+  bool (*handler)(const String &msg); // false = rejected
+};
+
+static uint32_t wsMsgCounts[WSMSG_TYPE_COUNT];
+
+// Value of the top-level "type" member. Strings are skipped whole and nesting
+// is tracked, so a "type" inside a nested object or a string never matches.
+static bool jsonTopLevelType(const char *p, size_t len, char *out, size_t outSize)
+{
+  const char *end = p + len;
+  uint8_t depth = 0;
+  bool keyNext = false;
+  while (p < end)
+  {
+    char c = *p++;
+    if (c == '"')
+    {
+      const char *start = p;
+      while (p < end && *p != '"')
+        p += (*p == '\\') ? 2 : 1;
+      if (p >= end)
+        return false;
+      size_t n = p++ - start;
+      if (depth != 1 || !keyNext)
+        continue;
+      keyNext = false;
+      while (p < end && isspace((unsigned char)*p))
+        p++;
+      if (p >= end || *p++ != ':')
+        return false;
+      if (n != 4 || memcmp(start, "type", 4) != 0)
+        continue;
+      while (p < end && isspace((unsigned char)*p))
+        p++;
+      if (p >= end || *p++ != '"')
+        return false;
+      start = p;
+      while (p < end && *p != '"' && *p != '\\')
+        p++;
+      if (p >= end || *p != '"' || (size_t)(p - start) >= outSize)
+        return false;
+      memcpy(out, start, p - start);
+      out[p - start] = '\0';
+      return true;
+    }
+    if (c == '{' || c == '[')
+      keyNext = (++depth == 1 && c == '{');
+    else if (c == '}' || c == ']')
+    {
+      if (depth-- == 0)
+        return false;
+    }
+    else if (c == ',' && depth == 1)
+      keyNext = true;
+  }
+  return false;
+}
+
+static bool handleStatusMessage(const String &msg)
+{
+  if (msg.length() == 1)
+    return applyStatus(msg[0] == '1', false, 0);
+  StaticJsonDocument<128> doc;
+  if (deserializeJson(doc, msg))
+    return false;
+  uint32_t mask;
+  if (doc.containsKey("mask"))
+    mask = doc["mask"] | 0u;
+  else if (doc.containsKey("on"))
+    mask = (doc["on"] | false) ? 1 : 0;
+  else
+    return false;
+  return applyStatus(mask, doc.containsKey("seq"), doc["seq"] | 0u);
+}
+
+static bool handleAuthOk(const String &)
+{
+  Serial.println("✅ Auth OK");
+  authFailureCount = 0;
+  relayReady(millis());
+  configTrialAuthOk();
+  return true;
+}
+
+static bool handleNoAuth(const String &)
+{
+  if (configTrialNoAuth())
+    return true;
+
+  authFailureCount++;
+  Serial.printf("❌ NOAUTH (%u/%u)\n", authFailureCount, MAX_AUTH_FAILURES);
+
+  if (authFailureCount >= MAX_AUTH_FAILURES) {
+    Serial.println("🛠 Too many auth failures -> portal");
+    authFailureCount = 0;
+    startConfigPortalAndSave();
+    setupWebSocketFromConfig();
+  }
+  return true;
+}
+
+// Application-level ping for relays that want a round trip through the
+// firmware (the WS ping is answered by the library): echo every member back.
+static bool pongFor(const String &msg, String &reply)
+{
+  StaticJsonDocument<256> doc;
+  if (deserializeJson(doc, msg))
+    return false;
+  if (doc["rtt"].is<uint32_t>()) // the sender's last round trip to us, see Power
+    recordRelayRtt(doc["rtt"].as<uint32_t>());
+  doc["type"] = "pong";
+  serializeJson(doc, reply);
+  return true;
+}
+
+static bool handlePingMessage(const String &msg)
+{
+  String reply;
+  if (!pongFor(msg, reply))
+    return false;
+  wsCaptureRecord('O', WStype_TEXT, (const uint8_t *)reply.c_str(), reply.length());
+  webSocket.sendTXT(reply);
+  return true;
+}
+
+// Indexed by WsMsgType
+static const WsRoute WS_ROUTES[WSMSG_TYPE_COUNT] = {
+    {"status", true, handleStatusMessage},
+    {"auth_ok", false, handleAuthOk},
+    {"noauth", false, handleNoAuth},
+    {"ota", true, maybeHandleOtaMessage},
+    {"session", false, maybeHandleSession},
+    {"ping", true, handlePingMessage},
+    {"config", true, handleConfigMessage},
+    {"redirect", true, handleRedirectMessage},
+    {"drain", true, handleDrainMessage},
+    {"ignored", false, nullptr},
+};
+
+static WsMsgType classifyWsText(const String &msg)
+{
+  if (msg == "1" || msg == "0")
+    return WSMSG_STATUS;
+  if (msg == PROTO_AUTH_OK)
+    return WSMSG_AUTH_OK;
+  if (msg == PROTO_NOAUTH)
+    return WSMSG_NOAUTH;
+  if (msg.startsWith(PROTO_OTA_PREFIX))
+    return WSMSG_OTA;
+  if (msg.startsWith(PROTO_SESSION_PREFIX))
+    return WSMSG_SESSION;
+  if (msg.length() > 0 && msg[0] == '{')
+  {
+    char type[16];
+    if (!jsonTopLevelType(msg.c_str(), msg.length(), type, sizeof(type)))
+      return WSMSG_IGNORED;
+    for (uint8_t i = 0; i < WSMSG_TYPE_COUNT; i++)
+      if (WS_ROUTES[i].jsonType && strcmp(type, WS_ROUTES[i].name) == 0)
+        return (WsMsgType)i;
+  }
+  return WSMSG_IGNORED;
+}
+
+static void routeWsText(const String &msg)
+{
+  WsMsgType type = classifyWsText(msg);
+  const WsRoute &route = WS_ROUTES[type];
+  if (route.handler && route.handler(msg))
+    wsMsgCounts[type]++;
+  else
+    wsMsgCounts[WSMSG_IGNORED]++;
+}
+
+#if FEATURE_SERIAL_CONFIG
+// MSG_STATS:{"status":n,...,"ignored":n}
+static void printWsMsgStats()
+{
+  Serial.print("MSG_STATS:{");
+  for (uint8_t i = 0; i < WSMSG_TYPE_COUNT; i++)
+    Serial.printf("%s\"%s\":%lu", i ? "," : "", WS_ROUTES[i].name, (unsigned long)wsMsgCounts[i]);
+  Serial.println("}");
+}
+#endif
+
+static void onWsEvent(WStype_t type, uint8_t *payload, size_t length)
+{
+  wsCaptureRecord('I', type, payload, length);
+
+  switch (type) {
+    case WStype_CONNECTED: {
+      wsWasConnected = true;
+      Serial.println("🔌 WS connected -> AUTH");
+
+      // Sent even when the upgrade carried the token: relays that ignore the
+      // header need it, relays that used it ignore it. No need to wait either way.
+      String authMsg = PROTO_AUTH_PREFIX + cfg.authToken;
+#if WS_CAPTURE_BYTES > 0
+      String redacted = String(PROTO_AUTH_PREFIX) + "****"; // keep the token out of captures
+      wsCaptureRecord('O', WStype_TEXT, (const uint8_t *)redacted.c_str(), redacted.length());
+#endif
+      webSocket.sendTXT(authMsg);
+
+      wsSession = {false, 0, 0, 0, 0};
+      sendCaps();
+    } break;
+
+    case WStype_DISCONNECTED:
+      wsSession = {false, 0, 0, 0, 0};
+      if (wsWasConnected) {
+        Serial.println("⚠️ WS disconnected");
+        wsWasConnected = false;
+        relayDropped(millis());
+      }
+      break;
+
+    case WStype_BIN:
+      handleBinaryFrame(payload, length);
+      break;
+
+    case WStype_TEXT: {
+      // payload is length bytes; don't rely on a terminating NUL
+      String s;
+      s.concat((const char *)payload, length);
+      s.trim();
+      routeWsText(s);
+    } break;
+
+    default:
+      break;
+  }
+}
+
+static void setupWebSocketFromConfig()
+{
+  restartMqtt(); // only comes up with cfg.mqttUrl set
+  if (cfg.mqttUrl.length() > 0)
+  {
+    wsWasConnected = false;
+    webSocket.disconnect(); // the broker replaces the relay
+    return;
+  }
+
+  String &url = relayUrl(currentRelay);
+  WsParts parts;
+  if (url.length() == 0 && currentRelay == 0 && localDiscoveryOn())
+  {
+    webSocket.disconnect();
+    Serial.println("🔎 No relay URL and none found on this network yet");
+    return;
+  }
+  if (!parseWsUrl(url, parts))
+  {
+    if (currentRelay != 0)
+    {
+      // a fallback from an older config: skip it like a dead relay
+      relayFailed(currentRelay, millis());
+      return;
+    }
+    Serial.println("❌ Bad WS URL -> portal");
+    startConfigPortalAndSave();
+    return;
+  }
+
+  if (!WS_TLS && parts.secure && BOARD.wsTls)
+  {
+    // Only this build lacks TLS (FEATURE_TLS=0): the URL stays as saved, and
+    // the relay counts as down so a fallback or a full build can take over
+    Serial.println("❌ wss:// needs a build with FEATURE_TLS, not connecting");
+    wsWasConnected = false;
+    webSocket.disconnect();
+    relayFailed(currentRelay, millis());
+    return;
+  }
+  if (!WS_TLS && parts.secure)
+  {
+    Serial.println("⚠️ wss:// not available here, auto-switching to ws://");
+    url.replace("wss://", "ws://");
+    if (!configTrial.active && currentRelay != RELAY_REDIRECT) // a URL on trial is saved once it works
+      saveConfig(cfg);
+    if (!parseWsUrl(url, parts))
+      return;
+  }
 
-        if (s == "NOAUTH") {
-          authFailureCount++;
-          Serial.printf("❌ NOAUTH (%u/%u)\n", authFailureCount, MAX_AUTH_FAILURES);
+  wsHost = parts.host;
 
-          if (authFailureCount >= MAX_AUTH_FAILURES) {
-            Serial.println("🛠 Too many auth failures -> portal");
-            authFailureCount = 0;
-            startConfigPortalAndSave();
-            setupWebSocketFromConfig();
-          }
-          return;
-        }
+  wsWasConnected = false; // leaving on purpose is not a relay failure
+  webSocket.disconnect();
+  webSocket.setReconnectInterval(0); // manual pacing
+  sessionHeartbeatMs = WS_HEARTBEAT_PING_MS; // until SESSION says otherwise
+  webSocket.enableHeartbeat(WS_HEARTBEAT_PING_MS, WS_HEARTBEAT_PONG_TIMEOUT_MS, WS_HEARTBEAT_MISSES);
 
-        if (s == "1") { setLed(true);  return; }
-        if (s == "0") { setLed(false); return; }
-      } break;
+  webSocket.onEvent(onWsEvent);
 
-      default:
-        break;
-    } });
+  // Token in the upgrade request: relays that support it push OK + state, or
+  // NOAUTH and a close, right after the 101, saving the AUTH round trip.
+  String extraHeaders = "Origin: file://"; // the library default we replace
+  if (cfg.authToken.length() > 0 && cfg.authToken.indexOf('\r') < 0 && cfg.authToken.indexOf('\n') < 0)
+    extraHeaders += String("\r\n") + PROTO_AUTH_HEADER + cfg.authToken;
+  webSocket.setExtraHeaders(extraHeaders.c_str());
 
   Serial.print("🌐 Connecting to: ");
-  Serial.println(cfg.wsUrl);
+  Serial.println(url);
 
-  wsWasConnected = false;
+  relayAttemptOpen = true;
+  relayAttemptMs = millis();
 
-  if (parts.secure)
+  if (parts.secure && WS_TLS) // the downgrade above leaves no other secure URL
   {
-#if defined(ESP8266)
-    // ESP8266 should have been downgraded already
-    Serial.println("❌ ESP8266: wss:// not supported reliably. Use ws:// in portal.");
-    webSocket.disconnect();
+    webSocket.beginSSL(parts.host.c_str(), parts.port, parts.path.c_str());
+  }
+  else
+  {
+    webSocket.begin(parts.host.c_str(), parts.port, parts.path.c_str());
+  }
+}
+
+// -------------- MQTT --------------
+// With cfg.mqttUrl set (mqtt://host[:port][/prefix]) the device gets its
+// status from an MQTT broker instead of a relay; wsUrl and the relay list are
+// left alone. Topics under <prefix>/<deviceId>/ (protocol.h):
+//   status  subscribed at QoS 0. Publishers retain it, so the broker hands
+//           over the current state right after subscribe. Payload as a relay
+//           status frame: 1/0 or {"type":"status",...} with an optional seq
+//   ota     OTA:<url> or {"type":"ota",...}. A retained trigger is cleared
+//           before the update starts, so it runs once
+//   online  "1" (retained) once connected, "0" as the will
+// The login is <deviceId> / authToken, so a broker can scope each device to
+// its own topics. CONNACK stands in for OK and a refused login for NOAUTH,
+// config trials and the portal after MAX_AUTH_FAILURES included.
+#if FEATURE_MQTT
+static const uint16_t MQTT_BUFFER_BYTES = 512; // an OTA JSON with url and md5
+
+static WiFiClient mqttNet;
+static PubSubClient mqtt(mqttNet);
+static MqttParts mqttParts; // setServer keeps a pointer to the host
+static String mqttStatusTopic;
+static String mqttOtaTopic;
+static String mqttOnlineTopic;
+static uint32_t lastMqttAttemptMs = 0;
+static bool mqttWasConnected = false;
+static uint32_t mqttStatusCount = 0;
+
+static void onMqttMessage(char *topic, uint8_t *payload, unsigned int length)
+{
+  String msg;
+  msg.concat((const char *)payload, length);
+  msg.trim();
+  if (mqttStatusTopic == topic)
+  {
+    if (classifyWsText(msg) == WSMSG_STATUS && handleStatusMessage(msg))
+      mqttStatusCount++;
+  }
+  else if (mqttOtaTopic == topic && msg.length() > 0)
+  {
+    mqtt.publish(mqttOtaTopic.c_str(), "", true); // clears a retained trigger
+    maybeHandleOtaMessage(msg);
+  }
+}
+
+static void mqttConnect(uint32_t now)
+{
+  lastMqttAttemptMs = now;
+  Serial.printf("🌐 MQTT connecting to %s:%u as %s\n", mqttParts.host.c_str(), mqttParts.port, deviceId().c_str());
+  if (!mqtt.connect(deviceId().c_str(), deviceId().c_str(), cfg.authToken.c_str(), mqttOnlineTopic.c_str(), 0, true,
+                    "0"))
+  {
+    int rc = mqtt.state();
+    if (rc == MQTT_CONNECT_BAD_CREDENTIALS || rc == MQTT_CONNECT_UNAUTHORIZED)
+      handleNoAuth(PROTO_NOAUTH);
+    else
+      Serial.printf("⚠️ MQTT connect failed (%d)\n", rc);
     return;
+  }
+  mqttWasConnected = true;
+  mqtt.publish(mqttOnlineTopic.c_str(), "1", true);
+  mqtt.subscribe(mqttStatusTopic.c_str(), 0);
+  mqtt.subscribe(mqttOtaTopic.c_str(), 0);
+  Serial.println("✅ MQTT connected");
+  authFailureCount = 0;
+  configTrialAuthOk();
+}
+
+static void restartMqtt()
+{
+  mqtt.disconnect();
+  mqttWasConnected = false;
+  mqttParts.host = "";
+  if (cfg.mqttUrl.length() == 0)
+    return;
+  if (!parseMqttUrl(cfg.mqttUrl, mqttParts))
+  {
+    Serial.println("❌ Bad MQTT URL");
+    return;
+  }
+  String base = mqttParts.prefix + "/" + deviceId() + "/";
+  mqttStatusTopic = base + PROTO_MQTT_STATUS_TOPIC;
+  mqttOtaTopic = base + PROTO_MQTT_OTA_TOPIC;
+  mqttOnlineTopic = base + PROTO_MQTT_ONLINE_TOPIC;
+  mqtt.setServer(mqttParts.host.c_str(), mqttParts.port);
+  mqtt.setCallback(onMqttMessage);
+  mqtt.setKeepAlive((cfg.powerMode ? POWER_HEARTBEAT_MS : WS_HEARTBEAT_PING_MS) / 1000);
+  mqtt.setBufferSize(MQTT_BUFFER_BYTES);
+  lastMqttAttemptMs = millis() - WS_RECONNECT_MS; // connect from the next loop()
+}
+
+static void maybeServiceMqtt(uint32_t now)
+{
+  if (mqtt.loop())
+    return;
+  if (mqttWasConnected)
+  {
+    Serial.printf("⚠️ MQTT disconnected (%d)\n", mqtt.state());
+    mqttWasConnected = false;
+  }
+  if (mqttParts.host.length() > 0 && (now - lastMqttAttemptMs) >= WS_RECONNECT_MS)
+    mqttConnect(now);
+}
+
+#if FEATURE_SERIAL_CONFIG
+// MQTT:{"url":"...","connected":bool,"state":n,"topic":"...","status":n}
+static void printMqtt()
+{
+  Serial.printf("MQTT:{\"url\":\"%s\",\"connected\":%s,\"state\":%d,\"topic\":\"%s\",\"status\":%lu}\n",
+                cfg.mqttUrl.c_str(), mqtt.connected() ? "true" : "false", mqtt.state(), mqttStatusTopic.c_str(),
+                (unsigned long)mqttStatusCount);
+}
+#endif
 #else
-    webSocket.beginSSL(parts.host.c_str(), parts.port, parts.path.c_str());
+// cfg.mqttUrl stays empty (loadConfig skips it, CONFIG rejects it), so the
+// relay path is the only one
+static void restartMqtt() {}
+static void maybeServiceMqtt(uint32_t) {}
+#if FEATURE_SERIAL_CONFIG
+static void printMqtt() { Serial.println("ERR:MQTT_NOT_BUILT"); }
+#endif
+#endif
+
+// -------------- UDP status --------------
+// Status datagrams (status_datagram.h) alongside the WS, so a status does not
+// wait behind a stalled TCP stream or a reconnect. A relay that offers "udp"
+// in SESSION gets a hello from us right away and every UDP_HELLO_MS: it tells
+// the relay where to send and keeps a NAT mapping open. The relay then sends
+// each status a few times, a few ms apart, and also on the WS; a LAN agent
+// may send them to lanPort (sid 0). The first copy to arrive applies and seq
+// drops the rest (applyStatus). Same socket for both, on lanPort or an
+// ephemeral port.
+#if FEATURE_UDP
+static const uint32_t UDP_HELLO_MS = PROTO_UDP_HELLO_MS;
+static const uint8_t UDP_READS_PER_LOOP = 8;
+
+static WiFiUDP statusUdp;
+static bool statusUdpOpen = false;
+static uint32_t udpHelloSeq = 0; // never reused while up, so a replayed hello is ignored
+static uint32_t lastUdpHelloMs = 0;
+static uint32_t udpStatusCount = 0;
+static uint32_t udpRejected = 0; // bad MAC, wrong sid or not a status
+
+static void restartStatusUdp()
+{
+  statusUdp.stop();
+  statusUdpOpen = statusUdp.begin(cfg.lanPort) == 1;
+  if (!statusUdpOpen)
+    Serial.println("⚠️ UDP status socket failed; status over WS only");
+}
+
+static void sendUdpHello(uint32_t now)
+{
+  lastUdpHelloMs = now;
+  uint8_t dgram[PROTO_UDP_LEN];
+  StatusDatagram hello = {PROTO_UDP_HELLO, wsSession.udpSid, ++udpHelloSeq, 0};
+  statusDatagramSeal(dgram, hello, (const uint8_t *)cfg.authToken.c_str(), cfg.authToken.length());
+  if (statusUdp.beginPacket(wsHost.c_str(), wsSession.udpPort))
+  {
+    statusUdp.write(dgram, sizeof(dgram));
+    statusUdp.endPacket();
+  }
+}
+
+static void maybeServiceUdp(uint32_t now)
+{
+  if (!statusUdpOpen)
+    return;
+  if (wsSession.udpPort && webSocket.isConnected() && (udpHelloDue || now - lastUdpHelloMs >= UDP_HELLO_MS))
+  {
+    udpHelloDue = false;
+    sendUdpHello(now);
+  }
+
+  for (uint8_t i = 0; i < UDP_READS_PER_LOOP; i++)
+  {
+    int size = statusUdp.parsePacket();
+    if (size <= 0)
+      break;
+    uint8_t buf[PROTO_UDP_LEN];
+    int got = size == PROTO_UDP_LEN ? statusUdp.read(buf, sizeof(buf)) : 0;
+    StatusDatagram d;
+    if (got != PROTO_UDP_LEN ||
+        !statusDatagramOpen(buf, got, (const uint8_t *)cfg.authToken.c_str(), cfg.authToken.length(), d) ||
+        d.type != PROTO_UDP_STATUS ||
+        (d.sid == 0 ? cfg.lanPort == 0 : (wsSession.udpPort == 0 || d.sid != wsSession.udpSid)))
+    {
+      udpRejected++;
+      continue;
+    }
+    if (applyStatus(d.mask, true, d.seq))
+      udpStatusCount++;
+  }
+}
+#else
+// CAPS leaves out "udp", so wsSession.udpPort stays 0
+static const uint32_t udpStatusCount = 0;
+static const uint32_t udpRejected = 0;
+static void restartStatusUdp() {}
+static void maybeServiceUdp(uint32_t) {}
+#endif
+
+// -------------- LAN direct --------------
+// With cfg.lanPort set, a desktop agent on the same network can push status
+// straight to the device at ws://<deviceId>.local:<lanPort>/, advertised
+// over mDNS as _dvs._tcp. The agent authenticates like a relay (AUTH:<token>
+// -> OK, or NOAUTH and close) and may then send status frames (text, JSON or
+// binary) and JSON pings; anything else is ignored. The relay connection
+// stays up alongside it, and seq decides which status is newer (applyStatus).
+#if FEATURE_LAN
+static const uint32_t LAN_AUTH_TIMEOUT_MS = 5000;
+static_assert(WEBSOCKETS_SERVER_CLIENT_MAX <= 8, "one bit per LAN client");
+
+static WebSocketsServer *lanServer = nullptr;
+static uint8_t lanOpen = 0;   // bit per client number
+static uint8_t lanAuthed = 0; // bit per client number
+static uint32_t lanOpenedMs[WEBSOCKETS_SERVER_CLIENT_MAX];
+static uint32_t lanStatusCount = 0;
+
+// Same length first, then every byte, so a wrong guess takes the same time
+// whichever byte is wrong.
+static bool lanTokenMatches(const String &token)
+{
+  if (cfg.authToken.length() == 0 || token.length() != cfg.authToken.length())
+    return false;
+  uint8_t diff = 0;
+  for (size_t i = 0; i < token.length(); i++)
+    diff |= (uint8_t)(token[i] ^ cfg.authToken[i]);
+  return diff == 0;
+}
+
+static void handleLanText(uint8_t num, const String &msg)
+{
+  uint8_t bit = 1 << num;
+  if (!(lanAuthed & bit))
+  {
+    if (msg.startsWith(PROTO_AUTH_PREFIX) && lanTokenMatches(msg.substring(strlen(PROTO_AUTH_PREFIX))))
+    {
+      lanAuthed |= bit;
+      lanServer->sendTXT(num, PROTO_AUTH_OK);
+      Serial.printf("🏠 LAN agent %u authenticated\n", num);
+      return;
+    }
+    lanServer->sendTXT(num, PROTO_NOAUTH);
+    lanServer->disconnect(num);
+    return;
+  }
+
+  WsMsgType type = classifyWsText(msg);
+  if (type == WSMSG_STATUS)
+  {
+    if (handleStatusMessage(msg))
+      lanStatusCount++;
+  }
+  else if (type == WSMSG_PING)
+  {
+    String reply;
+    if (pongFor(msg, reply))
+      lanServer->sendTXT(num, reply);
+  }
+}
+
+static void onLanEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length)
+{
+  if (num >= WEBSOCKETS_SERVER_CLIENT_MAX)
+    return;
+  uint8_t bit = 1 << num;
+  switch (type)
+  {
+  case WStype_CONNECTED:
+    lanOpen |= bit;
+    lanAuthed &= ~bit;
+    lanOpenedMs[num] = millis();
+    break;
+  case WStype_DISCONNECTED:
+    lanOpen &= ~bit;
+    lanAuthed &= ~bit;
+    break;
+  case WStype_TEXT:
+  {
+    String s;
+    s.concat((const char *)payload, length);
+    s.trim();
+    handleLanText(num, s);
+  }
+  break;
+  case WStype_BIN:
+    if ((lanAuthed & bit) && handleBinaryStatus(payload, length))
+      lanStatusCount++;
+    break;
+  default:
+    break;
+  }
+}
+
+static void stopLanListener()
+{
+  if (!lanServer)
+    return;
+  lanServer->close();
+  delete lanServer;
+  lanServer = nullptr;
+  lanOpen = lanAuthed = 0;
+#if FEATURE_MDNS
+  stopMdns(); // a later relay browse starts it again, without the service
 #endif
+}
+
+static void restartLanListener()
+{
+  stopLanListener();
+  restartStatusUdp(); // binds lanPort too
+  if (cfg.lanPort == 0)
+    return;
+
+  lanServer = new WebSocketsServer(cfg.lanPort);
+  lanServer->onEvent(onLanEvent);
+  lanServer->begin();
+#if FEATURE_MDNS
+  if (startMdns())
+  {
+    MDNS.addService(PROTO_MDNS_SERVICE, "tcp", cfg.lanPort);
+    MDNS.addServiceTxt(PROTO_MDNS_SERVICE, "tcp", "chip", CHIP_NAME);
+    MDNS.addServiceTxt(PROTO_MDNS_SERVICE, "tcp", "board", BOARD.name);
+    MDNS.addServiceTxt(PROTO_MDNS_SERVICE, "tcp", "fw", FW_VERSION_STR);
   }
   else
   {
-    webSocket.begin(parts.host.c_str(), parts.port, parts.path.c_str());
+    Serial.println("⚠️ mDNS failed; LAN listener reachable by IP only");
+  }
+#else
+  Serial.println("ℹ️ mDNS not built; LAN listener reachable by IP only");
+#endif
+  Serial.printf("🏠 LAN listener on ws://%s.local:%u/\n", deviceId().c_str(), cfg.lanPort);
+}
+
+static void maybeServiceLan(uint32_t now)
+{
+  if (!lanServer)
+    return;
+  lanServer->loop();
+#if defined(ESP8266) && FEATURE_MDNS
+  MDNS.update();
+#endif
+  // a silent connection must not hold one of the few client slots
+  for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++)
+  {
+    uint8_t bit = 1 << num;
+    if ((lanOpen & bit) && !(lanAuthed & bit) && (now - lanOpenedMs[num]) >= LAN_AUTH_TIMEOUT_MS)
+      lanServer->disconnect(num);
+  }
+}
+
+#if FEATURE_SERIAL_CONFIG
+// LAN:{"port":n,"host":"dvs-xxxxxx.local","clients":n,"authed":n,"status":n,"stale":n,
+//      "udpPort":n,"udpStatus":n,"udpRejected":n}
+static void printLan()
+{
+  uint8_t clients = 0, authed = 0;
+  for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++)
+  {
+    clients += (lanOpen >> num) & 1;
+    authed += (lanAuthed >> num) & 1;
   }
+  Serial.printf("LAN:{\"port\":%u,\"host\":\"%s.local\",\"clients\":%u,\"authed\":%u,\"status\":%lu,\"stale\":%lu,"
+                "\"udpPort\":%u,\"udpStatus\":%lu,\"udpRejected\":%lu}\n",
+                lanServer ? cfg.lanPort : 0, deviceId().c_str(), clients, authed, (unsigned long)lanStatusCount,
+                (unsigned long)statusStale, wsSession.udpPort, (unsigned long)udpStatusCount, (unsigned long)udpRejected);
 }
+#endif
+#else
+// cfg.lanPort stays 0 (loadConfig skips it, CONFIG rejects it); the status
+// socket still needs opening for relay datagrams
+static void restartLanListener() { restartStatusUdp(); }
+static void maybeServiceLan(uint32_t) {}
+#if FEATURE_SERIAL_CONFIG
+static void printLan() { Serial.println("ERR:LAN_NOT_BUILT"); }
+#endif
+#endif
 
 // -------------- Serial Command Handler --------------
+#if FEATURE_SERIAL_CONFIG
 static void handleSerialCommand(const String &cmd)
 {
-  // CONFIG:{"wsUrl":"...","authToken":"..."}
+  // CONFIG:{"wsUrl":"...","authToken":"..."}, applied without a reboot (see Live config)
   if (cmd.startsWith("CONFIG:"))
   {
     String json = cmd.substring(7);
@@ -807,52 +2946,7 @@ static void handleSerialCommand(const String &cmd)
     auto err = deserializeJson(doc, json);
     if (!err)
     {
-      bool changed = false;
-      
-      if (doc.containsKey("wsUrl"))
-      {
-        cfg.wsUrl = doc["wsUrl"].as<String>();
-        changed = true;
-      }
-      if (doc.containsKey("authToken"))
-      {
-        cfg.authToken = doc["authToken"].as<String>();
-        changed = true;
-      }
-      if (doc.containsKey("eapIdentity"))
-      {
-        cfg.eapIdentity = doc["eapIdentity"].as<String>();
-        changed = true;
-      }
-      if (doc.containsKey("eapPassword"))
-      {
-        cfg.eapPassword = doc["eapPassword"].as<String>();
-        changed = true;
-      }
-      if (doc.containsKey("wifiSsid"))
-      {
-        cfg.wifiSsid = doc["wifiSsid"].as<String>();
-        changed = true;
-      }
-      if (doc.containsKey("wifiPass"))
-      {
-        cfg.wifiPass = doc["wifiPass"].as<String>();
-        changed = true;
-      }
-      
-      if (changed)
-      {
-        saveConfig(cfg);
-        Serial.println("OK:CONFIG_SAVED");
-        Serial.println("OK:REBOOTING");
-        Serial.flush();
-        delay(100);
-        ESP.restart();
-      }
-      else
-      {
-        Serial.println("OK:NO_CHANGES");
-      }
+      applyConfig(doc, false);
     }
     else
     {
@@ -863,12 +2957,23 @@ static void handleSerialCommand(const String &cmd)
   {
     StaticJsonDocument<512> doc;
     doc["wsUrl"] = cfg.wsUrl;
+    for (uint8_t i = 0; i < MAX_FALLBACK_URLS; i++)
+      if (cfg.fallbackUrls[i].length() > 0)
+        doc["fallbackUrls"].add(cfg.fallbackUrls[i]);
     doc["authToken"] = cfg.authToken.length() > 0 ? "****" : "";
     doc["wifiSsid"] = cfg.wifiSsid;
     doc["hasWifiPass"] = cfg.wifiPass.length() > 0;
     doc["eapIdentity"] = cfg.eapIdentity;
     doc["hasEapPassword"] = cfg.eapPassword.length() > 0;
+    doc["telemetryMs"] = cfg.telemetryMs;
+    doc["lanPort"] = cfg.lanPort;
+    doc["mqttUrl"] = cfg.mqttUrl;
+    doc["preferLocal"] = cfg.preferLocal;
+    doc["powerMode"] = cfg.powerMode;
+    doc["listenInterval"] = cfg.listenInterval;
     doc["version"] = FW_VERSION_STR;
+    doc["profile"] = FW_PROFILE_STR;
+    doc["board"] = BOARD.name;
     Serial.print("CONFIG:");
     serializeJson(doc, Serial);
     Serial.println();
@@ -886,12 +2991,232 @@ static void handleSerialCommand(const String &cmd)
     startConfigPortalAndSave();
     setupWebSocketFromConfig();
   }
+  else if (cmd == "GET_MSG_STATS")
+  {
+    printWsMsgStats();
+  }
+  else if (cmd == "GET_RELAYS")
+  {
+    printRelays();
+  }
+  else if (cmd == "GET_LAN")
+  {
+    printLan();
+  }
+  else if (cmd == "GET_MQTT")
+  {
+    printMqtt();
+  }
+  else if (cmd == "GET_POWER")
+  {
+    printPower();
+  }
+  else if (cmd == "GET_CORES")
+  {
+    printCores();
+  }
   else if (cmd == "PING")
   {
     Serial.println("PONG");
   }
+#if WS_CAPTURE_BYTES > 0
+  else if (cmd == "CAPTURE_DUMP")
+  {
+    wsCaptureDump();
+  }
+  else if (cmd == "CAPTURE_CLEAR")
+  {
+    wsCaptureClear();
+    Serial.println("OK:CAPTURE_CLEARED");
+  }
+#endif
+}
+#endif
+
+// -------------- Soak mode --------------
+// Weeks of uptime in minutes: drives the status, reconnect, config and
+// OTA-rejection paths at SOAK_DAYS simulated days of traffic, sampling free
+// heap, largest free block and fragmentation once per simulated day, then
+// prints the trend. -D SOAK_MODE=1 (env:esp8266_soak, env:esp32s2_soak) runs it
+// at boot before WiFi; env:soak runs it on the host. Machine-readable lines:
+//   SOAK:SAMPLE {"day":n,"free":..,"maxBlock":..,"frag":..}
+//   SOAK:REPORT {..., "verdict":"ok|leak|fragmentation"}
+#ifndef SOAK_MODE
+#define SOAK_MODE 0
+#endif
+
+#if SOAK_MODE
+
+#ifndef SOAK_DAYS
+#define SOAK_DAYS 30
+#endif
+
+// Traffic per simulated hour (a busy voice channel)
+static const uint16_t SOAK_STATUS_PER_HOUR = 120;
+static const uint8_t SOAK_RECONNECTS_PER_HOUR = 2;
+static const uint8_t SOAK_MAX_SAMPLES = 64;
+// Trend per simulated day beyond which the report flags a regression
+static const float SOAK_LEAK_BYTES_PER_DAY = 16.0f;
+static const float SOAK_BLOCK_BYTES_PER_DAY = 64.0f;
+static const float SOAK_FRAG_PCT_PER_DAY = 0.25f;
+// Documentation range, never routed: reconnects fail fast without a relay
+static const char *SOAK_WS_URL = "ws://192.0.2.1:8080/ws";
+
+struct HeapSample
+{
+  uint32_t freeBytes;
+  uint32_t maxBlock;
+  uint8_t frag;
+};
+
+static HeapSample soakSamples[SOAK_MAX_SAMPLES];
+static uint32_t soakOps = 0;
+
+static HeapSample sampleHeap()
+{
+  HeapSample s;
+  s.freeBytes = ESP.getFreeHeap();
+#if defined(ESP8266)
+  s.maxBlock = ESP.getMaxFreeBlockSize();
+  s.frag = ESP.getHeapFragmentation();
+#else
+  s.maxBlock = ESP.getMaxAllocHeap();
+  s.frag = s.freeBytes > 0 ? 100 - (uint8_t)((uint64_t)s.maxBlock * 100 / s.freeBytes) : 0;
+#endif
+  return s;
+}
+
+static void soakText(const char *text)
+{
+  onWsEvent(WStype_TEXT, (uint8_t *)text, strlen(text));
+  soakOps++;
+}
+
+static void soakHour()
+{
+  for (uint16_t i = 0; i < SOAK_STATUS_PER_HOUR; i++)
+  {
+    soakText((i & 1) ? "0" : "1");
+    if ((i & 15) == 0)
+    {
+      webSocket.loop();
+      delay(1); // feed the WDT and the radio
+    }
+  }
+
+  for (uint8_t i = 0; i < SOAK_RECONNECTS_PER_HOUR; i++)
+  {
+    onWsEvent(WStype_DISCONNECTED, nullptr, 0);
+    setupWebSocketFromConfig();
+    webSocket.loop();
+    onWsEvent(WStype_CONNECTED, (uint8_t *)"/ws", 3);
+    soakText(PROTO_AUTH_OK);
+    soakText("SESSION:{\"enc\":\"bin\",\"hb\":15000,\"tele\":60000}");
+    soakOps += 4;
+  }
+
+  // Config: serial query, no-op update, re-read from flash (no writes)
+#if FEATURE_SERIAL_CONFIG
+  handleSerialCommand("GET_CONFIG");
+  handleSerialCommand("CONFIG:{}");
+  soakOps += 2;
+#endif
+  AppConfig stored;
+  loadConfig(stored);
+  soakOps++;
+
+  // OTA offers the firmware turns down without touching the network
+  soakText(strcmp(CHIP_NAME, "esp8266") == 0 ? "{\"type\":\"ota\",\"url\":\"http://192.0.2.1/fw.bin\",\"chip\":\"esp32s2\"}"
+                                             : "{\"type\":\"ota\",\"url\":\"http://192.0.2.1/fw.bin\",\"chip\":\"esp8266\"}");
+  soakText("{\"type\":\"ota\",\"url\":\"\"}");
+}
+
+// Least-squares slope per simulated day of one sample field
+static float soakSlope(uint8_t n, uint16_t daysPerSample, uint8_t field)
+{
+  float sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (uint8_t i = 0; i < n; i++)
+  {
+    float x = (float)i * daysPerSample;
+    float y = field == 0 ? soakSamples[i].freeBytes : field == 1 ? soakSamples[i].maxBlock : soakSamples[i].frag;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  float d = n * sxx - sx * sx;
+  return d != 0 ? (n * sxy - sx * sy) / d : 0;
+}
+
+// Returns true when neither a leak nor a fragmentation trend shows up.
+static bool soakRun(uint16_t days)
+{
+  AppConfig saved = cfg;
+  cfg.wsUrl = SOAK_WS_URL;
+  soakOps = 0;
+
+  uint16_t daysPerSample = (days + SOAK_MAX_SAMPLES - 2) / (SOAK_MAX_SAMPLES - 1);
+  if (daysPerSample == 0)
+    daysPerSample = 1;
+  Serial.printf("🧪 Soak: %u simulated days, heap sampled every %u day(s)\n", days, daysPerSample);
+
+  // First day is warm-up: one-time allocations (WS client, JSON pools) settle
+  for (uint8_t h = 0; h < 24; h++)
+    soakHour();
+
+  uint8_t n = 0;
+  for (uint16_t day = 0;; day++)
+  {
+    if (day % daysPerSample == 0 && n < SOAK_MAX_SAMPLES)
+    {
+      HeapSample s = sampleHeap();
+      soakSamples[n++] = s;
+      Serial.printf("SOAK:SAMPLE {\"day\":%u,\"free\":%u,\"maxBlock\":%u,\"frag\":%u}\n", day, s.freeBytes, s.maxBlock, s.frag);
+    }
+    if (day == days)
+      break;
+    for (uint8_t h = 0; h < 24; h++)
+      soakHour();
+  }
+
+  float freePerDay = soakSlope(n, daysPerSample, 0);
+  float blockPerDay = soakSlope(n, daysPerSample, 1);
+  float fragPerDay = soakSlope(n, daysPerSample, 2);
+  uint32_t freeMin = soakSamples[0].freeBytes;
+  for (uint8_t i = 1; i < n; i++)
+    if (soakSamples[i].freeBytes < freeMin)
+      freeMin = soakSamples[i].freeBytes;
+
+  const char *verdict = "ok";
+  if (freePerDay < -SOAK_LEAK_BYTES_PER_DAY)
+    verdict = "leak";
+  else if (fragPerDay > SOAK_FRAG_PCT_PER_DAY || blockPerDay < -SOAK_BLOCK_BYTES_PER_DAY)
+    verdict = "fragmentation";
+
+  const HeapSample &first = soakSamples[0];
+  const HeapSample &last = soakSamples[n - 1];
+  Serial.printf("🧪 Soak done: %lu ops, free %u -> %u B (%.1f B/day), max block %u -> %u B (%.1f B/day), frag %u -> %u%% (%.2f%%/day)\n",
+                (unsigned long)soakOps, first.freeBytes, last.freeBytes, freePerDay, first.maxBlock, last.maxBlock, blockPerDay,
+                first.frag, last.frag, fragPerDay);
+  Serial.printf("SOAK:REPORT {\"fw\":\"%s\",\"days\":%u,\"ops\":%lu,\"samples\":%u,\"freeStart\":%u,\"freeEnd\":%u,\"freeMin\":%u,"
+                "\"maxBlockStart\":%u,\"maxBlockEnd\":%u,\"fragStart\":%u,\"fragEnd\":%u,"
+                "\"freePerDay\":%.1f,\"maxBlockPerDay\":%.1f,\"fragPerDay\":%.2f,\"verdict\":\"%s\"}\n",
+                FW_VERSION_STR, days, (unsigned long)soakOps, n, first.freeBytes, last.freeBytes, freeMin,
+                first.maxBlock, last.maxBlock, first.frag, last.frag, freePerDay, blockPerDay, fragPerDay, verdict);
+  Serial.println(strcmp(verdict, "ok") == 0 ? "✅ Soak: no heap trend" : "❌ Soak: heap trend exceeds limits");
+
+  cfg = saved;
+  webSocket.disconnect();
+  setLed(false);
+  return strcmp(verdict, "ok") == 0;
 }
 
+#endif
+
+#if BOARD_DUAL_CORE
+static void startNetworkTask();
+#endif
+
 void setup()
 {
   Serial.begin(115200);
@@ -906,6 +3231,11 @@ void setup()
   cfg.eapPassword = DEFAULT_EAP_PASSWORD;
   loadConfig(cfg);
 
+#if SOAK_MODE
+  soakRun(SOAK_DAYS);
+#endif
+
+#if FEATURE_SERIAL_CONFIG
   // Only wait for WEB_CONFIG if we don't have app config yet
   // If wsUrl and authToken are already set, skip the wait and go straight to WiFi
   bool webConfigMode = false;
@@ -936,6 +3266,8 @@ void setup()
           {
             handleSerialCommand(cmd);
             loadConfig(cfg);
+            if (hasAppConfig())
+              break;
           }
         }
       }
@@ -981,6 +3313,7 @@ void setup()
   {
     Serial.println("✅ Config found! Skipping WEB_CONFIG wait.");
   }
+#endif
 
   if (FORCE_PORTAL_PIN >= 0)
   {
@@ -994,7 +3327,7 @@ void setup()
   // Check if we have app config (from defaults, flash, or just received via serial)
   if (!hasAppConfig())
   {
-    Serial.println("🛠 No WS_URL/AUTH_TOKEN configured -> portal");
+    Serial.println("🛠 No AUTH_TOKEN configured -> portal");
     Serial.println("💡 Tip: Send CONFIG:{\"wsUrl\":\"...\",\"authToken\":\"...\"} via serial to skip portal");
     startConfigPortalAndSave();
   }
@@ -1065,13 +3398,36 @@ void setup()
     }
   }
 
+  applyPowerMode();
+  loadLocalRelay();
+  if (localDiscoveryOn() && localRelayUrl.length() == 0)
+    browseLocalRelay(millis());
+  currentRelay = bestRelay(millis());
   setupWebSocketFromConfig();
   lastWsAttemptMs = 0;
+  restartLanListener();
+  appRunning = true;
+#if BOARD_DUAL_CORE
+  startNetworkTask();
+#endif
+  Serial.printf("⏱ Ready in %lu ms (%s build)\n", (unsigned long)millis(), FW_PROFILE_STR);
 }
 
-void loop()
+// Everything but writing outputs and reading serial input: the network task
+// on DualCore boards, all of loop() otherwise (see Cores)
+static void networkPass()
 {
+  uint32_t passStartUs = micros();
+#if FEATURE_SERIAL_CONFIG
   // Handle serial commands FIRST - before WiFi checks so config works even without WiFi
+#if BOARD_DUAL_CORE
+  String *line;
+  while (serialQueue.pop(line))
+  {
+    handleSerialCommand(*line);
+    delete line;
+  }
+#else
   if (Serial.available())
   {
     String cmd = Serial.readStringUntil('\n');
@@ -1082,11 +3438,13 @@ void loop()
       handleSerialCommand(cmd);
     }
   }
+#endif
+#endif
 
   if (WiFi.status() != WL_CONNECTED)
   {
     Serial.println("📶 WiFi lost");
-    setLed(false);
+    outputStatus(0);
     webSocket.disconnect();
 
     bool wifiConnected = false;
@@ -1145,18 +3503,72 @@ void loop()
       startConfigPortalAndSave();
     }
 
+    applyPowerMode();
     setupWebSocketFromConfig();
   }
 
-  webSocket.loop();
-
-  // Manual reconnect pacing
   uint32_t now = millis();
-  if (!webSocket.isConnected() && (now - lastWsAttemptMs) >= WS_RECONNECT_MS)
+  if (cfg.mqttUrl.length() > 0)
   {
-    lastWsAttemptMs = now;
-    setupWebSocketFromConfig();
+    maybeServiceMqtt(now);
+  }
+  else
+  {
+    webSocket.loop();
+
+    // Manual reconnect pacing
+    now = millis();
+    if (!webSocket.isConnected() && (now - lastWsAttemptMs) >= WS_RECONNECT_MS)
+    {
+      lastWsAttemptMs = now;
+      nextRelayAttempt(now);
+      setupWebSocketFromConfig();
+    }
+    else
+    {
+      maybeReprobeRelay(now);
+    }
+    maybeMoveRelay(now);
+    maybeDiscoverRelay(now);
   }
+  maybeServiceLan(now);
+  maybeServiceUdp(now);
+
+  maybeSendTelemetry(now);
+  maybeExpireConfigTrial(now);
+
+  countBusy(netLoad, passStartUs);
+  delay(loopIdleMs()); // light sleep happens here on ESP8266 with powerMode 2
+}
+
+#if BOARD_DUAL_CORE
+static void networkTask(void *)
+{
+  for (;;)
+    networkPass();
+}
+
+// Started at the end of setup(), which ran the first connection on OUT_CORE
+static void startNetworkTask()
+{
+  outputTask = xTaskGetCurrentTaskHandle();
+  coresSplit = true;
+  xTaskCreatePinnedToCore(networkTask, "net", NET_TASK_STACK, nullptr, 1, nullptr, NET_CORE);
+  Serial.printf("🧵 Network on core %d, outputs and serial on core %d\n", (int)NET_CORE, (int)OUT_CORE);
+}
+#endif
 
-  delay(5);
+void loop()
+{
+#if BOARD_DUAL_CORE
+  uint32_t passStartUs = micros();
+  drainOutputs();
+#if FEATURE_SERIAL_CONFIG
+  readSerialLines();
+#endif
+  countBusy(outLoad, passStartUs);
+  ulTaskNotifyTake(pdTRUE, 1); // woken by outputStatus(), or after a tick to poll serial
+#else
+  networkPass();
+#endif
 }
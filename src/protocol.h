@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+
+// Device <-> relay WebSocket protocol. Shared with the host tools under
+// tools/ so load and conformance testing follow the firmware's own numbers.
+//
+//   upgrade: Authorization: Bearer <token>   relay -> 101 + OK + state | 101 + NOAUTH
+//   device -> AUTH:<token>          relay -> OK | NOAUTH
+//   relay  -> 1 | 0                 voice state (LED on/off)
+//   relay  -> OTA:<url>             or {"type":"ota","url":...,"md5":...,"chip":...}
+//   relay  -> {"type":"status","on":true} or {"type":"status","mask":n}, optional "seq":n
+//   relay  -> {"type":"ping",...}   device -> the same object with "type":"pong"
+//   relay  -> {"type":"config","wsUrl":...,"authToken":...,"telemetryMs":...}
+//                                   device -> {"type":"config_result","state":...}
+//   relay  -> {"type":"redirect","url":...,"delayMs":n,"jitterMs":n} or
+//             {"type":"drain","delayMs":n,"jitterMs":n}   move after a jittered delay
+//
+// JSON frames are routed by their top-level "type"; unknown types are ignored.
+//
+// LAN direct (device config lanPort): a desktop agent connects to the device
+// itself at ws://dvs-xxxxxx.local:<lanPort>/ (mDNS _dvs._tcp), sends
+// AUTH:<token> and then status frames. A status with a seq only applies when
+// newer than the last one with a seq, whichever side sent it.
+//
+// UDP status (CAPS "udp":1, SESSION "udp":port,"sid":n): the device sends
+// sealed hellos to the relay's host at that port, the relay answers each
+// status with datagrams as well as the WS frame (status_datagram.h has the
+// layout). Copies and reordering are resolved by seq like above.
+//
+// MQTT instead of a relay (device config mqttUrl=mqtt://host[:port][/prefix]):
+// login <device id>/<token>, then <prefix>/<device id>/status (retained 1/0 or
+// status JSON, QoS 0) and .../ota in, .../online ("1", will "0") out.
+//
+// Local relay (device config preferLocal, wsUrl may then be blank): a relay on
+// the LAN advertises _discordvoice._tcp over mDNS and the device connects to
+// ws://<ip>:<port>/ ahead of the configured relays.
+//
+// Capabilities, right after AUTH (relays that don't know CAPS ignore it and
+// the session stays on the text defaults above):
+//   device -> CAPS:{"chip":"esp32s2","fw":"1.2.0","out":1,"bin":1,"tele":1,"udp":1}
+//   relay  -> SESSION:{"enc":"bin","hb":15000,"tele":60000,"udp":4443,"sid":n}
+//   relay  -> bin [0x01, output bitmask]     voice state when enc is "bin"
+//             bin [0x01, output bitmask, seq u32le]   the same with a seq
+//   device -> TEL:{"rssi":..,"heap":..,"up":..} or bin [0x02, rssi, heap u32le, uptime s u32le]
+//                                            every "tele" ms (0 = off)
+//
+// A device in a power-saving mode adds "hb":<ms> to CAPS, the longer heartbeat
+// it would like; relay pings may carry "rtt":<ms> (their last round trip to
+// the device), which the device keeps as its sleep latency measurement.
+//
+// The full spec (formats, timing budgets, scripted exchanges) is protocol.json;
+// tools/conformance checks this header, the native build and relays against it.
+
+static const char *const PROTO_AUTH_HEADER = "Authorization: Bearer ";
+static const char *const PROTO_AUTH_PREFIX = "AUTH:";
+static const char *const PROTO_AUTH_OK = "OK";
+static const char *const PROTO_NOAUTH = "NOAUTH";
+static const char *const PROTO_OTA_PREFIX = "OTA:";
+static const char *const PROTO_CAPS_PREFIX = "CAPS:";
+static const char *const PROTO_SESSION_PREFIX = "SESSION:";
+static const char *const PROTO_TELEMETRY_PREFIX = "TEL:";
+
+// First byte of a binary frame
+static const uint8_t PROTO_BIN_STATUS = 0x01;
+static const uint8_t PROTO_BIN_TELEMETRY = 0x02;
+static const uint8_t PROTO_BIN_TELEMETRY_LEN = 10;
+static const uint8_t PROTO_BIN_STATUS_SEQ_LEN = 6; // [0x01, mask, seq u32le]
+
+// LAN direct: the device advertises _dvs._tcp as <prefix><last 6 MAC hex digits>.local
+static const char *const PROTO_MDNS_SERVICE = "dvs";
+static const char *const PROTO_MDNS_HOST_PREFIX = "dvs-";
+
+// Local relay discovery: a relay on the LAN advertises _discordvoice._tcp
+static const char *const PROTO_MDNS_RELAY_SERVICE = "discordvoice";
+
+// MQTT transport (device config mqttUrl): topics under <prefix>/<device id>/
+static const char *const PROTO_MQTT_SCHEME = "mqtt://";
+static const uint16_t PROTO_MQTT_DEFAULT_PORT = 1883;
+static const char *const PROTO_MQTT_DEFAULT_PREFIX = "dvs";
+static const char *const PROTO_MQTT_STATUS_TOPIC = "status";
+static const char *const PROTO_MQTT_OTA_TOPIC = "ota";
+static const char *const PROTO_MQTT_ONLINE_TOPIC = "online";
+
+// UDP status: hello interval, short enough to keep a NAT mapping open
+static const uint32_t PROTO_UDP_HELLO_MS = 20000;
+
+// SESSION values outside these bounds are clamped by the device
+static const uint32_t PROTO_HEARTBEAT_MIN_MS = 5000;
+static const uint32_t PROTO_HEARTBEAT_MAX_MS = 120000;
+static const uint32_t PROTO_TELEMETRY_MIN_MS = 1000;
+
+// Auth failure behavior
+static const uint8_t MAX_AUTH_FAILURES = 3;
+
+// Timing can be overridden at build time (-D TUNE_<NAME>=<value>) for tuning
+// runs; see tools/netem.
+#ifndef TUNE_WS_RECONNECT_MS
+#define TUNE_WS_RECONNECT_MS 5000
+#endif
+#ifndef TUNE_WS_HEARTBEAT_PING_MS
+#define TUNE_WS_HEARTBEAT_PING_MS 15000
+#endif
+#ifndef TUNE_WS_HEARTBEAT_PONG_TIMEOUT_MS
+#define TUNE_WS_HEARTBEAT_PONG_TIMEOUT_MS 3000
+#endif
+#ifndef TUNE_WS_HEARTBEAT_MISSES
+#define TUNE_WS_HEARTBEAT_MISSES 2
+#endif
+#ifndef TUNE_CONFIG_TRIAL_MS
+#define TUNE_CONFIG_TRIAL_MS 20000
+#endif
+
+// WS reconnect pacing
+static const uint32_t WS_RECONNECT_MS = TUNE_WS_RECONNECT_MS;
+
+// WebSocket heartbeat: ping interval, pong timeout, missed pongs before disconnect
+static const uint32_t WS_HEARTBEAT_PING_MS = TUNE_WS_HEARTBEAT_PING_MS;
+static const uint32_t WS_HEARTBEAT_PONG_TIMEOUT_MS = TUNE_WS_HEARTBEAT_PONG_TIMEOUT_MS;
+static const uint8_t WS_HEARTBEAT_MISSES = TUNE_WS_HEARTBEAT_MISSES;
+
+// Live config: new URL/token/network must see OK within this, or it is rolled back
+static const uint32_t CONFIG_TRIAL_MS = TUNE_CONFIG_TRIAL_MS;
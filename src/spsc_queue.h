@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Bounded single-producer/single-consumer ring, lock-free: the producer only
+// writes head_, the consumer only writes tail_, and each publishes its index
+// with release after touching the slot. Used between the network and output
+// cores on dual-core boards (see Cores in main.cpp). N must be a power of two;
+// one slot stays empty to tell full from empty.
+template <typename T, uint32_t N>
+class SpscQueue
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  // Producer side. False when full; the item is not taken.
+  bool push(const T &item)
+  {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    uint32_t next = (head + 1) & (N - 1);
+    if (next == tail_.load(std::memory_order_acquire))
+      return false;
+    slots_[head] = item;
+    head_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. False when empty.
+  bool pop(T &item)
+  {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire))
+      return false;
+    item = slots_[tail];
+    tail_.store((tail + 1) & (N - 1), std::memory_order_release);
+    return true;
+  }
+
+  // Either side; a snapshot that may be stale by the time it is used.
+  uint32_t size() const
+  {
+    return (head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire)) & (N - 1);
+  }
+
+private:
+  T slots_[N];
+  std::atomic<uint32_t> head_{0};
+  std::atomic<uint32_t> tail_{0};
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// UDP status datagrams (see "udp" in protocol.json). Shared by the firmware,
+// the reference relay and the host tools, so all sides seal and check the
+// same bytes:
+//
+//   [0]      PROTO_UDP_MAGIC
+//   [1]      PROTO_UDP_STATUS (sender -> device) or PROTO_UDP_HELLO (device -> relay)
+//   [2..5]   sid u32le    relay session id from SESSION; 0 from a LAN agent
+//   [6..9]   seq u32le    status seq, or the hello counter
+//   [10]     output bitmask (0 in a hello)
+//   [11..18] first 8 bytes of HMAC-SHA256(device token, bytes 0..10)
+//
+// SHA-256 is written out here rather than taken from BearSSL (ESP8266) or
+// mbedTLS (ESP32) so every target runs the same code; a datagram costs four
+// compressions.
+
+static const uint8_t PROTO_UDP_MAGIC = 0xD5;
+static const uint8_t PROTO_UDP_STATUS = 0x01;
+static const uint8_t PROTO_UDP_HELLO = 0x02;
+static const uint8_t PROTO_UDP_LEN = 19;
+static const uint8_t PROTO_UDP_MAC_LEN = 8;
+
+struct StatusDatagram
+{
+  uint8_t type;
+  uint32_t sid;
+  uint32_t seq;
+  uint8_t mask;
+};
+
+static inline uint32_t sha256Ror(uint32_t x, uint8_t n) { return (x >> n) | (x << (32 - n)); }
+
+static void sha256Block(uint32_t h[8], const uint8_t block[64])
+{
+  static const uint32_t K[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+      0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+      0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+      0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+      0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+      0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+  uint32_t w[64];
+  for (uint8_t i = 0; i < 16; i++)
+    w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+  for (uint8_t i = 16; i < 64; i++)
+  {
+    uint32_t s0 = sha256Ror(w[i - 15], 7) ^ sha256Ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = sha256Ror(w[i - 2], 17) ^ sha256Ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+  for (uint8_t i = 0; i < 64; i++)
+  {
+    uint32_t t1 = k + (sha256Ror(e, 6) ^ sha256Ror(e, 11) ^ sha256Ror(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+    uint32_t t2 = (sha256Ror(a, 2) ^ sha256Ror(a, 13) ^ sha256Ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    k = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+  h[5] += f;
+  h[6] += g;
+  h[7] += k;
+}
+
+// SHA-256 of prefix (exactly 64 bytes, or none) followed by data.
+static void sha256(const uint8_t *prefix64, const uint8_t *data, size_t len, uint8_t out[32])
+{
+  uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  uint64_t bits = ((uint64_t)len + (prefix64 ? 64 : 0)) * 8;
+  if (prefix64)
+    sha256Block(h, prefix64);
+  for (; len >= 64; data += 64, len -= 64)
+    sha256Block(h, data);
+  uint8_t tail[128] = {0};
+  memcpy(tail, data, len);
+  tail[len] = 0x80;
+  size_t tailLen = len < 56 ? 64 : 128;
+  for (uint8_t i = 0; i < 8; i++)
+    tail[tailLen - 1 - i] = (uint8_t)(bits >> (i * 8));
+  sha256Block(h, tail);
+  if (tailLen == 128)
+    sha256Block(h, tail + 64);
+  for (uint8_t i = 0; i < 32; i++)
+    out[i] = (uint8_t)(h[i / 4] >> (24 - (i % 4) * 8));
+}
+
+static void hmacSha256(const uint8_t *key, size_t keyLen, const uint8_t *data, size_t len, uint8_t out[32])
+{
+  uint8_t k[64] = {0};
+  if (keyLen > 64)
+    sha256(nullptr, key, keyLen, k);
+  else
+    memcpy(k, key, keyLen);
+  uint8_t pad[64];
+  uint8_t inner[32];
+  for (uint8_t i = 0; i < 64; i++)
+    pad[i] = k[i] ^ 0x36;
+  sha256(pad, data, len, inner);
+  for (uint8_t i = 0; i < 64; i++)
+    pad[i] = k[i] ^ 0x5c;
+  sha256(pad, inner, sizeof(inner), out);
+}
+
+static void statusDatagramSeal(uint8_t out[PROTO_UDP_LEN], const StatusDatagram &d, const uint8_t *key, size_t keyLen)
+{
+  out[0] = PROTO_UDP_MAGIC;
+  out[1] = d.type;
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    out[2 + i] = (uint8_t)(d.sid >> (i * 8));
+    out[6 + i] = (uint8_t)(d.seq >> (i * 8));
+  }
+  out[10] = d.mask;
+  uint8_t mac[32];
+  hmacSha256(key, keyLen, out, PROTO_UDP_LEN - PROTO_UDP_MAC_LEN, mac);
+  memcpy(out + PROTO_UDP_LEN - PROTO_UDP_MAC_LEN, mac, PROTO_UDP_MAC_LEN);
+}
+
+// False for anything that is not a datagram sealed with key.
+static bool statusDatagramOpen(const uint8_t *in, size_t len, const uint8_t *key, size_t keyLen, StatusDatagram &d)
+{
+  if (len != PROTO_UDP_LEN || in[0] != PROTO_UDP_MAGIC || keyLen == 0)
+    return false;
+  uint8_t mac[32];
+  hmacSha256(key, keyLen, in, PROTO_UDP_LEN - PROTO_UDP_MAC_LEN, mac);
+  uint8_t diff = 0;
+  for (uint8_t i = 0; i < PROTO_UDP_MAC_LEN; i++)
+    diff |= mac[i] ^ in[PROTO_UDP_LEN - PROTO_UDP_MAC_LEN + i];
+  if (diff != 0)
+    return false;
+  d.type = in[1];
+  d.sid = 0;
+  d.seq = 0;
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    d.sid |= (uint32_t)in[2 + i] << (i * 8);
+    d.seq |= (uint32_t)in[6 + i] << (i * 8);
+  }
+  d.mask = in[10];
+  return true;
+}
@@ -0,0 +1,40 @@
+// Counts every heap allocation in the process by interposing glibc's malloc
+// family. operator new, ArduinoJson's allocator and the String emulation all
+// end up here, so the counters cover everything the firmware allocates.
+
+#include <stddef.h>
+
+#include "alloc_hooks.h"
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+namespace bench
+{
+AllocStats gAllocStats;
+}
+
+extern "C" void *malloc(size_t size)
+{
+  bench::gAllocStats.count++;
+  bench::gAllocStats.bytes += size;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+  bench::gAllocStats.count++;
+  bench::gAllocStats.bytes += n * size;
+  return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  bench::gAllocStats.count++;
+  bench::gAllocStats.bytes += size;
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr) { __libc_free(ptr); }
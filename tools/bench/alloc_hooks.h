@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace bench
+{
+struct AllocStats
+{
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+};
+
+// Running totals since process start; diff two snapshots to measure a region.
+extern AllocStats gAllocStats;
+} // namespace bench
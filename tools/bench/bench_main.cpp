@@ -0,0 +1,388 @@
+// Host micro-benchmarks for the firmware's hot paths.
+//
+//   pio run -e bench && .pio/build/bench/program [options]
+//
+//   --filter <substr>      only run benchmarks whose name contains substr
+//   --json <path>          write results as JSON
+//   --baseline <path>      compare allocations against a stored run, exit 1
+//                          when any benchmark allocates more
+//   --write-baseline <path> store this run's allocation counts as the baseline
+//   --min-time-ms <n>      measuring time per benchmark (default 300)
+//
+// src/main.cpp is compiled into this translation unit so its static helpers
+// can be called directly, exactly as the firmware calls them.
+//
+// ns/op depends on the machine and is only reported; the baseline holds
+// allocation counts, which are deterministic for a given build. They count
+// ArduinoJson's allocations too, so write the baseline from a build against
+// the real library (the bench env's lib_deps), never a stand-in. The
+// committed one has only the 17 benchmarks that never reach ArduinoJson
+// (parseWsUrl, classifyWsText, the dispatch and serial commands that parse
+// no JSON, spscQueue); the rest report "new" until it is rewritten from the
+// env.
+
+#include "../../src/main.cpp"
+#include "../../src/spsc_queue.h"
+
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "alloc_hooks.h"
+#include "host/host.h"
+
+namespace
+{
+struct Restarted
+{
+};
+
+struct Result
+{
+  std::string name;
+  uint64_t iterations = 0;
+  double nsPerOp = 0;
+  double allocsPerOp = 0;
+  double bytesPerOp = 0;
+};
+
+struct Options
+{
+  std::string filter;
+  std::string jsonPath;
+  std::string baselinePath;
+  std::string writeBaselinePath;
+  uint32_t minTimeMs = 300;
+};
+
+uint64_t nowNs()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Result measure(const std::string &name, const std::function<void()> &op, uint32_t minTimeMs)
+{
+  // warm up caches, the filesystem and any lazily created state
+  for (int i = 0; i < 16; i++)
+    op();
+
+  uint64_t iterations = 1;
+  for (;;)
+  {
+    bench::AllocStats before = bench::gAllocStats;
+    uint64_t start = nowNs();
+    for (uint64_t i = 0; i < iterations; i++)
+      op();
+    uint64_t elapsed = nowNs() - start;
+    bench::AllocStats after = bench::gAllocStats;
+
+    if (elapsed >= (uint64_t)minTimeMs * 1000000ull || iterations >= (1ull << 30))
+    {
+      Result r;
+      r.name = name;
+      r.iterations = iterations;
+      r.nsPerOp = (double)elapsed / iterations;
+      r.allocsPerOp = (double)(after.count - before.count) / iterations;
+      r.bytesPerOp = (double)(after.bytes - before.bytes) / iterations;
+      return r;
+    }
+    // aim straight for the target time, with some slack
+    uint64_t next = elapsed > 0 ? (uint64_t)((double)iterations * minTimeMs * 1.2e6 / elapsed) : iterations * 100;
+    iterations = next > iterations * 100 ? iterations * 100 : (next > iterations ? next : iterations * 2);
+  }
+}
+
+// Runs fn, swallowing the Restarted exception thrown by the restart handler.
+void expectRestart(const std::function<void()> &fn)
+{
+  try
+  {
+    fn();
+  }
+  catch (const Restarted &)
+  {
+  }
+}
+
+void dispatchText(const char *text)
+{
+  // the library hands the callback a mutable, NUL-terminated copy
+  char buf[256];
+  size_t len = strlen(text);
+  memcpy(buf, text, len + 1);
+  webSocket.injectEvent(WStype_TEXT, (uint8_t *)buf, len);
+}
+
+void resetConfig()
+{
+  cfg = AppConfig();
+  cfg.wsUrl = "ws://relay.example.com:8080/ws";
+  cfg.authToken = "0123456789abcdef0123456789abcdef";
+  cfg.wifiSsid = "bench-ssid";
+  cfg.wifiPass = "bench-pass";
+  saveConfig(cfg);
+}
+
+std::vector<std::pair<std::string, std::function<void()>>> benchmarks()
+{
+  std::vector<std::pair<std::string, std::function<void()>>> b;
+
+  // ---- parseWsUrl ----
+  static const String plainUrl("ws://relay.example.com:8080/ws");
+  static const String secureUrl("wss://relay.example.com/devices/ws");
+  static const String badUrl("http://relay.example.com/");
+  b.push_back({"parseWsUrl/ws_port_path", [] {
+                 WsParts p;
+                 parseWsUrl(plainUrl, p);
+               }});
+  b.push_back({"parseWsUrl/wss_default_port", [] {
+                 WsParts p;
+                 parseWsUrl(secureUrl, p);
+               }});
+  b.push_back({"parseWsUrl/invalid_scheme", [] {
+                 WsParts p;
+                 parseWsUrl(badUrl, p);
+               }});
+
+  // ---- WS text frame dispatch (onEvent lambda) ----
+  b.push_back({"wsDispatch/status_1", [] { dispatchText("1"); }});
+  b.push_back({"wsDispatch/status_0", [] { dispatchText("0"); }});
+  b.push_back({"wsDispatch/auth_ok", [] { dispatchText("OK"); }});
+  b.push_back({"wsDispatch/unknown_text", [] { dispatchText("hello relay"); }});
+  b.push_back({"wsDispatch/non_ota_json", [] { dispatchText("{\"type\":\"status\",\"on\":true,\"seq\":42}"); }});
+  b.push_back({"wsDispatch/unknown_json_type", [] { dispatchText("{\"type\":\"presence\",\"users\":[{\"id\":1,\"type\":\"x\"}]}"); }});
+  b.push_back({"wsDispatch/ping_json", [] { dispatchText("{\"type\":\"ping\",\"ts\":1700000000}"); }});
+
+  // ---- message router: classification alone, type first vs. after a nested member ----
+  static const String typeFirst("{\"type\":\"ota\",\"url\":\"http://192.0.2.1/fw.bin\",\"chip\":\"esp32s2\"}");
+  static const String typeLast("{\"meta\":{\"type\":\"x\",\"tags\":[\"a\",\"b\"]},\"note\":\"\\\"type\\\"\",\"type\":\"status\"}");
+  b.push_back({"classifyWsText/json_type_first", [] { classifyWsText(typeFirst); }});
+  b.push_back({"classifyWsText/json_type_last", [] { classifyWsText(typeLast); }});
+  static const String statusWord("1");
+  b.push_back({"classifyWsText/status_text", [] { classifyWsText(statusWord); }});
+
+  // ---- maybeHandleOtaMessage on traffic that is not OTA ----
+  static const String statusText("1");
+  static const String statusJson("{\"type\":\"status\",\"on\":true,\"seq\":42}");
+  static const String otherJson("{\"type\":\"ping\",\"ts\":1700000000,\"payload\":\"abcdefghijklmnopqrstuvwxyz\"}");
+  b.push_back({"maybeHandleOtaMessage/plain_text", [] { maybeHandleOtaMessage(statusText); }});
+  b.push_back({"maybeHandleOtaMessage/status_json", [] { maybeHandleOtaMessage(statusJson); }});
+  b.push_back({"maybeHandleOtaMessage/other_json", [] { maybeHandleOtaMessage(otherJson); }});
+
+  // ---- handleSerialCommand ----
+  static const String ping("PING");
+  static const String getConfig("GET_CONFIG");
+  static const String configNoop("CONFIG:{}");
+  static const String configInvalid("CONFIG:{\"wsUrl\":");
+  // alternates between two URLs so every call is a real change (stored, no reboot)
+  static const String configChange[2] = {
+      String("CONFIG:{\"wsUrl\":\"ws://relay.example.com:8081/ws\",\"authToken\":\"0123456789abcdef0123456789abcdef\"}"),
+      String("CONFIG:{\"wsUrl\":\"ws://relay.example.com:8080/ws\",\"authToken\":\"0123456789abcdef0123456789abcdef\"}")};
+  static const String configTelemetry("CONFIG:{\"telemetryMs\":60000}");
+  static const String reboot("REBOOT");
+  static const String portal("PORTAL");
+  static const String unknown("NOT_A_COMMAND");
+  b.push_back({"handleSerialCommand/PING", [] { handleSerialCommand(ping); }});
+  b.push_back({"handleSerialCommand/GET_CONFIG", [] { handleSerialCommand(getConfig); }});
+  b.push_back({"handleSerialCommand/CONFIG_no_changes", [] { handleSerialCommand(configNoop); }});
+  b.push_back({"handleSerialCommand/CONFIG_invalid_json", [] { handleSerialCommand(configInvalid); }});
+  b.push_back({"handleSerialCommand/CONFIG_save", [] {
+                 static uint32_t n = 0;
+                 handleSerialCommand(configChange[n++ & 1]);
+               }});
+  b.push_back({"handleSerialCommand/CONFIG_telemetry_unchanged", [] { handleSerialCommand(configTelemetry); }});
+  b.push_back({"handleSerialCommand/REBOOT", [] { expectRestart([] { handleSerialCommand(reboot); }); }});
+  b.push_back({"handleSerialCommand/PORTAL", [] { handleSerialCommand(portal); }});
+  b.push_back({"handleSerialCommand/unknown", [] { handleSerialCommand(unknown); }});
+
+  // ---- config persistence ----
+  b.push_back({"config/saveConfig", [] { saveConfig(cfg); }});
+  b.push_back({"config/loadConfig", [] {
+                 AppConfig c;
+                 loadConfig(c);
+               }});
+  b.push_back({"config/round_trip", [] {
+                 AppConfig c;
+                 saveConfig(cfg);
+                 loadConfig(c);
+               }});
+
+  // ---- dual-core handoff (the status ring between the network and output cores) ----
+  struct Ev
+  {
+    uint32_t mask;
+    uint32_t acceptedUs;
+  };
+  static SpscQueue<Ev, 16> ring;
+  b.push_back({"spscQueue/push_pop", [] {
+                 Ev ev = {1, 0};
+                 ring.push(ev);
+                 ring.pop(ev);
+               }});
+
+  return b;
+}
+
+void printResults(const std::vector<Result> &results)
+{
+  printf("%-44s %12s %12s %10s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op", "bytes/op");
+  for (const auto &r : results)
+    printf("%-44s %12llu %12.1f %10.2f %12.1f\n", r.name.c_str(), (unsigned long long)r.iterations, r.nsPerOp, r.allocsPerOp, r.bytesPerOp);
+}
+
+bool writeJson(const std::string &path, const std::vector<Result> &results, bool withTimes)
+{
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f)
+  {
+    fprintf(stderr, "cannot write %s\n", path.c_str());
+    return false;
+  }
+  fprintf(f, "{\n  \"fw\": \"%s\",\n  \"results\": [\n", FW_VERSION_STR);
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const Result &r = results[i];
+    if (withTimes)
+      fprintf(f, "    {\"name\": \"%s\", \"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f}%s\n",
+              r.name.c_str(), r.nsPerOp, r.allocsPerOp, r.bytesPerOp, i + 1 < results.size() ? "," : "");
+    else
+      fprintf(f, "    {\"name\": \"%s\", \"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f}%s\n", r.name.c_str(),
+              r.allocsPerOp, r.bytesPerOp, i + 1 < results.size() ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+  return true;
+}
+
+// Returns the number of benchmarks that allocate more than in the baseline
+// file. Times are printed for reference and never count.
+int compareBaseline(const std::string &path, const std::vector<Result> &results)
+{
+  FILE *f = fopen(path.c_str(), "r");
+  if (!f)
+  {
+    fprintf(stderr, "cannot read baseline %s\n", path.c_str());
+    return -1;
+  }
+  std::string text;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    text.append(buf, n);
+  fclose(f);
+
+  JsonDocument doc;
+  if (deserializeJson(doc, text.c_str(), text.size()))
+  {
+    fprintf(stderr, "baseline %s is not valid JSON\n", path.c_str());
+    return -1;
+  }
+
+  int regressions = 0;
+  printf("\n%-44s %12s %10s %10s\n", "vs baseline", "ns/op", "allocs/op", "base");
+  for (const auto &r : results)
+  {
+    JsonVariantConst base;
+    for (JsonVariantConst entry : doc["results"].as<JsonArrayConst>())
+    {
+      if (r.name == (entry["name"] | ""))
+        base = entry;
+    }
+    if (base.isNull())
+    {
+      printf("%-44s %12.1f %10.2f %10s  new\n", r.name.c_str(), r.nsPerOp, r.allocsPerOp, "-");
+      continue;
+    }
+    double baseAllocs = base["allocs_per_op"] | 0.0;
+    bool moreAllocs = r.allocsPerOp > baseAllocs + 0.005;
+    if (moreAllocs)
+      regressions++;
+    printf("%-44s %12.1f %10.2f %10.2f  %s\n", r.name.c_str(), r.nsPerOp, r.allocsPerOp, baseAllocs,
+           moreAllocs ? "REGRESSION (allocs)" : "ok");
+  }
+  return regressions;
+}
+
+Options parseArgs(int argc, char **argv)
+{
+  Options o;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string a = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc)
+        throw std::runtime_error("missing value for " + a);
+      return argv[++i];
+    };
+    if (a == "--filter")
+      o.filter = next();
+    else if (a == "--json")
+      o.jsonPath = next();
+    else if (a == "--baseline")
+      o.baselinePath = next();
+    else if (a == "--write-baseline")
+      o.writeBaselinePath = next();
+    else if (a == "--min-time-ms")
+      o.minTimeMs = (uint32_t)atoi(next().c_str());
+    else
+      throw std::runtime_error("unknown option " + a);
+  }
+  return o;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options opts;
+  try
+  {
+    opts = parseArgs(argc, argv);
+  }
+  catch (const std::exception &e)
+  {
+    fprintf(stderr, "%s\n", e.what());
+    return 2;
+  }
+
+  host::init(argc, argv);
+  // delay()s inside the measured paths (portal timeout, reboot pacing) must
+  // not turn into wall-clock sleeps
+  host::setClockMode(host::ClockMode::Virtual);
+  host::setFsRoot(".pio/bench-fs");
+  host::serialDetach();
+  host::setRestartHandler([] { throw Restarted(); });
+
+  pinMode(LED_PIN, OUTPUT);
+  resetConfig();
+  setupWebSocketFromConfig();
+
+  std::vector<Result> results;
+  for (auto &b : benchmarks())
+  {
+    if (!opts.filter.empty() && b.first.find(opts.filter) == std::string::npos)
+      continue;
+    resetConfig();
+    results.push_back(measure(b.first, b.second, opts.minTimeMs));
+  }
+
+  printResults(results);
+
+  if (!opts.jsonPath.empty() && !writeJson(opts.jsonPath, results, true))
+    return 2;
+  if (!opts.writeBaselinePath.empty() && !writeJson(opts.writeBaselinePath, results, false))
+    return 2;
+  if (!opts.baselinePath.empty())
+  {
+    int regressions = compareBaseline(opts.baselinePath, results);
+    if (regressions < 0)
+      return 2;
+    if (regressions > 0)
+    {
+      printf("\n%d regression(s)\n", regressions);
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,835 @@
+#!/usr/bin/env python3
+"""Conformance suite for the device <-> relay WebSocket protocol.
+
+The protocol is specified in src/protocol.json: constants, message formats,
+timing budgets and scripted exchanges. This suite runs those exchanges, with
+their timing assertions, against both ends of the wire:
+
+  spec    src/protocol.h and src/status_datagram.h agree with the spec constants
+  device  the native firmware build; the suite plays the relay and watches
+          the LED and OTA/portal events on the HOST_TRACE stream
+  server  any relay; the suite plays the device. Stimuli (voice state, OTA)
+          go through the reference relay's control port (--control) or an
+          arbitrary command (--stimulus-cmd); without either, scenarios that
+          need them are skipped
+  loadgen the fleet load generator's hand-written device model
+          (tools/loadgen), one device with --trace, against the device
+          scenarios; the ones it does not model are listed in
+          LOADGEN_NOT_MODELLED and skipped
+
+    pio run -e native -e relay -e loadgen
+    python3 tools/conformance/conformance.py
+    python3 tools/conformance/conformance.py server --relay ws://relay.example:8080/ws \\
+        --token T --bad-token X --stimulus-cmd './poke.sh {event} {user}'
+
+Budgets can be scaled with --timing-scale for slow hosts (sanitizers, CI).
+Exit status is 1 when any scenario fails.
+"""
+
+import argparse
+import asyncio
+import base64
+import hashlib
+import json
+import os
+import re
+import shlex
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+from urllib.parse import urlparse
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), "..", ".."))
+SPEC_PATH = os.path.join(ROOT, "src", "protocol.json")
+HEADER_PATH = os.path.join(ROOT, "src", "protocol.h")
+DATAGRAM_PATH = os.path.join(ROOT, "src", "status_datagram.h")
+
+WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+OP_TEXT, OP_BIN, OP_CLOSE, OP_PING, OP_PONG = 0x1, 0x2, 0x8, 0x9, 0xA
+
+# Reference relay control commands for each stimulus (tools/relay)
+CONTROL_STIMULI = {
+    "voice_on": "SET {user} 1",
+    "voice_off": "SET {user} 0",
+    "ota": "OTA {user} http://192.0.2.1/fw.bin",
+}
+
+TRACE_RE = re.compile(r"^HOST (\d+) (.*)$")
+
+# Device scenarios tools/loadgen does not model, and why. Anything else it has
+# to pass, so a firmware change the model misses fails here.
+LOADGEN_NOT_MODELLED = {
+    "config_telemetry_in_place": "remote config is not modelled",
+    "config_bad_token_rolled_back": "remote config is not modelled",
+}
+
+
+class StepFailed(Exception):
+    pass
+
+
+class Skipped(Exception):
+    pass
+
+
+# ---------------------------------------------------------------- websocket
+
+
+class WsConn:
+    """Minimal RFC 6455 endpoint; clients mask, servers do not."""
+
+    def __init__(self, reader, writer, mask):
+        self.reader = reader
+        self.writer = writer
+        self.mask = mask
+
+    async def send(self, opcode, payload):
+        head = bytearray([0x80 | opcode])
+        n = len(payload)
+        bit = 0x80 if self.mask else 0
+        if n < 126:
+            head.append(bit | n)
+        elif n < 65536:
+            head += bytes([bit | 126]) + n.to_bytes(2, "big")
+        else:
+            head += bytes([bit | 127]) + n.to_bytes(8, "big")
+        if self.mask:
+            key = os.urandom(4)
+            payload = bytes(b ^ key[i & 3] for i, b in enumerate(payload))
+            head += key
+        self.writer.write(bytes(head) + payload)
+        await self.writer.drain()
+
+    async def recv(self):
+        """Returns (opcode, payload); (None, b"") once the peer is gone."""
+        data = b""
+        try:
+            while True:
+                b0, b1 = await self.reader.readexactly(2)
+                n = b1 & 0x7F
+                if n == 126:
+                    n = int.from_bytes(await self.reader.readexactly(2), "big")
+                elif n == 127:
+                    n = int.from_bytes(await self.reader.readexactly(8), "big")
+                key = await self.reader.readexactly(4) if b1 & 0x80 else None
+                payload = await self.reader.readexactly(n)
+                if key:
+                    payload = bytes(b ^ key[i & 3] for i, b in enumerate(payload))
+                opcode = b0 & 0x0F
+                if opcode >= 0x8:
+                    return opcode, payload
+                data += payload
+                if b0 & 0x80:
+                    return opcode or OP_TEXT, data
+        except (asyncio.IncompleteReadError, ConnectionError):
+            return None, b""
+
+    def close(self):
+        self.writer.close()
+
+
+def accept_key(key):
+    return base64.b64encode(hashlib.sha1((key + WS_GUID).encode()).digest()).decode()
+
+
+async def read_upgrade_request(reader):
+    """Header names are lower-cased."""
+    head = await reader.readuntil(b"\r\n\r\n")
+    headers = {}
+    for line in head.decode(errors="replace").split("\r\n")[1:]:
+        name, _, value = line.partition(":")
+        if name:
+            headers[name.strip().lower()] = value.strip()
+    return headers
+
+
+async def ws_server_accept(reader, writer, headers, push=()):
+    """Completes the upgrade; push frames go out in the same write as the 101."""
+    out = ("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+           "Sec-WebSocket-Accept: %s\r\n\r\n" % accept_key(headers.get("sec-websocket-key", ""))).encode()
+    for text in push:
+        payload = text.encode()
+        out += bytes([0x80 | OP_TEXT, len(payload)]) + payload
+    writer.write(out)
+    await writer.drain()
+    return WsConn(reader, writer, mask=False)
+
+
+async def ws_client_connect(url, timeout, authorization=None):
+    """Returns (conn, status); conn is None when the upgrade was refused."""
+    u = urlparse(url)
+    if u.scheme != "ws":
+        raise StepFailed("only ws:// relays are supported, got %s" % url)
+    reader, writer = await asyncio.wait_for(asyncio.open_connection(u.hostname, u.port or 80), timeout)
+    key = base64.b64encode(os.urandom(16)).decode()
+    path = (u.path or "/") + ("?" + u.query if u.query else "")
+    writer.write(("GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                  "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n%s\r\n" % (
+                      path, u.netloc, key, "Authorization: Bearer %s\r\n" % authorization if authorization else "")).encode())
+    await writer.drain()
+    head = await asyncio.wait_for(reader.readuntil(b"\r\n\r\n"), timeout)
+    status_line = head.split(b"\r\n", 1)[0].decode(errors="replace")
+    parts = status_line.split(" ")
+    status = int(parts[1]) if len(parts) > 1 and parts[1].isdigit() else 0
+    if status != 101:
+        writer.close()
+        return None, status
+    if accept_key(key).encode() not in head:
+        raise StepFailed("bad Sec-WebSocket-Accept in %r" % head)
+    return WsConn(reader, writer, mask=True), status
+
+
+# ---------------------------------------------------------------- spec
+
+
+def load_spec(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def budget_ms(spec, value, scale):
+    """within_ms is a number or a '+'-joined list of timing/constant keys."""
+    if isinstance(value, (int, float)):
+        return value * scale
+    total = 0
+    for key in value.split("+"):
+        node = spec["constants"] if "." not in key else spec["timing"]
+        for part in key.split("."):
+            node = node[part]
+        total += node
+    return total * scale
+
+
+def expand(text, ctx):
+    text = text.replace("{token}", ctx["token"]).replace("{bad_token}", ctx["bad_token"])
+    return text.replace("{relay_url}", ctx.get("relay_url", ""))
+
+
+def message_matches(spec, msg_id, text):
+    if msg_id == "ota_json":
+        try:
+            doc = json.loads(text)
+        except ValueError:
+            return False
+        if not isinstance(doc, dict) or doc.get("type") != "ota":
+            return False
+        if not isinstance(doc.get("url"), str) or not doc["url"]:
+            return False
+        if "md5" in doc and not isinstance(doc["md5"], str):
+            return False
+        return doc.get("chip", "esp32s2") in spec["chips"]["ids"] + ["esp32"]
+    for m in spec["messages"]["server_to_device"] + spec["messages"]["device_to_server"]:
+        if m["id"] != msg_id:
+            continue
+        if "pattern" not in m:
+            return text == m["format"]
+        match = re.match(m["pattern"], text)
+        if not match or "json_keys" not in m:
+            return match is not None
+        try:
+            doc = json.loads(match.group(1))
+        except ValueError:
+            return False
+        return isinstance(doc, dict) and all(k in doc for k in m["json_keys"])
+    return False
+
+
+def frame_matches(spec, want, text, ctx):
+    """Every criterion given (equals, pattern, message) must hold."""
+    if "equals" in want and text != expand(want["equals"], ctx):
+        return False
+    if "pattern" in want and re.search(want["pattern"], text) is None:
+        return False
+    return "message" not in want or any(message_matches(spec, m, text) for m in want["message"])
+
+
+def check_header(spec):
+    """src/protocol.h and src/status_datagram.h constants vs the spec; returns
+    a list of mismatches."""
+    header = ""
+    for path in (HEADER_PATH, DATAGRAM_PATH):
+        with open(path) as f:
+            header += f.read()
+    c = spec["constants"]
+    want = {
+        r'PROTO_AUTH_HEADER = "([^"]*)"': c["authHeader"],
+        r'PROTO_AUTH_PREFIX = "([^"]*)"': c["authPrefix"],
+        r'PROTO_AUTH_OK = "([^"]*)"': c["authOk"],
+        r'PROTO_NOAUTH = "([^"]*)"': c["noAuth"],
+        r'PROTO_OTA_PREFIX = "([^"]*)"': c["otaPrefix"],
+        r'PROTO_CAPS_PREFIX = "([^"]*)"': c["capsPrefix"],
+        r'PROTO_SESSION_PREFIX = "([^"]*)"': c["sessionPrefix"],
+        r'PROTO_TELEMETRY_PREFIX = "([^"]*)"': c["telemetryPrefix"],
+        r"PROTO_BIN_STATUS = 0x([0-9A-Fa-f]+)": "%02X" % c["binStatus"],
+        r"PROTO_BIN_TELEMETRY = 0x([0-9A-Fa-f]+)": "%02X" % c["binTelemetry"],
+        r"PROTO_BIN_TELEMETRY_LEN = (\d+)": c["binTelemetryLen"],
+        r"PROTO_BIN_STATUS_SEQ_LEN = (\d+)": c["binStatusSeqLen"],
+        r'PROTO_MDNS_SERVICE = "([^"]*)"': c["mdnsService"],
+        r'PROTO_MDNS_HOST_PREFIX = "([^"]*)"': c["mdnsHostPrefix"],
+        r'PROTO_MDNS_RELAY_SERVICE = "([^"]*)"': c["mdnsRelayService"],
+        r"PROTO_UDP_HELLO_MS = (\d+)": c["udpHelloMs"],
+        r"PROTO_UDP_MAGIC = 0x([0-9A-Fa-f]+)": "%02X" % c["udpMagic"],
+        r"PROTO_UDP_STATUS = 0x([0-9A-Fa-f]+)": "%02X" % c["udpStatus"],
+        r"PROTO_UDP_HELLO = 0x([0-9A-Fa-f]+)": "%02X" % c["udpHello"],
+        r"PROTO_UDP_LEN = (\d+)": c["udpLen"],
+        r"PROTO_UDP_MAC_LEN = (\d+)": c["udpMacLen"],
+        r'PROTO_MQTT_SCHEME = "([^"]*)"': c["mqttScheme"],
+        r"PROTO_MQTT_DEFAULT_PORT = (\d+)": c["mqttDefaultPort"],
+        r'PROTO_MQTT_DEFAULT_PREFIX = "([^"]*)"': c["mqttDefaultPrefix"],
+        r'PROTO_MQTT_STATUS_TOPIC = "([^"]*)"': c["mqttStatusTopic"],
+        r'PROTO_MQTT_OTA_TOPIC = "([^"]*)"': c["mqttOtaTopic"],
+        r'PROTO_MQTT_ONLINE_TOPIC = "([^"]*)"': c["mqttOnlineTopic"],
+        r"PROTO_HEARTBEAT_MIN_MS = (\d+)": c["heartbeatMinMs"],
+        r"PROTO_HEARTBEAT_MAX_MS = (\d+)": c["heartbeatMaxMs"],
+        r"PROTO_TELEMETRY_MIN_MS = (\d+)": c["telemetryMinMs"],
+        r"MAX_AUTH_FAILURES = (\d+)": c["maxAuthFailures"],
+        r"#define TUNE_WS_RECONNECT_MS (\d+)": c["reconnectMs"],
+        r"#define TUNE_WS_HEARTBEAT_PING_MS (\d+)": c["heartbeatPingMs"],
+        r"#define TUNE_WS_HEARTBEAT_PONG_TIMEOUT_MS (\d+)": c["heartbeatPongTimeoutMs"],
+        r"#define TUNE_WS_HEARTBEAT_MISSES (\d+)": c["heartbeatMisses"],
+        r"#define TUNE_CONFIG_TRIAL_MS (\d+)": c["configTrialMs"],
+    }
+    problems = []
+    for pattern, value in want.items():
+        m = re.search(pattern, header)
+        got = m.group(1) if m else None
+        if got is not None and "0x" in pattern:
+            got = got.upper()
+        if got is None or got != str(value):
+            problems.append("%s: header %r, spec %r" % (pattern.split(" ")[0].lstrip("#"), got, value))
+    return problems
+
+
+# ---------------------------------------------------------------- runs
+
+
+class Run:
+    """Step interpreter shared by both roles. mark is the time of the last
+    action (accept, connect, send, close, stimulus, ping); within_ms budgets
+    are measured from it."""
+
+    def __init__(self, spec, ctx, scale):
+        self.spec = spec
+        self.ctx = ctx
+        self.scale = scale
+        self.mark = time.monotonic()
+        self.conn = None
+        self.frames = asyncio.Queue()
+        self.pongs = asyncio.Queue()
+        self.timings = []  # (budget name, observed ms, budget ms)
+        self.reader_task = None
+        self.session_enc = "text"  # from the last SESSION frame seen
+
+    def budget(self, step):
+        return budget_ms(self.spec, step["within_ms"], self.scale)
+
+    def observed(self, step, at):
+        ms = (at - self.mark) * 1000.0
+        name = step["within_ms"] if isinstance(step["within_ms"], str) else "%dms" % step["within_ms"]
+        self.timings.append((name, ms, self.budget(step)))
+        if ms > self.budget(step):
+            raise StepFailed("%s took %.1f ms, budget %.0f ms" % (name, ms, self.budget(step)))
+
+    def attach(self, conn, answer_pings):
+        self.conn = conn
+        self.frames = asyncio.Queue()
+        if self.reader_task:
+            self.reader_task.cancel()
+        self.reader_task = asyncio.ensure_future(self.read_frames(conn, answer_pings))
+
+    async def read_frames(self, conn, answer_pings):
+        while True:
+            opcode, payload = await conn.recv()
+            now = time.monotonic()
+            if opcode is None or opcode == OP_CLOSE:
+                await self.frames.put((now, None))
+                return
+            if opcode == OP_PING and answer_pings:
+                await conn.send(OP_PONG, payload)
+            elif opcode == OP_PONG:
+                await self.pongs.put((now, payload))
+            elif opcode == OP_TEXT:
+                await self.frames.put((now, payload.decode(errors="replace")))
+            elif opcode == OP_BIN:
+                await self.frames.put((now, "bin:" + payload.hex()))
+
+    async def expect_frame(self, step):
+        want = step["expect_frame"]
+        if "session_status" in want:
+            # voice state in whichever encoding the relay's SESSION chose
+            level = want["session_status"]
+            want = {"equals": "bin:%02x%02x" % (self.spec["constants"]["binStatus"], level)
+                    if self.session_enc == "bin" else str(level)}
+        deadline = self.mark + self.budget(step) / 1000.0 + 2.0  # report overruns, don't just time out
+        skip = step.get("skip_frames")
+        while True:
+            try:
+                at, text = await asyncio.wait_for(self.frames.get(), max(0.0, deadline - time.monotonic()))
+            except asyncio.TimeoutError:
+                raise StepFailed("no frame matching %s" % json.dumps(step["expect_frame"]))
+            if text is None:
+                raise StepFailed("connection closed waiting for %s" % json.dumps(step["expect_frame"]))
+            if skip and re.search(skip, text):
+                continue
+            if not frame_matches(self.spec, want, text, self.ctx):
+                raise StepFailed("got %r, want %s" % (text, json.dumps(want)))
+            prefix = self.spec["constants"]["sessionPrefix"]
+            if text.startswith(prefix):
+                self.session_enc = json.loads(text[len(prefix):]).get("enc", "text")
+            self.observed(step, at)
+            return
+
+    async def expect_no_frame(self, step):
+        try:
+            at, text = await asyncio.wait_for(self.frames.get(), step["for_ms"] * self.scale / 1000.0)
+        except asyncio.TimeoutError:
+            return
+        raise StepFailed("unexpected %s" % ("close" if text is None else "frame %r" % text))
+
+    async def send(self, text):
+        if not self.conn:
+            raise StepFailed("send without a connection")
+        await self.conn.send(OP_TEXT, expand(text, self.ctx).encode())
+        self.mark = time.monotonic()
+
+    async def send_bin(self, hex_payload):
+        if not self.conn:
+            raise StepFailed("send without a connection")
+        await self.conn.send(OP_BIN, bytes.fromhex(hex_payload))
+        self.mark = time.monotonic()
+
+    async def close(self):
+        self.conn.close()
+        self.conn = None
+        self.mark = time.monotonic()
+
+
+class DeviceRun(Run):
+    """Suite = relay, subject = native firmware."""
+
+    def __init__(self, spec, ctx, scale, program, led_pin):
+        super().__init__(spec, ctx, scale)
+        self.program = program
+        self.led_pin = led_pin
+        self.accepted = asyncio.Queue()
+        self.events = []  # (arrival, text)
+        self.event_added = asyncio.Event()
+        self.led = None
+        self.request_headers = {}
+        self.proc = None
+        self.server = None
+        self.work = tempfile.mkdtemp(prefix="conformance-")
+
+    async def start(self):
+        async def on_client(reader, writer):
+            try:
+                headers = await read_upgrade_request(reader)
+            except (asyncio.IncompleteReadError, asyncio.LimitOverrunError, ConnectionError):
+                return
+            await self.accepted.put((time.monotonic(), reader, writer, headers))
+
+        self.server = await asyncio.start_server(on_client, "127.0.0.1", 0)
+        port = self.server.sockets[0].getsockname()[1]
+        self.ctx = dict(self.ctx, relay_url="ws://127.0.0.1:%d/ws" % port)
+        await self.spawn(port)
+        asyncio.ensure_future(self.read_trace())
+        self.mark = time.monotonic()
+
+    async def spawn(self, port):
+        fs = os.path.join(self.work, "fs")
+        os.makedirs(fs)
+        with open(os.path.join(fs, "config.json"), "w") as f:
+            json.dump({"wsUrl": "ws://127.0.0.1:%d/ws" % port, "fallbackUrls": ["ws://127.0.0.1:%d/ws-fallback" % port],
+                       "authToken": self.ctx["token"],
+                       "wifiSsid": "conformance", "wifiPass": "conformance-pass"}, f)
+        env = dict(os.environ)
+        env.update({"HOST_FS_DIR": fs, "HOST_TRACE": "1", "HOST_PORTAL_SSID": "conformance"})
+        env.pop("HOST_CLOCK", None)
+        self.proc = await asyncio.create_subprocess_exec(self.program, stdin=subprocess.DEVNULL,
+                                                         stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                                                         env=env)
+
+    def led_level(self, text):
+        """LED level a trace line sets, or None."""
+        words = text.split()
+        if words[:1] == ["GPIO"] and len(words) >= 3 and int(words[1]) == self.led_pin:
+            return int(words[2])
+        return None
+
+    async def read_trace(self):
+        while True:
+            raw = await self.proc.stderr.readline()
+            if not raw:
+                return
+            m = TRACE_RE.match(raw.decode(errors="replace").rstrip())
+            if not m:
+                continue
+            text = m.group(2)
+            level = self.led_level(text)
+            if level is not None:
+                self.led = level
+            self.events.append((time.monotonic(), text))
+            self.event_added.set()
+
+    async def stop(self):
+        if self.proc and self.proc.returncode is None:
+            self.proc.kill()
+            await self.proc.wait()
+        if self.server:
+            self.server.close()
+        if self.reader_task:
+            self.reader_task.cancel()
+        shutil.rmtree(self.work, ignore_errors=True)
+
+    async def wait_event(self, predicate, deadline):
+        seen = 0
+        while True:
+            for at, text in self.events[seen:]:
+                if at >= self.mark and predicate(text):
+                    return at, text
+            seen = len(self.events)
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return None
+            self.event_added.clear()
+            try:
+                await asyncio.wait_for(self.event_added.wait(), remaining)
+            except asyncio.TimeoutError:
+                pass
+
+    def led_write(self, level):
+        return lambda text: self.led_level(text) == level
+
+    async def step(self, step):
+        if "accept" in step:
+            try:
+                at, reader, writer, headers = await asyncio.wait_for(self.accepted.get(), self.budget(step) / 1000.0 + 2.0)
+            except asyncio.TimeoutError:
+                raise StepFailed("device never connected")
+            self.observed(step, at)
+            self.request_headers = headers
+            conn = await ws_server_accept(reader, writer, headers, [expand(t, self.ctx) for t in step.get("push", [])])
+            self.attach(conn, answer_pings=True)
+            self.mark = time.monotonic() if step.get("push") else at
+        elif "expect_request_header" in step:
+            want = step["expect_request_header"]
+            got = self.request_headers.get(want["name"].lower())
+            if got != expand(want["equals"], self.ctx):
+                raise StepFailed("%s: %r, want %r" % (want["name"], got, expand(want["equals"], self.ctx)))
+        elif "expect_frame" in step:
+            await self.expect_frame(step)
+        elif "expect_no_frame" in step:
+            await self.expect_no_frame(step)
+        elif "send" in step:
+            await self.send(step["send"])
+        elif "send_bin" in step:
+            await self.send_bin(step["send_bin"])
+        elif "close" in step:
+            await self.close()
+        elif "expect_led" in step:
+            level = step["expect_led"]
+            hit = await self.wait_event(self.led_write(level), self.mark + self.budget(step) / 1000.0 + 2.0)
+            if hit is None:
+                if self.led == level:
+                    return  # already in that state and the firmware skipped the write
+                raise StepFailed("LED never went to %d (now %s)" % (level, self.led))
+            self.observed(step, hit[0])
+        elif "hold_led" in step:
+            level = step["hold_led"]
+            await asyncio.sleep(step["for_ms"] * self.scale / 1000.0)
+            changed = [t for at, t in self.events if at >= self.mark and self.led_level(t) not in (None, level)]
+            if changed or self.led != level:
+                raise StepFailed("LED left %d: %s" % (level, ", ".join(changed) or "now %s" % self.led))
+        elif "expect_event" in step:
+            needle = step["expect_event"]
+            hit = await self.wait_event(lambda t: t.startswith(needle), self.mark + self.budget(step) / 1000.0 + 2.0)
+            if hit is None:
+                raise StepFailed("no %r event" % needle)
+            self.observed(step, hit[0])
+        elif "expect_no_event" in step:
+            needle = step["expect_no_event"]
+            await asyncio.sleep(step["for_ms"] * self.scale / 1000.0)
+            bad = [t for at, t in self.events if at >= self.mark and t.startswith(needle)]
+            if bad:
+                raise StepFailed("unexpected %r" % bad[0])
+        else:
+            raise StepFailed("device role cannot run step %s" % json.dumps(step))
+
+
+class LoadgenRun(DeviceRun):
+    """Suite = relay, subject = the loadgen's device model."""
+
+    async def spawn(self, port):
+        tokens = os.path.join(self.work, "tokens")
+        with open(tokens, "w") as f:
+            f.write("%s %s\n" % (self.ctx["token"], self.ctx["user"]))
+        self.proc = await asyncio.create_subprocess_exec(
+            self.program, "--url", "ws://127.0.0.1:%d/ws" % port, "--devices", "1", "--duration", "3600",
+            "--tokens", tokens, "--quiet", "--trace",
+            stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+
+    def led_level(self, text):
+        # the model has no LED; it traces the status it applied
+        words = text.split()
+        return int(words[1]) if words[:1] == ["STATUS"] and len(words) == 2 else None
+
+
+class ServerRun(Run):
+    """Suite = device, subject = a relay."""
+
+    def __init__(self, spec, ctx, scale, url, stimulate):
+        super().__init__(spec, ctx, scale)
+        self.url = url
+        self.stimulate = stimulate
+
+    async def start(self):
+        pass
+
+    async def stop(self):
+        if self.reader_task:
+            self.reader_task.cancel()
+        if self.conn:
+            self.conn.close()
+
+    async def step(self, step):
+        if "connect" in step:
+            opts = step["connect"] if isinstance(step["connect"], dict) else {}
+            auth = expand(opts["authorization"], self.ctx) if "authorization" in opts else None
+            self.mark = time.monotonic()
+            try:
+                conn, status = await ws_client_connect(self.url, 5.0, auth)
+            except (OSError, asyncio.TimeoutError, asyncio.IncompleteReadError) as e:
+                raise StepFailed("connect %s: %s" % (self.url, e))
+            want = opts.get("expect_status", 101)
+            if status != want:
+                raise StepFailed("upgrade answered %d, want %d" % (status, want))
+            if conn:
+                self.attach(conn, answer_pings=True)
+        elif "expect_frame" in step:
+            await self.expect_frame(step)
+        elif "expect_no_frame" in step:
+            await self.expect_no_frame(step)
+        elif "send" in step:
+            await self.send(step["send"])
+        elif "send_bin" in step:
+            await self.send_bin(step["send_bin"])
+        elif "close" in step:
+            await self.close()
+        elif "stimulus" in step:
+            if not self.stimulate:
+                raise Skipped("needs --control or --stimulus-cmd")
+            if not await self.stimulate(step["stimulus"]):
+                raise StepFailed("stimulus %s failed" % step["stimulus"])
+            self.mark = time.monotonic()
+        elif "ping" in step:
+            await self.conn.send(OP_PING, step["ping"].encode())
+            self.mark = time.monotonic()
+        elif "expect_pong" in step:
+            try:
+                at, payload = await asyncio.wait_for(self.pongs.get(), self.budget(step) / 1000.0 + 2.0)
+            except asyncio.TimeoutError:
+                raise StepFailed("no pong")
+            if payload != step["expect_pong"].encode():
+                raise StepFailed("pong payload %r" % payload)
+            self.observed(step, at)
+        else:
+            raise StepFailed("server role cannot run step %s" % json.dumps(step))
+
+
+async def run_scenario(run, scenario):
+    try:
+        await run.start()
+        for i, step in enumerate(scenario["steps"]):
+            try:
+                await run.step(step)
+            except StepFailed as e:
+                return "FAIL", "step %d: %s" % (i + 1, e), run.timings
+        return "PASS", "", run.timings
+    except Skipped as e:
+        return "SKIP", str(e), run.timings
+    finally:
+        await run.stop()
+
+
+# ---------------------------------------------------------------- stimuli
+
+
+def control_stimulus(addr, user):
+    host, _, port = addr.rpartition(":")
+
+    async def stimulate(event):
+        line = CONTROL_STIMULI[event].format(user=user)
+        try:
+            reader, writer = await asyncio.open_connection(host or "127.0.0.1", int(port))
+            writer.write((line + "\n").encode())
+            await writer.drain()
+            reply = await asyncio.wait_for(reader.readline(), 2.0)
+            writer.close()
+            return reply.startswith(b"OK")
+        except (OSError, asyncio.TimeoutError):
+            return False
+
+    return stimulate
+
+
+def command_stimulus(template, user):
+    async def stimulate(event):
+        cmd = template.format(event=shlex.quote(event), user=shlex.quote(user))
+        proc = await asyncio.create_subprocess_shell(cmd)
+        return await proc.wait() == 0
+
+    return stimulate
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def wait_port(port, timeout=5.0):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection(("127.0.0.1", port), timeout=0.2).close()
+            return True
+        except OSError:
+            time.sleep(0.05)
+    return False
+
+
+def start_reference_relay(binary, ctx, work):
+    port, control = free_port(), free_port()
+    tokens = os.path.join(work, "tokens.txt")
+    with open(tokens, "w") as f:
+        f.write("%s %s\n" % (ctx["token"], ctx["user"]))
+    proc = subprocess.Popen([binary, "--port", str(port), "--control-port", str(control), "--tokens", tokens,
+                             "--no-stdin"], stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL,
+                            stderr=subprocess.DEVNULL)
+    if not wait_port(port) or not wait_port(control):
+        proc.kill()
+        raise RuntimeError("reference relay did not start: %s" % binary)
+    return proc, "ws://127.0.0.1:%d/ws" % port, "127.0.0.1:%d" % control
+
+
+# ---------------------------------------------------------------- main
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("suites", nargs="*", metavar="spec|device|server|loadgen", help="default: all four")
+    ap.add_argument("--spec", default=SPEC_PATH)
+    ap.add_argument("--device", default=os.path.join(ROOT, ".pio", "build", "native", "program"),
+                    help="native firmware binary")
+    ap.add_argument("--led-pin", type=int, default=2, help="LED GPIO of the native build")
+    ap.add_argument("--loadgen", default=os.path.join(ROOT, ".pio", "build", "loadgen", "program"),
+                    help="load generator binary")
+    ap.add_argument("--relay", help="ws:// URL of the relay under test (default: start --relay-bin)")
+    ap.add_argument("--relay-bin", default=os.path.join(ROOT, ".pio", "build", "relay", "program"))
+    ap.add_argument("--token", default="conformance-token")
+    ap.add_argument("--bad-token", default="conformance-wrong-token")
+    ap.add_argument("--user", default="conformance", help="user the token maps to (stimuli)")
+    ap.add_argument("--control", help="reference-relay control port HOST:PORT for stimuli")
+    ap.add_argument("--stimulus-cmd", help="shell template run per stimulus, with {event} and {user}")
+    ap.add_argument("--scenario", action="append", help="only these scenario ids")
+    ap.add_argument("--protocol-version", type=int,
+                    help="skip scenarios newer than this spec version (older relays/devices)")
+    ap.add_argument("--timing-scale", type=float, default=1.0, help="multiply every budget")
+    ap.add_argument("--json", action="store_true", help="print results as JSON")
+    args = ap.parse_args()
+
+    suites = args.suites or ["spec", "device", "server", "loadgen"]
+    for s in suites:
+        if s not in ("spec", "device", "server", "loadgen"):
+            ap.error("unknown suite %r" % s)
+    spec = load_spec(args.spec)
+    ctx = {"token": args.token, "bad_token": args.bad_token, "user": args.user}
+    results = []
+
+    if "spec" in suites:
+        problems = check_header(spec)
+        results.append({"role": "spec", "id": "protocol_h_matches", "result": "FAIL" if problems else "PASS",
+                        "detail": "; ".join(problems), "timings": []})
+
+    relay_proc = None
+    work = tempfile.mkdtemp(prefix="conformance-relay-")
+    try:
+        for role in ("device", "server", "loadgen"):
+            if role not in suites:
+                continue
+            stimulate = None
+            url = args.relay
+            if role == "server":
+                control = args.control
+                if not url:
+                    if not os.path.exists(args.relay_bin):
+                        results.append({"role": role, "id": "*", "result": "SKIP", "timings": [],
+                                        "detail": "no --relay and %s not built (pio run -e relay)" % args.relay_bin})
+                        continue
+                    relay_proc, url, control = start_reference_relay(args.relay_bin, ctx, work)
+                if control:
+                    stimulate = control_stimulus(control, args.user)
+                elif args.stimulus_cmd:
+                    stimulate = command_stimulus(args.stimulus_cmd, args.user)
+            elif role == "device" and not os.path.exists(args.device):
+                results.append({"role": role, "id": "*", "result": "SKIP", "timings": [],
+                                "detail": "%s not built (pio run -e native)" % args.device})
+                continue
+            elif role == "loadgen":
+                if not os.path.exists(args.loadgen):
+                    results.append({"role": role, "id": "*", "result": "SKIP", "timings": [],
+                                    "detail": "%s not built (pio run -e loadgen)" % args.loadgen})
+                    continue
+                stale = sorted(set(LOADGEN_NOT_MODELLED) - {s["id"] for s in spec["scenarios"]["device"]})
+                if stale:
+                    results.append({"role": role, "id": "not_modelled", "result": "FAIL", "timings": [],
+                                    "detail": "no such device scenario: %s" % ", ".join(stale)})
+
+            for scenario in spec["scenarios"]["server" if role == "server" else "device"]:
+                if args.scenario and scenario["id"] not in args.scenario:
+                    continue
+                if role == "loadgen" and scenario["id"] in LOADGEN_NOT_MODELLED:
+                    results.append({"role": role, "id": scenario["id"], "rule": scenario.get("rule", ""),
+                                    "result": "SKIP", "timings": [],
+                                    "detail": LOADGEN_NOT_MODELLED[scenario["id"]]})
+                    continue
+                if args.protocol_version and scenario.get("since", 1) > args.protocol_version:
+                    results.append({"role": role, "id": scenario["id"], "rule": scenario.get("rule", ""),
+                                    "result": "SKIP", "timings": [],
+                                    "detail": "since protocol v%d" % scenario["since"]})
+                    continue
+                if role == "device":
+                    run = DeviceRun(spec, ctx, args.timing_scale, args.device, args.led_pin)
+                elif role == "loadgen":
+                    run = LoadgenRun(spec, ctx, args.timing_scale, args.loadgen, args.led_pin)
+                else:
+                    run = ServerRun(spec, ctx, args.timing_scale, url, stimulate)
+                result, detail, timings = asyncio.run(run_scenario(run, scenario))
+                results.append({"role": role, "id": scenario["id"], "rule": scenario.get("rule", ""),
+                                "result": result, "detail": detail,
+                                "timings": [{"budget": n, "ms": round(ms, 1), "limit_ms": lim} for n, ms, lim in timings]})
+    finally:
+        if relay_proc:
+            relay_proc.kill()
+            relay_proc.wait()
+        shutil.rmtree(work, ignore_errors=True)
+
+    if args.json:
+        print(json.dumps({"spec_version": spec["version"], "results": results}, indent=2))
+    else:
+        print("%-7s %-30s %-5s %10s  %s" % ("role", "scenario", "", "worst", "detail"))
+        for r in results:
+            worst = max(r["timings"], key=lambda t: t["ms"] / t["limit_ms"] if t["limit_ms"] else 0, default=None)
+            worst_s = "%.1f/%.0f" % (worst["ms"], worst["limit_ms"]) if worst else ""
+            print("%-7s %-30s %-5s %10s  %s" % (r["role"], r["id"], r["result"], worst_s, r["detail"]))
+        counts = {k: sum(1 for r in results if r["result"] == k) for k in ("PASS", "FAIL", "SKIP")}
+        print("\n%d passed, %d failed, %d skipped (worst = slowest step vs its budget, ms)" % (
+            counts["PASS"], counts["FAIL"], counts["SKIP"]))
+    return 1 if any(r["result"] == "FAIL" for r in results) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,55 @@
+#pragma once
+
+// Shared setup for the fuzz targets: the firmware translation unit on a quiet,
+// virtual-clock host, so portal timeouts and reboot delays cost nothing and
+// ESP.restart() unwinds back to the target instead of exec'ing.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "../../src/main.cpp"
+
+#include "host/host.h"
+
+namespace fuzz
+{
+struct Restarted
+{
+};
+
+inline void init()
+{
+  static bool done = false;
+  if (done)
+    return;
+  done = true;
+
+  static char dir[] = "/tmp/fuzz-fs-XXXXXX";
+  if (!mkdtemp(dir))
+    abort();
+  host::setClockMode(host::ClockMode::Virtual);
+  host::setFsRoot(dir);
+  host::serialDetach();
+  host::setRestartHandler([] { throw Restarted(); });
+  pinMode(LED_PIN, OUTPUT);
+}
+
+// A configured device, as the firmware sees it after loadConfig().
+inline void resetConfig()
+{
+  cfg = AppConfig();
+  cfg.wsUrl = "ws://relay.example.com:8080/ws";
+  cfg.authToken = "fuzz-token";
+  cfg.wifiSsid = "fuzz-ssid";
+  cfg.wifiPass = "fuzz-pass";
+  authFailureCount = 0;
+}
+
+inline String toString(const uint8_t *data, size_t size)
+{
+  String s;
+  s.concat((const char *)data, (unsigned int)size);
+  return s;
+}
+} // namespace fuzz
@@ -0,0 +1,21 @@
+// loadConfig(): /config.json as left on flash by any earlier firmware.
+
+#include <stdio.h>
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  fuzz::init();
+
+  std::string path = host::fsRoot() + CONFIG_PATH;
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f)
+    abort();
+  fwrite(data, 1, size, f);
+  fclose(f);
+
+  AppConfig c;
+  loadConfig(c);
+  return 0;
+}
@@ -0,0 +1,20 @@
+// maybeHandleOtaMessage(): OTA:<url> and {"type":"ota",...} from the relay.
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  fuzz::init();
+  fuzz::resetConfig();
+
+  String msg = fuzz::toString(data, size);
+  msg.trim();
+  try
+  {
+    maybeHandleOtaMessage(msg);
+  }
+  catch (const fuzz::Restarted &)
+  {
+  }
+  return 0;
+}
@@ -0,0 +1,16 @@
+// parseWsUrl(): the wsUrl from config, portal and serial CONFIG:.
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  fuzz::init();
+  WsParts parts;
+  if (parseWsUrl(fuzz::toString(data, size), parts))
+  {
+    // what setupWebSocketFromConfig() relies on
+    if (parts.host.length() == 0 || parts.port == 0 || !parts.path.startsWith("/"))
+      abort();
+  }
+  return 0;
+}
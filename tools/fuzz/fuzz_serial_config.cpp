@@ -0,0 +1,25 @@
+// handleSerialCommand() with the CONFIG:<json> line the web installer sends.
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  fuzz::init();
+  fuzz::resetConfig();
+
+  // the command loop reads up to '\n' and trims
+  size_t lineLen = 0;
+  while (lineLen < size && data[lineLen] != '\n')
+    lineLen++;
+  String cmd = "CONFIG:" + fuzz::toString(data, lineLen);
+  cmd.trim();
+
+  try
+  {
+    handleSerialCommand(cmd);
+  }
+  catch (const fuzz::Restarted &)
+  {
+  }
+  return 0;
+}
@@ -0,0 +1,34 @@
+// The WS event handler installed by setupWebSocketFromConfig(). The first
+// byte picks the event type; the rest is handed over exactly as the library
+// does, as a length-delimited buffer with nothing after it.
+
+#include <vector>
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  static const WStype_t types[] = {WStype_TEXT, WStype_TEXT, WStype_TEXT, WStype_CONNECTED,
+                                   WStype_DISCONNECTED, WStype_BIN, WStype_PING, WStype_ERROR};
+  fuzz::init();
+  if (size == 0)
+    return 0;
+
+  static bool wsReady = false;
+  fuzz::resetConfig();
+  try
+  {
+    if (!wsReady)
+    {
+      setupWebSocketFromConfig();
+      wsReady = true;
+    }
+    // exact-size heap copy so ASan sees any read past length
+    std::vector<uint8_t> payload(data + 1, data + size);
+    webSocket.injectEvent(types[data[0] % 8], payload.empty() ? nullptr : payload.data(), payload.size());
+  }
+  catch (const fuzz::Restarted &)
+  {
+  }
+  return 0;
+}
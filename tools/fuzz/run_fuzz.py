@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""Run the fuzz targets for a fixed time and track their exec/s.
+
+Each target is started with its seed corpus (tools/fuzz/corpus/<target>,
+read-only) and a working corpus under .pio/fuzz/<target>, so new coverage
+accumulates across runs without touching the committed seeds. Crashes are
+saved by libFuzzer as .pio/fuzz/<target>/crash-* and fail the run.
+
+exec/s is parsed from -print_final_stats; a target more than 25% slower than
+its baseline entry counts as a regression, as in the bench env, and so does a
+libFuzzer target with no entry at all: write one with --write-baseline from a
+clang build against the real ArduinoJson. Binaries built with gcc (no
+libFuzzer, see scripts/fuzz_toolchain.py) only replay the corpus; their
+numbers are reported but never compared or written.
+
+  pio run -e fuzz_parse_ws_url -e fuzz_serial_config -e fuzz_ota_message \\
+          -e fuzz_load_config -e fuzz_ws_event
+  python3 tools/fuzz/run_fuzz.py --seconds 60 --baseline tools/fuzz/exec_baseline.json
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+
+TARGETS = ["parse_ws_url", "serial_config", "ota_message", "load_config", "ws_event"]
+EXEC_REGRESSION_RATIO = 0.75
+
+STAT_RE = re.compile(r"stat::(\w+):\s+(\d+)")
+
+
+def run_target(target, args):
+    program = os.path.join(args.build_dir, "fuzz_" + target, "program")
+    if not os.path.exists(program):
+        return {"target": target, "error": "not built (pio run -e fuzz_%s)" % target}
+    work = os.path.join(ROOT, ".pio", "fuzz", target)
+    os.makedirs(work, exist_ok=True)
+    cmd = [program, "-max_total_time=%d" % args.seconds, "-print_final_stats=1",
+           "-artifact_prefix=" + work + "/", work, os.path.join(HERE, "corpus", target)]
+    proc = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                          text=True, errors="replace")
+    stats = {k: int(v) for k, v in STAT_RE.findall(proc.stderr)}
+    result = {
+        "target": target,
+        "mode": "replay" if "standalone:" in proc.stderr else "libfuzzer",
+        "exec_per_sec": stats.get("average_exec_per_sec", 0),
+        "executed": stats.get("number_of_executed_units", 0),
+        "peak_rss_mb": stats.get("peak_rss_mb", 0),
+        "corpus": len(os.listdir(work)),
+    }
+    if proc.returncode != 0:
+        result["error"] = "exit %d, see %s" % (proc.returncode, work)
+        sys.stderr.write(proc.stderr[-4000:])
+    return result
+
+
+def compare(results, path):
+    with open(path) as f:
+        base = {r["target"]: r for r in json.load(f).get("results", [])}
+    regressions = 0
+    print("\n%-16s %12s %12s" % ("vs baseline", "exec/s", "base exec/s"))
+    for r in results:
+        b = base.get(r["target"])
+        if r.get("mode") != "libfuzzer" or "error" in r:
+            continue
+        if not b:
+            # an empty baseline must not pass as a clean run
+            regressions += 1
+            print("%-16s %12d %12s  NO BASELINE (--write-baseline)" % (r["target"], r["exec_per_sec"], "-"))
+            continue
+        slow = r["exec_per_sec"] < b["exec_per_sec"] * EXEC_REGRESSION_RATIO
+        regressions += slow
+        print("%-16s %12d %12d%s" % (r["target"], r["exec_per_sec"], b["exec_per_sec"],
+                                      "  REGRESSION" if slow else ""))
+    return regressions
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--seconds", type=int, default=60, help="fuzzing time per target")
+    ap.add_argument("--build-dir", default=os.path.join(ROOT, ".pio", "build"))
+    ap.add_argument("--baseline", help="compare against a stored run, exit 1 on regression")
+    ap.add_argument("--write-baseline", help="store this run as the new baseline")
+    ap.add_argument("--json", action="store_true", help="print results as JSON")
+    ap.add_argument("targets", nargs="*", default=TARGETS)
+    args = ap.parse_args()
+
+    results = [run_target(t, args) for t in args.targets]
+
+    if args.json:
+        print(json.dumps({"seconds": args.seconds, "results": results}, indent=2))
+    else:
+        print("%-16s %-10s %12s %12s %8s %8s" % ("target", "mode", "exec/s", "executed", "corpus", "rss MB"))
+        for r in results:
+            if "error" in r and "mode" not in r:
+                print("%-16s %s" % (r["target"], r["error"]))
+                continue
+            print("%-16s %-10s %12d %12d %8d %8d%s" % (r["target"], r["mode"], r["exec_per_sec"],
+                                                       r["executed"], r["corpus"], r["peak_rss_mb"],
+                                                       "  " + r["error"] if "error" in r else ""))
+
+    if args.write_baseline:
+        with open(args.write_baseline, "w") as f:
+            json.dump({"seconds": args.seconds,
+                       "results": [r for r in results if r.get("mode") == "libfuzzer" and "error" not in r]},
+                      f, indent=2)
+            f.write("\n")
+
+    failed = any("error" in r for r in results)
+    if args.baseline and compare(results, args.baseline) > 0:
+        failed = True
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Build the fuzz seed corpus from real device traffic.
+
+Sources are CAPTURE_DUMP output (tools/replay/captures/*.cap by default) and
+serial logs; everything that looks like input to one of the fuzz targets is
+written to tools/fuzz/corpus/<target>/<sha1>, libFuzzer's own naming, so
+re-running is idempotent:
+
+  CAP:<ms> I TEXT <hex>          -> ota_message, ws_event
+  CAP:<ms> I CONNECTED|... <hex> -> ws_event
+  CONFIG:{...}                   -> serial_config, load_config
+  ws://... / wss://...           -> parse_ws_url
+  *.json (a config.json pulled off flash) -> load_config
+
+  python3 tools/fuzz/seed_corpus.py [--out DIR] [FILE ...]
+"""
+
+import argparse
+import glob
+import hashlib
+import json
+import os
+import re
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+
+# first byte of a ws_event input; see types[] in fuzz_ws_event.cpp
+WS_EVENT_TYPE = {"TEXT": 0, "CONNECTED": 3, "DISCONNECTED": 4, "BIN": 5, "PING": 6, "ERROR": 7}
+
+CAP_RE = re.compile(r"CAP:\d+ I (\w+) ?([0-9a-f]*)")
+CONFIG_RE = re.compile(r"CONFIG:(\{.*\})")
+URL_RE = re.compile(r"wss?://[^\s\"']+")
+
+
+def add(seeds, target, data):
+    seeds.setdefault(target, set()).add(data)
+
+
+def scan(path, seeds):
+    if path.endswith(".json"):
+        with open(path, "rb") as f:
+            add(seeds, "load_config", f.read())
+        return
+    with open(path, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            m = CAP_RE.search(line)
+            if m:
+                kind, payload = m.group(1), bytes.fromhex(m.group(2))
+                if kind == "TEXT":
+                    add(seeds, "ota_message", payload)
+                if kind in WS_EVENT_TYPE:
+                    add(seeds, "ws_event", bytes([WS_EVENT_TYPE[kind]]) + payload)
+                continue
+            m = CONFIG_RE.search(line)
+            if m:
+                body = m.group(1).encode()
+                add(seeds, "serial_config", body)
+                add(seeds, "load_config", body)
+                try:
+                    url = json.loads(body).get("wsUrl")
+                except ValueError:
+                    url = None
+                if url:
+                    add(seeds, "parse_ws_url", url.encode())
+            for url in URL_RE.findall(line):
+                add(seeds, "parse_ws_url", url.encode())
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--out", default=os.path.join(HERE, "corpus"))
+    ap.add_argument("files", nargs="*")
+    args = ap.parse_args()
+
+    files = args.files or sorted(glob.glob(os.path.join(ROOT, "tools/replay/captures/*.cap")) +
+                                 glob.glob(os.path.join(HERE, "sessions/*")))
+    seeds = {}
+    for path in files:
+        scan(path, seeds)
+
+    for target, items in sorted(seeds.items()):
+        d = os.path.join(args.out, target)
+        os.makedirs(d, exist_ok=True)
+        added = 0
+        for data in items:
+            p = os.path.join(d, hashlib.sha1(data).hexdigest())
+            if not os.path.exists(p):
+                with open(p, "wb") as f:
+                    f.write(data)
+                added += 1
+        print(f"{target:14} {len(items):4} seeds ({added} new)")
+
+
+if __name__ == "__main__":
+    main()
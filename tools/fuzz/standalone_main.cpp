@@ -0,0 +1,78 @@
+// Corpus replay driver for toolchains without libFuzzer (gcc): runs every file
+// named on the command line, directories recursively, through
+// LLVMFuzzerTestOneInput once and reports exec/s. libFuzzer-style "-flag"
+// arguments are ignored. Left out when scripts/fuzz_toolchain.py builds with
+// clang's -fsanitize=fuzzer, which brings its own main().
+
+#ifndef FUZZ_LIBFUZZER
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static void collect(const std::string &path, std::vector<std::string> &files)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return;
+  if (!S_ISDIR(st.st_mode))
+  {
+    files.push_back(path);
+    return;
+  }
+  DIR *d = opendir(path.c_str());
+  if (!d)
+    return;
+  while (dirent *e = readdir(d))
+  {
+    if (e->d_name[0] != '.')
+      collect(path + "/" + e->d_name, files);
+  }
+  closedir(d);
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++)
+  {
+    if (argv[i][0] != '-')
+      collect(argv[i], files);
+  }
+
+  timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (const std::string &path : files)
+  {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+      continue;
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+      data.insert(data.end(), buf, buf + n);
+    fclose(f);
+    // exact-size heap copy, like libFuzzer, so overreads are caught
+    uint8_t *copy = new uint8_t[data.size()];
+    std::copy(data.begin(), data.end(), copy);
+    LLVMFuzzerTestOneInput(copy, data.size());
+    delete[] copy;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "standalone: replayed %zu inputs in %.3fs\n", files.size(), s);
+  fprintf(stderr, "stat::number_of_executed_units: %zu\n", files.size());
+  fprintf(stderr, "stat::average_exec_per_sec: %.0f\n", s > 0 ? files.size() / s : 0.0);
+  return 0;
+}
+
+#endif
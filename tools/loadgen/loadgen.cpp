@@ -0,0 +1,1346 @@
+// Fleet load generator: N simulated devices per process against a relay.
+//
+//   pio run -e loadgen && .pio/build/loadgen/program --url ws://127.0.0.1:8080/ --devices 5000
+//
+// The devices are a hand-maintained model of the firmware's WebSocket
+// behaviour, not the firmware itself: none of src/main.cpp is compiled in, so
+// a change there has to be made here too. `conformance.py loadgen` runs the
+// spec's device scenarios against this model (one device, --trace) and lists
+// the ones it does not cover; it fails when the two drift apart.
+// What is modelled (see setupWebSocketFromConfig() and loop() in src/main.cpp):
+//   - connect + upgrade carrying "Authorization: Bearer <token>", then
+//     AUTH:<token> and CAPS without waiting; OK / NOAUTH / OTA handling
+//   - frames trimmed and routed as routeWsText() does: 1 / 0 and JSON status
+//     (older seq dropped), JSON ping answered with a pong, ota with a chip
+//     other than esp32s2 ignored; config frames are not modelled
+//   - SESSION switches status frames to binary and sets the ping and
+//     telemetry intervals, as maybeHandleSession() does
+//   - the WebSockets library runs with reconnect interval 0, so a failed or
+//     dropped connection is retried on the next loop() pass (every LOOP_MS)
+//   - loop() re-runs setupWebSocketFromConfig() every WS_RECONNECT_MS while
+//     not connected, aborting an attempt that is still in flight
+//   - heartbeat ping every WS_HEARTBEAT_PING_MS (or SESSION "hb"), disconnect after
+//     WS_HEARTBEAT_MISSES pongs missing for WS_HEARTBEAT_PONG_TIMEOUT_MS
+//   - NOAUTHs count across reconnects and only OK resets the counter;
+//     MAX_AUTH_FAILURES sends the device into the config portal (silent 180 s)
+//   - OTA drops the socket; the device stays away for --ota-offline-ms
+//     (0 = download failed, resume immediately)
+//   - redirect / drain: reconnect after delayMs plus a random share of
+//     jitterMs, as maybeMoveRelay() does; every relay is the --url one here
+//
+// Options:
+//   --url ws://host:port/path   relay to load (default ws://127.0.0.1:8080/)
+//   --devices <n>               simulated devices (default 1000)
+//   --ramp <n/s>                device boots per second (default 1000)
+//   --duration <s>              run time (default 60)
+//   --tokens <file>             relay tokens file ("<token> [user]"); devices take
+//                               tokens round-robin. Without it tokens are
+//                               <prefix><i / devices-per-user> for a relay in --open mode
+//   --token-prefix <s>          (default "load-")
+//   --devices-per-user <n>      devices sharing one token/user (default 1)
+//   --bad-auth <pct>            percentage of devices with an invalid token
+//   --control host:port         relay control port; enables fan-out and OTA probes
+//   --flip-hz <n>               voice-state flips per second via the control port
+//   --ota-at <s>                push OTA to all devices at this time
+//   --ota-offline-ms <ms>       time a device spends on OTA before reconnecting (default 0)
+//   --restart-at <s>            run --restart-cmd at this time (reconnect storm)
+//   --restart-cmd <cmd>         shell command that restarts the relay
+//   --drain-at <s>              DRAIN the relay at this time (jittered rebalance), then
+//                               UNDRAIN so it stands in for the relay the devices move to
+//   --drain-jitter-ms <ms>      jitter handed out with the drain (default 30000)
+//   --legacy-auth               no token in the upgrade (firmware before header auth)
+//   --no-caps                   no CAPS after AUTH (firmware before capability negotiation)
+//   --json                      machine-readable final report on stdout
+//   --quiet                     no per-second progress lines
+//   --trace                     "HOST <ms> <event>" lines on stderr as the native build's
+//                               HOST_TRACE prints them: STATUS <0|1>, OTA url=..., PORTAL open
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "host/ws_frame.h"
+#include "../../src/protocol.h"
+
+namespace
+{
+// loop() ends with delay(5)
+const uint32_t LOOP_MS = 5;
+// WiFiManager config portal timeout used by startConfigPortalAndSave()
+const uint32_t PORTAL_MS = 180000;
+const uint32_t NO_USER = 0xFFFFFFFFu;
+
+const char WS_KEY[] = "dGhlIHNhbXBsZSBub25jZQ==";
+
+// The board the devices claim in CAPS; "esp32" is its pre-spec-13 OTA alias
+const char CHIP[] = "esp32s2";
+const char CHIP_ALIAS[] = "esp32";
+
+enum class DevState : uint8_t
+{
+  Waiting,    // not booted yet / retry pending
+  Connecting, // TCP connect in flight
+  Upgrading,  // HTTP upgrade sent
+  Authing,    // AUTH sent, waiting for OK
+  Online,
+  Offline, // portal or OTA
+};
+
+struct Device
+{
+  int fd = -1;
+  DevState state = DevState::Waiting;
+  uint8_t authFailures = 0;
+  uint8_t missedPongs = 0;
+  bool pingOutstanding = false;
+  bool badToken = false;
+  bool binary = false;           // SESSION chose binary status frames
+  bool statusSeqValid = false;   // applyStatus(): a status with a seq was seen
+  uint32_t statusSeq = 0;
+  uint32_t token = 0;            // index into tokens
+  uint32_t user = NO_USER;       // index into users
+  uint32_t seenSeq = 0;          // last voice-state flip observed
+  uint32_t nextActionMs = 0;     // boot, retry or end of Offline
+  uint32_t lastSetupMs = 0;      // last setupWebSocketFromConfig()
+  uint32_t lastPingMs = 0;
+  uint32_t pingMs = WS_HEARTBEAT_PING_MS;
+  uint32_t telemetryMs = 0;
+  uint32_t lastTelemetryMs = 0;
+  uint32_t moveAtMs = 0;         // pending redirect/drain, 0 = none
+  uint64_t attemptStartUs = 0;
+  uint64_t authSentUs = 0;
+  std::string pending; // partial frames only
+};
+
+struct User
+{
+  std::string name;
+  bool on = false;
+  uint32_t seq = 0;
+  uint64_t flipUs = 0;
+};
+
+struct Options
+{
+  std::string host = "127.0.0.1";
+  uint16_t port = 8080;
+  std::string path = "/";
+  uint32_t devices = 1000;
+  double rampPerS = 1000;
+  uint32_t durationS = 60;
+  std::string tokensPath;
+  std::string tokenPrefix = "load-";
+  uint32_t devicesPerUser = 1;
+  double badAuthPct = 0;
+  std::string controlHost;
+  uint16_t controlPort = 0;
+  double flipHz = 0;
+  int otaAtS = -1;
+  uint32_t otaOfflineMs = 0;
+  int restartAtS = -1;
+  std::string restartCmd;
+  int drainAtS = -1;
+  uint32_t drainJitterMs = 30000;
+  bool legacyAuth = false;
+  bool noCaps = false;
+  bool json = false;
+  bool quiet = false;
+  bool trace = false;
+};
+
+struct Counters
+{
+  uint64_t attempts = 0;
+  uint64_t refused = 0;
+  uint64_t connectFailed = 0; // other errors, aborted attempts
+  uint64_t opens = 0;         // completed upgrades
+  uint64_t authOk = 0;
+  uint64_t noauth = 0;
+  uint64_t portals = 0;
+  uint64_t disconnects = 0;   // drops of an upgraded connection
+  uint64_t heartbeatDrops = 0;
+  uint64_t otaReceived = 0;
+  uint64_t statusFrames = 0;
+  uint64_t staleStatus = 0; // dropped as older than the last seq
+  uint64_t binarySessions = 0;
+  uint64_t telemetrySent = 0;
+  uint64_t moveOrders = 0; // redirect/drain frames received
+  uint64_t moves = 0;      // reconnects they caused
+};
+
+struct Storm
+{
+  bool active = false;
+  double startS = 0;
+  double endS = 0;
+  uint32_t onlineBefore = 0;
+  uint64_t attemptsAtStart = 0;
+  uint64_t attempts = 0;
+  uint64_t peakAttemptsPerS = 0;
+  bool done = false;
+};
+
+volatile sig_atomic_t gStop = 0;
+
+uint64_t monoUs()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+double percentile(std::vector<uint32_t> &v, double p)
+{
+  if (v.empty())
+    return 0;
+  size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i] / 1000.0;
+}
+
+// Position of the value of "key" in a flat JSON object, npos when absent.
+// The frames this reads are the relay's own, so no nesting or escapes.
+size_t jsonValue(const std::string &json, const char *key)
+{
+  size_t at = json.find(std::string("\"") + key + "\"");
+  if (at == std::string::npos)
+    return at;
+  at = json.find_first_not_of(" :", at + strlen(key) + 2);
+  return at;
+}
+
+uint32_t jsonUint(const std::string &json, const char *key, uint32_t fallback)
+{
+  size_t at = jsonValue(json, key);
+  return at == std::string::npos ? fallback : (uint32_t)strtoul(json.c_str() + at, nullptr, 10);
+}
+
+std::string jsonString(const std::string &json, const char *key)
+{
+  size_t at = jsonValue(json, key);
+  if (at == std::string::npos || json[at] != '"')
+    return "";
+  size_t end = json.find('"', at + 1);
+  return end == std::string::npos ? "" : json.substr(at + 1, end - at - 1);
+}
+
+// jsonTopLevelType() in src/main.cpp: "type" of the outer object only
+std::string jsonTopLevelType(const std::string &json)
+{
+  const char *p = json.data(), *end = p + json.size();
+  uint8_t depth = 0;
+  bool keyNext = false;
+  while (p < end)
+  {
+    char c = *p++;
+    if (c == '"')
+    {
+      const char *start = p;
+      while (p < end && *p != '"')
+        p += (*p == '\\') ? 2 : 1;
+      if (p >= end)
+        return "";
+      size_t n = p++ - start;
+      if (depth != 1 || !keyNext)
+        continue;
+      keyNext = false;
+      while (p < end && isspace((unsigned char)*p))
+        p++;
+      if (p >= end || *p++ != ':')
+        return "";
+      if (n != 4 || memcmp(start, "type", 4) != 0)
+        continue;
+      while (p < end && isspace((unsigned char)*p))
+        p++;
+      if (p >= end || *p++ != '"')
+        return "";
+      start = p;
+      while (p < end && *p != '"' && *p != '\\')
+        p++;
+      return p < end && *p == '"' ? std::string(start, p) : "";
+    }
+    if (c == '{' || c == '[')
+      keyNext = (++depth == 1 && c == '{');
+    else if (c == '}' || c == ']')
+    {
+      if (depth-- == 0)
+        return "";
+    }
+    else if (c == ',' && depth == 1)
+      keyNext = true;
+  }
+  return "";
+}
+
+struct Summary
+{
+  double p50, p90, p99, max;
+  size_t n;
+};
+
+Summary summarize(std::vector<uint32_t> &v)
+{
+  Summary s{};
+  s.n = v.size();
+  if (v.empty())
+    return s;
+  s.p50 = percentile(v, 0.50);
+  s.p90 = percentile(v, 0.90);
+  s.p99 = percentile(v, 0.99);
+  s.max = *std::max_element(v.begin(), v.end()) / 1000.0;
+  return s;
+}
+
+class LoadGen
+{
+public:
+  explicit LoadGen(const Options &opts) : opts_(opts), rng_(42) {}
+
+  bool start();
+  void run();
+  void report();
+
+private:
+  uint32_t nowMs() const { return (uint32_t)((nowUs_ - startUs_) / 1000); }
+
+  void setup(Device &d);
+  void beginConnect(Device &d);
+  void dropSocket(Device &d);
+  void onConnectFailed(Device &d, bool refused);
+  void onDisconnected(Device &d);
+  void onEvent(Device &d, uint32_t events);
+  void onConnected(Device &d);
+  void sendUpgrade(Device &d);
+  std::string deviceToken(const Device &d) const;
+  void onReadable(Device &d);
+  bool processBuffer(Device &d, const uint8_t *data, size_t len, size_t &used);
+  void onText(Device &d, const char *s, size_t len);
+  void onSession(Device &d, const std::string &json);
+  void onOta(Device &d, const std::string &url);
+  void onStatus(Device &d, uint32_t mask, bool hasSeq, uint32_t seq);
+  void trace(const char *fmt, ...);
+  void sendTelemetry(Device &d);
+  void sendFrame(Device &d, uint8_t opcode, const char *data, size_t len);
+  void tick();
+  void drive();
+  bool connectControl();
+  bool control(const std::string &line);
+  void tickSecond();
+
+  Options opts_;
+  std::mt19937 rng_;
+  sockaddr_in addr_{};
+  int epfd_ = -1;
+  int controlFd_ = -1;
+  uint64_t controlRetryUs_ = 0;
+  uint64_t startUs_ = 0;
+  uint64_t nowUs_ = 0;
+  std::vector<Device> devices_;
+  std::vector<Device *> byFd_;
+  std::vector<std::string> tokens_;
+  std::vector<uint32_t> tokenUser_;
+  std::vector<User> users_;
+  std::vector<uint32_t> connectLatUs_; // attempt start -> upgrade complete
+  std::vector<uint32_t> authLatUs_;    // token sent (upgrade or AUTH) -> OK
+  std::vector<uint32_t> readyLatUs_;   // attempt start -> OK, the figure header auth improves
+  std::vector<uint32_t> fanoutLatUs_;  // SET on control port -> frame at device
+  std::vector<uint32_t> otaLatUs_;
+  uint64_t otaSentUs_ = 0;
+  uint64_t drainSentUs_ = 0;
+  double lastMoveS_ = 0;
+  uint64_t drainPeakAttemptsPerS_ = 0;
+  Counters c_;
+  Counters lastSecond_;
+  uint32_t online_ = 0;
+  uint32_t peakOnline_ = 0;
+  uint64_t peakOpensPerS_ = 0;
+  uint32_t booted_ = 0;
+  uint32_t goodDevices_ = 0;
+  double firstAllOnlineS_ = -1;
+  Storm storm_;
+  std::string upgradeRequest_;
+};
+
+bool LoadGen::start()
+{
+  addrinfo hints{}, *res = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(opts_.host.c_str(), std::to_string(opts_.port).c_str(), &hints, &res) != 0 || !res)
+  {
+    fprintf(stderr, "loadgen: cannot resolve %s\n", opts_.host.c_str());
+    return false;
+  }
+  memcpy(&addr_, res->ai_addr, sizeof(addr_));
+  freeaddrinfo(res);
+
+  upgradeRequest_ = "GET " + opts_.path + " HTTP/1.1\r\nHost: " + opts_.host + ":" + std::to_string(opts_.port) +
+                    "\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: " +
+                    WS_KEY + "\r\nUser-Agent: arduino-WebSocket-Client\r\nOrigin: file://\r\n";
+
+  // tokens and their users
+  if (!opts_.tokensPath.empty())
+  {
+    std::ifstream in(opts_.tokensPath);
+    if (!in)
+    {
+      fprintf(stderr, "loadgen: cannot read %s\n", opts_.tokensPath.c_str());
+      return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+      std::istringstream ls(line);
+      std::string token, user;
+      if (!(ls >> token) || token[0] == '#')
+        continue;
+      if (!(ls >> user))
+        user = token;
+      uint32_t idx = NO_USER;
+      for (size_t i = 0; i < users_.size(); i++)
+        if (users_[i].name == user)
+          idx = (uint32_t)i;
+      if (idx == NO_USER)
+      {
+        users_.push_back(User{user});
+        idx = (uint32_t)users_.size() - 1;
+      }
+      tokens_.push_back(token);
+      tokenUser_.push_back(idx);
+    }
+    if (tokens_.empty())
+    {
+      fprintf(stderr, "loadgen: no tokens in %s\n", opts_.tokensPath.c_str());
+      return false;
+    }
+  }
+  else
+  {
+    uint32_t perUser = std::max<uint32_t>(1, opts_.devicesPerUser);
+    for (uint32_t i = 0; i < (opts_.devices + perUser - 1) / perUser; i++)
+    {
+      tokens_.push_back(opts_.tokenPrefix + std::to_string(i));
+      tokenUser_.push_back(i);
+      users_.push_back(User{tokens_.back()});
+    }
+  }
+
+  devices_.resize(opts_.devices);
+  std::uniform_real_distribution<double> pct(0, 100);
+  uint32_t perUser = opts_.tokensPath.empty() ? std::max<uint32_t>(1, opts_.devicesPerUser) : 1;
+  for (uint32_t i = 0; i < opts_.devices; i++)
+  {
+    Device &d = devices_[i];
+    d.token = (i / perUser) % tokens_.size();
+    d.user = tokenUser_[d.token];
+    d.badToken = pct(rng_) < opts_.badAuthPct;
+    if (!d.badToken)
+      goodDevices_++;
+    d.nextActionMs = opts_.rampPerS > 0 ? (uint32_t)(i * 1000.0 / opts_.rampPerS) : 0;
+  }
+
+  epfd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (!opts_.controlHost.empty() && !connectControl())
+  {
+    fprintf(stderr, "loadgen: cannot reach control port %s:%u\n", opts_.controlHost.c_str(), opts_.controlPort);
+    return false;
+  }
+
+  fprintf(stderr, "loadgen: %u devices (%zu bytes each + socket), %zu users -> %s:%u%s\n", opts_.devices, sizeof(Device),
+          users_.size(), opts_.host.c_str(), opts_.port, opts_.path.c_str());
+  startUs_ = nowUs_ = monoUs();
+  return true;
+}
+
+// setupWebSocketFromConfig(): drop whatever is in flight, begin() again.
+void LoadGen::setup(Device &d)
+{
+  if (d.fd >= 0)
+  {
+    if (d.state == DevState::Connecting || d.state == DevState::Upgrading)
+      c_.connectFailed++;
+    dropSocket(d);
+  }
+  d.lastSetupMs = nowMs();
+  beginConnect(d);
+}
+
+void LoadGen::beginConnect(Device &d)
+{
+  c_.attempts++;
+  d.attemptStartUs = nowUs_;
+  d.pending.clear();
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    onConnectFailed(d, false);
+    return;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  int buf = 4096;
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+  if (connect(fd, (sockaddr *)&addr_, sizeof(addr_)) != 0 && errno != EINPROGRESS)
+  {
+    bool refused = errno == ECONNREFUSED;
+    close(fd);
+    onConnectFailed(d, refused);
+    return;
+  }
+  d.fd = fd;
+  d.state = DevState::Connecting;
+  if ((size_t)fd >= byFd_.size())
+    byFd_.resize(fd + 1024, nullptr);
+  byFd_[fd] = &d;
+  epoll_event ev{};
+  ev.events = EPOLLOUT | EPOLLIN | EPOLLRDHUP;
+  ev.data.fd = fd;
+  epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void LoadGen::dropSocket(Device &d)
+{
+  if (d.state == DevState::Online)
+    online_--;
+  epoll_ctl(epfd_, EPOLL_CTL_DEL, d.fd, nullptr);
+  close(d.fd);
+  byFd_[d.fd] = nullptr;
+  d.fd = -1;
+  d.state = DevState::Waiting;
+  d.pending.clear();
+  d.pending.shrink_to_fit();
+}
+
+void LoadGen::onConnectFailed(Device &d, bool refused)
+{
+  if (refused)
+    c_.refused++;
+  else
+    c_.connectFailed++;
+  if (d.fd >= 0)
+    dropSocket(d);
+  // reconnect interval 0: the library tries again on the next loop() pass
+  d.state = DevState::Waiting;
+  d.nextActionMs = nowMs() + LOOP_MS;
+}
+
+void LoadGen::onDisconnected(Device &d)
+{
+  c_.disconnects++;
+  dropSocket(d);
+  d.nextActionMs = nowMs() + LOOP_MS;
+}
+
+void LoadGen::onEvent(Device &d, uint32_t events)
+{
+  if (d.state == DevState::Connecting)
+  {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(d.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0 || (events & (EPOLLERR | EPOLLHUP)))
+    {
+      onConnectFailed(d, err == ECONNREFUSED);
+      return;
+    }
+    if (!(events & EPOLLOUT))
+      return;
+    sendUpgrade(d);
+    d.state = DevState::Upgrading;
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = d.fd;
+    epoll_ctl(epfd_, EPOLL_CTL_MOD, d.fd, &ev);
+    return;
+  }
+  if (events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+    onReadable(d);
+}
+
+// WStype_CONNECTED
+void LoadGen::onConnected(Device &d)
+{
+  c_.opens++;
+  connectLatUs_.push_back((uint32_t)(nowUs_ - d.attemptStartUs));
+  d.state = DevState::Authing;
+  d.missedPongs = 0;
+  d.pingOutstanding = false;
+  d.lastPingMs = nowMs();
+  d.binary = false;
+  d.pingMs = WS_HEARTBEAT_PING_MS;
+  d.telemetryMs = 0;
+  std::string auth = PROTO_AUTH_PREFIX + deviceToken(d);
+  if (opts_.legacyAuth)
+    d.authSentUs = nowUs_;
+  sendFrame(d, host::WS_OP_TEXT, auth.data(), auth.size());
+  if (!opts_.noCaps)
+  {
+    static const std::string caps = std::string(PROTO_CAPS_PREFIX) + "{\"chip\":\"" + CHIP + "\",\"fw\":\"loadgen\",\"out\":1,\"bin\":1,\"tele\":1}";
+    sendFrame(d, host::WS_OP_TEXT, caps.data(), caps.size());
+  }
+}
+
+std::string LoadGen::deviceToken(const Device &d) const
+{
+  return d.badToken ? "invalid-" + tokens_[d.token] : tokens_[d.token];
+}
+
+// Shared request head, then the device's own Authorization line.
+void LoadGen::sendUpgrade(Device &d)
+{
+  std::string token = deviceToken(d);
+  iovec iov[4] = {
+      {(void *)upgradeRequest_.data(), upgradeRequest_.size()},
+      {(void *)PROTO_AUTH_HEADER, opts_.legacyAuth ? 0 : strlen(PROTO_AUTH_HEADER)},
+      {(void *)token.data(), opts_.legacyAuth ? 0 : token.size()},
+      {(void *)"\r\n\r\n", opts_.legacyAuth ? 2u : 4u},
+  };
+  writev(d.fd, iov, 4);
+  d.authSentUs = nowUs_;
+}
+
+void LoadGen::onReadable(Device &d)
+{
+  uint8_t buf[4096];
+  for (;;)
+  {
+    ssize_t n = recv(d.fd, buf, sizeof(buf), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    if (n <= 0)
+    {
+      if (d.state == DevState::Upgrading)
+        onConnectFailed(d, false);
+      else
+        onDisconnected(d);
+      return;
+    }
+
+    int fd = d.fd;
+    if (d.pending.empty())
+    {
+      size_t used = 0;
+      bool alive = processBuffer(d, buf, (size_t)n, used);
+      if (!alive || d.fd != fd)
+        return;
+      if (used < (size_t)n)
+        d.pending.assign((const char *)buf + used, (size_t)n - used);
+    }
+    else
+    {
+      d.pending.append((const char *)buf, (size_t)n);
+      std::string data;
+      data.swap(d.pending);
+      size_t used = 0;
+      bool alive = processBuffer(d, (const uint8_t *)data.data(), data.size(), used);
+      if (!alive || d.fd != fd)
+        return;
+      d.pending.assign(data, used, std::string::npos);
+    }
+  }
+}
+
+// Returns false when the device dropped the connection.
+bool LoadGen::processBuffer(Device &d, const uint8_t *data, size_t len, size_t &used)
+{
+  used = 0;
+  if (d.state == DevState::Upgrading)
+  {
+    const char *end = (const char *)memmem(data, len, "\r\n\r\n", 4);
+    if (!end)
+      return true;
+    size_t headLen = end - (const char *)data + 4;
+    if (len < 12 || memcmp(data + 9, "101", 3) != 0)
+    {
+      onConnectFailed(d, false);
+      return false;
+    }
+    used = headLen;
+    onConnected(d);
+    if (d.fd < 0)
+      return false;
+  }
+
+  while (used < len)
+  {
+    host::WsFrameHeader h;
+    int r = host::wsParseHeader(data + used, len - used, h);
+    if (r == 0)
+      return true;
+    if (r < 0)
+    {
+      onDisconnected(d);
+      return false;
+    }
+    if (len - used < h.headerLength + h.payloadLength)
+      return true;
+    const char *payload = (const char *)data + used + h.headerLength;
+    size_t plen = (size_t)h.payloadLength;
+    used += h.headerLength + plen;
+
+    int fd = d.fd;
+    switch (h.opcode)
+    {
+    case host::WS_OP_TEXT:
+      onText(d, payload, plen);
+      break;
+    case host::WS_OP_BIN:
+      if (d.binary && plen >= 2 && (uint8_t)payload[0] == PROTO_BIN_STATUS)
+      {
+        const uint8_t *p = (const uint8_t *)payload;
+        bool hasSeq = plen >= PROTO_BIN_STATUS_SEQ_LEN;
+        onStatus(d, p[1], hasSeq, hasSeq ? (uint32_t)p[2] | (uint32_t)p[3] << 8 | (uint32_t)p[4] << 16 | (uint32_t)p[5] << 24 : 0);
+      }
+      break;
+    case host::WS_OP_PING:
+      sendFrame(d, host::WS_OP_PONG, payload, plen);
+      break;
+    case host::WS_OP_PONG:
+      d.pingOutstanding = false;
+      d.missedPongs = 0;
+      break;
+    case host::WS_OP_CLOSE:
+      onDisconnected(d);
+      return false;
+    default:
+      break;
+    }
+    if (d.fd != fd)
+      return false;
+  }
+  return true;
+}
+
+// routeWsText() after onWsEvent() trimmed the frame
+void LoadGen::onText(Device &d, const char *data, size_t len)
+{
+  while (len > 0 && isspace((unsigned char)*data))
+    data++, len--;
+  while (len > 0 && isspace((unsigned char)data[len - 1]))
+    len--;
+  std::string s(data, len);
+  if (s == "1" || s == "0")
+  {
+    onStatus(d, s == "1", false, 0);
+    return;
+  }
+  if (s == PROTO_AUTH_OK)
+  {
+    c_.authOk++;
+    authLatUs_.push_back((uint32_t)(nowUs_ - d.authSentUs));
+    readyLatUs_.push_back((uint32_t)(nowUs_ - d.attemptStartUs));
+    d.authFailures = 0;
+    if (d.state != DevState::Online)
+    {
+      d.state = DevState::Online;
+      online_++;
+      peakOnline_ = std::max(peakOnline_, online_);
+    }
+    // the state that follows OK is the current one, not a fan-out
+    d.seenSeq = users_[d.user].seq;
+    return;
+  }
+  if (s == PROTO_NOAUTH)
+  {
+    c_.noauth++;
+    d.authFailures++;
+    if (d.authFailures >= MAX_AUTH_FAILURES)
+    {
+      // startConfigPortalAndSave(): the device is gone until the portal times out
+      c_.portals++;
+      trace("PORTAL open");
+      d.authFailures = 0;
+      dropSocket(d);
+      d.state = DevState::Offline;
+      d.nextActionMs = nowMs() + PORTAL_MS;
+    }
+    return;
+  }
+  if (s.compare(0, strlen(PROTO_OTA_PREFIX), PROTO_OTA_PREFIX) == 0)
+  {
+    onOta(d, s.substr(strlen(PROTO_OTA_PREFIX)));
+    return;
+  }
+  if (s.compare(0, strlen(PROTO_SESSION_PREFIX), PROTO_SESSION_PREFIX) == 0)
+  {
+    onSession(d, s.substr(strlen(PROTO_SESSION_PREFIX)));
+    return;
+  }
+  if (s.empty() || s[0] != '{')
+    return;
+  std::string type = jsonTopLevelType(s);
+  if (type == "status")
+  {
+    // handleStatusMessage(): mask, else on, else not a status
+    size_t at = jsonValue(s, "mask");
+    uint32_t mask;
+    if (at != std::string::npos)
+      mask = (uint32_t)strtoul(s.c_str() + at, nullptr, 10);
+    else if ((at = jsonValue(s, "on")) != std::string::npos)
+      mask = s.compare(at, 4, "true") == 0 ? 1 : 0;
+    else
+      return;
+    onStatus(d, mask, jsonValue(s, "seq") != std::string::npos, jsonUint(s, "seq", 0));
+  }
+  else if (type == "ota")
+  {
+    std::string chip = jsonString(s, "chip");
+    if (chip.empty() || chip == CHIP || chip == CHIP_ALIAS)
+      onOta(d, jsonString(s, "url"));
+  }
+  else if (type == "ping")
+  {
+    // handlePingMessage(): every member back, "type" now "pong"
+    std::string reply = s;
+    reply.replace(reply.find("\"ping\""), 6, "\"pong\"");
+    sendFrame(d, host::WS_OP_TEXT, reply.data(), reply.size());
+  }
+  else if (type == "redirect" || type == "drain")
+  {
+    c_.moveOrders++;
+    uint32_t jitterMs = jsonUint(s, "jitterMs", 0);
+    uint32_t waitMs = jsonUint(s, "delayMs", 0) + (jitterMs ? std::uniform_int_distribution<uint32_t>(0, jitterMs)(rng_) : 0);
+    d.moveAtMs = (nowMs() + waitMs) | 1;
+  }
+}
+
+// maybeHandleOtaMessage() -> performOtaUpdate(): webSocket.disconnect(),
+// download, reboot or resume
+void LoadGen::onOta(Device &d, const std::string &url)
+{
+  size_t first = url.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos)
+    return;
+  trace("OTA url=%s", url.substr(first, url.find_last_not_of(" \t\r\n") + 1 - first).c_str());
+  c_.otaReceived++;
+  if (otaSentUs_)
+    otaLatUs_.push_back((uint32_t)(nowUs_ - otaSentUs_));
+  dropSocket(d);
+  d.state = DevState::Offline;
+  d.nextActionMs = nowMs() + opts_.otaOfflineMs;
+}
+
+// maybeHandleSession(): same defaults and clamping
+void LoadGen::onSession(Device &d, const std::string &json)
+{
+  d.binary = json.find("\"enc\":\"bin\"") != std::string::npos;
+  d.pingMs = std::min(std::max(jsonUint(json, "hb", WS_HEARTBEAT_PING_MS), PROTO_HEARTBEAT_MIN_MS), PROTO_HEARTBEAT_MAX_MS);
+  d.telemetryMs = jsonUint(json, "tele", 0);
+  if (d.telemetryMs > 0)
+    d.telemetryMs = std::max(d.telemetryMs, PROTO_TELEMETRY_MIN_MS);
+  d.lastTelemetryMs = nowMs();
+  if (d.binary)
+    c_.binarySessions++;
+}
+
+// applyStatus(): a seq older than the last one seen is dropped
+void LoadGen::onStatus(Device &d, uint32_t mask, bool hasSeq, uint32_t seq)
+{
+  if (hasSeq)
+  {
+    if (d.statusSeqValid && (int32_t)(seq - d.statusSeq) <= 0)
+    {
+      c_.staleStatus++;
+      return;
+    }
+    d.statusSeqValid = true;
+    d.statusSeq = seq;
+  }
+  c_.statusFrames++;
+  bool on = mask & 0x01;
+  trace("STATUS %d", on ? 1 : 0);
+  User &u = users_[d.user];
+  if (u.flipUs && d.seenSeq != u.seq && on == u.on)
+  {
+    fanoutLatUs_.push_back((uint32_t)(nowUs_ - u.flipUs));
+    d.seenSeq = u.seq;
+  }
+}
+
+void LoadGen::trace(const char *fmt, ...)
+{
+  if (!opts_.trace)
+    return;
+  char buf[512];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  fprintf(stderr, "HOST %u %s\n", nowMs(), buf);
+}
+
+// maybeSendTelemetry(): fixed figures, only the frame size and rate matter here
+void LoadGen::sendTelemetry(Device &d)
+{
+  c_.telemetrySent++;
+  if (d.binary)
+  {
+    static const char frame[PROTO_BIN_TELEMETRY_LEN] = {(char)PROTO_BIN_TELEMETRY, (char)-55, 0x50, (char)0xC3, 0, 0, 0, 0, 0, 0};
+    sendFrame(d, host::WS_OP_BIN, frame, sizeof(frame));
+  }
+  else
+  {
+    static const std::string text = std::string(PROTO_TELEMETRY_PREFIX) + "{\"rssi\":-55,\"heap\":50000,\"up\":0}";
+    sendFrame(d, host::WS_OP_TEXT, text.data(), text.size());
+  }
+}
+
+void LoadGen::sendFrame(Device &d, uint8_t opcode, const char *data, size_t len)
+{
+  std::string frame;
+  host::wsAppendFrame(frame, opcode, (const uint8_t *)data, len, true, (uint32_t)rng_());
+  send(d.fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+}
+
+// What every device's loop() would do at this instant.
+void LoadGen::tick()
+{
+  uint32_t now = nowMs();
+  for (Device &d : devices_)
+  {
+    switch (d.state)
+    {
+    case DevState::Waiting:
+      if ((int32_t)(now - d.nextActionMs) < 0)
+        break;
+      if (d.attemptStartUs == 0)
+      {
+        booted_++;
+        setup(d);
+      }
+      else if (now - d.lastSetupMs >= WS_RECONNECT_MS)
+        setup(d);
+      else
+        beginConnect(d);
+      break;
+    case DevState::Connecting:
+    case DevState::Upgrading:
+      if (now - d.lastSetupMs >= WS_RECONNECT_MS)
+        setup(d);
+      break;
+    case DevState::Authing:
+    case DevState::Online:
+      if (d.moveAtMs && (int32_t)(now - d.moveAtMs) >= 0)
+      {
+        // maybeMoveRelay() -> switchRelay(): a fresh setupWebSocketFromConfig()
+        d.moveAtMs = 0;
+        c_.moves++;
+        lastMoveS_ = (nowUs_ - startUs_) / 1e6;
+        setup(d);
+        break;
+      }
+      if (d.pingOutstanding && now - d.lastPingMs >= WS_HEARTBEAT_PONG_TIMEOUT_MS)
+      {
+        d.pingOutstanding = false;
+        if (++d.missedPongs >= WS_HEARTBEAT_MISSES)
+        {
+          c_.heartbeatDrops++;
+          onDisconnected(d);
+          break;
+        }
+      }
+      if (now - d.lastPingMs >= d.pingMs)
+      {
+        d.lastPingMs = now;
+        d.pingOutstanding = true;
+        sendFrame(d, host::WS_OP_PING, "", 0);
+      }
+      if (d.telemetryMs > 0 && now - d.lastTelemetryMs >= d.telemetryMs)
+      {
+        d.lastTelemetryMs = now;
+        sendTelemetry(d);
+      }
+      break;
+    case DevState::Offline:
+      if ((int32_t)(now - d.nextActionMs) >= 0)
+        setup(d);
+      break;
+    }
+  }
+}
+
+bool LoadGen::connectControl()
+{
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in ca{};
+  ca.sin_family = AF_INET;
+  ca.sin_port = htons(opts_.controlPort);
+  if (inet_pton(AF_INET, opts_.controlHost.c_str(), &ca.sin_addr) != 1 || connect(fd, (sockaddr *)&ca, sizeof(ca)) != 0)
+  {
+    close(fd);
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  controlFd_ = fd;
+  return true;
+}
+
+// Commands are dropped while the relay is down; the control connection is
+// re-established at most once a second.
+bool LoadGen::control(const std::string &line)
+{
+  if (opts_.controlHost.empty())
+    return false;
+  if (controlFd_ < 0)
+  {
+    if (nowUs_ - controlRetryUs_ < 1000000)
+      return false;
+    controlRetryUs_ = nowUs_;
+    if (!connectControl())
+      return false;
+  }
+  std::string l = line + "\n";
+  if (send(controlFd_, l.data(), l.size(), MSG_NOSIGNAL) < 0)
+  {
+    close(controlFd_);
+    controlFd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+// Scripted actions: voice-state flips, OTA push, relay restart.
+void LoadGen::drive()
+{
+  static double flipCarry = 0;
+  static uint64_t lastDriveUs = 0;
+  double elapsedS = lastDriveUs ? (nowUs_ - lastDriveUs) / 1e6 : 0;
+  lastDriveUs = nowUs_;
+
+  if (controlFd_ >= 0)
+  {
+    char drain[4096];
+    while (recv(controlFd_, drain, sizeof(drain), 0) > 0)
+    {
+    }
+  }
+
+  if (opts_.flipHz > 0 && !opts_.controlHost.empty() && online_ > 0)
+  {
+    flipCarry += opts_.flipHz * elapsedS;
+    std::uniform_int_distribution<size_t> pick(0, users_.size() - 1);
+    while (flipCarry >= 1.0)
+    {
+      flipCarry -= 1.0;
+      User &u = users_[pick(rng_)];
+      if (!control("SET " + u.name + (u.on ? " 0" : " 1")))
+        continue;
+      u.on = !u.on;
+      u.seq++;
+      u.flipUs = nowUs_;
+    }
+  }
+
+  double t = (nowUs_ - startUs_) / 1e6;
+  if (opts_.otaAtS >= 0 && !otaSentUs_ && t >= opts_.otaAtS)
+  {
+    otaSentUs_ = nowUs_;
+    control("OTA * http://127.0.0.1:9/loadgen.bin");
+  }
+  if (opts_.drainAtS >= 0 && !drainSentUs_ && t >= opts_.drainAtS)
+  {
+    // devices that were told to move come back to this same relay
+    drainSentUs_ = nowUs_;
+    control("DRAIN " + std::to_string(opts_.drainJitterMs));
+    control("UNDRAIN");
+  }
+  if (opts_.restartAtS >= 0 && !opts_.restartCmd.empty() && t >= opts_.restartAtS)
+  {
+    opts_.restartAtS = -1;
+    fprintf(stderr, "loadgen: t=%.1fs running restart command\n", t);
+    if (fork() == 0)
+    {
+      execl("/bin/sh", "sh", "-c", opts_.restartCmd.c_str(), (char *)nullptr);
+      _exit(127);
+    }
+  }
+}
+
+// Once a second: progress line and reconnect-storm tracking.
+void LoadGen::tickSecond()
+{
+  double t = (nowUs_ - startUs_) / 1e6;
+  uint64_t attemptsPerS = c_.attempts - lastSecond_.attempts;
+  uint64_t opensPerS = c_.opens - lastSecond_.opens;
+  peakOpensPerS_ = std::max(peakOpensPerS_, opensPerS);
+
+  if (firstAllOnlineS_ < 0 && booted_ == opts_.devices && online_ >= goodDevices_)
+    firstAllOnlineS_ = t;
+
+  // a storm starts when half the fleet drops at once, and ends when 99% of
+  // the devices that were online are back
+  if (!storm_.active && !storm_.done && peakOnline_ > 0 && online_ * 2 < peakOnline_ && firstAllOnlineS_ >= 0)
+  {
+    storm_.active = true;
+    storm_.startS = t;
+    storm_.onlineBefore = peakOnline_;
+    storm_.attemptsAtStart = c_.attempts;
+  }
+  if (storm_.active)
+  {
+    storm_.peakAttemptsPerS = std::max(storm_.peakAttemptsPerS, attemptsPerS);
+    if (online_ * 100 >= storm_.onlineBefore * 99)
+    {
+      storm_.active = false;
+      storm_.done = true;
+      storm_.endS = t;
+      storm_.attempts = c_.attempts - storm_.attemptsAtStart;
+    }
+  }
+
+  if (drainSentUs_ && t - (drainSentUs_ - startUs_) / 1e6 <= opts_.drainJitterMs / 1000.0 + 1)
+    drainPeakAttemptsPerS_ = std::max(drainPeakAttemptsPerS_, attemptsPerS);
+
+  if (!opts_.quiet)
+    fprintf(stderr, "t=%5.0fs online=%u attempts/s=%llu opens/s=%llu auth_ok/s=%llu refused/s=%llu noauth/s=%llu drops/s=%llu\n", t,
+            online_, (unsigned long long)attemptsPerS, (unsigned long long)opensPerS,
+            (unsigned long long)(c_.authOk - lastSecond_.authOk), (unsigned long long)(c_.refused - lastSecond_.refused),
+            (unsigned long long)(c_.noauth - lastSecond_.noauth), (unsigned long long)(c_.disconnects - lastSecond_.disconnects));
+  lastSecond_ = c_;
+}
+
+void LoadGen::run()
+{
+  std::vector<epoll_event> events(4096);
+  uint64_t lastTickUs = 0;
+  uint64_t lastSecondUs = startUs_;
+  uint64_t endUs = startUs_ + (uint64_t)opts_.durationS * 1000000ull;
+
+  while (!gStop && nowUs_ < endUs)
+  {
+    int n = epoll_wait(epfd_, events.data(), (int)events.size(), 1);
+    nowUs_ = monoUs();
+    for (int i = 0; i < n; i++)
+    {
+      int fd = events[i].data.fd;
+      if ((size_t)fd < byFd_.size() && byFd_[fd])
+        onEvent(*byFd_[fd], events[i].events);
+    }
+    if (nowUs_ - lastTickUs >= LOOP_MS * 1000)
+    {
+      lastTickUs = nowUs_;
+      tick();
+      drive();
+    }
+    if (nowUs_ - lastSecondUs >= 1000000)
+    {
+      lastSecondUs += 1000000;
+      tickSecond();
+    }
+    while (waitpid(-1, nullptr, WNOHANG) > 0)
+    {
+    }
+  }
+}
+
+void LoadGen::report()
+{
+  double elapsed = (nowUs_ - startUs_) / 1e6;
+  Summary conn = summarize(connectLatUs_);
+  Summary auth = summarize(authLatUs_);
+  Summary ready = summarize(readyLatUs_);
+  Summary fan = summarize(fanoutLatUs_);
+  Summary ota = summarize(otaLatUs_);
+  double stormS = storm_.done ? storm_.endS - storm_.startS : (storm_.active ? -1 : 0);
+  double drainS = drainSentUs_ && c_.moves ? lastMoveS_ - (drainSentUs_ - startUs_) / 1e6 : 0;
+
+  if (opts_.json)
+  {
+    auto js = [](const char *name, const Summary &s) {
+      printf("  \"%s\": {\"n\": %zu, \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f},\n", name, s.n, s.p50,
+             s.p90, s.p99, s.max);
+    };
+    printf("{\n  \"devices\": %u,\n  \"elapsed_s\": %.1f,\n  \"online\": %u,\n", opts_.devices, elapsed, online_);
+    printf("  \"all_online_s\": %.1f,\n  \"connect_rate_peak_per_s\": %llu,\n  \"connect_rate_avg_per_s\": %.1f,\n", firstAllOnlineS_,
+           (unsigned long long)peakOpensPerS_, c_.opens / elapsed);
+    js("connect_latency", conn);
+    js("auth_latency", auth);
+    js("ready_latency", ready);
+    js("fanout_latency", fan);
+    js("ota_latency", ota);
+    printf("  \"storm\": {\"seen\": %s, \"recovery_s\": %.1f, \"attempts\": %llu, \"peak_attempts_per_s\": %llu},\n",
+           storm_.done || storm_.active ? "true" : "false", stormS, (unsigned long long)storm_.attempts,
+           (unsigned long long)storm_.peakAttemptsPerS);
+    printf("  \"drain\": {\"orders\": %llu, \"moves\": %llu, \"spread_s\": %.1f, \"peak_attempts_per_s\": %llu},\n",
+           (unsigned long long)c_.moveOrders, (unsigned long long)c_.moves, drainS, (unsigned long long)drainPeakAttemptsPerS_);
+    printf("  \"counters\": {\"attempts\": %llu, \"refused\": %llu, \"connect_failed\": %llu, \"opens\": %llu, \"auth_ok\": %llu, "
+           "\"noauth\": %llu, \"portals\": %llu, \"disconnects\": %llu, \"heartbeat_drops\": %llu, \"ota\": %llu, \"status_frames\": %llu, "
+           "\"stale_status\": %llu, \"binary_sessions\": %llu, \"telemetry_sent\": %llu}\n}\n",
+           (unsigned long long)c_.attempts, (unsigned long long)c_.refused, (unsigned long long)c_.connectFailed,
+           (unsigned long long)c_.opens, (unsigned long long)c_.authOk, (unsigned long long)c_.noauth, (unsigned long long)c_.portals,
+           (unsigned long long)c_.disconnects, (unsigned long long)c_.heartbeatDrops, (unsigned long long)c_.otaReceived,
+           (unsigned long long)c_.statusFrames, (unsigned long long)c_.staleStatus, (unsigned long long)c_.binarySessions,
+           (unsigned long long)c_.telemetrySent);
+    return;
+  }
+
+  auto line = [](const char *name, const Summary &s) {
+    if (s.n == 0)
+      printf("%-18s -\n", name);
+    else
+      printf("%-18s n=%-8zu p50=%.2fms p90=%.2fms p99=%.2fms max=%.2fms\n", name, s.n, s.p50, s.p90, s.p99, s.max);
+  };
+  printf("\n%u devices, %.1fs, online at end %u\n", opts_.devices, elapsed, online_);
+  printf("connect rate       peak %llu/s, avg %.1f/s; whole fleet online after %s\n", (unsigned long long)peakOpensPerS_,
+         c_.opens / elapsed, firstAllOnlineS_ < 0 ? "never" : (std::to_string((int)firstAllOnlineS_) + "s").c_str());
+  line("connect latency", conn);
+  line("auth latency", auth);
+  line("ready latency", ready);
+  line("fan-out latency", fan);
+  line("ota latency", ota);
+  if (storm_.done)
+    printf("reconnect storm    %u devices back in %.1fs, %llu attempts, peak %llu attempts/s\n", storm_.onlineBefore, stormS,
+           (unsigned long long)storm_.attempts, (unsigned long long)storm_.peakAttemptsPerS);
+  else if (storm_.active)
+    printf("reconnect storm    not recovered after %.1fs (online %u of %u)\n", elapsed - storm_.startS, online_, storm_.onlineBefore);
+  if (c_.moveOrders)
+    printf("drain              %llu of %llu devices moved over %.1fs, peak %llu attempts/s\n", (unsigned long long)c_.moves,
+           (unsigned long long)c_.moveOrders, drainS, (unsigned long long)drainPeakAttemptsPerS_);
+  printf("attempts %llu, refused %llu, failed %llu, opens %llu, auth ok %llu, noauth %llu, portals %llu, drops %llu (heartbeat %llu), ota %llu\n",
+         (unsigned long long)c_.attempts, (unsigned long long)c_.refused, (unsigned long long)c_.connectFailed,
+         (unsigned long long)c_.opens, (unsigned long long)c_.authOk, (unsigned long long)c_.noauth, (unsigned long long)c_.portals,
+         (unsigned long long)c_.disconnects, (unsigned long long)c_.heartbeatDrops, (unsigned long long)c_.otaReceived);
+  printf("status frames %llu (stale %llu), binary sessions %llu, telemetry sent %llu\n", (unsigned long long)c_.statusFrames,
+         (unsigned long long)c_.staleStatus, (unsigned long long)c_.binarySessions, (unsigned long long)c_.telemetrySent);
+}
+
+bool parseUrl(const std::string &url, Options &o)
+{
+  const std::string scheme = "ws://";
+  if (url.compare(0, scheme.size(), scheme) != 0)
+    return false; // TLS is out of scope for load generation
+  std::string rest = url.substr(scheme.size());
+  size_t slash = rest.find('/');
+  std::string hostport = rest.substr(0, slash);
+  o.path = slash == std::string::npos ? "/" : rest.substr(slash);
+  size_t colon = hostport.find(':');
+  o.host = hostport.substr(0, colon);
+  o.port = colon == std::string::npos ? 80 : (uint16_t)atoi(hostport.c_str() + colon + 1);
+  return !o.host.empty();
+}
+
+bool parseHostPort(const std::string &s, std::string &host, uint16_t &port)
+{
+  size_t colon = s.rfind(':');
+  if (colon == std::string::npos)
+    return false;
+  host = s.substr(0, colon);
+  port = (uint16_t)atoi(s.c_str() + colon + 1);
+  return port != 0;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options opts;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string a = argv[i];
+    bool v = i + 1 < argc;
+    if (a == "--url" && v)
+    {
+      if (!parseUrl(argv[++i], opts))
+      {
+        fprintf(stderr, "loadgen: need a ws:// URL\n");
+        return 2;
+      }
+    }
+    else if (a == "--devices" && v)
+      opts.devices = (uint32_t)atoi(argv[++i]);
+    else if (a == "--ramp" && v)
+      opts.rampPerS = atof(argv[++i]);
+    else if (a == "--duration" && v)
+      opts.durationS = (uint32_t)atoi(argv[++i]);
+    else if (a == "--tokens" && v)
+      opts.tokensPath = argv[++i];
+    else if (a == "--token-prefix" && v)
+      opts.tokenPrefix = argv[++i];
+    else if (a == "--devices-per-user" && v)
+      opts.devicesPerUser = (uint32_t)atoi(argv[++i]);
+    else if (a == "--bad-auth" && v)
+      opts.badAuthPct = atof(argv[++i]);
+    else if (a == "--control" && v)
+    {
+      if (!parseHostPort(argv[++i], opts.controlHost, opts.controlPort))
+      {
+        fprintf(stderr, "loadgen: --control wants host:port\n");
+        return 2;
+      }
+    }
+    else if (a == "--flip-hz" && v)
+      opts.flipHz = atof(argv[++i]);
+    else if (a == "--ota-at" && v)
+      opts.otaAtS = atoi(argv[++i]);
+    else if (a == "--ota-offline-ms" && v)
+      opts.otaOfflineMs = (uint32_t)atoi(argv[++i]);
+    else if (a == "--restart-at" && v)
+      opts.restartAtS = atoi(argv[++i]);
+    else if (a == "--restart-cmd" && v)
+      opts.restartCmd = argv[++i];
+    else if (a == "--drain-at" && v)
+      opts.drainAtS = atoi(argv[++i]);
+    else if (a == "--drain-jitter-ms" && v)
+      opts.drainJitterMs = (uint32_t)atoi(argv[++i]);
+    else if (a == "--legacy-auth")
+      opts.legacyAuth = true;
+    else if (a == "--no-caps")
+      opts.noCaps = true;
+    else if (a == "--json")
+      opts.json = true;
+    else if (a == "--quiet")
+      opts.quiet = true;
+    else if (a == "--trace")
+      opts.trace = true;
+    else
+    {
+      fprintf(stderr, "usage: %s [--url ws://host:port/path] [--devices n] [--ramp n/s] [--duration s]\n"
+                      "          [--tokens file | --token-prefix s --devices-per-user n] [--bad-auth pct]\n"
+                      "          [--control host:port --flip-hz n --ota-at s --ota-offline-ms ms]\n"
+                      "          [--restart-at s --restart-cmd cmd] [--drain-at s --drain-jitter-ms ms]\n"
+                      "          [--legacy-auth] [--no-caps]\n"
+                      "          [--json] [--quiet] [--trace]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+  {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, [](int) { gStop = 1; });
+
+  LoadGen gen(opts);
+  if (!gen.start())
+    return 1;
+  gen.run();
+  gen.report();
+  return 0;
+}
@@ -0,0 +1,466 @@
+#!/usr/bin/env python3
+"""Network impairment harness for reconnect and heartbeat tuning.
+
+Runs the native firmware build against the reference relay through an
+impairment proxy, for every parameter set x scenario, in real time:
+
+    native program  --ws-->  impairment proxy  --tcp-->  tools/relay
+         ^ HOST_TRACE (LED, WS, WiFi events)                ^ control port (voice state)
+
+and reports availability, stale-LED seconds and reconnect counts.
+
+Parameter sets override the firmware's TUNE_* build macros (WS_RECONNECT_MS,
+WS_HEARTBEAT_PING_MS, WS_HEARTBEAT_PONG_TIMEOUT_MS, WS_HEARTBEAT_MISSES,
+WIFI_TRY_TIMEOUT_MS, WIFI_CONNECT_TRIES); each set with overrides is built
+with `pio run -e native` into its own build dir unless a binary is given
+with --program NAME=PATH.
+
+    pio run -e native -e relay
+    python3 tools/netem/netem.py --params tools/netem/params.json --jobs 4
+
+Metrics, per run of --duration seconds:
+  availability  share of time the firmware had a WS session whose traffic
+                actually flowed (dead half-open sessions do not count)
+  stale LED     seconds the LED disagreed with the voice state the relay had
+  ws attempts   WS connection attempts; sessions = upgrades that completed
+  wifi begins   WiFi.begin() calls; portals = config portals opened
+"""
+
+import argparse
+import asyncio
+import json
+import os
+import random
+import re
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from concurrent.futures import ProcessPoolExecutor
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), "..", ".."))
+
+TUNABLES = [
+    "WS_RECONNECT_MS",
+    "WS_HEARTBEAT_PING_MS",
+    "WS_HEARTBEAT_PONG_TIMEOUT_MS",
+    "WS_HEARTBEAT_MISSES",
+    "WIFI_TRY_TIMEOUT_MS",
+    "WIFI_CONNECT_TRIES",
+]
+
+# Link settings apply for the whole run; events fire at the given second.
+#   half_open       existing connections silently stop passing traffic, as
+#                   when a NAT mapping or middlebox state is lost
+#   relay_stop/start  kill and restart the relay (state resynced on start)
+#   wifi_outage N   the AP disappears for N seconds (firmware sees WiFi drop,
+#                   open connections die like half_open)
+SCENARIOS = {
+    "clean": {},
+    "latency_300ms": {"latency_ms": 300, "jitter_ms": 150},
+    "loss_5pct": {"latency_ms": 40, "loss": 0.05},
+    "half_open": {"events": [[30, "half_open"]]},
+    "relay_restart": {"events": [[30, "relay_stop"], [40, "relay_start"]]},
+    "wifi_outage_45s": {"events": [[30, "wifi_outage", 45]]},
+}
+
+TRACE_RE = re.compile(r"^HOST (\d+) (.*)$")
+
+
+# ---------------------------------------------------------------- proxy
+
+
+class Link:
+    def __init__(self, latency_ms=0, jitter_ms=0, loss=0.0, seed=1):
+        self.latency = latency_ms / 1000.0
+        self.jitter = jitter_ms / 1000.0
+        self.loss = loss
+        self.rng = random.Random(seed)
+
+    def delay(self, consecutive_losses):
+        d = self.latency + (self.rng.uniform(-self.jitter, self.jitter) if self.jitter else 0)
+        # TCP hides loss as retransmission delay: 200 ms minimum RTO, doubling
+        lost = 0
+        while self.loss and self.rng.random() < self.loss:
+            d += 0.2 * (2 ** (consecutive_losses + lost))
+            lost += 1
+        return max(d, 0), lost
+
+
+class ProxiedConn:
+    def __init__(self, t):
+        self.start = t
+        self.end = None
+        self.dead = False
+
+
+class Proxy:
+    def __init__(self, listen_port, upstream_port, link, clock):
+        self.listen_port = listen_port
+        self.upstream_port = upstream_port
+        self.link = link
+        self.clock = clock
+        self.conns = []
+        self.server = None
+
+    async def start(self):
+        self.server = await asyncio.start_server(self.handle, "127.0.0.1", self.listen_port)
+
+    def half_open(self):
+        t = self.clock()
+        for c in self.conns:
+            if c.end is None and not c.dead:
+                c.dead = True
+                c.end = t
+
+    async def handle(self, reader, writer):
+        try:
+            ureader, uwriter = await asyncio.open_connection("127.0.0.1", self.upstream_port)
+        except OSError:
+            writer.transport.abort()  # RST, like the relay port refusing
+            return
+        conn = ProxiedConn(self.clock())
+        self.conns.append(conn)
+        try:
+            await asyncio.gather(self.pump(reader, uwriter, conn), self.pump(ureader, writer, conn))
+        except asyncio.CancelledError:
+            pass  # end of run
+        if conn.end is None:
+            conn.end = self.clock()
+
+    async def pump(self, src, dst, conn):
+        queue = asyncio.Queue()
+        sender = asyncio.ensure_future(self.send(queue, dst, conn))
+        last_due = 0.0
+        losses = 0
+        while True:
+            try:
+                data = await src.read(4096)
+            except (ConnectionError, OSError):
+                data = b""
+            if conn.dead:
+                if not data:
+                    # never tell the other side: that is what half-open means
+                    await asyncio.sleep(3600)
+                continue
+            if not data:
+                await queue.put((last_due, None))
+                break
+            d, lost = self.link.delay(losses)
+            losses = losses + lost if lost else 0
+            last_due = max(last_due, time.monotonic() + d)
+            await queue.put((last_due, data))
+        await sender
+
+    async def send(self, queue, dst, conn):
+        while True:
+            due, data = await queue.get()
+            wait = due - time.monotonic()
+            if wait > 0:
+                await asyncio.sleep(wait)
+            if conn.dead:
+                continue
+            if data is None:
+                try:
+                    dst.close()
+                except OSError:
+                    pass
+                return
+            try:
+                dst.write(data)
+                await dst.drain()
+            except (ConnectionError, OSError):
+                return
+
+
+# ---------------------------------------------------------------- one run
+
+
+def wait_port(port, timeout=5.0):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            socket.create_connection(("127.0.0.1", port), timeout=0.2).close()
+            return True
+        except OSError:
+            time.sleep(0.05)
+    return False
+
+
+class Relay:
+    def __init__(self, binary, port, control_port, tokens):
+        self.cmd = [binary, "--port", str(port), "--control-port", str(control_port),
+                    "--tokens", tokens, "--no-stdin"]
+        self.control_port = control_port
+        self.proc = None
+
+    def start(self):
+        self.proc = subprocess.Popen(self.cmd, stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL,
+                                     stderr=subprocess.DEVNULL)
+        return wait_port(self.control_port)
+
+    def stop(self):
+        if self.proc:
+            self.proc.kill()
+            self.proc.wait()
+            self.proc = None
+
+    def command(self, line):
+        try:
+            with socket.create_connection(("127.0.0.1", self.control_port), timeout=1) as s:
+                s.sendall((line + "\n").encode())
+                s.recv(256)
+            return True
+        except OSError:
+            return False
+
+
+def read_trace(proc, lines):
+    for raw in proc.stderr:
+        m = TRACE_RE.match(raw.decode(errors="replace").rstrip())
+        if m:
+            lines.append((int(m.group(1)) / 1000.0, m.group(2)))
+
+
+def intervals_measure(intervals, lo, hi):
+    total = 0.0
+    for a, b in intervals:
+        a, b = max(a, lo), min(b, hi)
+        if b > a:
+            total += b - a
+    return total
+
+
+def intersect(xs, ys):
+    out = []
+    for a1, b1 in xs:
+        for a2, b2 in ys:
+            a, b = max(a1, a2), min(b1, b2)
+            if b > a:
+                out.append((a, b))
+    return out
+
+
+def merge(intervals):
+    out = []
+    for a, b in sorted(intervals):
+        if out and a <= out[-1][1]:
+            out[-1] = (out[-1][0], max(out[-1][1], b))
+        else:
+            out.append((a, b))
+    return out
+
+
+def analyse(trace, intended, proxy_conns, duration, led_pin):
+    led = [(0.0, False)]
+    open_since = None
+    sessions_open = []
+    counts = {"ws_attempts": 0, "sessions": 0, "wifi_begins": 0, "portals": 0, "pong_timeouts": 0}
+    for t, ev in trace:
+        words = ev.split()
+        if words[:1] == ["GPIO"] and len(words) >= 3 and int(words[1]) == led_pin:
+            led.append((t, words[2] == "1"))
+        elif ev.startswith("WS connect ") or ev == "WS connect":
+            counts["ws_attempts"] += 1
+        elif ev == "WS open":
+            counts["sessions"] += 1
+            open_since = t
+        elif ev.startswith("WS disconnect") or ev.startswith("WS closed") or ev == "RESTART":
+            if open_since is not None:
+                sessions_open.append((open_since, t))
+                open_since = None
+        elif ev.startswith("WS pong-timeout"):
+            counts["pong_timeouts"] += 1
+        elif ev.startswith("WIFI begin"):
+            counts["wifi_begins"] += 1
+        elif ev.startswith("PORTAL open"):
+            counts["portals"] += 1
+    if open_since is not None:
+        sessions_open.append((open_since, duration))
+
+    alive = merge([(c.start, c.end if c.end is not None else duration) for c in proxy_conns])
+    available = intervals_measure(merge(intersect(sessions_open, alive)), 0, duration)
+
+    # stale LED: walk both step functions
+    points = sorted(set([t for t, _ in led] + [t for t, _ in intended] + [duration]))
+    stale = 0.0
+
+    def value_at(series, t):
+        v = series[0][1]
+        for ts, val in series:
+            if ts <= t:
+                v = val
+            else:
+                break
+        return v
+
+    for a, b in zip(points, points[1:]):
+        if b > duration:
+            b = duration
+        if b > a and value_at(led, a) != value_at(intended, a):
+            stale += b - a
+
+    result = dict(counts)
+    result["availability"] = available / duration
+    result["stale_led_s"] = stale
+    return result
+
+
+def run_one(job):
+    params, scenario_name, scenario, program, relay_bin, ports, duration, flip_every, led_pin = job
+    relay_port, control_port, proxy_port = ports
+    work = tempfile.mkdtemp(prefix="netem-")
+    tokens = os.path.join(work, "tokens.txt")
+    with open(tokens, "w") as f:
+        f.write("netem-token netem\n")
+    fs = os.path.join(work, "fs")
+    os.makedirs(fs)
+    with open(os.path.join(fs, "config.json"), "w") as f:
+        json.dump({"wsUrl": "ws://127.0.0.1:%d/ws" % proxy_port, "authToken": "netem-token",
+                   "wifiSsid": "netem", "wifiPass": "netem-pass"}, f)
+
+    relay = Relay(relay_bin, relay_port, control_port, tokens)
+    if not relay.start():
+        raise RuntimeError("relay did not start: %s" % " ".join(relay.cmd))
+
+    env = dict(os.environ)
+    env.update({"HOST_FS_DIR": fs, "HOST_TRACE": "1"})
+    env.pop("HOST_CLOCK", None)
+    for ev in scenario.get("events", []):
+        if ev[1] == "wifi_outage":
+            env["HOST_WIFI_OUTAGE"] = "%d:%d" % (ev[0] * 1000, ev[2] * 1000)
+
+    link = Link(scenario.get("latency_ms", 0), scenario.get("jitter_ms", 0), scenario.get("loss", 0.0))
+    t0 = time.monotonic()
+    clock = lambda: time.monotonic() - t0
+    proxy = Proxy(proxy_port, relay_port, link, clock)
+    trace = []
+    intended = [(0.0, False)]
+    state = {"on": False}
+
+    async def main():
+        await proxy.start()
+        fw = subprocess.Popen([program], env=env, stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL,
+                              stderr=subprocess.PIPE)
+        reader = threading.Thread(target=read_trace, args=(fw, trace), daemon=True)
+        reader.start()
+        events = sorted(scenario.get("events", []), key=lambda e: e[0])
+        next_flip = flip_every
+        loop = asyncio.get_running_loop()
+        try:
+            while clock() < duration:
+                now = clock()
+                while events and events[0][0] <= now:
+                    ev = events.pop(0)
+                    if ev[1] in ("half_open", "wifi_outage"):
+                        proxy.half_open()
+                    elif ev[1] == "relay_stop":
+                        await loop.run_in_executor(None, relay.stop)
+                    elif ev[1] == "relay_start":
+                        await loop.run_in_executor(None, relay.start)
+                        # the voice source resyncs a restarted relay
+                        await loop.run_in_executor(None, relay.command, "SET netem %d" % state["on"])
+                if now >= next_flip:
+                    next_flip += flip_every
+                    if await loop.run_in_executor(None, relay.command, "SET netem %d" % (not state["on"])):
+                        state["on"] = not state["on"]
+                        intended.append((clock(), state["on"]))
+                await asyncio.sleep(0.05)
+        finally:
+            fw.kill()
+            fw.wait()
+            proxy.server.close()
+
+    try:
+        asyncio.run(main())
+    finally:
+        relay.stop()
+        shutil.rmtree(work, ignore_errors=True)
+
+    result = analyse(trace, intended, proxy.conns, duration, led_pin)
+    result.update({"params": params["name"], "scenario": scenario_name})
+    return result
+
+
+# ---------------------------------------------------------------- driver
+
+
+def build_program(params, default_program):
+    overrides = {k: v for k, v in params.items() if k in TUNABLES}
+    if not overrides:
+        return default_program
+    pio = shutil.which("pio") or shutil.which("platformio")
+    if not pio:
+        raise SystemExit("parameter set '%s' needs a build but pio is not on PATH "
+                         "(or pass --program %s=<binary>)" % (params["name"], params["name"]))
+    build_dir = os.path.join(ROOT, ".pio", "netem", params["name"])
+    env = dict(os.environ)
+    env["PLATFORMIO_BUILD_FLAGS"] = " ".join("-D TUNE_%s=%s" % kv for kv in sorted(overrides.items()))
+    env["PLATFORMIO_BUILD_DIR"] = build_dir
+    print("building %s: %s" % (params["name"], env["PLATFORMIO_BUILD_FLAGS"]), file=sys.stderr)
+    subprocess.run([pio, "run", "-e", "native", "-d", ROOT], env=env, check=True,
+                   stdout=subprocess.DEVNULL)
+    return os.path.join(build_dir, "native", "program")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--params", help="JSON list of parameter sets ({\"name\": ..., \"WS_RECONNECT_MS\": ...})")
+    ap.add_argument("--scenario", action="append", help="run only these scenarios (repeatable)")
+    ap.add_argument("--program", action="append", default=[], metavar="NAME=PATH",
+                    help="prebuilt native binary for a parameter set")
+    ap.add_argument("--native", default=os.path.join(ROOT, ".pio", "build", "native", "program"),
+                    help="native build used for sets without overrides")
+    ap.add_argument("--relay", default=os.path.join(ROOT, ".pio", "build", "relay", "program"))
+    ap.add_argument("--duration", type=float, default=150, help="seconds per run (default 150)")
+    ap.add_argument("--flip-every", type=float, default=10, help="voice-state flip period in seconds")
+    ap.add_argument("--led-pin", type=int, default=2)
+    ap.add_argument("--jobs", type=int, default=1, help="runs in parallel")
+    ap.add_argument("--base-port", type=int, default=19000)
+    ap.add_argument("--json", action="store_true")
+    args = ap.parse_args()
+
+    param_sets = [{"name": "shipped"}]
+    if args.params:
+        with open(args.params) as f:
+            param_sets = json.load(f)
+    prebuilt = dict(p.split("=", 1) for p in args.program)
+    scenarios = {k: v for k, v in SCENARIOS.items() if not args.scenario or k in args.scenario}
+    if not scenarios:
+        raise SystemExit("no scenarios selected (known: %s)" % ", ".join(SCENARIOS))
+
+    jobs = []
+    for params in param_sets:
+        program = prebuilt.get(params["name"]) or build_program(params, args.native)
+        for name, scenario in scenarios.items():
+            base = args.base_port + 10 * len(jobs)
+            jobs.append((params, name, scenario, program, args.relay, (base, base + 1, base + 2),
+                         args.duration, args.flip_every, args.led_pin))
+
+    print("%d runs x %.0fs, %d at a time" % (len(jobs), args.duration, args.jobs), file=sys.stderr)
+    with ProcessPoolExecutor(max_workers=max(1, args.jobs)) as pool:
+        results = list(pool.map(run_one, jobs))
+
+    if args.json:
+        json.dump(results, sys.stdout, indent=2)
+        print()
+        return
+
+    fmt = "%-18s %-16s %7s %9s %8s %8s %6s %7s %7s"
+    print(fmt % ("params", "scenario", "avail", "stale-LED", "attempts", "sessions", "pong-to", "wifi", "portals"))
+    for r in results:
+        print(fmt % (r["params"], r["scenario"], "%.1f%%" % (100 * r["availability"]), "%.1fs" % r["stale_led_s"],
+                     r["ws_attempts"], r["sessions"], r["pong_timeouts"], r["wifi_begins"], r["portals"]))
+    print()
+    for params in param_sets:
+        rs = [r for r in results if r["params"] == params["name"]]
+        print("%-18s mean availability %.1f%%, stale LED %.1fs total, %d WS attempts" % (
+            params["name"], 100 * sum(r["availability"] for r in rs) / len(rs),
+            sum(r["stale_led_s"] for r in rs), sum(r["ws_attempts"] for r in rs)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,1150 @@
+#include "relay.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "host/ws_frame.h"
+#include "../../src/protocol.h"
+#include "../../src/status_datagram.h"
+
+namespace relay
+{
+namespace
+{
+const uint32_t NO_USER = 0xFFFFFFFFu;
+
+// Device frames are tiny (AUTH:<token> and CAPS are the largest), and the upgrade
+// request fits comfortably too; anything bigger is not a device.
+const size_t RX_CAP = 512;
+
+enum class ConnState : uint8_t
+{
+  Http,
+  Ws,
+  Authed,
+  Closing,
+};
+
+double monotonicS()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Status seq source: milliseconds since the Unix epoch, truncated, so a
+// restarted relay and a LAN agent stay ordered against each other.
+uint32_t epochMs32()
+{
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+bool startsWithNoCase(const char *s, size_t len, const char *prefix)
+{
+  size_t n = strlen(prefix);
+  return len >= n && strncasecmp(s, prefix, n) == 0;
+}
+
+// Numeric or boolean member of the flat JSON object a device sends in CAPS.
+// The firmware builds it with ArduinoJson, so no escapes or nesting to handle.
+bool capsFlag(const std::string &json, const char *key)
+{
+  size_t at = json.find(std::string("\"") + key + "\"");
+  if (at == std::string::npos)
+    return false;
+  at = json.find_first_not_of(" \t:", at + strlen(key) + 2);
+  return at != std::string::npos && (json[at] == 't' || (json[at] >= '1' && json[at] <= '9'));
+}
+
+// Unsigned member of the same kind of object, 0 when missing.
+uint32_t capsNumber(const std::string &json, const char *key)
+{
+  size_t at = json.find(std::string("\"") + key + "\"");
+  if (at == std::string::npos)
+    return 0;
+  at = json.find_first_not_of(" \t:", at + strlen(key) + 2);
+  return at == std::string::npos ? 0 : (uint32_t)strtoul(json.c_str() + at, nullptr, 10);
+}
+
+uint32_t monotonicMs() { return (uint32_t)(monotonicS() * 1000); }
+} // namespace
+
+struct Conn
+{
+  int fd = -1;
+  ConnState state = ConnState::Http;
+  bool wantWrite = false;
+  bool upgradeAuthed = false; // token came in the upgrade request
+  bool binary = false;        // SESSION chose binary status frames
+  bool udpReady = false;      // a hello told us where to send datagrams
+  uint16_t rxLen = 0;
+  uint32_t user = NO_USER;
+  uint32_t openedS = 0;
+  uint32_t lastRxS = 0;
+  uint32_t sid = 0;      // UDP session id, 0 = WS only
+  uint32_t helloSeq = 0; // last accepted hello counter
+  uint32_t lastProbeS = 0;
+  uint32_t rttMs = 0; // last JSON ping round trip, 0 = none yet
+  sockaddr_in udpAddr{};
+  std::string token; // HMAC key for datagrams, kept only with --udp-port
+  std::string caps;  // a CAPS that came before AUTH, answered once authenticated
+  Conn *prev = nullptr;
+  Conn *next = nullptr;
+  std::string tx; // only holds bytes the socket would not take
+  char rx[RX_CAP];
+};
+
+Server::Server(const Options &opts) : opts_(opts) {}
+
+Server::~Server()
+{
+  for (Conn *c : conns_)
+  {
+    if (c)
+    {
+      close(c->fd);
+      delete c;
+    }
+  }
+  if (listenFd_ >= 0)
+    close(listenFd_);
+  if (controlFd_ >= 0)
+    close(controlFd_);
+  if (udpFd_ >= 0)
+    close(udpFd_);
+  if (epfd_ >= 0)
+    close(epfd_);
+}
+
+uint32_t Server::userIndex(const std::string &name, bool create)
+{
+  auto it = userByName_.find(name);
+  if (it != userByName_.end())
+    return it->second;
+  if (!create)
+    return NO_USER;
+  users_.push_back(User());
+  users_.back().name = name;
+  uint32_t idx = (uint32_t)(users_.size() - 1);
+  userByName_[name] = idx;
+  return idx;
+}
+
+bool Server::loadTokens()
+{
+  if (opts_.tokensPath.empty())
+    return true;
+  std::ifstream in(opts_.tokensPath);
+  if (!in)
+  {
+    fprintf(stderr, "relay: cannot read tokens file %s\n", opts_.tokensPath.c_str());
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line))
+  {
+    std::istringstream ls(line);
+    std::string token, user;
+    if (!(ls >> token) || token[0] == '#')
+      continue;
+    if (!(ls >> user))
+      user = token;
+    userByToken_[token] = userIndex(user, true);
+  }
+  fprintf(stderr, "relay: %zu tokens for %zu users\n", userByToken_.size(), users_.size());
+  return true;
+}
+
+int Server::listenOn(const std::string &addr, uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(port);
+  if (inet_pton(AF_INET, addr.c_str(), &sa.sin_addr) != 1 || bind(fd, (sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, 4096) != 0)
+  {
+    fprintf(stderr, "relay: cannot listen on %s:%u: %s\n", addr.c_str(), port, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+  return fd;
+}
+
+bool Server::start()
+{
+  if (!loadTokens())
+    return false;
+  if (!opts_.openAuth && userByToken_.empty())
+  {
+    fprintf(stderr, "relay: no tokens configured (use --tokens <file> or --open)\n");
+    return false;
+  }
+
+  epfd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd_ < 0)
+    return false;
+  listenFd_ = listenOn(opts_.bindAddr, opts_.port);
+  if (listenFd_ < 0)
+    return false;
+  if (opts_.controlPort != 0)
+  {
+    controlFd_ = listenOn(opts_.controlAddr, opts_.controlPort);
+    if (controlFd_ < 0)
+      return false;
+  }
+  if (opts_.udpPort != 0)
+  {
+    udpFd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_in sa{};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(opts_.udpPort);
+    if (udpFd_ < 0 || inet_pton(AF_INET, opts_.bindAddr.c_str(), &sa.sin_addr) != 1 ||
+        bind(udpFd_, (sockaddr *)&sa, sizeof(sa)) != 0)
+    {
+      fprintf(stderr, "relay: cannot bind UDP %s:%u: %s\n", opts_.bindAddr.c_str(), opts_.udpPort, strerror(errno));
+      return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = udpFd_;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, udpFd_, &ev);
+    std::random_device rd;
+    nextSid_ = rd();
+  }
+  if (opts_.readStdin)
+  {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = STDIN_FILENO;
+    // fails harmlessly when stdin is a regular file or /dev/null
+    if (epoll_ctl(epfd_, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == 0)
+      controlBuffers_[STDIN_FILENO];
+  }
+
+  fprintf(stderr, "relay: devices on %s:%u, control on %s:%u%s\n", opts_.bindAddr.c_str(), opts_.port,
+          opts_.controlAddr.c_str(), opts_.controlPort, opts_.openAuth ? " (open auth)" : "");
+  running_ = true;
+  return true;
+}
+
+void Server::run()
+{
+  std::vector<epoll_event> events(1024);
+  double start = monotonicS();
+  double lastSweep = start;
+  double lastSim = start;
+
+  while (running_)
+  {
+    int timeoutMs = opts_.simulateVoiceHz > 0 ? 10 : 1000;
+    if (!udpResends_.empty())
+    {
+      int dueMs = udpTimeoutMs(monotonicS());
+      timeoutMs = dueMs < timeoutMs ? dueMs : timeoutMs;
+    }
+    int n = epoll_wait(epfd_, events.data(), (int)events.size(), timeoutMs);
+    if (n < 0 && errno != EINTR)
+    {
+      perror("epoll_wait");
+      break;
+    }
+    double now = monotonicS();
+    nowS_ = (uint32_t)(now - start);
+
+    for (int i = 0; i < n; i++)
+    {
+      int fd = events[i].data.fd;
+      uint32_t ev = events[i].events;
+      if (fd == listenFd_)
+        acceptDevices();
+      else if (fd == controlFd_)
+        acceptControl();
+      else if (fd == udpFd_)
+        readUdp();
+      else if (controlBuffers_.count(fd))
+        handleControlInput(fd, controlBuffers_[fd]);
+      else if ((size_t)fd < conns_.size() && conns_[fd])
+      {
+        Conn *c = conns_[fd];
+        if (ev & (EPOLLERR | EPOLLHUP))
+        {
+          closeConn(c);
+          continue;
+        }
+        if (ev & EPOLLOUT)
+          onWritable(c);
+        if ((ev & EPOLLIN) && conns_[fd] == c)
+          onReadable(c);
+      }
+    }
+
+    if (!udpResends_.empty())
+      flushUdpResends(now);
+    if (opts_.simulateVoiceHz > 0)
+    {
+      simulateVoice(now - lastSim);
+      lastSim = now;
+    }
+    if (now - lastSweep >= 1.0)
+    {
+      lastSweep = now;
+      sweep();
+    }
+  }
+}
+
+void Server::acceptDevices()
+{
+  for (;;)
+  {
+    int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      if (errno == EMFILE || errno == ENFILE)
+        fprintf(stderr, "relay: out of file descriptors at %zu connections\n", live_);
+      return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (opts_.socketBufferBytes > 0)
+    {
+      // the kernel buffers dominate per-connection memory; devices need little
+      setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &opts_.socketBufferBytes, sizeof(int));
+      setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opts_.socketBufferBytes, sizeof(int));
+    }
+
+    if ((size_t)fd >= conns_.size())
+      conns_.resize(fd + 1024, nullptr);
+    Conn *c = new Conn();
+    c->fd = fd;
+    c->openedS = c->lastRxS = nowS_;
+    conns_[fd] = c;
+    live_++;
+    stats_.accepted++;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+void Server::acceptControl()
+{
+  for (;;)
+  {
+    int fd = accept4(controlFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+      return;
+    controlBuffers_[fd];
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+void Server::onReadable(Conn *c)
+{
+  for (;;)
+  {
+    if (c->rxLen == RX_CAP)
+    {
+      closeConn(c); // oversized request or frame
+      return;
+    }
+    ssize_t n = recv(c->fd, c->rx + c->rxLen, RX_CAP - c->rxLen, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+      closeConn(c);
+      return;
+    }
+    if (n < 0)
+      return;
+    c->rxLen += (uint16_t)n;
+    c->lastRxS = nowS_;
+
+    if (c->state == ConnState::Http && !handleHttp(c))
+      return;
+    if (c->state != ConnState::Http && !handleFrames(c))
+      return;
+  }
+}
+
+void Server::onWritable(Conn *c)
+{
+  while (!c->tx.empty())
+  {
+    ssize_t n = send(c->fd, c->tx.data(), c->tx.size(), MSG_NOSIGNAL);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    if (n <= 0)
+    {
+      closeConn(c);
+      return;
+    }
+    c->tx.erase(0, (size_t)n);
+  }
+  std::string().swap(c->tx); // give the memory back
+  if (c->state == ConnState::Closing)
+  {
+    closeConn(c);
+    return;
+  }
+  c->wantWrite = false;
+  epoll_event ev{};
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.fd = c->fd;
+  epoll_ctl(epfd_, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+// Returns false when the connection was closed.
+bool Server::handleHttp(Conn *c)
+{
+  const char *end = (const char *)memmem(c->rx, c->rxLen, "\r\n\r\n", 4);
+  if (!end)
+    return true;
+  size_t headLen = end - c->rx + 4;
+
+  std::string key, protocol, bearer;
+  bool hasBearer = false;
+  bool upgrade = startsWithNoCase(c->rx, c->rxLen, "GET ");
+  const char *p = c->rx;
+  while (p < end)
+  {
+    const char *eol = (const char *)memmem(p, end + 2 - p, "\r\n", 2);
+    if (!eol)
+      break;
+    size_t len = eol - p;
+    auto value = [&](size_t nameLen) {
+      const char *v = p + nameLen;
+      while (v < eol && *v == ' ')
+        v++;
+      return std::string(v, eol - v);
+    };
+    if (startsWithNoCase(p, len, "Sec-WebSocket-Key:"))
+      key = value(18);
+    else if (startsWithNoCase(p, len, "Sec-WebSocket-Protocol:"))
+    {
+      protocol = value(23);
+      protocol = protocol.substr(0, protocol.find(','));
+    }
+    else if (startsWithNoCase(p, len, PROTO_AUTH_HEADER))
+    {
+      bearer = value(strlen(PROTO_AUTH_HEADER));
+      hasBearer = true;
+    }
+    p = eol + 2;
+  }
+
+  if (!upgrade || key.empty())
+  {
+    static const char bad[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    c->state = ConnState::Closing;
+    sendRaw(c, bad, sizeof(bad) - 1);
+    if (conns_[c->fd] == c && c->tx.empty())
+      closeConn(c);
+    return false;
+  }
+
+  // A draining relay takes no new devices; they retry with backoff and land
+  // on another relay (or another node behind the same address).
+  if (draining_)
+  {
+    stats_.drainRejected++;
+    static const char unavailable[] = "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    c->state = ConnState::Closing;
+    sendRaw(c, unavailable, sizeof(unavailable) - 1);
+    if (conns_[c->fd] == c && c->tx.empty())
+      closeConn(c);
+    return false;
+  }
+
+  // Token in the upgrade: a good one gets OK and the current state in the
+  // same write as the 101, a bad one gets NOAUTH there and a hang-up. Not a
+  // 401: the device only counts auth failures it sees as NOAUTH frames.
+  uint32_t user = NO_USER;
+  bool badBearer = false;
+  if (hasBearer)
+  {
+    user = resolveToken(bearer);
+    badBearer = user == NO_USER;
+  }
+
+  std::string resp = "HTTP/1.1 101 Switching Protocols\r\n"
+                     "Upgrade: websocket\r\n"
+                     "Connection: Upgrade\r\n"
+                     "Sec-WebSocket-Accept: " +
+                     host::wsAcceptKey(key) + "\r\n";
+  if (!protocol.empty())
+    resp += "Sec-WebSocket-Protocol: " + protocol + "\r\n";
+  resp += "\r\n";
+
+  memmove(c->rx, c->rx + headLen, c->rxLen - headLen);
+  c->rxLen -= (uint16_t)headLen;
+  c->state = ConnState::Ws;
+  if (user != NO_USER)
+  {
+    stats_.authOk++;
+    subscribe(c, user);
+    c->upgradeAuthed = true;
+    if (udpFd_ >= 0)
+      c->token = bearer;
+    host::wsAppendFrame(resp, host::WS_OP_TEXT, (const uint8_t *)PROTO_AUTH_OK, strlen(PROTO_AUTH_OK), false);
+    host::wsAppendFrame(resp, host::WS_OP_TEXT, (const uint8_t *)(users_[user].on ? "1" : "0"), 1, false);
+    stats_.framesOut += 2;
+  }
+  else if (badBearer)
+  {
+    stats_.authFail++;
+    c->state = ConnState::Closing;
+    host::wsAppendFrame(resp, host::WS_OP_TEXT, (const uint8_t *)PROTO_NOAUTH, strlen(PROTO_NOAUTH), false);
+    stats_.framesOut++;
+  }
+  sendRaw(c, resp.data(), resp.size());
+  if (conns_[c->fd] != c)
+    return false;
+  if (badBearer)
+  {
+    if (c->tx.empty())
+      closeConn(c);
+    return false;
+  }
+  return true;
+}
+
+// Returns false when the connection was closed.
+bool Server::handleFrames(Conn *c)
+{
+  int fd = c->fd;
+  while (c->rxLen > 0)
+  {
+    host::WsFrameHeader h;
+    int r = host::wsParseHeader((const uint8_t *)c->rx, c->rxLen, h);
+    if (r == 0)
+      return true;
+    if (r < 0 || !h.masked || !h.fin || h.headerLength + h.payloadLength > RX_CAP)
+    {
+      closeConn(c);
+      return false;
+    }
+    size_t total = h.headerLength + (size_t)h.payloadLength;
+    if (c->rxLen < total)
+      return true;
+
+    char *payload = c->rx + h.headerLength;
+    size_t len = (size_t)h.payloadLength;
+    host::wsUnmask((uint8_t *)payload, len, h.mask);
+    stats_.framesIn++;
+
+    switch (h.opcode)
+    {
+    case host::WS_OP_TEXT:
+      handleText(c, payload, len);
+      break;
+    case host::WS_OP_BIN:
+      if (c->binary && len == PROTO_BIN_TELEMETRY_LEN && (uint8_t)payload[0] == PROTO_BIN_TELEMETRY)
+        stats_.telemetryIn++;
+      break;
+    case host::WS_OP_PING:
+      sendFrame(c, host::WS_OP_PONG, payload, len);
+      break;
+    case host::WS_OP_CLOSE:
+      c->state = ConnState::Closing;
+      sendFrame(c, host::WS_OP_CLOSE, payload, len < 2 ? len : 2);
+      if (conns_[fd] == c && c->tx.empty())
+        closeConn(c);
+      return false;
+    default:
+      break; // pong: nothing to do
+    }
+    if (fd >= (int)conns_.size() || conns_[fd] != c)
+      return false;
+
+    memmove(c->rx, c->rx + total, c->rxLen - total);
+    c->rxLen -= (uint16_t)total;
+  }
+  return true;
+}
+
+void Server::handleText(Conn *c, const char *data, size_t len)
+{
+  size_t prefixLen = strlen(PROTO_AUTH_PREFIX);
+  if (len >= prefixLen && memcmp(data, PROTO_AUTH_PREFIX, prefixLen) == 0)
+  {
+    uint32_t user = resolveToken(std::string(data + prefixLen, len - prefixLen));
+    // devices send AUTH: even after authenticating in the upgrade, for relays
+    // that ignore the header; the session already has its OK
+    if (c->upgradeAuthed && user == c->user)
+      return;
+
+    if (user == NO_USER)
+    {
+      stats_.authFail++;
+      // hang up; the device counts NOAUTHs across reconnects until an OK
+      c->state = ConnState::Closing;
+      sendFrame(c, host::WS_OP_TEXT, PROTO_NOAUTH, strlen(PROTO_NOAUTH));
+      if (conns_[c->fd] == c && c->tx.empty())
+        closeConn(c);
+      return;
+    }
+
+    stats_.authOk++;
+    subscribe(c, user);
+    if (udpFd_ >= 0)
+      c->token.assign(data + prefixLen, len - prefixLen);
+    sendFrame(c, host::WS_OP_TEXT, PROTO_AUTH_OK, strlen(PROTO_AUTH_OK));
+    if (conns_[c->fd] == c)
+      sendFrame(c, host::WS_OP_TEXT, users_[user].on ? "1" : "0", 1);
+    if (conns_[c->fd] == c && !c->caps.empty())
+    {
+      std::string caps;
+      caps.swap(c->caps);
+      answerCaps(c, caps);
+    }
+    return;
+  }
+
+  prefixLen = strlen(PROTO_CAPS_PREFIX);
+  if (len >= prefixLen && memcmp(data, PROTO_CAPS_PREFIX, prefixLen) == 0)
+  {
+    // The device pipelines AUTH and CAPS. A CAPS that overtakes AUTH waits
+    // for it: nothing, a UDP sid included, is handed out before a token.
+    std::string caps(data + prefixLen, len - prefixLen);
+    stats_.capsIn++;
+    if (c->state != ConnState::Authed)
+      c->caps = caps; // the last one counts
+    else
+      answerCaps(c, caps);
+    return;
+  }
+
+  prefixLen = strlen(PROTO_TELEMETRY_PREFIX);
+  if (len >= prefixLen && memcmp(data, PROTO_TELEMETRY_PREFIX, prefixLen) == 0)
+  {
+    stats_.telemetryIn++;
+    return;
+  }
+
+  if (len > 0 && data[0] == '{')
+    handlePong(c, data, len);
+}
+
+void Server::answerCaps(Conn *c, const std::string &caps)
+{
+  c->binary = !opts_.textOnly && capsFlag(caps, "bin");
+  if (c->binary)
+    stats_.binarySessions++;
+  if (udpFd_ >= 0 && capsFlag(caps, "udp") && c->sid == 0)
+  {
+    do
+      c->sid = nextSid_++;
+    while (c->sid == 0 || connBySid_.count(c->sid));
+    connBySid_[c->sid] = c;
+    stats_.udpSessions++;
+  }
+  // A sleeping device asks for a longer heartbeat; granted up to three
+  // quarters of the idle timeout, never below ours
+  uint32_t hb = opts_.heartbeatMs;
+  uint32_t wantHb = capsNumber(caps, "hb");
+  uint32_t hbCap = opts_.idleTimeoutS * 750;
+  if (wantHb > hb)
+    hb = wantHb < hbCap ? wantHb : (hbCap > hb ? hbCap : hb);
+  char session[160];
+  int n = snprintf(session, sizeof(session), "%s{\"enc\":\"%s\",\"hb\":%u,\"tele\":%u", PROTO_SESSION_PREFIX,
+                   c->binary ? "bin" : "text", hb, capsFlag(caps, "tele") ? opts_.telemetryMs : 0);
+  if (c->sid)
+    n += snprintf(session + n, sizeof(session) - n, ",\"udp\":%u,\"sid\":%u", opts_.udpPort, c->sid);
+  n += snprintf(session + n, sizeof(session) - n, "}");
+  sendFrame(c, host::WS_OP_TEXT, session, (size_t)n);
+}
+
+void Server::probeRtt(Conn *c)
+{
+  c->lastProbeS = nowS_;
+  char ping[80];
+  int n = snprintf(ping, sizeof(ping), "{\"type\":\"ping\",\"t\":%u", monotonicMs());
+  if (c->rttMs)
+    n += snprintf(ping + n, sizeof(ping) - n, ",\"rtt\":%u", c->rttMs);
+  n += snprintf(ping + n, sizeof(ping) - n, "}");
+  sendFrame(c, host::WS_OP_TEXT, ping, (size_t)n);
+}
+
+// The device echoes a JSON ping with "type":"pong"; t is ours
+void Server::handlePong(Conn *c, const char *data, size_t len)
+{
+  std::string json(data, len);
+  if (json.find("\"pong\"") == std::string::npos)
+    return;
+  uint32_t t = capsNumber(json, "t");
+  if (t == 0)
+    return;
+  c->rttMs = monotonicMs() - t;
+  if (c->rttMs == 0)
+    c->rttMs = 1; // 0 means none
+  stats_.rttSamples++;
+  stats_.rttSumMs += c->rttMs;
+  if (c->rttMs > stats_.rttMaxMs)
+    stats_.rttMaxMs = c->rttMs;
+}
+
+uint32_t Server::resolveToken(const std::string &token)
+{
+  auto it = userByToken_.find(token);
+  if (it != userByToken_.end())
+    return it->second;
+  if (opts_.openAuth && !token.empty())
+    return userIndex(token, true);
+  return NO_USER;
+}
+
+void Server::sendFrame(Conn *c, uint8_t opcode, const char *data, size_t len)
+{
+  std::string frame;
+  host::wsAppendFrame(frame, opcode, (const uint8_t *)data, len, false);
+  stats_.framesOut++;
+  sendRaw(c, frame.data(), frame.size());
+}
+
+void Server::sendRaw(Conn *c, const char *data, size_t len)
+{
+  stats_.bytesOut += len;
+  if (c->tx.empty())
+  {
+    ssize_t n = send(c->fd, data, len, MSG_NOSIGNAL);
+    if (n == (ssize_t)len)
+      return;
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      closeConn(c);
+      return;
+    }
+    if (n > 0)
+    {
+      data += n;
+      len -= (size_t)n;
+    }
+  }
+  stats_.txBuffered++;
+  c->tx.append(data, len);
+  if (!c->wantWrite)
+  {
+    c->wantWrite = true;
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    ev.data.fd = c->fd;
+    epoll_ctl(epfd_, EPOLL_CTL_MOD, c->fd, &ev);
+  }
+}
+
+void Server::closeConn(Conn *c)
+{
+  unsubscribe(c);
+  if (c->sid)
+    connBySid_.erase(c->sid);
+  epoll_ctl(epfd_, EPOLL_CTL_DEL, c->fd, nullptr);
+  close(c->fd);
+  conns_[c->fd] = nullptr;
+  live_--;
+  stats_.closed++;
+  delete c;
+}
+
+void Server::subscribe(Conn *c, uint32_t user)
+{
+  if (c->state == ConnState::Authed)
+    unsubscribe(c);
+  c->state = ConnState::Authed;
+  c->user = user;
+  User &u = users_[user];
+  c->prev = nullptr;
+  c->next = u.subscribers;
+  if (u.subscribers)
+    u.subscribers->prev = c;
+  u.subscribers = c;
+  u.subscriberCount++;
+  authed_++;
+}
+
+void Server::unsubscribe(Conn *c)
+{
+  if (c->user == NO_USER)
+    return;
+  User &u = users_[c->user];
+  if (c->prev)
+    c->prev->next = c->next;
+  else
+    u.subscribers = c->next;
+  if (c->next)
+    c->next->prev = c->prev;
+  c->prev = c->next = nullptr;
+  c->user = NO_USER;
+  u.subscriberCount--;
+  authed_--;
+}
+
+bool Server::setVoiceState(const std::string &user, bool on)
+{
+  uint32_t idx = userIndex(user, opts_.openAuth);
+  if (idx == NO_USER)
+    return false;
+  User &u = users_[idx];
+  if (u.on == on)
+    return true;
+  u.on = on;
+  uint32_t now = epochMs32();
+  u.seq = (int32_t)(now - u.seq) > 0 ? now : u.seq + 1;
+
+  // pre-encoded: server frames are unmasked, so every subscriber gets the same bytes
+  static const char frameOn[] = {(char)0x81, 0x01, '1'};
+  static const char frameOff[] = {(char)0x81, 0x01, '0'};
+  static const char binOn[] = {(char)0x82, 0x02, (char)PROTO_BIN_STATUS, 0x01};
+  static const char binOff[] = {(char)0x82, 0x02, (char)PROTO_BIN_STATUS, 0x00};
+  // UDP sessions get the seq on the WS too, so whichever copy lands first wins
+  char binSeq[2 + PROTO_BIN_STATUS_SEQ_LEN] = {(char)0x82, PROTO_BIN_STATUS_SEQ_LEN, (char)PROTO_BIN_STATUS, (char)(on ? 1 : 0)};
+  for (uint8_t i = 0; i < 4; i++)
+    binSeq[4 + i] = (char)(u.seq >> (i * 8));
+  std::string textSeq; // built on first use
+  Conn *c = u.subscribers;
+  while (c)
+  {
+    Conn *next = c->next; // sendRaw may close c
+    stats_.framesOut++;
+    stats_.statusPushes++;
+    if (c->sid == 0)
+    {
+      if (c->binary)
+        sendRaw(c, on ? binOn : binOff, sizeof(binOn));
+      else
+        sendRaw(c, on ? frameOn : frameOff, sizeof(frameOn));
+      c = next;
+      continue;
+    }
+
+    if (c->udpReady)
+    {
+      UdpResend r;
+      StatusDatagram d = {PROTO_UDP_STATUS, c->sid, u.seq, (uint8_t)(on ? 1 : 0)};
+      statusDatagramSeal(r.dgram, d, (const uint8_t *)c->token.data(), c->token.size());
+      sendDatagram(c, r.dgram);
+      if (opts_.udpCopies > 1)
+      {
+        r.dueS = monotonicS() + opts_.udpGapMs / 1000.0;
+        r.sid = c->sid;
+        r.copiesLeft = (uint8_t)(opts_.udpCopies - 1);
+        udpResends_.push_back(r);
+      }
+    }
+    if (c->binary)
+      sendRaw(c, binSeq, sizeof(binSeq));
+    else
+    {
+      if (textSeq.empty())
+      {
+        std::string json = "{\"type\":\"status\",\"mask\":" + std::to_string(on ? 1 : 0) +
+                           ",\"seq\":" + std::to_string(u.seq) + "}";
+        host::wsAppendFrame(textSeq, host::WS_OP_TEXT, (const uint8_t *)json.data(), json.size(), false);
+      }
+      sendRaw(c, textSeq.data(), textSeq.size());
+    }
+    c = next;
+  }
+  return true;
+}
+
+// Hellos only: devices never send status. A hello moves the session's address
+// (NAT rebinding, roaming) only when its counter is newer, so a captured one
+// cannot be replayed to redirect the datagrams.
+void Server::readUdp()
+{
+  for (;;)
+  {
+    uint8_t buf[PROTO_UDP_LEN + 1];
+    sockaddr_in from{};
+    socklen_t fromLen = sizeof(from);
+    ssize_t n = recvfrom(udpFd_, buf, sizeof(buf), 0, (sockaddr *)&from, &fromLen);
+    if (n < 0)
+      return;
+    uint32_t sid = n == PROTO_UDP_LEN ? (uint32_t)buf[2] | (uint32_t)buf[3] << 8 | (uint32_t)buf[4] << 16 | (uint32_t)buf[5] << 24 : 0;
+    auto it = sid ? connBySid_.find(sid) : connBySid_.end();
+    StatusDatagram d;
+    if (it == connBySid_.end() ||
+        !statusDatagramOpen(buf, (size_t)n, (const uint8_t *)it->second->token.data(), it->second->token.size(), d) ||
+        d.type != PROTO_UDP_HELLO || (it->second->udpReady && (int32_t)(d.seq - it->second->helloSeq) <= 0))
+    {
+      stats_.udpRejected++;
+      continue;
+    }
+    Conn *c = it->second;
+    c->udpReady = true;
+    c->helloSeq = d.seq;
+    c->udpAddr = from;
+    c->lastRxS = nowS_;
+    stats_.udpHellos++;
+  }
+}
+
+void Server::sendDatagram(Conn *c, const uint8_t *dgram)
+{
+  stats_.udpOut++;
+  sendto(udpFd_, dgram, PROTO_UDP_LEN, 0, (const sockaddr *)&c->udpAddr, sizeof(c->udpAddr));
+}
+
+// Copies go out udpGapMs apart; every entry is queued at now + gap, so the
+// queue stays in due order without sorting.
+void Server::flushUdpResends(double now)
+{
+  static_assert(sizeof(UdpResend::dgram) == PROTO_UDP_LEN, "relay.h copy of PROTO_UDP_LEN");
+  while (!udpResends_.empty() && udpResends_.front().dueS <= now)
+  {
+    UdpResend r = udpResends_.front();
+    udpResends_.pop_front();
+    auto it = connBySid_.find(r.sid);
+    if (it == connBySid_.end() || !it->second->udpReady)
+      continue;
+    sendDatagram(it->second, r.dgram);
+    if (--r.copiesLeft > 0)
+    {
+      r.dueS = now + opts_.udpGapMs / 1000.0;
+      udpResends_.push_back(r);
+    }
+  }
+}
+
+int Server::udpTimeoutMs(double now) const
+{
+  double waitMs = (udpResends_.front().dueS - now) * 1000.0;
+  return waitMs <= 0 ? 0 : (int)waitMs + 1;
+}
+
+size_t Server::pushText(const std::string &user, const std::string &payload)
+{
+  std::string frame;
+  host::wsAppendFrame(frame, host::WS_OP_TEXT, (const uint8_t *)payload.data(), payload.size(), false);
+  size_t sent = 0;
+  auto pushTo = [&](User &u) {
+    Conn *c = u.subscribers;
+    while (c)
+    {
+      Conn *next = c->next;
+      stats_.framesOut++;
+      sendRaw(c, frame.data(), frame.size());
+      sent++;
+      c = next;
+    }
+  };
+  if (user == "*")
+  {
+    for (User &u : users_)
+      pushTo(u);
+  }
+  else
+  {
+    uint32_t idx = userIndex(user, false);
+    if (idx != NO_USER)
+      pushTo(users_[idx]);
+  }
+  return sent;
+}
+
+size_t Server::kick(const std::string &user)
+{
+  size_t n = 0;
+  for (Conn *c : conns_)
+  {
+    if (!c || c->user == NO_USER)
+      continue;
+    if (user == "*" || users_[c->user].name == user)
+    {
+      closeConn(c);
+      n++;
+    }
+  }
+  return n;
+}
+
+// Devices spread their reconnects over jitterMs themselves, so moving a whole
+// relay's worth of devices costs one frame each here and no reconnect storm.
+size_t Server::redirect(const std::string &user, const std::string &url, uint32_t delayMs, uint32_t jitterMs)
+{
+  std::string msg = "{\"type\":\"redirect\",\"url\":\"" + url + "\",\"delayMs\":" + std::to_string(delayMs) +
+                    ",\"jitterMs\":" + std::to_string(jitterMs) + "}";
+  size_t n = pushText(user, msg);
+  stats_.redirects += n;
+  return n;
+}
+
+size_t Server::drain(uint32_t jitterMs)
+{
+  draining_ = true;
+  size_t n = pushText("*", "{\"type\":\"drain\",\"jitterMs\":" + std::to_string(jitterMs) + "}");
+  stats_.redirects += n;
+  return n;
+}
+
+void Server::sweep()
+{
+  for (Conn *c : conns_)
+  {
+    if (!c)
+      continue;
+    bool unauthed = c->state == ConnState::Http || c->state == ConnState::Ws;
+    if ((unauthed && nowS_ - c->openedS >= opts_.authTimeoutS) || nowS_ - c->lastRxS >= opts_.idleTimeoutS)
+      closeConn(c);
+    else if (opts_.rttProbeS && c->state == ConnState::Authed && nowS_ - c->lastProbeS >= opts_.rttProbeS)
+      probeRtt(c);
+  }
+}
+
+void Server::simulateVoice(double elapsedS)
+{
+  static std::mt19937 rng(12345);
+  static double carry = 0;
+  if (users_.empty())
+    return;
+  carry += opts_.simulateVoiceHz * elapsedS;
+  std::uniform_int_distribution<size_t> pick(0, users_.size() - 1);
+  while (carry >= 1.0)
+  {
+    carry -= 1.0;
+    User &u = users_[pick(rng)];
+    setVoiceState(u.name, !u.on);
+  }
+}
+
+std::string Server::statsLine() const
+{
+  char buf[1024];
+  snprintf(buf, sizeof(buf),
+           "conns=%zu authed=%zu users=%zu accepted=%llu auth_ok=%llu auth_fail=%llu closed=%llu frames_in=%llu frames_out=%llu status_pushes=%llu bytes_out=%llu tx_buffered=%llu caps=%llu bin_sessions=%llu telemetry=%llu redirects=%llu drain_rejected=%llu draining=%d udp_sessions=%llu udp_hellos=%llu udp_out=%llu udp_rejected=%llu rtt_samples=%llu rtt_avg_ms=%llu rtt_max_ms=%u",
+           live_, authed_, users_.size(), (unsigned long long)stats_.accepted, (unsigned long long)stats_.authOk,
+           (unsigned long long)stats_.authFail, (unsigned long long)stats_.closed, (unsigned long long)stats_.framesIn,
+           (unsigned long long)stats_.framesOut, (unsigned long long)stats_.statusPushes, (unsigned long long)stats_.bytesOut,
+           (unsigned long long)stats_.txBuffered, (unsigned long long)stats_.capsIn, (unsigned long long)stats_.binarySessions,
+           (unsigned long long)stats_.telemetryIn, (unsigned long long)stats_.redirects,
+           (unsigned long long)stats_.drainRejected, draining_ ? 1 : 0, (unsigned long long)stats_.udpSessions,
+           (unsigned long long)stats_.udpHellos, (unsigned long long)stats_.udpOut, (unsigned long long)stats_.udpRejected,
+           (unsigned long long)stats_.rttSamples,
+           (unsigned long long)(stats_.rttSamples ? stats_.rttSumMs / stats_.rttSamples : 0), stats_.rttMaxMs);
+  return buf;
+}
+
+// Control protocol, one command per line:
+//   SET <user> <0|1>          voice-state change (the Discord stand-in)
+//   OTA <user|*> <url|json>   push an OTA trigger (plain URLs become OTA:<url>)
+//   SEND <user|*> <text>      push an arbitrary text frame
+//   KICK <user|*>             drop connections
+//   REDIRECT <user|*> <url> [delayMs] [jitterMs]
+//                             move devices to another relay
+//   DRAIN [jitterMs]          refuse new devices, ask connected ones to move
+//   UNDRAIN                   take devices again
+//   STATS
+std::string Server::runControlCommand(const std::string &line)
+{
+  std::istringstream in(line);
+  std::string cmd, user;
+  in >> cmd;
+  if (cmd == "STATS")
+    return "OK " + statsLine();
+  if (cmd == "DRAIN")
+  {
+    uint32_t jitterMs = 30000;
+    in >> jitterMs;
+    return "OK " + std::to_string(drain(jitterMs));
+  }
+  if (cmd == "UNDRAIN")
+  {
+    undrain();
+    return "OK";
+  }
+  if (!(in >> user))
+    return "ERR usage";
+  std::string rest;
+  std::getline(in, rest);
+  size_t startPos = rest.find_first_not_of(' ');
+  rest = startPos == std::string::npos ? "" : rest.substr(startPos);
+
+  if (cmd == "SET")
+  {
+    if (rest != "0" && rest != "1")
+      return "ERR usage: SET <user> <0|1>";
+    return setVoiceState(user, rest == "1") ? "OK" : "ERR unknown user";
+  }
+  if (cmd == "OTA" || cmd == "SEND")
+  {
+    if (rest.empty())
+      return "ERR missing payload";
+    std::string payload = (cmd == "OTA" && rest[0] != '{') ? PROTO_OTA_PREFIX + rest : rest;
+    return "OK " + std::to_string(pushText(user, payload));
+  }
+  if (cmd == "KICK")
+    return "OK " + std::to_string(kick(user));
+  if (cmd == "REDIRECT")
+  {
+    std::istringstream args(rest);
+    std::string url;
+    uint32_t delayMs = 0, jitterMs = 0;
+    if (!(args >> url))
+      return "ERR usage: REDIRECT <user|*> <url> [delayMs] [jitterMs]";
+    args >> delayMs >> jitterMs;
+    return "OK " + std::to_string(redirect(user, url, delayMs, jitterMs));
+  }
+  return "ERR unknown command";
+}
+
+void Server::handleControlInput(int fd, std::string &buffer)
+{
+  char buf[4096];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n <= 0)
+  {
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+      return;
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+    if (fd != STDIN_FILENO)
+      close(fd);
+    controlBuffers_.erase(fd);
+    return;
+  }
+  buffer.append(buf, (size_t)n);
+  size_t eol;
+  while ((eol = buffer.find('\n')) != std::string::npos)
+  {
+    std::string line = buffer.substr(0, eol);
+    buffer.erase(0, eol + 1);
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty())
+      continue;
+    std::string reply = runControlCommand(line) + "\n";
+    int out = fd == STDIN_FILENO ? STDOUT_FILENO : fd;
+    if (write(out, reply.data(), reply.size()) < 0)
+      break;
+  }
+}
+} // namespace relay
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace relay
+{
+struct Options
+{
+  std::string bindAddr = "0.0.0.0";
+  uint16_t port = 8080;
+  std::string controlAddr = "127.0.0.1";
+  uint16_t controlPort = 8081; // 0 disables the control port
+  std::string tokensPath;      // "<token> [user]" per line
+  bool openAuth = false;       // accept any token, user = token
+  uint32_t authTimeoutS = 10;
+  uint32_t idleTimeoutS = 60; // devices ping every 15 s
+  int socketBufferBytes = 4096;
+  double simulateVoiceHz = 0; // voice-state changes per second from the stand-in source
+  // SESSION answer to a device's CAPS
+  bool textOnly = false;        // never choose binary status frames
+  uint32_t heartbeatMs = 15000; // keep well under idleTimeoutS; a device's CAPS "hb" may raise it
+  uint32_t telemetryMs = 0;     // 0 = don't ask for telemetry
+  // UDP status next to the WS, for devices that offer "udp" in CAPS
+  uint16_t udpPort = 0;  // 0 = off; same bind address as the device port
+  uint8_t udpCopies = 3; // datagrams per status change
+  uint32_t udpGapMs = 10;
+  // JSON ping per authenticated device every rttProbeS (0 = off), carrying
+  // the previous round trip so the device can account for its sleep latency
+  uint32_t rttProbeS = 0;
+  bool readStdin = true;
+};
+
+struct Stats
+{
+  uint64_t accepted = 0;
+  uint64_t authOk = 0;
+  uint64_t authFail = 0;
+  uint64_t closed = 0;
+  uint64_t framesIn = 0;
+  uint64_t framesOut = 0;
+  uint64_t bytesOut = 0;
+  uint64_t statusPushes = 0;
+  uint64_t txBuffered = 0; // writes that hit EAGAIN and had to be queued
+  uint64_t capsIn = 0;
+  uint64_t binarySessions = 0;
+  uint64_t telemetryIn = 0;
+  uint64_t redirects = 0;     // redirect/drain frames pushed
+  uint64_t drainRejected = 0; // upgrades answered 503 while draining
+  uint64_t udpSessions = 0;
+  uint64_t udpHellos = 0;   // accepted hellos (address learned or refreshed)
+  uint64_t udpOut = 0;      // status datagrams sent, copies included
+  uint64_t udpRejected = 0; // datagrams that failed sid, MAC or counter checks
+  uint64_t rttSamples = 0;  // JSON ping round trips measured
+  uint64_t rttSumMs = 0;
+  uint32_t rttMaxMs = 0;
+};
+
+struct Conn;
+
+struct User
+{
+  std::string name;
+  bool on = false;
+  uint32_t seq = 0; // last status seq, epoch ms based (see status_seq in protocol.json)
+  Conn *subscribers = nullptr; // intrusive list of authenticated connections
+  uint32_t subscriberCount = 0;
+};
+
+// Single-threaded epoll relay speaking the device protocol:
+//   upgrade with "Authorization: Bearer <token>"
+//                                relay -> 101 + OK + current "1"/"0", or 101 + NOAUTH + close
+//   device -> AUTH:<token>       relay -> OK + current "1"/"0", or NOAUTH + close
+//   device -> CAPS:{...}         relay -> SESSION:{"enc","hb","tele"[,"udp","sid"]},
+//                                held back until the connection is authenticated
+//   relay  -> {"type":"ping","t":ms,"rtt":ms}  every rttProbeS; the pong gives the next rtt
+//   relay  -> "1" / "0"          on every voice-state change of the token's user,
+//             or bin [0x01, mask] once the session chose "bin"
+//   device -> UDP hello          relay -> udpCopies status datagrams udpGapMs
+//             apart per change, and the WS frame carries the same seq
+//   relay  -> OTA:<url> / {"type":"ota",...}   pushed from the control port
+//   relay  -> {"type":"redirect"|"drain",...}  pushed from the control port;
+//             a draining relay answers new upgrades with 503
+class Server
+{
+public:
+  explicit Server(const Options &opts);
+  ~Server();
+
+  bool start();
+  void run();
+  void stop() { running_ = false; }
+
+  // Voice-state source API (control port, stdin, simulator).
+  bool setVoiceState(const std::string &user, bool on);
+  size_t pushText(const std::string &user, const std::string &payload); // "*" = everyone
+  size_t kick(const std::string &user);
+  size_t redirect(const std::string &user, const std::string &url, uint32_t delayMs, uint32_t jitterMs);
+  size_t drain(uint32_t jitterMs); // stop taking devices and ask the connected ones to move
+  void undrain() { draining_ = false; }
+  std::string statsLine() const;
+
+private:
+  bool loadTokens();
+  int listenOn(const std::string &addr, uint16_t port);
+
+  void acceptDevices();
+  void acceptControl();
+  void onReadable(Conn *c);
+  void onWritable(Conn *c);
+  bool handleHttp(Conn *c);
+  bool handleFrames(Conn *c);
+  void handleText(Conn *c, const char *data, size_t len);
+  uint32_t resolveToken(const std::string &token); // NO_USER when rejected
+  void sendFrame(Conn *c, uint8_t opcode, const char *data, size_t len);
+  void sendRaw(Conn *c, const char *data, size_t len);
+  void closeConn(Conn *c);
+  void subscribe(Conn *c, uint32_t user);
+  void unsubscribe(Conn *c);
+  void sweep();
+  void probeRtt(Conn *c);
+  void handlePong(Conn *c, const char *data, size_t len);
+  void answerCaps(Conn *c, const std::string &caps);
+  void simulateVoice(double elapsedS);
+  void handleControlInput(int fd, std::string &buffer);
+  void readUdp();
+  void sendDatagram(Conn *c, const uint8_t *dgram);
+  void flushUdpResends(double now);
+  int udpTimeoutMs(double now) const;
+  std::string runControlCommand(const std::string &line);
+
+  uint32_t userIndex(const std::string &name, bool create);
+
+  Options opts_;
+  Stats stats_;
+  bool running_ = false;
+  bool draining_ = false;
+  int epfd_ = -1;
+  int listenFd_ = -1;
+  int controlFd_ = -1;
+  int udpFd_ = -1;
+  uint32_t nowS_ = 0;
+
+  std::vector<Conn *> conns_; // indexed by fd
+  size_t live_ = 0;
+  size_t authed_ = 0;
+  std::vector<User> users_;
+  std::unordered_map<std::string, uint32_t> userByName_;
+  std::unordered_map<std::string, uint32_t> userByToken_;
+  std::unordered_map<int, std::string> controlBuffers_;
+
+  struct UdpResend
+  {
+    double dueS;
+    uint32_t sid; // the connection may be gone by then
+    uint8_t copiesLeft;
+    uint8_t dgram[19]; // PROTO_UDP_LEN (asserted in relay.cpp)
+  };
+  uint32_t nextSid_ = 0;
+  std::unordered_map<uint32_t, Conn *> connBySid_;
+  std::deque<UdpResend> udpResends_; // due times never decrease
+};
+} // namespace relay
@@ -0,0 +1,124 @@
+// Reference relay for the device protocol.
+//
+//   pio run -e relay && .pio/build/relay/program --tokens tokens.txt
+//
+//   --port <n>            device WebSocket port (default 8080)
+//   --bind <addr>         device listen address (default 0.0.0.0)
+//   --control-port <n>    line-based control port on 127.0.0.1 (default 8081, 0 = off)
+//   --tokens <file>       "<token> [user]" per line; users group tokens
+//   --open                accept any token (user = token)
+//   --simulate-voice <hz> stand-in Discord source: random voice-state flips per second
+//   --auth-timeout <s>    close sockets that have not authenticated (default 10)
+//   --idle-timeout <s>    close sockets with no traffic (default 60)
+//   --sockbuf <bytes>     SO_SNDBUF/SO_RCVBUF per device socket (default 4096)
+//   --text-only           answer CAPS with the text encoding even when binary is offered
+//   --heartbeat-ms <ms>   ping interval handed to devices in SESSION (default 15000)
+//   --telemetry-ms <ms>   telemetry interval asked of devices that offer it (default 0 = off)
+//   --udp-port <n>        UDP status port offered to devices that support it (default 0 = off)
+//   --udp-copies <n>      datagrams per status change (default 3)
+//   --udp-gap-ms <ms>     spacing between the copies (default 10)
+//   --rtt-probe <s>       JSON ping per device carrying the last round trip (default 0 = off)
+//   --no-stdin            do not read control commands from stdin
+//
+// Control commands (stdin or control port): SET <user> <0|1>, OTA <user|*>
+// <url|json>, SEND <user|*> <text>, KICK <user|*>, REDIRECT <user|*> <url>
+// [delayMs] [jitterMs], DRAIN [jitterMs], UNDRAIN, STATS.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <string>
+
+#include "relay.h"
+
+static relay::Server *gServer = nullptr;
+
+static void onSignal(int)
+{
+  if (gServer)
+    gServer->stop();
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr, "usage: %s [--port n] [--bind addr] [--control-port n] [--tokens file] [--open]\n"
+                  "          [--simulate-voice hz] [--auth-timeout s] [--idle-timeout s] [--sockbuf bytes]\n"
+                  "          [--text-only] [--heartbeat-ms ms] [--telemetry-ms ms] [--udp-port n] [--udp-copies n]\n"
+                  "          [--udp-gap-ms ms] [--rtt-probe s] [--no-stdin]\n",
+          argv0);
+}
+
+int main(int argc, char **argv)
+{
+  relay::Options opts;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string a = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (a == "--port" && hasValue)
+      opts.port = (uint16_t)atoi(argv[++i]);
+    else if (a == "--bind" && hasValue)
+      opts.bindAddr = argv[++i];
+    else if (a == "--control-port" && hasValue)
+      opts.controlPort = (uint16_t)atoi(argv[++i]);
+    else if (a == "--tokens" && hasValue)
+      opts.tokensPath = argv[++i];
+    else if (a == "--open")
+      opts.openAuth = true;
+    else if (a == "--simulate-voice" && hasValue)
+      opts.simulateVoiceHz = atof(argv[++i]);
+    else if (a == "--auth-timeout" && hasValue)
+      opts.authTimeoutS = (uint32_t)atoi(argv[++i]);
+    else if (a == "--idle-timeout" && hasValue)
+      opts.idleTimeoutS = (uint32_t)atoi(argv[++i]);
+    else if (a == "--sockbuf" && hasValue)
+      opts.socketBufferBytes = atoi(argv[++i]);
+    else if (a == "--text-only")
+      opts.textOnly = true;
+    else if (a == "--heartbeat-ms" && hasValue)
+      opts.heartbeatMs = (uint32_t)atoi(argv[++i]);
+    else if (a == "--telemetry-ms" && hasValue)
+      opts.telemetryMs = (uint32_t)atoi(argv[++i]);
+    else if (a == "--udp-port" && hasValue)
+      opts.udpPort = (uint16_t)atoi(argv[++i]);
+    else if (a == "--udp-copies" && hasValue)
+      opts.udpCopies = (uint8_t)atoi(argv[++i]);
+    else if (a == "--udp-gap-ms" && hasValue)
+      opts.udpGapMs = (uint32_t)atoi(argv[++i]);
+    else if (a == "--rtt-probe" && hasValue)
+      opts.rttProbeS = (uint32_t)atoi(argv[++i]);
+    else if (a == "--no-stdin")
+      opts.readStdin = false;
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  // tens of thousands of devices need tens of thousands of descriptors
+  rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+  {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  relay::Server server(opts);
+  gServer = &server;
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = onSignal;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  if (!server.start())
+    return 1;
+  server.run();
+  fprintf(stderr, "relay: %s\n", server.statsLine().c_str());
+  return 0;
+}
@@ -0,0 +1,391 @@
+// Replays WS session captures (CAPTURE_DUMP output from a device built with
+// WS_CAPTURE_BYTES) through the firmware's WS event handler and reports
+// dispatch throughput and differences from the recorded outcome.
+//
+//   pio run -e replay && .pio/build/replay/program session.log [more.log ...]
+//
+//   --speed max|recorded|<factor>  pacing between events (default max); the
+//                                  virtual clock always follows the recorded
+//                                  timestamps so millis() based logic matches
+//   --repeat <n>                   dispatch the capture n times for throughput
+//                                  (max speed only, default 1)
+//   --json                         machine-readable results on stdout
+//
+// A capture file is any text containing CAP:/CAPTURE: lines, so raw serial
+// logs work as-is. Outbound frames produced during the replay are compared
+// with the recorded 'O' records, and the state after the last event with the
+// recorded CAPTURE:STATE line. Exit status is 1 when any capture differs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../src/main.cpp"
+
+#include "host/host.h"
+
+#if WS_CAPTURE_BYTES == 0
+#error "the replay env must build the firmware with WS_CAPTURE_BYTES"
+#endif
+
+namespace
+{
+struct Restarted
+{
+};
+
+struct Record
+{
+  uint32_t ms;
+  char dir;
+  std::string type;
+  std::string payload;
+};
+
+struct Capture
+{
+  std::string path;
+  std::vector<Record> records;
+  std::string finalState; // CAPTURE:STATE line, "" if missing
+  uint32_t dropped = 0;
+};
+
+struct Options
+{
+  std::vector<std::string> paths;
+  double speed = 0; // 0 = max, 1 = recorded, n = n times faster
+  int repeat = 1;
+  bool json = false;
+};
+
+struct Outcome
+{
+  std::string path;
+  size_t events = 0;
+  size_t bytes = 0;
+  double seconds = 0;
+  uint32_t restarts = 0;
+  uint32_t otaRequests = 0;
+  uint32_t portalOpens = 0;
+  std::vector<std::string> diffs;
+};
+
+std::string gSerial;
+
+bool hexDecode(const std::string &hex, std::string &out)
+{
+  if (hex.size() % 2)
+    return false;
+  out.clear();
+  for (size_t i = 0; i < hex.size(); i += 2)
+  {
+    char *end = nullptr;
+    std::string byte = hex.substr(i, 2);
+    long v = strtol(byte.c_str(), &end, 16);
+    if (*end)
+      return false;
+    out.push_back((char)v);
+  }
+  return true;
+}
+
+// Pulls CAP:/CAPTURE: lines out of arbitrary serial output.
+void parseCapture(std::istream &in, Capture &cap)
+{
+  std::string line;
+  while (std::getline(in, line))
+  {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    size_t at;
+    if ((at = line.find("CAP:")) != std::string::npos)
+    {
+      std::istringstream ls(line.substr(at + 4));
+      Record r;
+      std::string hex;
+      if (!(ls >> r.ms >> r.dir >> r.type))
+        continue;
+      ls >> hex;
+      if (!hexDecode(hex, r.payload))
+        continue;
+      cap.records.push_back(r);
+    }
+    else if ((at = line.find("CAPTURE:STATE ")) != std::string::npos)
+      cap.finalState = line.substr(at + 14);
+    else if ((at = line.find("\"dropped\":")) != std::string::npos && line.find("CAPTURE:BEGIN") != std::string::npos)
+      cap.dropped = (uint32_t)atoi(line.c_str() + at + 10);
+  }
+}
+
+bool loadCapture(const std::string &path, Capture &cap)
+{
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  cap.path = path;
+  parseCapture(in, cap);
+  return true;
+}
+
+std::map<std::string, std::string> parseState(const std::string &line)
+{
+  std::map<std::string, std::string> m;
+  std::istringstream ls(line);
+  std::string kv;
+  while (ls >> kv)
+  {
+    size_t eq = kv.find('=');
+    if (eq != std::string::npos)
+      m[kv.substr(0, eq)] = kv.substr(eq + 1);
+  }
+  return m;
+}
+
+bool typeFromName(const std::string &name, WStype_t &type)
+{
+  static const std::map<std::string, WStype_t> types = {
+      {"ERROR", WStype_ERROR}, {"DISCONNECTED", WStype_DISCONNECTED}, {"CONNECTED", WStype_CONNECTED}, {"TEXT", WStype_TEXT},
+      {"BIN", WStype_BIN},     {"PING", WStype_PING},                 {"PONG", WStype_PONG},
+  };
+  auto it = types.find(name);
+  if (it == types.end())
+    return false;
+  type = it->second;
+  return true;
+}
+
+// Puts the firmware into the state the capture started from.
+void resetFirmware(const Capture &cap)
+{
+  cfg = AppConfig();
+  cfg.wsUrl = "ws://replay.invalid:8080/ws";
+  cfg.authToken = "replay-token";
+  cfg.wifiSsid = "replay-ssid";
+  saveConfig(cfg);
+  setupWebSocketFromConfig();
+  setLed(false);
+  wsWasConnected = false;
+
+  if (!cap.records.empty() && cap.records[0].dir == 'S')
+  {
+    auto s = parseState(cap.records[0].payload);
+    setLed(s["led"] == "1");
+    authFailureCount = (uint8_t)atoi(s["authFailures"].c_str());
+    wsWasConnected = s["connected"] == "1";
+  }
+  wsCaptureClear();
+}
+
+void dispatch(const Record &r)
+{
+  WStype_t type;
+  if (r.dir != 'I' || !typeFromName(r.type, type))
+    return;
+  // the library hands the callback a mutable, NUL-terminated copy
+  std::vector<uint8_t> buf(r.payload.begin(), r.payload.end());
+  buf.push_back(0);
+  webSocket.injectEvent(type, buf.data(), r.payload.size());
+}
+
+// Runs the capture once; returns the firmware's own dump of what it did.
+// Side effects are only counted on the first pass.
+Capture replayOnce(const Capture &cap, const Options &opts, Outcome &out, bool first)
+{
+  resetFirmware(cap);
+  uint32_t portalsBefore = host::portalOpenCount();
+  gSerial.clear();
+
+  uint32_t firstMs = cap.records.empty() ? 0 : cap.records[0].ms;
+  uint64_t baseUs = host::nowMicros();
+  auto start = std::chrono::steady_clock::now();
+  for (const Record &r : cap.records)
+  {
+    uint64_t targetUs = baseUs + (uint64_t)(r.ms - firstMs) * 1000;
+    uint64_t now = host::nowMicros();
+    if (targetUs > now)
+    {
+      if (opts.speed > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)((targetUs - now) / opts.speed)));
+      host::advanceMicros(targetUs - now);
+    }
+    if (r.dir != 'I')
+      continue;
+    try
+    {
+      dispatch(r);
+    }
+    catch (const Restarted &)
+    {
+      // a real device would lose the rest of the session here
+      if (first)
+        out.restarts++;
+      break;
+    }
+    out.events++;
+    out.bytes += r.payload.size();
+  }
+  out.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (first)
+  {
+    size_t pos = 0;
+    while ((pos = gSerial.find("OTA requested", pos)) != std::string::npos)
+    {
+      out.otaRequests++;
+      pos++;
+    }
+    out.portalOpens = host::portalOpenCount() - portalsBefore;
+  }
+
+  gSerial.clear();
+  handleSerialCommand("CAPTURE_DUMP");
+  Capture replayed;
+  std::istringstream in(gSerial);
+  parseCapture(in, replayed);
+  return replayed;
+}
+
+Outcome replay(const Capture &cap, const Options &opts)
+{
+  Outcome out;
+  out.path = cap.path;
+  Capture replayed = replayOnce(cap, opts, out, true);
+  for (int i = 1; i < opts.repeat && opts.speed == 0; i++)
+    replayOnce(cap, opts, out, false);
+
+  // outbound frames, in order
+  std::vector<const Record *> want, got;
+  for (const Record &r : cap.records)
+    if (r.dir == 'O')
+      want.push_back(&r);
+  for (const Record &r : replayed.records)
+    if (r.dir == 'O')
+      got.push_back(&r);
+  for (size_t i = 0; i < want.size() || i < got.size(); i++)
+  {
+    const Record *w = i < want.size() ? want[i] : nullptr;
+    const Record *g = i < got.size() ? got[i] : nullptr;
+    if (w && g && w->type == g->type && w->payload == g->payload)
+      continue;
+    char buf[512];
+    snprintf(buf, sizeof(buf), "outbound #%zu: recorded %s%s%s, replay %s%s%s", i, w ? w->type.c_str() : "-", w ? " " : "",
+             w ? w->payload.c_str() : "", g ? g->type.c_str() : "-", g ? " " : "", g ? g->payload.c_str() : "");
+    out.diffs.push_back(buf);
+  }
+
+  // final state
+  if (!cap.finalState.empty())
+  {
+    auto want = parseState(cap.finalState);
+    auto got = parseState(replayed.finalState);
+    for (auto &kv : want)
+      if (got[kv.first] != kv.second)
+        out.diffs.push_back("state " + kv.first + ": recorded " + kv.second + ", replay " + got[kv.first]);
+  }
+  return out;
+}
+
+void usage(const char *argv0)
+{
+  fprintf(stderr, "usage: %s [--speed max|recorded|<factor>] [--repeat n] [--json] capture...\n", argv0);
+}
+
+bool parseArgs(int argc, char **argv, Options &o)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string a = argv[i];
+    if (a == "--speed" && i + 1 < argc)
+    {
+      std::string v = argv[++i];
+      o.speed = v == "max" ? 0 : v == "recorded" ? 1 : atof(v.c_str());
+      if (o.speed < 0)
+        return false;
+    }
+    else if (a == "--repeat" && i + 1 < argc)
+      o.repeat = atoi(argv[++i]) > 0 ? atoi(argv[i]) : 1;
+    else if (a == "--json")
+      o.json = true;
+    else if (a.rfind("--", 0) == 0)
+      return false;
+    else
+      o.paths.push_back(a);
+  }
+  return !o.paths.empty();
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options opts;
+  if (!parseArgs(argc, argv, opts))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  host::init(argc, argv);
+  host::setClockMode(host::ClockMode::Virtual);
+  host::setFsRoot(".pio/replay-fs");
+  host::serialDetach();
+  host::onSerialWrite([](const uint8_t *data, size_t len) { gSerial.append((const char *)data, len); });
+  host::setRestartHandler([] { throw Restarted(); });
+  pinMode(LED_PIN, OUTPUT);
+
+  std::vector<Outcome> outcomes;
+  bool differs = false;
+  for (const std::string &path : opts.paths)
+  {
+    Capture cap;
+    if (!loadCapture(path, cap))
+    {
+      fprintf(stderr, "replay: cannot read %s\n", path.c_str());
+      return 2;
+    }
+    if (cap.records.empty())
+    {
+      fprintf(stderr, "replay: no CAP: records in %s\n", path.c_str());
+      return 2;
+    }
+    if (cap.dropped > 0)
+      fprintf(stderr, "replay: %s: ring dropped %u records, start state is a guess\n", path.c_str(), cap.dropped);
+    outcomes.push_back(replay(cap, opts));
+    differs |= !outcomes.back().diffs.empty();
+  }
+
+  if (opts.json)
+  {
+    printf("{\"fw\": \"%s\", \"captures\": [\n", FW_VERSION_STR);
+    for (size_t i = 0; i < outcomes.size(); i++)
+    {
+      const Outcome &o = outcomes[i];
+      printf("  {\"path\": \"%s\", \"events\": %zu, \"events_per_s\": %.0f, \"ns_per_event\": %.1f, \"restarts\": %u, "
+             "\"ota_requests\": %u, \"portal_opens\": %u, \"diffs\": %zu}%s\n",
+             o.path.c_str(), o.events, o.seconds > 0 ? o.events / o.seconds : 0, o.events ? o.seconds * 1e9 / o.events : 0, o.restarts,
+             o.otaRequests, o.portalOpens, o.diffs.size(), i + 1 < outcomes.size() ? "," : "");
+    }
+    printf("]}\n");
+  }
+  else
+  {
+    for (const Outcome &o : outcomes)
+    {
+      printf("%s: %zu events, %.0f events/s (%.1f ns/event, %.1f MB/s), restarts %u, ota %u, portal %u\n", o.path.c_str(), o.events,
+             o.seconds > 0 ? o.events / o.seconds : 0, o.events ? o.seconds * 1e9 / o.events : 0,
+             o.seconds > 0 ? o.bytes / o.seconds / 1e6 : 0, o.restarts, o.otaRequests, o.portalOpens);
+      for (const std::string &d : o.diffs)
+        printf("  DIFF %s\n", d.c_str());
+      if (o.diffs.empty())
+        printf("  outbound frames and final state match\n");
+    }
+  }
+  return differs ? 1 : 0;
+}
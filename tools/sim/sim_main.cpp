@@ -0,0 +1,310 @@
+// Discrete-event simulation of the firmware boot and reconnect paths.
+//
+//   pio run -e sim && .pio/build/sim/program [--scenario <name>] [--verbose]
+//                                             [--horizon-ms <n>] [--json <path>]
+//
+// Every scenario runs the real setup()/loop() on the virtual clock in a forked
+// child, against a scripted AP (host::setWifiPolicy) and relay (SimWsBackend).
+// The figure of merit is time-to-LED-correct: how long after the scenario's
+// reference point the LED first shows the voice state the relay holds.
+
+#include "../../src/main.cpp"
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "host/host.h"
+#include "sim_relay.h"
+
+namespace
+{
+const uint32_t NEVER = 0xFFFFFFFFu;
+
+struct Scenario
+{
+  const char *name;
+  const char *description;
+  // Prepares config, AP and relay behaviour before setup() runs.
+  std::function<void(sim::RelayModel &relay)> arrange;
+  // Reference point for the measurement (simulated ms since boot).
+  uint32_t measureFromMs = 0;
+};
+
+struct Outcome
+{
+  uint32_t ledCorrectMs = NEVER;
+  uint32_t wallMs = 0;
+  uint32_t wsConnectAttempts = 0;
+  uint32_t wsSessions = 0;
+  uint32_t authFrames = 0;
+  uint32_t portalOpens = 0;
+  uint32_t wifiBegins = 0;
+  bool restarted = false;
+};
+
+struct Restarted
+{
+};
+
+uint32_t wifiBegins = 0;
+
+// AP model: association takes assocMs and succeeds unless available() says no,
+// in which case the scan gives up after scanMs.
+void setAccessPoint(std::function<bool(uint32_t nowMs, bool enterprise)> available, uint32_t assocMs = 2500, uint32_t scanMs = 4000)
+{
+  host::setWifiPolicy([available, assocMs, scanMs](const std::string &ssid, bool enterprise) -> host::WifiOutcome {
+    wifiBegins++;
+    if (ssid.empty())
+      return {WL_NO_SSID_AVAIL, 0};
+    if (!available(millis(), enterprise))
+      return {enterprise ? WL_CONNECT_FAILED : WL_NO_SSID_AVAIL, scanMs};
+    return {WL_CONNECTED, assocMs};
+  });
+}
+
+void seedConfig(const sim::RelayModel &relay, bool eap = false)
+{
+  AppConfig c;
+  c.wsUrl = "ws://relay.sim:8080/ws";
+  c.authToken = relay.token.c_str();
+  c.wifiSsid = "sim-ap";
+  c.wifiPass = "sim-pass";
+  if (eap)
+  {
+    c.eapIdentity = "alice";
+    c.eapPassword = "secret";
+  }
+  saveConfig(c);
+  host::setSavedSsid("sim-ap");
+}
+
+std::vector<Scenario> scenarios()
+{
+  std::vector<Scenario> s;
+
+  s.push_back({"healthy", "config stored, AP and relay up",
+               [](sim::RelayModel &relay) {
+                 seedConfig(relay);
+                 setAccessPoint([](uint32_t, bool) { return true; });
+               }});
+
+  s.push_back({"ap_missing_60s", "AP absent for the first 60 s after boot",
+               [](sim::RelayModel &relay) {
+                 seedConfig(relay);
+                 setAccessPoint([](uint32_t now, bool) { return now >= 60000; });
+               }});
+
+  s.push_back({"eap_reject_45s", "802.1X network, RADIUS rejects for the first 45 s",
+               [](sim::RelayModel &relay) {
+                 seedConfig(relay, true);
+                 setAccessPoint([](uint32_t now, bool enterprise) { return enterprise && now >= 45000; }, 3500, 3000);
+               }});
+
+  s.push_back({"dns_slow_4s", "every relay lookup takes 4 s",
+               [](sim::RelayModel &relay) {
+                 seedConfig(relay);
+                 setAccessPoint([](uint32_t, bool) { return true; });
+                 relay.dnsMs = 4000;
+               }});
+
+  s.push_back({"relay_down_90s", "relay refuses connections for the first 90 s",
+               [](sim::RelayModel &relay) {
+                 seedConfig(relay);
+                 setAccessPoint([](uint32_t, bool) { return true; });
+                 relay.down = [](uint32_t now) { return now < 90000; };
+               }});
+
+  s.push_back({"relay_restart", "relay restarts at 120 s (5 s outage), user joins voice at 121 s",
+               [](sim::RelayModel &relay) {
+                 seedConfig(relay);
+                 setAccessPoint([](uint32_t, bool) { return true; });
+                 relay.down = [](uint32_t now) { return now >= 120000 && now < 125000; };
+                 relay.voiceOn = [](uint32_t now) { return now >= 121000; };
+               },
+               121000});
+
+  s.push_back({"wifi_drop_20s", "AP drops at 60 s for 20 s, user joins voice at 65 s",
+               [](sim::RelayModel &relay) {
+                 seedConfig(relay);
+                 setAccessPoint([](uint32_t now, bool) { return now < 60000 || now >= 80000; });
+                 host::schedule(60000, [] { host::dropWifi(); });
+                 relay.voiceOn = [](uint32_t now) { return now >= 65000; };
+               },
+               65000});
+
+  s.push_back({"first_boot_portal", "no config; user submits the portal 60 s after it opens",
+               [](sim::RelayModel &relay) {
+                 setAccessPoint([](uint32_t, bool) { return true; });
+                 std::string token = relay.token;
+                 host::PortalSubmission sub;
+                 sub.ssid = "sim-ap";
+                 sub.pass = "sim-pass";
+                 sub.afterMs = 60000;
+                 sub.param = [token](const std::string &id) -> std::string {
+                   if (id == "wsurl")
+                     return "ws://relay.sim:8080/ws";
+                   if (id == "authtok")
+                     return token;
+                   return "";
+                 };
+                 host::setPortalSubmission(sub);
+               }});
+
+  return s;
+}
+
+Outcome runScenario(const Scenario &sc, uint32_t horizonMs, bool verbose)
+{
+  Outcome out;
+  auto wallStart = std::chrono::steady_clock::now();
+
+  char dir[] = "/tmp/dvs-sim-XXXXXX";
+  if (!mkdtemp(dir))
+    return out;
+
+  host::setClockMode(host::ClockMode::Virtual);
+  host::setFsRoot(dir);
+  host::serialDetach();
+  if (verbose)
+    host::onSerialWrite([](const uint8_t *d, size_t n) { fwrite(d, 1, n, stderr); });
+  host::setRestartHandler([] { throw Restarted(); });
+
+  sim::RelayModel relay;
+  host::setWsBackendFactory([&relay] { return std::unique_ptr<host::WsBackend>(new sim::SimWsBackend(relay)); });
+
+  ensureFS();
+  sc.arrange(relay);
+
+  host::onPinWrite([&](uint8_t pin, uint8_t level) {
+    uint32_t now = millis();
+    if (pin == LED_PIN && out.ledCorrectMs == NEVER && now >= sc.measureFromMs && (level == HIGH) == relay.voiceOn(now))
+      out.ledCorrectMs = now - sc.measureFromMs;
+  });
+
+  try
+  {
+    setup();
+    while (millis() < horizonMs && out.ledCorrectMs == NEVER)
+      loop();
+  }
+  catch (const Restarted &)
+  {
+    out.restarted = true;
+  }
+
+  out.wsConnectAttempts = relay.connectAttempts;
+  out.wsSessions = relay.sessions;
+  out.authFrames = relay.authFrames;
+  out.portalOpens = host::portalOpenCount();
+  out.wifiBegins = wifiBegins;
+  out.wallMs = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - wallStart).count();
+
+  std::string rm = std::string("rm -rf '") + dir + "'";
+  if (system(rm.c_str()) != 0)
+    fprintf(stderr, "could not remove %s\n", dir);
+  return out;
+}
+
+// Globals in main.cpp make setup() single-use, so each scenario gets a fresh
+// process image via fork().
+bool runIsolated(const Scenario &sc, uint32_t horizonMs, bool verbose, Outcome &out)
+{
+  int fds[2];
+  if (pipe(fds) != 0)
+    return false;
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    close(fds[0]);
+    Outcome o = runScenario(sc, horizonMs, verbose);
+    ssize_t n = write(fds[1], &o, sizeof(o));
+    _exit(n == (ssize_t)sizeof(o) ? 0 : 1);
+  }
+  close(fds[1]);
+  ssize_t n = read(fds[0], &out, sizeof(out));
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return n == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+  std::string only;
+  std::string jsonPath;
+  uint32_t horizonMs = 3600000;
+  bool verbose = false;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string a = argv[i];
+    if (a == "--scenario" && i + 1 < argc)
+      only = argv[++i];
+    else if (a == "--horizon-ms" && i + 1 < argc)
+      horizonMs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (a == "--json" && i + 1 < argc)
+      jsonPath = argv[++i];
+    else if (a == "--verbose")
+      verbose = true;
+    else
+    {
+      fprintf(stderr, "usage: %s [--scenario <name>] [--horizon-ms <n>] [--json <path>] [--verbose]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  host::init(argc, argv);
+
+  FILE *json = nullptr;
+  if (!jsonPath.empty())
+  {
+    json = fopen(jsonPath.c_str(), "w");
+    if (!json)
+    {
+      fprintf(stderr, "cannot write %s\n", jsonPath.c_str());
+      return 2;
+    }
+    fprintf(json, "[\n");
+  }
+
+  printf("%-20s %14s %9s %6s %8s %6s %6s  %s\n", "scenario", "led_correct_ms", "wall_ms", "ws_try", "sessions", "portal", "wifi", "description");
+  bool first = true;
+  int failures = 0;
+  for (const auto &sc : scenarios())
+  {
+    if (!only.empty() && only != sc.name)
+      continue;
+    Outcome o;
+    if (!runIsolated(sc, horizonMs, verbose, o))
+    {
+      printf("%-20s %14s\n", sc.name, "CRASHED");
+      failures++;
+      continue;
+    }
+    char led[24];
+    if (o.ledCorrectMs == NEVER)
+      snprintf(led, sizeof(led), o.restarted ? "restart" : "never");
+    else
+      snprintf(led, sizeof(led), "%u", o.ledCorrectMs);
+    printf("%-20s %14s %9u %6u %8u %6u %6u  %s\n", sc.name, led, o.wallMs, o.wsConnectAttempts, o.wsSessions, o.portalOpens, o.wifiBegins, sc.description);
+
+    if (json)
+    {
+      fprintf(json, "%s  {\"scenario\": \"%s\", \"led_correct_ms\": %s, \"wall_ms\": %u, \"ws_connect_attempts\": %u, \"ws_sessions\": %u, \"auth_frames\": %u, \"portal_opens\": %u, \"wifi_begins\": %u, \"restarted\": %s}",
+              first ? "" : ",\n", sc.name, o.ledCorrectMs == NEVER ? "null" : std::to_string(o.ledCorrectMs).c_str(), o.wallMs,
+              o.wsConnectAttempts, o.wsSessions, o.authFrames, o.portalOpens, o.wifiBegins, o.restarted ? "true" : "false");
+      first = false;
+    }
+  }
+  if (json)
+  {
+    fprintf(json, "\n]\n");
+    fclose(json);
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+#include "sim_relay.h"
+
+#include <Arduino.h>
+
+#include "host/host.h"
+#include "host/ws_frame.h"
+
+namespace sim
+{
+void SimWsBackend::connect(const host::WsEndpoint &ep)
+{
+  (void)ep;
+  inbox_.clear();
+  authed_ = false;
+  relay_.connectAttempts++;
+
+  delay(relay_.dnsMs);
+  if (relay_.down(millis()))
+  {
+    // RST comes back after one round trip
+    delay(relay_.rttMs);
+    relay_.refused++;
+    state_ = State::Failed;
+    return;
+  }
+  delay(relay_.rttMs); // SYN / SYN-ACK
+  state_ = State::Upgrading;
+  openAtMs_ = millis() + relay_.rttMs;
+}
+
+void SimWsBackend::queue(uint32_t delayMs, uint8_t opcode, const std::string &payload)
+{
+  inbox_.push_back({millis() + delayMs, opcode, payload});
+}
+
+bool SimWsBackend::send(uint8_t opcode, const uint8_t *payload, size_t length)
+{
+  if (state_ != State::Open)
+    return false;
+  std::string msg((const char *)payload, length);
+
+  if (opcode == host::WS_OP_PING)
+  {
+    queue(relay_.rttMs, host::WS_OP_PONG, msg);
+    return true;
+  }
+  if (opcode == host::WS_OP_TEXT && msg.compare(0, 5, "AUTH:") == 0)
+  {
+    relay_.authFrames++;
+    if (msg.substr(5) == relay_.token)
+    {
+      authed_ = true;
+      lastPushed_ = relay_.voiceOn(millis());
+      queue(relay_.rttMs, host::WS_OP_TEXT, "OK");
+      queue(relay_.rttMs, host::WS_OP_TEXT, lastPushed_ ? "1" : "0");
+    }
+    else
+    {
+      queue(relay_.rttMs, host::WS_OP_TEXT, "NOAUTH");
+    }
+  }
+  return true;
+}
+
+void SimWsBackend::close()
+{
+  state_ = State::Idle;
+  inbox_.clear();
+  authed_ = false;
+}
+
+void SimWsBackend::poll(Events &events)
+{
+  uint32_t now = millis();
+  switch (state_)
+  {
+  case State::Idle:
+    return;
+  case State::Failed:
+    state_ = State::Idle;
+    events.onWsClose();
+    return;
+  case State::Upgrading:
+    if ((int32_t)(now - openAtMs_) < 0)
+      return;
+    if (relay_.down(now))
+    {
+      state_ = State::Idle;
+      events.onWsClose();
+      return;
+    }
+    state_ = State::Open;
+    relay_.sessions++;
+    events.onWsOpen();
+    return;
+  case State::Open:
+    break;
+  }
+
+  if (relay_.down(now))
+  {
+    // relay process died: the socket closes under us
+    close();
+    events.onWsClose();
+    return;
+  }
+
+  if (authed_)
+  {
+    bool on = relay_.voiceOn(now);
+    if (on != lastPushed_)
+    {
+      lastPushed_ = on;
+      // one-way trip from the relay
+      queue(relay_.rttMs / 2, host::WS_OP_TEXT, on ? "1" : "0");
+    }
+  }
+
+  while (state_ == State::Open && !inbox_.empty() && (int32_t)(now - inbox_.front().atMs) >= 0)
+  {
+    Frame f = inbox_.front();
+    inbox_.pop_front();
+    events.onWsFrame(f.opcode, (const uint8_t *)f.payload.data(), f.payload.size());
+  }
+}
+} // namespace sim
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <string>
+
+#include "host/ws_backend.h"
+
+namespace sim
+{
+// Network and relay behaviour for one scenario, all in simulated time.
+struct RelayModel
+{
+  std::string token = "sim-token";
+  uint32_t rttMs = 40;
+  uint32_t dnsMs = 15;
+  // The relay refuses connections while this returns true.
+  std::function<bool(uint32_t nowMs)> down = [](uint32_t) { return false; };
+  // The voice state the relay would push for the device's token.
+  std::function<bool(uint32_t nowMs)> voiceOn = [](uint32_t) { return true; };
+
+  // counters
+  uint32_t connectAttempts = 0;
+  uint32_t refused = 0;
+  uint32_t sessions = 0;
+  uint32_t authFrames = 0;
+};
+
+// WsBackend that talks to RelayModel instead of a socket. connect() blocks for
+// DNS plus the TCP handshake like the ESP client does inside loop(); the
+// upgrade and every frame after it take one RTT.
+class SimWsBackend : public host::WsBackend
+{
+public:
+  explicit SimWsBackend(RelayModel &relay) : relay_(relay) {}
+
+  void connect(const host::WsEndpoint &ep) override;
+  bool send(uint8_t opcode, const uint8_t *payload, size_t length) override;
+  void close() override;
+  void poll(Events &events) override;
+
+private:
+  struct Frame
+  {
+    uint32_t atMs;
+    uint8_t opcode;
+    std::string payload;
+  };
+
+  enum class State
+  {
+    Idle,
+    Failed,
+    Upgrading,
+    Open,
+  };
+
+  void queue(uint32_t delayMs, uint8_t opcode, const std::string &payload);
+
+  RelayModel &relay_;
+  State state_ = State::Idle;
+  uint32_t openAtMs_ = 0;
+  bool authed_ = false;
+  bool lastPushed_ = false;
+  std::deque<Frame> inbox_;
+};
+} // namespace sim
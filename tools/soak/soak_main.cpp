@@ -0,0 +1,82 @@
+// Host soak run: soakRun() from src/main.cpp on the virtual clock, with the
+// heap figures from host/ (HOST_HEAP_BYTES budget, holes as fragmentation).
+//
+//   pio run -e soak && .pio/build/soak/program [--days <n>] [--verbose]
+//
+// Prints the SOAK:SAMPLE / SOAK:REPORT lines (everything with --verbose) and
+// exits 1 when the report's verdict is not "ok", so CI can gate on it.
+
+#include "../../src/main.cpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "host/host.h"
+
+namespace
+{
+struct Restarted
+{
+};
+
+std::string lineBuf;
+bool verbose = false;
+
+void onSerial(const uint8_t *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    if (data[i] != '\n')
+    {
+      lineBuf += (char)data[i];
+      continue;
+    }
+    if (verbose || lineBuf.compare(0, 5, "SOAK:") == 0 || lineBuf.find(" Soak") != std::string::npos)
+      printf("%s\n", lineBuf.c_str());
+    lineBuf.clear();
+  }
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+  host::init(argc, argv);
+
+  unsigned days = SOAK_DAYS;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--days") == 0 && i + 1 < argc)
+      days = (unsigned)atoi(argv[++i]);
+    else if (strcmp(argv[i], "--verbose") == 0)
+      verbose = true;
+    else
+    {
+      fprintf(stderr, "usage: %s [--days <n>] [--verbose]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  char dir[] = "/tmp/soak-fs-XXXXXX";
+  if (!mkdtemp(dir))
+    return 2;
+  host::setClockMode(host::ClockMode::Virtual);
+  host::setFsRoot(dir);
+  host::serialDetach();
+  host::onSerialWrite(onSerial);
+  host::setRestartHandler([] { throw Restarted(); });
+  pinMode(LED_PIN, OUTPUT);
+
+  bool ok = false;
+  try
+  {
+    ok = soakRun((uint16_t)days);
+  }
+  catch (const Restarted &)
+  {
+    fprintf(stderr, "soak: firmware restarted mid-run\n");
+  }
+  fflush(stdout);
+  return ok ? 0 : 1;
+}
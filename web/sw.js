@@ -0,0 +1,208 @@
+// Service Worker for the installer: bench-flashing a batch of devices should
+// not download the same firmware again for every board, and should keep
+// working when unpkg or the network is down.
+//
+//   installer    index.html and manifest.json, network first so a new deploy
+//                shows up at once, cached copy when offline
+//   esptool      unpkg files at an exact version (x.y.z): the esptool-js
+//                bundle, the esp-web-tools install button, and every module
+//                either of them imports, since unpkg pins those to exact
+//                versions too. They never change, so they are cache first.
+//   firmware     ./firmware/<version>/ parts listed in manifest.json, cache
+//                first. A part is only stored, or served at all, when its
+//                SHA-256 matches the "sha256" the manifest gives for it. The
+//                cached copy carries its hash, and a manifest that lists a
+//                different one for the same URL gets it fetched again: a
+//                rerun of the Pages workflow rebuilds the same sha-<7>
+//                version with different bytes. Parts the current manifest
+//                no longer lists are dropped.
+//
+// ./firmware/latest/ is mutable and has no hashes, so it is never cached.
+
+const SHELL_CACHE = 'installer-v1';
+const TOOLS_CACHE = 'esptool-v2';
+const FIRMWARE_CACHE = 'firmware-v1';
+
+// Keep in step with ESPTOOL_BUNDLE in index.html
+const ESPTOOL_BUNDLE = 'https://unpkg.com/esptool-js@0.4.3/bundle.js';
+// https://unpkg.com/<package or @scope/package>@<x.y.z>/...
+const PINNED_UNPKG = /^https:\/\/unpkg\.com\/(@[^/]+\/)?[^/@]+@\d+\.\d+\.\d+\//;
+
+const SCOPE = new URL(self.registration.scope);
+const SHELL = ['./', './index.html', './manifest.json'].map(p => new URL(p, SCOPE).href);
+const MANIFEST_URL = new URL('./manifest.json', SCOPE).href;
+const FIRMWARE_PREFIX = new URL('./firmware/', SCOPE).href;
+
+self.addEventListener('install', event => {
+  event.waitUntil((async () => {
+    const shell = await caches.open(SHELL_CACHE);
+    await shell.addAll(SHELL);
+    // unpkg being down must not keep the installer from going offline-capable;
+    // the bundle is cached on first use instead
+    const tools = await caches.open(TOOLS_CACHE);
+    await tools.add(new Request(ESPTOOL_BUNDLE, { mode: 'cors' })).catch(() => {});
+    await self.skipWaiting();
+  })());
+});
+
+self.addEventListener('activate', event => {
+  event.waitUntil((async () => {
+    const keep = [SHELL_CACHE, TOOLS_CACHE, FIRMWARE_CACHE];
+    for (const name of await caches.keys()) {
+      if (!keep.includes(name)) await caches.delete(name);
+    }
+    await self.clients.claim();
+    // Warm the firmware cache from whatever manifest we have
+    const cached = await caches.match(MANIFEST_URL);
+    if (cached) await syncFirmware(await cached.json());
+  })());
+});
+
+self.addEventListener('fetch', event => {
+  const req = event.request;
+  if (req.method !== 'GET') return;
+  const url = req.url.split('#')[0];
+
+  if (url === MANIFEST_URL) {
+    event.respondWith(manifestFirst(event));
+  } else if (SHELL.includes(url) || req.mode === 'navigate') {
+    event.respondWith(networkFirst(req, SHELL_CACHE));
+  } else if (PINNED_UNPKG.test(url)) {
+    event.respondWith(cacheFirst(req, TOOLS_CACHE));
+  } else if (url.startsWith(FIRMWARE_PREFIX) && firmwareVersion(url) !== 'latest') {
+    event.respondWith(firmwarePart(url));
+  }
+});
+
+// Answers {type: 'status'} with what a reflash could use right now
+self.addEventListener('message', event => {
+  if (!event.data || event.data.type !== 'status') return;
+  event.waitUntil((async () => {
+    const manifest = await caches.match(MANIFEST_URL).then(r => r && r.json());
+    const parts = manifest ? [...manifestParts(manifest)].filter(([url, hash]) => cacheable(url, hash)) : [];
+    const cache = await caches.open(FIRMWARE_CACHE);
+    let cached = 0;
+    for (const [url, hash] of parts) {
+      if (await cachedPart(cache, url, hash)) cached++;
+    }
+    const esptool = !!(await caches.match(ESPTOOL_BUNDLE));
+    event.source.postMessage({
+      type: 'status',
+      version: manifest ? manifest.version : null,
+      parts: parts.length,
+      cached,
+      esptool
+    });
+  })());
+});
+
+async function networkFirst(req, cacheName) {
+  try {
+    const resp = await fetch(req);
+    if (resp.ok) {
+      const cache = await caches.open(cacheName);
+      await cache.put(req, resp.clone());
+    }
+    return resp;
+  } catch (err) {
+    const cached = await caches.match(req, { ignoreSearch: true });
+    if (cached) return cached;
+    throw err;
+  }
+}
+
+async function manifestFirst(event) {
+  const resp = await networkFirst(event.request, SHELL_CACHE);
+  // A new deploy lists a new version: fetch its parts now so the next flash
+  // does not wait, and forget the ones it replaced
+  event.waitUntil(resp.clone().json().then(syncFirmware).catch(() => {}));
+  return resp;
+}
+
+async function cacheFirst(req, cacheName) {
+  const cache = await caches.open(cacheName);
+  const cached = await cache.match(req);
+  if (cached) return cached;
+  const resp = await fetch(req);
+  if (resp.ok) await cache.put(req, resp.clone());
+  return resp;
+}
+
+function firmwareVersion(url) {
+  return url.substring(FIRMWARE_PREFIX.length).split('/')[0];
+}
+
+// Only hashed parts in a version directory are kept
+function cacheable(url, hash) {
+  return !!hash && firmwareVersion(url) !== 'latest';
+}
+
+// url -> expected sha256 (lower-case hex) for every part the manifest lists
+function manifestParts(manifest) {
+  const parts = new Map();
+  for (const build of manifest.builds || []) {
+    for (const part of build.parts || []) {
+      parts.set(new URL(part.path, MANIFEST_URL).href, (part.sha256 || '').toLowerCase());
+    }
+  }
+  return parts;
+}
+
+async function expectedHash(url) {
+  const manifest = await caches.match(MANIFEST_URL).then(r => r && r.json());
+  return manifest ? manifestParts(manifest).get(url) || '' : '';
+}
+
+async function sha256Hex(buffer) {
+  const digest = await crypto.subtle.digest('SHA-256', buffer);
+  return Array.from(new Uint8Array(digest), b => b.toString(16).padStart(2, '0')).join('');
+}
+
+// Fetches a part and stores it only when it matches its manifest hash
+async function fetchVerified(url, cache) {
+  const expected = await expectedHash(url);
+  const resp = await fetch(url, { cache: 'no-store' });
+  if (!resp.ok) return resp;
+  if (!expected) return resp; // not in the manifest, or published without a hash: pass through
+  const body = await resp.arrayBuffer();
+  const actual = await sha256Hex(body);
+  if (actual !== expected) {
+    return new Response('sha256 mismatch for ' + url + ': got ' + actual + ', manifest has ' + expected,
+                        { status: 502, statusText: 'Firmware hash mismatch' });
+  }
+  const verified = new Response(body, {
+    headers: { 'Content-Type': 'application/octet-stream', 'X-Firmware-SHA256': actual }
+  });
+  await cache.put(url, verified.clone());
+  return verified;
+}
+
+// The cached copy of url, unless the current manifest expects other bytes there
+async function cachedPart(cache, url, expected) {
+  const cached = await cache.match(url);
+  if (!cached) return null;
+  return cached.headers.get('X-Firmware-SHA256') === expected ? cached : null;
+}
+
+async function firmwarePart(url) {
+  const cache = await caches.open(FIRMWARE_CACHE);
+  const cached = await cachedPart(cache, url, await expectedHash(url));
+  if (cached) return cached;
+  return fetchVerified(url, cache);
+}
+
+async function syncFirmware(manifest) {
+  const parts = manifestParts(manifest);
+  const cache = await caches.open(FIRMWARE_CACHE);
+  for (const req of await cache.keys()) {
+    if (!parts.has(req.url) || !(await cachedPart(cache, req.url, parts.get(req.url)))) await cache.delete(req);
+  }
+  for (const [url, hash] of parts) {
+    if (!cacheable(url, hash) || await cachedPart(cache, url, hash)) continue;
+    try {
+      await fetchVerified(url, cache);
+    } catch (err) {
+      // offline or a bad deploy; the flash itself will report it
+    }
+  }
+}